@@ -1,3 +1,8 @@
 #pragma once
+#include "grassland/data_structure/acceleration_structure_mesh/binned_sah_builder.h"
+#include "grassland/data_structure/acceleration_structure_mesh/ccd_broad_phase.h"
+#include "grassland/data_structure/acceleration_structure_mesh/linear_bvh_builder.h"
+#include "grassland/data_structure/acceleration_structure_mesh/mesh_bvh.h"
+#include "grassland/data_structure/acceleration_structure_mesh/mesh_bvh_node.h"
 
 namespace grassland::data_structure {}
@@ -0,0 +1,349 @@
+#pragma once
+#include "algorithm"
+#include "array"
+#include "grassland/data_structure/acceleration_structure_mesh/mesh_bvh_node.h"
+#include "grassland/util/thread_pool.h"
+#include "limits"
+
+namespace grassland::data_structure {
+
+namespace detail {
+// Binned SAH build (Wald 2007) of a hierarchy over primitive boxes, with
+// the nodes in depth-first order. Nodes of more than kSubtreeSize
+// primitives are split first, binning in parallel, and the subtrees below
+// them are built in parallel and spliced into place. The tree does not
+// depend on the number of threads.
+template <typename Scalar>
+class BinnedSAHBuilder {
+ public:
+  using Box = geometry::AABB3<Scalar>;
+  using Node = MeshBVHNode<Scalar>;
+
+  BinnedSAHBuilder(const Box *boxes,
+                   size_t num_primitives,
+                   const MeshBVHSettings &settings)
+      : boxes_(boxes),
+        centroids_(num_primitives),
+        num_bins_(std::clamp(settings.num_bins, 2, kMaxBins)),
+        max_leaf_size_(std::clamp(settings.max_leaf_size, 1, 255)),
+        traversal_cost_(settings.traversal_cost) {
+    ParallelFor(0, int64_t(num_primitives), kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    centroids_[i] = boxes_[i].Center();
+                  }
+                });
+  }
+
+  // Fills nodes, and order with the primitive of every leaf slot.
+  void Build(std::vector<Node> *nodes, std::vector<uint32_t> *order) {
+    size_t n = centroids_.size();
+    nodes->clear();
+    order_.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      order_[i] = uint32_t(i);
+    }
+    if (n > 0) {
+      Range root{0, n, Box{}, Box{}, 0};
+      for (size_t i = 0; i < n; i++) {
+        root.bounds.Expand(boxes_[i]);
+        root.centroids.Expand(centroids_[i]);
+      }
+      int64_t top = BuildTop(root);
+      std::vector<std::vector<Node>> subtrees(subtree_ranges_.size());
+      ParallelFor(0, int64_t(subtrees.size()), 1,
+                  [&](int64_t begin, int64_t end) {
+                    for (int64_t i = begin; i < end; i++) {
+                      BuildSubtree(subtree_ranges_[i], &subtrees[i]);
+                    }
+                  });
+      Flatten(top, subtrees, nodes);
+    }
+    *order = std::move(order_);
+  }
+
+ private:
+  static constexpr int kMaxBins = 32;
+  static constexpr size_t kSubtreeSize = 8192;
+  static constexpr int64_t kBinGrain = 16384;
+  // Below this depth splits fall back to the centroid median, which bounds
+  // the depth of any tree by kMaxSahDepth + 32.
+  static constexpr int kMaxSahDepth = 64;
+
+  struct Range {
+    size_t begin;
+    size_t end;
+    Box bounds;
+    Box centroids;
+    int depth;
+  };
+
+  // Left uninitialized, Reset() is only called on the bins in use.
+  struct Bin {
+    geometry::Vector3<Scalar> min_bound;
+    geometry::Vector3<Scalar> max_bound;
+    geometry::Vector3<Scalar> centroid_min;
+    geometry::Vector3<Scalar> centroid_max;
+    size_t count;
+
+    void Reset() {
+      min_bound = centroid_min = Box{}.min_bound;
+      max_bound = centroid_max = Box{}.max_bound;
+      count = 0;
+    }
+
+    void Merge(const Bin &bin) {
+      min_bound = min_bound.cwiseMin(bin.min_bound);
+      max_bound = max_bound.cwiseMax(bin.max_bound);
+      centroid_min = centroid_min.cwiseMin(bin.centroid_min);
+      centroid_max = centroid_max.cwiseMax(bin.centroid_max);
+      count += bin.count;
+    }
+
+    void ExpandBounds(Box *box) const {
+      box->min_bound = box->min_bound.cwiseMin(min_bound);
+      box->max_bound = box->max_bound.cwiseMax(max_bound);
+    }
+
+    void ExpandCentroids(Box *box) const {
+      box->min_bound = box->min_bound.cwiseMin(centroid_min);
+      box->max_bound = box->max_bound.cwiseMax(centroid_max);
+    }
+  };
+
+  struct TopNode {
+    Box bounds;
+    uint16_t axis{0};
+    int64_t left{-1};
+    int64_t right{-1};
+    int64_t subtree{-1};
+  };
+
+  int64_t BuildTop(const Range &range) {
+    int64_t index = int64_t(top_nodes_.size());
+    top_nodes_.emplace_back();
+    top_nodes_[index].bounds = range.bounds;
+    Range left, right;
+    int axis;
+    if (range.end - range.begin <= kSubtreeSize ||
+        !Split(range, &left, &right, &axis)) {
+      top_nodes_[index].subtree = int64_t(subtree_ranges_.size());
+      subtree_ranges_.push_back(range);
+      return index;
+    }
+    top_nodes_[index].axis = uint16_t(axis);
+    int64_t left_index = BuildTop(left);
+    int64_t right_index = BuildTop(right);
+    top_nodes_[index].left = left_index;
+    top_nodes_[index].right = right_index;
+    return index;
+  }
+
+  void BuildSubtree(const Range &range, std::vector<Node> *nodes) {
+    size_t index = nodes->size();
+    nodes->emplace_back();
+    (*nodes)[index].bounds = range.bounds;
+    Range left, right;
+    int axis;
+    if (!Split(range, &left, &right, &axis)) {
+      (*nodes)[index].offset = uint32_t(range.begin);
+      (*nodes)[index].count = uint16_t(range.end - range.begin);
+      return;
+    }
+    (*nodes)[index].axis = uint16_t(axis);
+    BuildSubtree(left, nodes);
+    (*nodes)[index].offset = uint32_t(nodes->size());
+    BuildSubtree(right, nodes);
+  }
+
+  void Flatten(int64_t index,
+               const std::vector<std::vector<Node>> &subtrees,
+               std::vector<Node> *nodes) const {
+    const TopNode &top = top_nodes_[index];
+    if (top.subtree >= 0) {
+      uint32_t base = uint32_t(nodes->size());
+      for (Node node : subtrees[top.subtree]) {
+        if (node.count == 0) {
+          node.offset += base;
+        }
+        nodes->push_back(node);
+      }
+      return;
+    }
+    size_t node_index = nodes->size();
+    nodes->emplace_back();
+    (*nodes)[node_index].bounds = top.bounds;
+    (*nodes)[node_index].axis = top.axis;
+    Flatten(top.left, subtrees, nodes);
+    (*nodes)[node_index].offset = uint32_t(nodes->size());
+    Flatten(top.right, subtrees, nodes);
+  }
+
+  // Splits range at the binned SAH plane of least cost and partitions its
+  // primitives. Returns false if range should become a leaf.
+  bool Split(const Range &range, Range *left, Range *right, int *axis) {
+    size_t count = range.end - range.begin;
+    if (count <= 1) {
+      return false;
+    }
+    geometry::Vector3<Scalar> extent = range.centroids.Size();
+    bool degenerate = !(extent.maxCoeff() > Scalar(0));
+    if (degenerate && count <= size_t(max_leaf_size_)) {
+      return false;
+    }
+    if (degenerate || range.depth >= kMaxSahDepth) {
+      MedianSplit(range, left, right, axis);
+      return true;
+    }
+
+    std::array<Bin, 3 * kMaxBins> bins;
+    if (int64_t(count) <= kBinGrain) {
+      BinRange(range, range.begin, range.end, bins.data());
+    } else {
+      std::vector<std::array<Bin, 3 * kMaxBins>> partial(
+          (count + kBinGrain - 1) / kBinGrain);
+      ParallelFor(int64_t(range.begin), int64_t(range.end), kBinGrain,
+                  [&](int64_t begin, int64_t end) {
+                    BinRange(range, begin, end,
+                             partial[(begin - range.begin) / kBinGrain].data());
+                  });
+      bins = partial[0];
+      for (size_t c = 1; c < partial.size(); c++) {
+        for (int a = 0; a < 3; a++) {
+          for (int b = 0; b < num_bins_; b++) {
+            bins[a * kMaxBins + b].Merge(partial[c][a * kMaxBins + b]);
+          }
+        }
+      }
+    }
+
+    Scalar best_cost = std::numeric_limits<Scalar>::max();
+    int best_axis = -1;
+    int best_split = 0;
+    for (int a = 0; a < 3; a++) {
+      if (!(extent[a] > Scalar(0))) {
+        continue;
+      }
+      const Bin *axis_bins = bins.data() + a * kMaxBins;
+      // right_cost[b]: count times half area of bins b and above.
+      Scalar right_cost[kMaxBins];
+      Box box;
+      size_t right_count = 0;
+      for (int b = num_bins_ - 1; b > 0; b--) {
+        axis_bins[b].ExpandBounds(&box);
+        right_count += axis_bins[b].count;
+        right_cost[b] = right_count ? HalfArea(box) * Scalar(right_count) : 0;
+      }
+      box = Box{};
+      size_t left_count = 0;
+      for (int b = 1; b < num_bins_; b++) {
+        axis_bins[b - 1].ExpandBounds(&box);
+        left_count += axis_bins[b - 1].count;
+        if (left_count == 0 || left_count == count) {
+          continue;
+        }
+        Scalar cost = HalfArea(box) * Scalar(left_count) + right_cost[b];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = a;
+          best_split = b;
+        }
+      }
+    }
+    if (best_axis < 0) {
+      MedianSplit(range, left, right, axis);
+      return true;
+    }
+    if (count <= size_t(max_leaf_size_)) {
+      Scalar area = HalfArea(range.bounds);
+      if (!(area > Scalar(0)) ||
+          !(Scalar(traversal_cost_) + best_cost / area < Scalar(count))) {
+        return false;
+      }
+    }
+
+    const Bin *axis_bins = bins.data() + best_axis * kMaxBins;
+    *left = Range{range.begin, range.begin, Box{}, Box{}, range.depth + 1};
+    *right = Range{range.begin, range.end, Box{}, Box{}, range.depth + 1};
+    for (int b = 0; b < num_bins_; b++) {
+      Range &side = b < best_split ? *left : *right;
+      axis_bins[b].ExpandBounds(&side.bounds);
+      axis_bins[b].ExpandCentroids(&side.centroids);
+      if (b < best_split) {
+        left->end += axis_bins[b].count;
+      }
+    }
+    right->begin = left->end;
+    Scalar low = range.centroids.min_bound[best_axis];
+    Scalar scale = Scalar(num_bins_) / extent[best_axis];
+    std::partition(order_.begin() + range.begin, order_.begin() + range.end,
+                   [&](uint32_t i) {
+                     return BinIndex(centroids_[i][best_axis], low, scale) <
+                            best_split;
+                   });
+    *axis = best_axis;
+    return true;
+  }
+
+  void BinRange(const Range &range, int64_t begin, int64_t end, Bin *bins) {
+    for (int a = 0; a < 3; a++) {
+      for (int b = 0; b < num_bins_; b++) {
+        bins[a * kMaxBins + b].Reset();
+      }
+    }
+    geometry::Vector3<Scalar> extent = range.centroids.Size();
+    Scalar scale[3];
+    for (int a = 0; a < 3; a++) {
+      scale[a] = extent[a] > Scalar(0) ? Scalar(num_bins_) / extent[a] : 0;
+    }
+    for (int64_t j = begin; j < end; j++) {
+      uint32_t i = order_[j];
+      for (int a = 0; a < 3; a++) {
+        Bin &bin = bins[a * kMaxBins + BinIndex(centroids_[i][a],
+                                                 range.centroids.min_bound[a],
+                                                 scale[a])];
+        bin.min_bound = bin.min_bound.cwiseMin(boxes_[i].min_bound);
+        bin.max_bound = bin.max_bound.cwiseMax(boxes_[i].max_bound);
+        bin.centroid_min = bin.centroid_min.cwiseMin(centroids_[i]);
+        bin.centroid_max = bin.centroid_max.cwiseMax(centroids_[i]);
+        bin.count++;
+      }
+    }
+  }
+
+  void MedianSplit(const Range &range, Range *left, Range *right, int *axis) {
+    geometry::Vector3<Scalar> extent = range.centroids.Size();
+    int a = 0;
+    extent.maxCoeff(&a);
+    size_t middle = range.begin + (range.end - range.begin) / 2;
+    std::nth_element(order_.begin() + range.begin, order_.begin() + middle,
+                     order_.begin() + range.end, [&](uint32_t i, uint32_t j) {
+                       return centroids_[i][a] < centroids_[j][a] ||
+                              (centroids_[i][a] == centroids_[j][a] && i < j);
+                     });
+    *left = Range{range.begin, middle, Box{}, Box{}, range.depth + 1};
+    *right = Range{middle, range.end, Box{}, Box{}, range.depth + 1};
+    for (Range *side : {left, right}) {
+      for (size_t j = side->begin; j < side->end; j++) {
+        side->bounds.Expand(boxes_[order_[j]]);
+        side->centroids.Expand(centroids_[order_[j]]);
+      }
+    }
+    *axis = a;
+  }
+
+  int BinIndex(Scalar centroid, Scalar low, Scalar scale) const {
+    return std::min(int((centroid - low) * scale), num_bins_ - 1);
+  }
+
+  const Box *boxes_;
+  std::vector<geometry::Vector3<Scalar>> centroids_;
+  std::vector<uint32_t> order_;
+  std::vector<TopNode> top_nodes_;
+  std::vector<Range> subtree_ranges_;
+  int num_bins_;
+  int max_leaf_size_;
+  float traversal_cost_;
+};
+}  // namespace detail
+}  // namespace grassland::data_structure
@@ -0,0 +1,413 @@
+#pragma once
+#include "array"
+#include "grassland/data_structure/acceleration_structure_mesh/linear_bvh_builder.h"
+#include "grassland/geometry/continuous_collision_detection.h"
+
+namespace grassland::data_structure {
+
+enum class ccd_pair_type : uint8_t { vertex_face = 0, face_vertex, edge_edge };
+
+// Candidate pairs of a continuous collision query between a first and a
+// second mesh, which are the same mesh for self collisions. Each list is
+// ordered by its first primitive, so the pairs do not depend on the number
+// of threads.
+struct CCDPairs {
+  // Vertex of the first mesh and face of the second, for FacePointCCD.
+  std::vector<std::array<uint32_t, 2>> vertex_face;
+  // Face of the first mesh and vertex of the second, empty for self pairs.
+  std::vector<std::array<uint32_t, 2>> face_vertex;
+  // Edges of the first and second mesh, for EdgeEdgeCCD. Self pairs hold
+  // each pair once, smaller edge first.
+  std::vector<std::array<uint32_t, 2>> edge_edge;
+
+  size_t size() const {
+    return vertex_face.size() + face_vertex.size() + edge_edge.size();
+  }
+};
+
+template <typename Scalar>
+struct CCDImpact {
+  // Earliest time of impact as a fraction of the step, 1 if no pair
+  // collides.
+  Scalar t{1};
+  bool found{false};
+  ccd_pair_type type{ccd_pair_type::vertex_face};
+  // Index of the colliding pair in the list of its type.
+  uint32_t pair{0};
+};
+
+namespace detail {
+// Primitives handed to a thread at a time by the broad and narrow phases.
+constexpr int64_t kCCDGrain = 1024;
+
+// A hierarchy over boxes for overlap queries, built with the linear
+// builder since swept boxes change every step.
+template <typename Scalar>
+class SweptBoxTree {
+ public:
+  using Box = geometry::AABB3<Scalar>;
+
+  void Build(const std::vector<Box> &boxes) {
+    MeshBVHSettings settings;
+    settings.max_leaf_size = 4;
+    LinearBVHBuilder<Scalar> builder(boxes.data(), boxes.size(), settings);
+    builder.Build(&nodes_, &order_);
+    leaf_boxes_.resize(boxes.size());
+    ParallelFor(0, int64_t(boxes.size()), kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t j = begin; j < end; j++) {
+                    leaf_boxes_[j] = boxes[order_[j]];
+                  }
+                });
+  }
+
+  // Calls func(index) for every box overlapping box, touching included.
+  template <class Func>
+  void ForEachOverlap(const Box &box, Func &&func) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    uint32_t stack[128];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size) {
+      const MeshBVHNode<Scalar> &node = nodes_[stack[--stack_size]];
+      if (!Overlaps(node.bounds, box)) {
+        continue;
+      }
+      if (node.count) {
+        for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+          if (Overlaps(leaf_boxes_[j], box)) {
+            func(order_[j]);
+          }
+        }
+        continue;
+      }
+      stack[stack_size++] = node.offset;
+      stack[stack_size++] = uint32_t(&node - nodes_.data()) + 1;
+    }
+  }
+
+ private:
+  static bool Overlaps(const Box &a, const Box &b) {
+    return (a.min_bound.array() <= b.max_bound.array()).all() &&
+           (b.min_bound.array() <= a.max_bound.array()).all();
+  }
+
+  std::vector<MeshBVHNode<Scalar>> nodes_;
+  std::vector<uint32_t> order_;
+  std::vector<Box> leaf_boxes_;
+};
+
+// Runs query(i, pairs) for i in [0, n) in parallel and concatenates the
+// pairs each appends, in order of i.
+template <class Query>
+void CollectPairs(size_t n,
+                  Query &&query,
+                  std::vector<std::array<uint32_t, 2>> *pairs) {
+  size_t num_chunks = (n + kCCDGrain - 1) / kCCDGrain;
+  std::vector<std::vector<std::array<uint32_t, 2>>> chunks(num_chunks);
+  ParallelFor(0, int64_t(n), kCCDGrain, [&](int64_t begin, int64_t end) {
+    auto &chunk = chunks[begin / kCCDGrain];
+    for (int64_t i = begin; i < end; i++) {
+      query(uint32_t(i), &chunk);
+    }
+  });
+  std::vector<size_t> offsets(num_chunks + 1, 0);
+  for (size_t c = 0; c < num_chunks; c++) {
+    offsets[c + 1] = offsets[c] + chunks[c].size();
+  }
+  pairs->resize(offsets.back());
+  ParallelFor(0, int64_t(num_chunks), 1, [&](int64_t begin, int64_t end) {
+    for (int64_t c = begin; c < end; c++) {
+      std::copy(chunks[c].begin(), chunks[c].end(),
+                pairs->begin() + offsets[c]);
+    }
+  });
+}
+
+// The earliest impact among pairs 0 to n - 1, test(i, &t) lowering t to
+// the time of impact of pair i if it collides before t. Every chunk of
+// pairs keeps its own earliest impact, and the chunks are combined in
+// order with ties going to the first pair, so the result does not depend
+// on the number of threads.
+template <typename Scalar, class Test>
+CCDImpact<Scalar> EarliestImpactOf(size_t n, ccd_pair_type type, Test &&test) {
+  size_t num_chunks = (n + kCCDGrain - 1) / kCCDGrain;
+  std::vector<CCDImpact<Scalar>> chunk_impacts(num_chunks);
+  ParallelFor(0, int64_t(n), kCCDGrain, [&](int64_t begin, int64_t end) {
+    CCDImpact<Scalar> &impact = chunk_impacts[begin / kCCDGrain];
+    for (int64_t i = begin; i < end; i++) {
+      Scalar t = impact.t;
+      if (test(size_t(i), &t) && (!impact.found || t < impact.t)) {
+        impact = {t, true, type, uint32_t(i)};
+      }
+    }
+  });
+  CCDImpact<Scalar> earliest;
+  for (const auto &impact : chunk_impacts) {
+    if (impact.found && (!earliest.found || impact.t < earliest.t)) {
+      earliest = impact;
+    }
+  }
+  return earliest;
+}
+}  // namespace detail
+
+// A triangle mesh moving over a time step, with the swept boxes of its
+// vertices, edges and faces and hierarchies over those of the edges and
+// faces, for the broad phase of continuous collision detection. Vertex i
+// moves along positions[i] + t * displacements[i] for t in [0, 1], as in
+// FacePointCCD and EdgeEdgeCCD, so its swept box holds both ends.
+template <typename Scalar>
+class CCDMesh {
+ public:
+  using Box = geometry::AABB3<Scalar>;
+
+  CCDMesh() = default;
+
+  // indices holds three vertex indices per triangle. The edges, shared by
+  // adjacent triangles, are extracted once here.
+  CCDMesh(const uint32_t *indices, size_t num_triangles, size_t num_vertices)
+      : num_vertices_(num_vertices), faces_(num_triangles) {
+    edges_.reserve(3 * num_triangles);
+    for (size_t f = 0; f < num_triangles; f++) {
+      for (int k = 0; k < 3; k++) {
+        faces_[f][k] = indices[3 * f + k];
+        uint32_t a = indices[3 * f + k];
+        uint32_t b = indices[3 * f + (k + 1) % 3];
+        edges_.push_back({std::min(a, b), std::max(a, b)});
+      }
+    }
+    std::sort(edges_.begin(), edges_.end());
+    edges_.erase(std::unique(edges_.begin(), edges_.end()), edges_.end());
+  }
+
+  // Sets the vertices at the start of the step and their displacements
+  // over it, and rebuilds the swept boxes, grown by padding on every side,
+  // and the hierarchies over them.
+  void Update(const geometry::Vector3<Scalar> *positions,
+              const geometry::Vector3<Scalar> *displacements,
+              Scalar padding = 0) {
+    positions_.assign(positions, positions + num_vertices_);
+    displacements_.assign(displacements, displacements + num_vertices_);
+    vertex_boxes_.resize(num_vertices_);
+    geometry::Vector3<Scalar> pad =
+        geometry::Vector3<Scalar>::Constant(padding);
+    ParallelFor(0, int64_t(num_vertices_), detail::kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    Box &box = vertex_boxes_[i];
+                    box = Box(positions_[i]);
+                    box.Expand(positions_[i] + displacements_[i]);
+                    box.min_bound -= pad;
+                    box.max_bound += pad;
+                  }
+                });
+    SweptBoxes(edges_, &edge_boxes_);
+    SweptBoxes(faces_, &face_boxes_);
+    edge_tree_.Build(edge_boxes_);
+    face_tree_.Build(face_boxes_);
+  }
+
+  size_t num_vertices() const {
+    return num_vertices_;
+  }
+
+  const std::vector<std::array<uint32_t, 2>> &edges() const {
+    return edges_;
+  }
+
+  const std::vector<std::array<uint32_t, 3>> &faces() const {
+    return faces_;
+  }
+
+  const std::vector<geometry::Vector3<Scalar>> &positions() const {
+    return positions_;
+  }
+
+  const std::vector<geometry::Vector3<Scalar>> &displacements() const {
+    return displacements_;
+  }
+
+  const std::vector<Box> &vertex_boxes() const {
+    return vertex_boxes_;
+  }
+
+  const std::vector<Box> &edge_boxes() const {
+    return edge_boxes_;
+  }
+
+  const std::vector<Box> &face_boxes() const {
+    return face_boxes_;
+  }
+
+  const detail::SweptBoxTree<Scalar> &edge_tree() const {
+    return edge_tree_;
+  }
+
+  const detail::SweptBoxTree<Scalar> &face_tree() const {
+    return face_tree_;
+  }
+
+ private:
+  // The union of the swept boxes of the vertices of each primitive.
+  template <size_t N>
+  void SweptBoxes(const std::vector<std::array<uint32_t, N>> &primitives,
+                  std::vector<Box> *boxes) const {
+    boxes->resize(primitives.size());
+    ParallelFor(0, int64_t(primitives.size()), detail::kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    Box box = vertex_boxes_[primitives[i][0]];
+                    for (size_t k = 1; k < N; k++) {
+                      box.Expand(vertex_boxes_[primitives[i][k]]);
+                    }
+                    (*boxes)[i] = box;
+                  }
+                });
+  }
+
+  size_t num_vertices_{0};
+  std::vector<std::array<uint32_t, 2>> edges_;
+  std::vector<std::array<uint32_t, 3>> faces_;
+  std::vector<geometry::Vector3<Scalar>> positions_;
+  std::vector<geometry::Vector3<Scalar>> displacements_;
+  std::vector<Box> vertex_boxes_;
+  std::vector<Box> edge_boxes_;
+  std::vector<Box> face_boxes_;
+  detail::SweptBoxTree<Scalar> edge_tree_;
+  detail::SweptBoxTree<Scalar> face_tree_;
+};
+
+// Self collision candidates of mesh: vertices against the faces and edges
+// against the edges whose swept boxes overlap theirs, leaving out pairs
+// that share a vertex.
+template <typename Scalar>
+void FindCCDPairs(const CCDMesh<Scalar> &mesh, CCDPairs *pairs) {
+  const auto &faces = mesh.faces();
+  const auto &edges = mesh.edges();
+  detail::CollectPairs(
+      mesh.num_vertices(),
+      [&](uint32_t v, std::vector<std::array<uint32_t, 2>> *found) {
+        mesh.face_tree().ForEachOverlap(
+            mesh.vertex_boxes()[v], [&](uint32_t f) {
+              if (faces[f][0] != v && faces[f][1] != v && faces[f][2] != v) {
+                found->push_back({v, f});
+              }
+            });
+      },
+      &pairs->vertex_face);
+  pairs->face_vertex.clear();
+  detail::CollectPairs(
+      edges.size(),
+      [&](uint32_t e, std::vector<std::array<uint32_t, 2>> *found) {
+        mesh.edge_tree().ForEachOverlap(
+            mesh.edge_boxes()[e], [&](uint32_t other) {
+              const auto &a = edges[e];
+              const auto &b = edges[other];
+              if (e < other && a[0] != b[0] && a[0] != b[1] &&
+                  a[1] != b[0] && a[1] != b[1]) {
+                found->push_back({e, other});
+              }
+            });
+      },
+      &pairs->edge_edge);
+}
+
+// Collision candidates between two different meshes: the vertices of each
+// against the faces of the other, and the edges of a against those of b.
+template <typename Scalar>
+void FindCCDPairs(const CCDMesh<Scalar> &a,
+                  const CCDMesh<Scalar> &b,
+                  CCDPairs *pairs) {
+  detail::CollectPairs(
+      a.num_vertices(),
+      [&](uint32_t v, std::vector<std::array<uint32_t, 2>> *found) {
+        b.face_tree().ForEachOverlap(a.vertex_boxes()[v], [&](uint32_t f) {
+          found->push_back({v, f});
+        });
+      },
+      &pairs->vertex_face);
+  // Listed by the vertex of b, then stored face first.
+  detail::CollectPairs(
+      b.num_vertices(),
+      [&](uint32_t v, std::vector<std::array<uint32_t, 2>> *found) {
+        a.face_tree().ForEachOverlap(b.vertex_boxes()[v], [&](uint32_t f) {
+          found->push_back({f, v});
+        });
+      },
+      &pairs->face_vertex);
+  detail::CollectPairs(
+      a.edges().size(),
+      [&](uint32_t e, std::vector<std::array<uint32_t, 2>> *found) {
+        b.edge_tree().ForEachOverlap(a.edge_boxes()[e], [&](uint32_t other) {
+          found->push_back({e, other});
+        });
+      },
+      &pairs->edge_edge);
+}
+
+// Runs FacePointCCD and EdgeEdgeCCD on the pairs found by FindCCDPairs(a,
+// b, pairs), in parallel, and returns the earliest impact. Ties go to
+// vertex-face pairs, then face-vertex, then edge-edge, then to the first
+// pair of a list.
+template <typename Scalar>
+CCDImpact<Scalar> EarliestImpact(const CCDMesh<Scalar> &a,
+                                 const CCDMesh<Scalar> &b,
+                                 const CCDPairs &pairs) {
+  // FacePointCCD between face f of one mesh and vertex v of the other.
+  auto face_point = [](const CCDMesh<Scalar> &face_mesh, uint32_t f,
+                       const CCDMesh<Scalar> &point_mesh, uint32_t v,
+                       Scalar *t) {
+    const auto &face = face_mesh.faces()[f];
+    const auto &p = face_mesh.positions();
+    const auto &d = face_mesh.displacements();
+    return geometry::FacePointCCD(
+        p[face[0]], p[face[1]], p[face[2]], d[face[0]], d[face[1]],
+        d[face[2]], point_mesh.positions()[v],
+        point_mesh.displacements()[v], t);
+  };
+  CCDImpact<Scalar> impacts[3] = {
+      detail::EarliestImpactOf<Scalar>(
+          pairs.vertex_face.size(), ccd_pair_type::vertex_face,
+          [&](size_t i, Scalar *t) {
+            const auto &pair = pairs.vertex_face[i];
+            return face_point(b, pair[1], a, pair[0], t);
+          }),
+      detail::EarliestImpactOf<Scalar>(
+          pairs.face_vertex.size(), ccd_pair_type::face_vertex,
+          [&](size_t i, Scalar *t) {
+            const auto &pair = pairs.face_vertex[i];
+            return face_point(a, pair[0], b, pair[1], t);
+          }),
+      detail::EarliestImpactOf<Scalar>(
+          pairs.edge_edge.size(), ccd_pair_type::edge_edge,
+          [&](size_t i, Scalar *t) {
+            const auto &ea = a.edges()[pairs.edge_edge[i][0]];
+            const auto &eb = b.edges()[pairs.edge_edge[i][1]];
+            const auto &pa = a.positions();
+            const auto &da = a.displacements();
+            const auto &pb = b.positions();
+            const auto &db = b.displacements();
+            return geometry::EdgeEdgeCCD(pa[ea[0]], pa[ea[1]], da[ea[0]],
+                                         da[ea[1]], pb[eb[0]], pb[eb[1]],
+                                         db[eb[0]], db[eb[1]], t);
+          })};
+  CCDImpact<Scalar> earliest;
+  for (const auto &impact : impacts) {
+    if (impact.found && (!earliest.found || impact.t < earliest.t)) {
+      earliest = impact;
+    }
+  }
+  return earliest;
+}
+
+// EarliestImpact of the self collision pairs found by FindCCDPairs(mesh,
+// pairs).
+template <typename Scalar>
+CCDImpact<Scalar> EarliestImpact(const CCDMesh<Scalar> &mesh,
+                                 const CCDPairs &pairs) {
+  return EarliestImpact(mesh, mesh, pairs);
+}
+}  // namespace grassland::data_structure
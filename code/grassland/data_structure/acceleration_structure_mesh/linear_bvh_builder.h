@@ -0,0 +1,471 @@
+#pragma once
+#include "algorithm"
+#include "array"
+#include "atomic"
+#include "grassland/data_structure/acceleration_structure_mesh/mesh_bvh_node.h"
+#include "grassland/data_structure/grid/grid_util.h"
+#include "grassland/util/thread_pool.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if !defined(__CUDACC__) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace grassland::data_structure {
+
+// Morton codes of n points given as separate coordinate arrays. Coordinates
+// are quantized to the cells of a grid of 2^10 (Key = uint32_t, 30-bit
+// codes) or 2^21 (Key = uint64_t, 63-bit codes) cells per axis, cell c of
+// axis a starting at low[a] + c / scale[a].
+template <typename Scalar, typename Key>
+void MortonCodeBatchScalar(const Scalar *xs,
+                           const Scalar *ys,
+                           const Scalar *zs,
+                           const Scalar *low,
+                           const Scalar *scale,
+                           Key *codes,
+                           size_t n) {
+  constexpr int64_t kLastCell = sizeof(Key) == 4 ? 1023 : 2097151;
+  auto quantize = [&](Scalar value, int axis) {
+    return uint64_t(std::clamp(int64_t((value - low[axis]) * scale[axis]),
+                               int64_t(0), kLastCell));
+  };
+  for (size_t i = 0; i < n; i++) {
+    codes[i] = Key(MortonEncode3(quantize(xs[i], 0), quantize(ys[i], 1),
+                                 quantize(zs[i], 2)));
+  }
+}
+
+#if !defined(__CUDACC__) && defined(__AVX2__)
+// 8 30-bit codes per iteration, spreading the bits of the three quantized
+// coordinates in 32-bit lanes. Returns the number of codes written.
+inline size_t MortonCode30BatchAVX2(const float *xs,
+                                    const float *ys,
+                                    const float *zs,
+                                    const float *low,
+                                    const float *scale,
+                                    uint32_t *codes,
+                                    size_t n) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i last = _mm256_set1_epi32(1023);
+  auto quantize = [&](__m256 value, int axis) {
+    __m256 cell = _mm256_mul_ps(
+        _mm256_sub_ps(value, _mm256_set1_ps(low[axis])),
+        _mm256_set1_ps(scale[axis]));
+    __m256i q = _mm256_cvttps_epi32(cell);
+    return _mm256_min_epi32(_mm256_max_epi32(q, zero), last);
+  };
+  auto spread = [](__m256i v) {
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 16)),
+                         _mm256_set1_epi32(0x030000ff));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)),
+                         _mm256_set1_epi32(0x0300f00f));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 4)),
+                         _mm256_set1_epi32(0x030c30c3));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 2)),
+                         _mm256_set1_epi32(0x09249249));
+    return v;
+  };
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = spread(quantize(_mm256_loadu_ps(xs + i), 0));
+    __m256i y = spread(quantize(_mm256_loadu_ps(ys + i), 1));
+    __m256i z = spread(quantize(_mm256_loadu_ps(zs + i), 2));
+    __m256i code = _mm256_or_si256(
+        x, _mm256_or_si256(_mm256_slli_epi32(y, 1), _mm256_slli_epi32(z, 2)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(codes + i), code);
+  }
+  return i;
+}
+#endif
+
+// MortonCodeBatchScalar, with an AVX2 path for 30-bit codes of float
+// coordinates.
+template <typename Scalar, typename Key>
+void MortonCodeBatch(const Scalar *xs,
+                     const Scalar *ys,
+                     const Scalar *zs,
+                     const Scalar *low,
+                     const Scalar *scale,
+                     Key *codes,
+                     size_t n) {
+  size_t done = 0;
+#if !defined(__CUDACC__) && defined(__AVX2__)
+  if constexpr (std::is_same_v<Scalar, float> &&
+                std::is_same_v<Key, uint32_t>) {
+    done = MortonCode30BatchAVX2(xs, ys, zs, low, scale, codes, n);
+  }
+#endif
+  MortonCodeBatchScalar(xs + done, ys + done, zs + done, low, scale,
+                        codes + done, n - done);
+}
+
+// Stable least significant digit radix sort of the lower num_bits bits of
+// keys, moving values along. Every pass counts 8-bit digits per chunk of
+// keys in parallel and scatters the chunks in parallel to the offsets of
+// their digits, and passes whose digit is the same for all keys are
+// skipped.
+template <typename Key, typename Value>
+void ParallelRadixSort(std::vector<Key> *keys,
+                       std::vector<Value> *values,
+                       int num_bits) {
+  constexpr int64_t kGrain = 65536;
+  size_t n = keys->size();
+  size_t num_chunks = (n + kGrain - 1) / kGrain;
+  std::vector<Key> key_buffer(n);
+  std::vector<Value> value_buffer(n);
+  std::vector<std::array<size_t, 256>> offsets(num_chunks);
+  for (int shift = 0; shift < num_bits; shift += 8) {
+    ParallelFor(0, int64_t(n), kGrain, [&](int64_t begin, int64_t end) {
+      std::array<size_t, 256> &count = offsets[begin / kGrain];
+      count.fill(0);
+      for (int64_t i = begin; i < end; i++) {
+        count[((*keys)[i] >> shift) & 0xff]++;
+      }
+    });
+    // Digits major, chunks minor, which keeps equal digits in order.
+    size_t total = 0;
+    bool single_digit = false;
+    for (int digit = 0; digit < 256; digit++) {
+      size_t digit_begin = total;
+      for (size_t c = 0; c < num_chunks; c++) {
+        size_t count = offsets[c][digit];
+        offsets[c][digit] = total;
+        total += count;
+      }
+      single_digit |= total - digit_begin == n;
+    }
+    if (single_digit) {
+      continue;
+    }
+    ParallelFor(0, int64_t(n), kGrain, [&](int64_t begin, int64_t end) {
+      std::array<size_t, 256> &offset = offsets[begin / kGrain];
+      for (int64_t i = begin; i < end; i++) {
+        size_t slot = offset[((*keys)[i] >> shift) & 0xff]++;
+        key_buffer[slot] = (*keys)[i];
+        value_buffer[slot] = (*values)[i];
+      }
+    });
+    keys->swap(key_buffer);
+    values->swap(value_buffer);
+  }
+}
+
+namespace detail {
+// Leading zero bits of a nonzero x.
+inline int CountLeadingZeros64(uint64_t x) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return 63 - int(index);
+#else
+  return __builtin_clzll(x);
+#endif
+}
+
+// Linear BVH build: primitives are sorted along a Morton curve of their
+// centroids, and the hierarchy is the binary radix tree of the sorted codes
+// (Karras 2012), whose internal nodes are all found independently in
+// parallel. Bounds are then merged bottom-up in parallel, the second child
+// to finish carrying on to the parent, and the tree is written depth-first
+// into the MeshBVH node layout with subtrees of at most max_leaf_size
+// primitives as leaves. The tree does not depend on the number of threads.
+template <typename Scalar>
+class LinearBVHBuilder {
+ public:
+  using Box = geometry::AABB3<Scalar>;
+  using Node = MeshBVHNode<Scalar>;
+
+  LinearBVHBuilder(const Box *boxes,
+                   size_t num_primitives,
+                   const MeshBVHSettings &settings)
+      : boxes_(boxes),
+        n_(int64_t(num_primitives)),
+        max_leaf_size_(std::clamp(settings.max_leaf_size, 1, 255)),
+        wide_codes_(settings.wide_morton_codes) {
+  }
+
+  // Fills nodes, and order with the primitive of every leaf slot.
+  void Build(std::vector<Node> *nodes, std::vector<uint32_t> *order) {
+    nodes->clear();
+    order->clear();
+    if (n_ == 0) {
+      return;
+    }
+    if (wide_codes_) {
+      BuildWithCodes<uint64_t>(nodes, order);
+    } else {
+      BuildWithCodes<uint32_t>(nodes, order);
+    }
+  }
+
+ private:
+  // Subtrees below the top levels of the tree that the depth-first write
+  // spreads over threads.
+  static constexpr size_t kFrontierSize = 256;
+
+  // A node of the radix tree over sorted primitives first to last. Children
+  // are internal nodes when >= 0 and sorted primitives ~child otherwise.
+  // Size is the number of nodes of its subtree in the MeshBVH layout.
+  struct InternalNode {
+    int64_t left;
+    int64_t right;
+    uint32_t first;
+    uint32_t last;
+    geometry::Vector3<Scalar> min_bound;
+    geometry::Vector3<Scalar> max_bound;
+    uint32_t size;
+    uint16_t axis;
+  };
+
+  static int64_t LeafChild(int64_t j) {
+    return ~j;
+  }
+
+  template <typename Key>
+  void BuildWithCodes(std::vector<Node> *nodes, std::vector<uint32_t> *order) {
+    std::vector<Key> codes = ComputeCodes<Key>();
+    order->resize(n_);
+    for (int64_t i = 0; i < n_; i++) {
+      (*order)[i] = uint32_t(i);
+    }
+    ParallelRadixSort(&codes, order, sizeof(Key) == 4 ? 30 : 63);
+    order_ = order->data();
+
+    // Left uninitialized, every entry but the parent of the root is
+    // written by the parallel passes.
+    internal_.resize(n_ - 1);
+    parents_.resize(2 * n_ - 1);
+    parents_[0] = -1;
+    ParallelFor(0, n_ - 1, kBVHGrain, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        FindChildren(codes.data(), i);
+      }
+    });
+    MergeBounds();
+
+    nodes->resize(Size(0));
+    // Breadth-first from the root until the frontier has enough subtrees.
+    std::vector<std::pair<int64_t, uint32_t>> frontier = {{0, 0}};
+    while (frontier.size() < kFrontierSize) {
+      std::vector<std::pair<int64_t, uint32_t>> next;
+      for (const auto &[child, position] : frontier) {
+        if (Collapsed(child)) {
+          next.emplace_back(child, position);
+          continue;
+        }
+        WriteInterior(child, position, nodes);
+        const InternalNode &node = internal_[child];
+        next.emplace_back(node.left, position + 1);
+        next.emplace_back(node.right, position + 1 + Size(node.left));
+      }
+      if (next.size() == frontier.size()) {
+        break;
+      }
+      frontier.swap(next);
+    }
+    ParallelFor(0, int64_t(frontier.size()), 1,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t f = begin; f < end; f++) {
+                    Write(frontier[f].first, frontier[f].second, nodes);
+                  }
+                });
+  }
+
+  template <typename Key>
+  std::vector<Key> ComputeCodes() const {
+    // Centroids as separate coordinate arrays for MortonCodeBatch.
+    std::vector<Scalar> coordinates[3];
+    for (auto &axis : coordinates) {
+      axis.resize(n_);
+    }
+    size_t num_chunks = (n_ + kBVHGrain - 1) / kBVHGrain;
+    std::vector<Box> chunk_bounds(num_chunks);
+    ParallelFor(0, n_, kBVHGrain, [&](int64_t begin, int64_t end) {
+      Box &bounds = chunk_bounds[begin / kBVHGrain];
+      for (int64_t i = begin; i < end; i++) {
+        geometry::Vector3<Scalar> centroid = boxes_[i].Center();
+        bounds.Expand(centroid);
+        for (int a = 0; a < 3; a++) {
+          coordinates[a][i] = centroid[a];
+        }
+      }
+    });
+    Box bounds;
+    for (const Box &chunk : chunk_bounds) {
+      bounds.Expand(chunk);
+    }
+    Scalar cells = sizeof(Key) == 4 ? Scalar(1024) : Scalar(2097152);
+    Scalar low[3], scale[3];
+    for (int a = 0; a < 3; a++) {
+      low[a] = bounds.min_bound[a];
+      Scalar extent = bounds.max_bound[a] - bounds.min_bound[a];
+      scale[a] = extent > Scalar(0) ? cells / extent : Scalar(0);
+    }
+    std::vector<Key> codes(n_);
+    ParallelFor(0, n_, kBVHGrain, [&](int64_t begin, int64_t end) {
+      MortonCodeBatch(coordinates[0].data() + begin,
+                      coordinates[1].data() + begin,
+                      coordinates[2].data() + begin, low, scale,
+                      codes.data() + begin, size_t(end - begin));
+    });
+    return codes;
+  }
+
+  // Length of the common prefix of the codes of sorted primitives i and j,
+  // extended by the bits of i and j where the codes are equal, or -1 if j
+  // is out of range.
+  template <typename Key>
+  int Delta(const Key *codes, int64_t i, int64_t j) const {
+    if (j < 0 || j >= n_) {
+      return -1;
+    }
+    constexpr int kBits = 8 * sizeof(Key);
+    if (codes[i] != codes[j]) {
+      return CountLeadingZeros64(uint64_t(codes[i] ^ codes[j])) - (64 - kBits);
+    }
+    return kBits + CountLeadingZeros64(uint64_t(i ^ j));
+  }
+
+  template <typename Key>
+  void FindChildren(const Key *codes, int64_t i) {
+    // The range of the node extends from i towards the neighbour sharing
+    // the longer prefix.
+    int64_t d = Delta(codes, i, i + 1) > Delta(codes, i, i - 1) ? 1 : -1;
+    int delta_min = Delta(codes, i, i - d);
+    int64_t length_max = 2;
+    while (Delta(codes, i, i + length_max * d) > delta_min) {
+      length_max *= 2;
+    }
+    int64_t length = 0;
+    for (int64_t t = length_max / 2; t >= 1; t /= 2) {
+      if (Delta(codes, i, i + (length + t) * d) > delta_min) {
+        length += t;
+      }
+    }
+    int64_t j = i + length * d;
+    // The split is where the prefix of the whole range ends.
+    int delta_node = Delta(codes, i, j);
+    int64_t split = 0;
+    int64_t t = length;
+    do {
+      t = (t + 1) >> 1;
+      if (Delta(codes, i, i + (split + t) * d) > delta_node) {
+        split += t;
+      }
+    } while (t > 1);
+    int64_t gamma = i + split * d + std::min<int64_t>(d, 0);
+
+    InternalNode &node = internal_[i];
+    node.first = uint32_t(std::min(i, j));
+    node.last = uint32_t(std::max(i, j));
+    node.left = node.first == gamma ? LeafChild(gamma) : gamma;
+    node.right = node.last == gamma + 1 ? LeafChild(gamma + 1) : gamma + 1;
+    // Morton bit b holds axis b % 3, the bits of equal codes split along x.
+    constexpr int kBits = 8 * sizeof(Key);
+    node.axis = uint16_t(delta_node < kBits ? (kBits - 1 - delta_node) % 3
+                                            : 0);
+    parents_[ParentSlot(node.left)] = i;
+    parents_[ParentSlot(node.right)] = i;
+  }
+
+  // Slot of a child in parents_: internal nodes first, then leaves.
+  int64_t ParentSlot(int64_t child) const {
+    return child >= 0 ? child : n_ - 1 + ~child;
+  }
+
+  void MergeBounds() {
+    std::vector<std::atomic<int>> visits(n_ - 1);
+    ParallelFor(0, n_, kBVHGrain, [&](int64_t begin, int64_t end) {
+      for (int64_t j = begin; j < end; j++) {
+        int64_t node = parents_[ParentSlot(LeafChild(j))];
+        // The first child to arrive stops, the second merges both.
+        while (node >= 0 &&
+               visits[node].fetch_add(1, std::memory_order_acq_rel) == 1) {
+          InternalNode &internal = internal_[node];
+          Box bounds = Bounds(internal.left);
+          bounds.Expand(Bounds(internal.right));
+          internal.min_bound = bounds.min_bound;
+          internal.max_bound = bounds.max_bound;
+          internal.size = Collapsed(node) ? 1
+                                          : 1 + Size(internal.left) +
+                                                Size(internal.right);
+          node = parents_[ParentSlot(node)];
+        }
+      }
+    });
+  }
+
+  Box Bounds(int64_t child) const {
+    if (child < 0) {
+      return boxes_[order_[~child]];
+    }
+    Box bounds;
+    bounds.min_bound = internal_[child].min_bound;
+    bounds.max_bound = internal_[child].max_bound;
+    return bounds;
+  }
+
+  uint32_t Size(int64_t child) const {
+    if (n_ == 1) {
+      return 1;
+    }
+    return child >= 0 ? internal_[child].size : 1;
+  }
+
+  bool Collapsed(int64_t child) const {
+    return n_ == 1 || child < 0 ||
+           internal_[child].last - internal_[child].first <
+               uint32_t(max_leaf_size_);
+  }
+
+  void WriteInterior(int64_t child,
+                     uint32_t position,
+                     std::vector<Node> *nodes) const {
+    const InternalNode &node = internal_[child];
+    Node &out = (*nodes)[position];
+    out.bounds = Bounds(child);
+    out.offset = position + 1 + Size(node.left);
+    out.count = 0;
+    out.axis = node.axis;
+  }
+
+  void Write(int64_t child, uint32_t position, std::vector<Node> *nodes) const {
+    if (Collapsed(child)) {
+      Node &out = (*nodes)[position];
+      if (n_ == 1) {
+        out.bounds = boxes_[0];
+        out.offset = 0;
+        out.count = 1;
+      } else if (child < 0) {
+        out.bounds = boxes_[order_[~child]];
+        out.offset = uint32_t(~child);
+        out.count = 1;
+      } else {
+        const InternalNode &node = internal_[child];
+        out.bounds = Bounds(child);
+        out.offset = node.first;
+        out.count = uint16_t(node.last - node.first + 1);
+      }
+      out.axis = 0;
+      return;
+    }
+    WriteInterior(child, position, nodes);
+    const InternalNode &node = internal_[child];
+    Write(node.left, position + 1, nodes);
+    Write(node.right, position + 1 + Size(node.left), nodes);
+  }
+
+  const Box *boxes_;
+  int64_t n_;
+  int max_leaf_size_;
+  bool wide_codes_;
+  const uint32_t *order_{nullptr};
+  std::vector<InternalNode, DefaultInitAllocator<InternalNode>> internal_;
+  std::vector<int64_t, DefaultInitAllocator<int64_t>> parents_;
+};
+}  // namespace detail
+}  // namespace grassland::data_structure
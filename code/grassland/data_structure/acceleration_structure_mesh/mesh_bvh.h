@@ -0,0 +1,439 @@
+#pragma once
+#include "chrono"
+#include "grassland/data_structure/acceleration_structure_mesh/binned_sah_builder.h"
+#include "grassland/data_structure/acceleration_structure_mesh/linear_bvh_builder.h"
+#include "grassland/geometry/mesh.h"
+#include "grassland/geometry/ray.h"
+
+namespace grassland::data_structure {
+
+template <typename Scalar>
+struct MeshRayHit {
+  // The hit point is origin + t * direction.
+  Scalar t;
+  // Barycentric weights of the second and third vertex of the triangle.
+  Scalar u;
+  Scalar v;
+  // Index of the triangle in the mesh.
+  uint32_t triangle;
+};
+
+// Counters of the builds and refits of a MeshBVH since it was constructed,
+// the first build included.
+struct MeshBVHUpdateStats {
+  uint64_t builds{0};
+  uint64_t refits{0};
+  double build_seconds{0.0};
+  double refit_seconds{0.0};
+};
+
+// A bounding volume hierarchy over the triangles of a mesh for ray and box
+// queries on the CPU, built as chosen by settings.builder. The nodes are
+// stored depth-first in one array, and the triangles are copied in leaf
+// order so a leaf reads consecutive memory. Queries only read, so any
+// number of threads can run them at once.
+//
+// For deforming meshes, Refit moves the triangles and recomputes the node
+// bounds bottom-up while keeping the tree, in O(n). The tree degrades as
+// triangles drift from where it was built, which sah_cost_ratio() tracks,
+// and Update rebuilds it once the ratio passes settings.rebuild_threshold.
+template <typename Scalar>
+class MeshBVH {
+ public:
+  using Box = geometry::AABB3<Scalar>;
+  using Node = MeshBVHNode<Scalar>;
+
+  MeshBVH() = default;
+
+  explicit MeshBVH(const geometry::Mesh<Scalar> &mesh,
+                   const MeshBVHSettings &settings = {})
+      : MeshBVH(mesh.Positions(), mesh.Indices(), mesh.NumIndices() / 3,
+                settings) {
+  }
+
+  // indices holds three vertex indices per triangle.
+  MeshBVH(const geometry::Vector3<Scalar> *positions,
+          const uint32_t *indices,
+          size_t num_triangles,
+          const MeshBVHSettings &settings = {})
+      : settings_(settings) {
+    Rebuild(positions, indices, num_triangles);
+  }
+
+  // Builds the tree anew over the triangles of the mesh.
+  void Rebuild(const geometry::Vector3<Scalar> *positions,
+               const uint32_t *indices,
+               size_t num_triangles) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Box> boxes(num_triangles);
+    ParallelFor(0, int64_t(num_triangles), detail::kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    boxes[i] = Box(positions[indices[3 * i]]);
+                    boxes[i].Expand(positions[indices[3 * i + 1]]);
+                    boxes[i].Expand(positions[indices[3 * i + 2]]);
+                  }
+                });
+    if (settings_.builder == bvh_builder_type::linear) {
+      detail::LinearBVHBuilder<Scalar> builder(boxes.data(), num_triangles,
+                                               settings_);
+      builder.Build(&nodes_, &triangle_ids_);
+    } else {
+      detail::BinnedSAHBuilder<Scalar> builder(boxes.data(), num_triangles,
+                                               settings_);
+      builder.Build(&nodes_, &triangle_ids_);
+    }
+    triangles_.resize(num_triangles);
+    CopyTriangles(positions, indices);
+    FindRefitSubtrees();
+    built_sah_cost_ = sah_cost_ = ComputeSAHCost();
+    update_stats_.builds++;
+    update_stats_.build_seconds += SecondsSince(start);
+  }
+
+  // Moves the triangles to new positions of the same mesh, with the
+  // indices the tree was built with, and refits the node bounds. Leaves and
+  // the nodes below the top levels are refit in parallel over subtrees.
+  void Refit(const geometry::Vector3<Scalar> *positions,
+             const uint32_t *indices) {
+    auto start = std::chrono::steady_clock::now();
+    CopyTriangles(positions, indices);
+    ParallelFor(0, int64_t(subtrees_.size()), 1,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t s = begin; s < end; s++) {
+                    // Children follow their parents in depth-first order.
+                    for (uint32_t i = subtrees_[s].second;
+                         i-- > subtrees_[s].first;) {
+                      RefitNode(i);
+                    }
+                  }
+                });
+    for (uint32_t i : top_nodes_) {
+      RefitNode(i);
+    }
+    sah_cost_ = ComputeSAHCost();
+    update_stats_.refits++;
+    update_stats_.refit_seconds += SecondsSince(start);
+  }
+
+  // Refit, followed by Rebuild when the tree has degraded past
+  // settings.rebuild_threshold. Returns whether the tree was rebuilt.
+  bool Update(const geometry::Vector3<Scalar> *positions,
+              const uint32_t *indices) {
+    Refit(positions, indices);
+    if (sah_cost_ratio() <= Scalar(settings_.rebuild_threshold)) {
+      return false;
+    }
+    Rebuild(positions, indices, triangles_.size());
+    return true;
+  }
+
+  // Finds the first hit of ray at a parameter in [t_min, t_max].
+  bool ClosestHit(const geometry::Ray3<Scalar> &ray,
+                  Scalar t_min,
+                  Scalar t_max,
+                  MeshRayHit<Scalar> *hit) const {
+    uint32_t found = kNone;
+    Traverse(ray, t_min, t_max, [&](uint32_t j, Scalar t, Scalar u, Scalar v) {
+      found = j;
+      hit->t = t;
+      hit->u = u;
+      hit->v = v;
+      return false;
+    });
+    if (found == kNone) {
+      return false;
+    }
+    hit->triangle = triangle_ids_[found];
+    return true;
+  }
+
+  // Whether ray hits any triangle at a parameter in [t_min, t_max], for
+  // shadow and visibility rays. Stops at the first hit found.
+  bool AnyHit(const geometry::Ray3<Scalar> &ray,
+              Scalar t_min,
+              Scalar t_max) const {
+    bool found = false;
+    Traverse(ray, t_min, t_max, [&](uint32_t, Scalar, Scalar, Scalar) {
+      found = true;
+      return true;
+    });
+    return found;
+  }
+
+  // Calls func(triangle) for every triangle whose bounding box overlaps
+  // box, touching included.
+  template <class Func>
+  void ForEachOverlap(const Box &box, Func &&func) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    uint32_t stack[kStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size) {
+      const Node &node = nodes_[stack[--stack_size]];
+      if (!Overlaps(node.bounds, box)) {
+        continue;
+      }
+      if (node.count) {
+        for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+          const auto &m = triangles_[j].m;
+          Box triangle_box;
+          triangle_box.min_bound = m.rowwise().minCoeff();
+          triangle_box.max_bound = m.rowwise().maxCoeff();
+          if (Overlaps(triangle_box, box)) {
+            func(triangle_ids_[j]);
+          }
+        }
+        continue;
+      }
+      stack[stack_size++] = node.offset;
+      stack[stack_size++] = uint32_t(&node - nodes_.data()) + 1;
+    }
+  }
+
+  size_t num_triangles() const {
+    return triangles_.size();
+  }
+
+  size_t num_nodes() const {
+    return nodes_.size();
+  }
+
+  const std::vector<Node> &nodes() const {
+    return nodes_;
+  }
+
+  // The triangles in BVH order, and the index in the mesh of each of them.
+  const std::vector<geometry::Triangle3<Scalar>> &triangles() const {
+    return triangles_;
+  }
+
+  const std::vector<uint32_t> &triangle_ids() const {
+    return triangle_ids_;
+  }
+
+  const MeshBVHSettings &settings() const {
+    return settings_;
+  }
+
+  // Expected cost of a ray query under the surface area heuristic: the
+  // area of every node relative to the root, weighted by
+  // settings.traversal_cost for interior nodes and by the number of
+  // triangles for leaves.
+  Scalar sah_cost() const {
+    return sah_cost_;
+  }
+
+  // sah_cost() relative to its value right after the last build.
+  Scalar sah_cost_ratio() const {
+    return built_sah_cost_ > Scalar(0) ? sah_cost_ / built_sah_cost_
+                                       : Scalar(1);
+  }
+
+  const MeshBVHUpdateStats &update_stats() const {
+    return update_stats_;
+  }
+
+ private:
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+  static constexpr int kStackSize = 128;
+  // Subtrees below the top levels of the tree that Refit spreads over
+  // threads.
+  static constexpr size_t kRefitSubtrees = 256;
+
+  static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+
+  void CopyTriangles(const geometry::Vector3<Scalar> *positions,
+                     const uint32_t *indices) {
+    ParallelFor(0, int64_t(triangles_.size()), detail::kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t j = begin; j < end; j++) {
+                    const uint32_t *triangle = indices + 3 * triangle_ids_[j];
+                    for (int k = 0; k < 3; k++) {
+                      triangles_[j].m.col(k) = positions[triangle[k]];
+                    }
+                  }
+                });
+  }
+
+  // Splits the tree into the nodes of its top levels and the subtrees
+  // below them, each a range of consecutive nodes in depth-first order.
+  void FindRefitSubtrees() {
+    subtrees_.clear();
+    top_nodes_.clear();
+    if (nodes_.empty()) {
+      return;
+    }
+    std::vector<uint32_t> frontier = {0};
+    while (frontier.size() < kRefitSubtrees) {
+      std::vector<uint32_t> next;
+      for (uint32_t i : frontier) {
+        if (nodes_[i].count) {
+          next.push_back(i);
+          continue;
+        }
+        top_nodes_.push_back(i);
+        next.push_back(i + 1);
+        next.push_back(nodes_[i].offset);
+      }
+      if (next.size() == frontier.size()) {
+        break;
+      }
+      frontier.swap(next);
+    }
+    // Breadth-first order reversed visits children before parents.
+    std::reverse(top_nodes_.begin(), top_nodes_.end());
+    for (uint32_t i : frontier) {
+      // The subtree ends after the last node on its rightmost path.
+      uint32_t last = i;
+      while (!nodes_[last].count) {
+        last = nodes_[last].offset;
+      }
+      subtrees_.emplace_back(i, last + 1);
+    }
+  }
+
+  void RefitNode(uint32_t i) {
+    Node &node = nodes_[i];
+    if (!node.count) {
+      node.bounds = nodes_[i + 1].bounds;
+      node.bounds.Expand(nodes_[node.offset].bounds);
+      return;
+    }
+    Box bounds;
+    for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+      const auto &m = triangles_[j].m;
+      bounds.min_bound = bounds.min_bound.cwiseMin(m.rowwise().minCoeff());
+      bounds.max_bound = bounds.max_bound.cwiseMax(m.rowwise().maxCoeff());
+    }
+    node.bounds = bounds;
+  }
+
+  // Summed over chunks of nodes in a fixed order, so the cost does not
+  // depend on the number of threads.
+  Scalar ComputeSAHCost() const {
+    if (nodes_.empty()) {
+      return Scalar(0);
+    }
+    Scalar root_area = detail::HalfArea(nodes_[0].bounds);
+    if (!(root_area > Scalar(0))) {
+      return Scalar(0);
+    }
+    int64_t num_nodes = int64_t(nodes_.size());
+    std::vector<Scalar> chunk_costs(
+        (num_nodes + detail::kBVHGrain - 1) / detail::kBVHGrain, Scalar(0));
+    ParallelFor(0, num_nodes, detail::kBVHGrain,
+                [&](int64_t begin, int64_t end) {
+                  Scalar cost = 0;
+                  for (int64_t i = begin; i < end; i++) {
+                    const Node &node = nodes_[i];
+                    Scalar weight = node.count
+                                        ? Scalar(node.count)
+                                        : Scalar(settings_.traversal_cost);
+                    cost += weight * detail::HalfArea(node.bounds);
+                  }
+                  chunk_costs[begin / detail::kBVHGrain] = cost;
+                });
+    Scalar cost = 0;
+    for (Scalar chunk_cost : chunk_costs) {
+      cost += chunk_cost;
+    }
+    return cost / root_area;
+  }
+
+  static bool Overlaps(const Box &a, const Box &b) {
+    return (a.min_bound.array() <= b.max_bound.array()).all() &&
+           (b.min_bound.array() <= a.max_bound.array()).all();
+  }
+
+  // Visits the nodes hit by ray front to back and calls
+  // on_hit(j, t, u, v) for hits with triangle j in BVH order, shortening
+  // the ray to each hit. Stops when on_hit returns true.
+  template <class OnHit>
+  void Traverse(const geometry::Ray3<Scalar> &ray,
+                Scalar t_min,
+                Scalar t_max,
+                OnHit &&on_hit) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    geometry::Vector3<Scalar> inv_direction =
+        ray.direction.cwiseInverse();
+    bool negative[3] = {ray.direction[0] < 0, ray.direction[1] < 0,
+                        ray.direction[2] < 0};
+    uint32_t stack[kStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size) {
+      uint32_t index = stack[--stack_size];
+      const Node &node = nodes_[index];
+      if (!IntersectsBox(node.bounds, ray.origin, inv_direction, t_min,
+                         t_max)) {
+        continue;
+      }
+      if (node.count) {
+        for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+          Scalar u, v;
+          if (geometry::RayTriangleIntersection(ray, triangles_[j], t_min,
+                                                &t_max, &u, &v) &&
+              on_hit(j, t_max, u, v)) {
+            return;
+          }
+        }
+        continue;
+      }
+      // The near child goes on top.
+      if (negative[node.axis]) {
+        stack[stack_size++] = index + 1;
+        stack[stack_size++] = node.offset;
+      } else {
+        stack[stack_size++] = node.offset;
+        stack[stack_size++] = index + 1;
+      }
+    }
+  }
+
+  static bool IntersectsBox(const Box &box,
+                            const geometry::Vector3<Scalar> &origin,
+                            const geometry::Vector3<Scalar> &inv_direction,
+                            Scalar t_min,
+                            Scalar t_max) {
+    for (int a = 0; a < 3; a++) {
+      Scalar t0 = (box.min_bound[a] - origin[a]) * inv_direction[a];
+      Scalar t1 = (box.max_bound[a] - origin[a]) * inv_direction[a];
+      if (t0 > t1) {
+        std::swap(t0, t1);
+      }
+      // Widened by the rounding error of t1 so that rays grazing a box are
+      // not lost (Pharr et al., PBRT 3.9.2).
+      t1 *= 1 + 6 * std::numeric_limits<Scalar>::epsilon();
+      // Written so that NaN, from a zero direction on a slab plane, keeps
+      // the interval.
+      t_min = t0 > t_min ? t0 : t_min;
+      t_max = t1 < t_max ? t1 : t_max;
+    }
+    return t_min <= t_max;
+  }
+
+  MeshBVHSettings settings_;
+  std::vector<Node> nodes_;
+  std::vector<geometry::Triangle3<Scalar>> triangles_;
+  std::vector<uint32_t> triangle_ids_;
+  // Node ranges [first, second) refit in parallel, and the nodes above them
+  // refit afterwards in this order.
+  std::vector<std::pair<uint32_t, uint32_t>> subtrees_;
+  std::vector<uint32_t> top_nodes_;
+  Scalar sah_cost_{0};
+  Scalar built_sah_cost_{0};
+  MeshBVHUpdateStats update_stats_;
+};
+
+using MeshBVHf = MeshBVH<float>;
+using MeshBVHd = MeshBVH<double>;
+}  // namespace grassland::data_structure
@@ -0,0 +1,56 @@
+#pragma once
+#include "grassland/data_structure/data_structure_util.h"
+#include "grassland/geometry/axis_aligned_bounding_box.h"
+
+namespace grassland::data_structure {
+
+// How MeshBVH builds its hierarchy: top-down with the binned SAH, for the
+// fastest queries, or bottom-up from the Morton order of the triangles
+// (Karras 2012), which builds several times faster and suits meshes that
+// are rebuilt every frame.
+enum class bvh_builder_type : uint8_t { binned_sah = 0, linear };
+
+struct MeshBVHSettings {
+  bvh_builder_type builder{bvh_builder_type::binned_sah};
+  // Centroid bins per axis of the binned SAH build, between 2 and 32.
+  int num_bins{16};
+  // Nodes with more triangles are always split. The binned SAH build makes
+  // smaller ones leaves when no split lowers their SAH cost, the linear
+  // build always does. At most 255.
+  int max_leaf_size{8};
+  // Cost of visiting a node relative to testing a triangle.
+  float traversal_cost{1.0f};
+  // MeshBVH::Update rebuilds the tree once refits have raised its SAH cost
+  // by this factor over the cost right after the last build.
+  float rebuild_threshold{1.5f};
+  // Linear build: 63-bit instead of 30-bit Morton codes, for meshes with
+  // many triangles in the same of the 1024^3 cells of their bounds.
+  bool wide_morton_codes{false};
+};
+
+// A node of the flattened hierarchy, 32 bytes for float.
+template <typename Scalar>
+struct MeshBVHNode {
+  geometry::AABB3<Scalar> bounds;
+  // Leaves: the first of their triangles in BVH order. Interior nodes: the
+  // index of their second child, the first child follows the node.
+  uint32_t offset{0};
+  // Number of triangles of a leaf, 0 for interior nodes.
+  uint16_t count{0};
+  // Split axis of interior nodes, for front-to-back traversal.
+  uint16_t axis{0};
+};
+
+namespace detail {
+// Primitives handed to a thread at a time by the per-primitive loops.
+constexpr int64_t kBVHGrain = 4096;
+
+// Half the surface area of box, to which the SAH takes the probability of
+// a random ray hitting it to be proportional.
+template <typename Scalar>
+Scalar HalfArea(const geometry::AABB3<Scalar> &box) {
+  geometry::Vector3<Scalar> size = box.Size();
+  return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+}  // namespace detail
+}  // namespace grassland::data_structure
@@ -1,3 +1,4 @@
 #pragma once
+#include "grassland/data_structure/acceleration_structure_point_cloud/point_cloud_kd_tree.h"
 
 namespace grassland::data_structure {}
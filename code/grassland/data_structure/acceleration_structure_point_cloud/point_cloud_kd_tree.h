@@ -0,0 +1,317 @@
+#pragma once
+#include "algorithm"
+#include "grassland/data_structure/data_structure_util.h"
+#include "grassland/geometry/geometry_util.h"
+#include "grassland/util/thread_pool.h"
+#include "limits"
+
+namespace grassland::data_structure {
+
+// A k-d tree over points for k nearest neighbour and fixed-radius queries.
+// The tree is complete and implicit: every node splits its points at the
+// median along the widest axis of their bounds, all leaves sit at the same
+// depth with buckets of at most leaf_size points, and the nodes are stored
+// in heap order, so only one split value and axis per interior node is
+// kept and the points of a leaf are consecutive in a copy of the points in
+// tree order. Each level is built in parallel over its nodes, and the tree
+// does not depend on the number of threads. Queries only read, so any
+// number of threads can run them at once.
+template <typename Scalar>
+class PointCloudKDTree {
+ public:
+  using Neighbour = std::pair<Scalar, uint32_t>;
+
+  static constexpr uint32_t kInvalidIndex =
+      std::numeric_limits<uint32_t>::max();
+
+  explicit PointCloudKDTree(const geometry::Vector3<Scalar> *points = nullptr,
+                            size_t n_points = 0,
+                            size_t leaf_size = 16)
+      : num_points_(n_points) {
+    leaf_size = std::max<size_t>(leaf_size, 1);
+    depth_ = 0;
+    while ((n_points + (size_t(1) << depth_) - 1) >> depth_ > leaf_size) {
+      depth_++;
+    }
+    size_t num_interior = (size_t(1) << depth_) - 1;
+    splits_.resize(num_interior);
+    axes_.resize(num_interior);
+    // Points move with their indices so that every level scans memory in
+    // order.
+    std::vector<Entry> entries(n_points);
+    ParallelFor(0, int64_t(n_points), 4096, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        entries[i] = {points[i], uint32_t(i)};
+      }
+    });
+    for (int depth = 0; depth < depth_; depth++) {
+      int64_t num_nodes = int64_t(1) << depth;
+      int64_t first = num_nodes - 1;
+      ParallelFor(0, num_nodes, 1, [&](int64_t begin, int64_t end) {
+        for (int64_t l = begin; l < end; l++) {
+          SplitNode(entries, first + l, depth, l);
+        }
+      });
+    }
+    sorted_points_.resize(n_points);
+    indices_.resize(n_points);
+    ParallelFor(0, int64_t(n_points), 4096, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        sorted_points_[i] = entries[i].point;
+        indices_[i] = entries[i].index;
+      }
+    });
+  }
+
+  // Calls func(index, squared_distance) for every point within radius of
+  // pos, in tree order.
+  template <class Func>
+  void ForEachInRadius(const geometry::Vector3<Scalar> &pos,
+                       Scalar radius,
+                       Func &&func) const {
+    Scalar radius_squared = radius * radius;
+    Traverse(
+        pos, [&]() { return radius_squared; },
+        [&](size_t i, Scalar distance_squared) {
+          if (distance_squared <= radius_squared) {
+            func(indices_[i], distance_squared);
+          }
+        });
+  }
+
+  // Fills neighbours with the k points closest to pos as (squared
+  // distance, index) pairs, nearest first, and fewer if the tree holds
+  // fewer points. Reusing neighbours across calls avoids allocations.
+  void KNearest(const geometry::Vector3<Scalar> &pos,
+                size_t k,
+                std::vector<Neighbour> *neighbours) const {
+    neighbours->clear();
+    if (k == 0) {
+      return;
+    }
+    // A max-heap of the k best candidates so far.
+    Traverse(
+        pos,
+        [&]() {
+          return neighbours->size() < k ? std::numeric_limits<Scalar>::max()
+                                        : neighbours->front().first;
+        },
+        [&](size_t i, Scalar distance_squared) {
+          if (neighbours->size() < k) {
+            neighbours->emplace_back(distance_squared, indices_[i]);
+            std::push_heap(neighbours->begin(), neighbours->end());
+          } else if (distance_squared < neighbours->front().first) {
+            std::pop_heap(neighbours->begin(), neighbours->end());
+            neighbours->back() = {distance_squared, indices_[i]};
+            std::push_heap(neighbours->begin(), neighbours->end());
+          }
+        });
+    std::sort_heap(neighbours->begin(), neighbours->end());
+  }
+
+  // KNearest for every query in parallel. Row q of the n_queries x k
+  // outputs holds the neighbours of queries[q], nearest first, padded with
+  // kInvalidIndex and infinity when the tree holds fewer than k points.
+  // Queries run in the order of the leaves they fall in.
+  void KNearest(const geometry::Vector3<Scalar> *queries,
+                size_t n_queries,
+                size_t k,
+                std::vector<uint32_t> *indices,
+                std::vector<Scalar> *distances_squared) const {
+    indices->assign(n_queries * k, kInvalidIndex);
+    distances_squared->assign(n_queries * k,
+                              std::numeric_limits<Scalar>::infinity());
+    std::vector<uint32_t> order = QueryOrder(queries, n_queries);
+    ParallelFor(0, int64_t(n_queries), kQueryGrain,
+                [&](int64_t begin, int64_t end) {
+                  std::vector<Neighbour> neighbours;
+                  for (int64_t j = begin; j < end; j++) {
+                    size_t q = order[j];
+                    KNearest(queries[q], k, &neighbours);
+                    for (size_t n = 0; n < neighbours.size(); n++) {
+                      (*distances_squared)[q * k + n] = neighbours[n].first;
+                      (*indices)[q * k + n] = neighbours[n].second;
+                    }
+                  }
+                });
+  }
+
+  // ForEachInRadius for every query in parallel, with the results in
+  // compressed rows: the neighbours of queries[q] are entries offsets[q] to
+  // offsets[q + 1] of indices and distances_squared, in tree order.
+  void RadiusSearch(const geometry::Vector3<Scalar> *queries,
+                    size_t n_queries,
+                    Scalar radius,
+                    std::vector<size_t> *offsets,
+                    std::vector<uint32_t> *indices,
+                    std::vector<Scalar> *distances_squared) const {
+    std::vector<uint32_t> order = QueryOrder(queries, n_queries);
+    size_t num_chunks = (n_queries + kQueryGrain - 1) / kQueryGrain;
+    std::vector<std::vector<Neighbour>> found(num_chunks);
+    // Where the neighbours of each query start in its chunk.
+    std::vector<size_t> starts(n_queries);
+    offsets->assign(n_queries + 1, 0);
+    ParallelFor(0, int64_t(n_queries), kQueryGrain,
+                [&](int64_t begin, int64_t end) {
+                  std::vector<Neighbour> &chunk = found[begin / kQueryGrain];
+                  for (int64_t j = begin; j < end; j++) {
+                    size_t q = order[j];
+                    starts[q] = chunk.size();
+                    ForEachInRadius(queries[q], radius,
+                                    [&](uint32_t i, Scalar distance_squared) {
+                                      chunk.emplace_back(distance_squared, i);
+                                    });
+                    (*offsets)[q + 1] = chunk.size() - starts[q];
+                  }
+                });
+    for (size_t q = 0; q < n_queries; q++) {
+      (*offsets)[q + 1] += (*offsets)[q];
+    }
+    indices->resize(offsets->back());
+    distances_squared->resize(offsets->back());
+    ParallelFor(0, int64_t(n_queries), kQueryGrain,
+                [&](int64_t begin, int64_t end) {
+                  const auto &chunk = found[begin / kQueryGrain];
+                  for (int64_t j = begin; j < end; j++) {
+                    size_t q = order[j];
+                    size_t offset = (*offsets)[q];
+                    for (size_t n = 0; n < (*offsets)[q + 1] - offset; n++) {
+                      (*distances_squared)[offset + n] =
+                          chunk[starts[q] + n].first;
+                      (*indices)[offset + n] = chunk[starts[q] + n].second;
+                    }
+                  }
+                });
+  }
+
+  size_t num_points() const {
+    return num_points_;
+  }
+
+  // Levels of interior nodes; there are 2^depth leaves.
+  int depth() const {
+    return depth_;
+  }
+
+  // The points in tree order, and the index of each of them.
+  const std::vector<geometry::Vector3<Scalar>> &sorted_points() const {
+    return sorted_points_;
+  }
+
+  const std::vector<uint32_t> &indices() const {
+    return indices_;
+  }
+
+ private:
+  static constexpr int64_t kQueryGrain = 256;
+
+  // Points [begin, end) of tree order under node l of a level.
+  void NodeRange(int depth, int64_t l, size_t *begin, size_t *end) const {
+    *begin = size_t((uint64_t(l) * num_points_) >> depth);
+    *end = size_t((uint64_t(l + 1) * num_points_) >> depth);
+  }
+
+  struct Entry {
+    geometry::Vector3<Scalar> point;
+    uint32_t index;
+  };
+
+  void SplitNode(std::vector<Entry> &entries,
+                 int64_t node,
+                 int depth,
+                 int64_t l) {
+    size_t begin, end;
+    NodeRange(depth, l, &begin, &end);
+    size_t middle = size_t((uint64_t(2 * l + 1) * num_points_) >>
+                           (depth + 1));
+    geometry::Vector3<Scalar> low = geometry::Vector3<Scalar>::Constant(
+        std::numeric_limits<Scalar>::max());
+    geometry::Vector3<Scalar> high = -low;
+    for (size_t i = begin; i < end; i++) {
+      low = low.cwiseMin(entries[i].point);
+      high = high.cwiseMax(entries[i].point);
+    }
+    int axis = 0;
+    (high - low).maxCoeff(&axis);
+    axes_[node] = uint8_t(axis);
+    if (middle == end) {
+      // An empty right child, which queries always take as the far side.
+      splits_[node] = std::numeric_limits<Scalar>::max();
+      return;
+    }
+    std::nth_element(entries.begin() + begin, entries.begin() + middle,
+                     entries.begin() + end,
+                     [axis](const Entry &a, const Entry &b) {
+                       return a.point[axis] < b.point[axis] ||
+                              (a.point[axis] == b.point[axis] &&
+                               a.index < b.index);
+                     });
+    splits_[node] = entries[middle].point[axis];
+  }
+
+  // Visits the leaves that may hold points closer than bound() to pos,
+  // nearest side first, and calls visit(i, squared_distance) for their
+  // points, i being the position in tree order.
+  template <class Bound, class Visit>
+  void Traverse(const geometry::Vector3<Scalar> &pos,
+                Bound &&bound,
+                Visit &&visit) const {
+    // Pending far children with the squared distance to their half space.
+    std::pair<int64_t, Scalar> stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = {0, Scalar(0)};
+    int64_t num_interior = int64_t(splits_.size());
+    while (stack_size) {
+      auto [node, plane_distance] = stack[--stack_size];
+      if (plane_distance > bound()) {
+        continue;
+      }
+      while (node < num_interior) {
+        Scalar diff = pos[axes_[node]] - splits_[node];
+        int64_t left = 2 * node + 1;
+        stack[stack_size++] = {diff < 0 ? left + 1 : left, diff * diff};
+        node = diff < 0 ? left : left + 1;
+      }
+      size_t begin, end;
+      NodeRange(depth_, node - num_interior, &begin, &end);
+      for (size_t i = begin; i < end; i++) {
+        visit(i, (sorted_points_[i] - pos).squaredNorm());
+      }
+    }
+  }
+
+  // The order in which batched queries run: by the leaf each query falls
+  // in, so consecutive queries read nearby nodes and points.
+  std::vector<uint32_t> QueryOrder(const geometry::Vector3<Scalar> *queries,
+                                   size_t n_queries) const {
+    std::vector<std::pair<uint32_t, uint32_t>> keys(n_queries);
+    int64_t num_interior = int64_t(splits_.size());
+    ParallelFor(0, int64_t(n_queries), 4096, [&](int64_t begin, int64_t end) {
+      for (int64_t q = begin; q < end; q++) {
+        int64_t node = 0;
+        while (node < num_interior) {
+          bool right = queries[q][axes_[node]] >= splits_[node];
+          node = 2 * node + 1 + right;
+        }
+        keys[q] = {uint32_t(node - num_interior), uint32_t(q)};
+      }
+    });
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> order(n_queries);
+    for (size_t j = 0; j < n_queries; j++) {
+      order[j] = keys[j].second;
+    }
+    return order;
+  }
+
+  size_t num_points_;
+  int depth_;
+  std::vector<Scalar> splits_;
+  std::vector<uint8_t> axes_;
+  std::vector<uint32_t> indices_;
+  std::vector<geometry::Vector3<Scalar>> sorted_points_;
+};
+
+using PointCloudKDTreef = PointCloudKDTree<float>;
+using PointCloudKDTreed = PointCloudKDTree<double>;
+}  // namespace grassland::data_structure
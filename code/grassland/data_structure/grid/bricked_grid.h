@@ -0,0 +1,230 @@
+#pragma once
+
+#include "grassland/data_structure/grid/grid_util.h"
+
+namespace grassland::data_structure {
+
+// A drop-in replacement of LinearGrid that stores its content in cubic
+// bricks of BrickSize^3 cells. Cells inside a brick and the bricks themselves
+// are laid out in Morton (Z-curve) order, so the 8 corners of a trilinear
+// sample and the neighbours of a 7-point stencil mostly share a cache line or
+// at least a page, instead of being width * height elements apart.
+template <typename ContentType, size_t BrickSize = 8>
+class BrickedGrid {
+  static_assert(BrickSize >= 2 && (BrickSize & (BrickSize - 1)) == 0,
+                "BrickSize must be a power of two");
+
+ public:
+  BrickedGrid(size_t width,
+              size_t height,
+              const ContentType &default_value = ContentType{})
+      : BrickedGrid(width, height, 1, default_value) {
+  }
+
+  BrickedGrid(size_t width,
+              size_t height,
+              size_t depth,
+              const ContentType &default_value = ContentType{})
+      : width_(width), height_(height), depth_(depth) {
+    bricks_x_ = (width_ + BrickSize - 1) / BrickSize;
+    bricks_y_ = (height_ + BrickSize - 1) / BrickSize;
+    bricks_z_ = (depth_ + BrickSize - 1) / BrickSize;
+
+    // 2D grids get flat BrickSize^2 bricks, so they do not pay for BrickSize
+    // unused z layers.
+    bool flat = depth_ == 1;
+    brick_volume_ = flat ? BrickSize * BrickSize
+                         : BrickSize * BrickSize * BrickSize;
+    for (size_t i = 0; i < BrickSize; i++) {
+      if (flat) {
+        local_x_[i] = MortonSpreadBits2(i);
+        local_y_[i] = MortonSpreadBits2(i) << 1;
+        local_z_[i] = 0;
+      } else {
+        local_x_[i] = MortonSpreadBits3(i);
+        local_y_[i] = MortonSpreadBits3(i) << 1;
+        local_z_[i] = MortonSpreadBits3(i) << 2;
+      }
+    }
+
+    size_t num_bricks = bricks_x_ * bricks_y_ * bricks_z_;
+    std::vector<std::pair<uint64_t, size_t>> brick_order(num_bricks);
+    for (size_t bz = 0; bz < bricks_z_; bz++) {
+      for (size_t by = 0; by < bricks_y_; by++) {
+        for (size_t bx = 0; bx < bricks_x_; bx++) {
+          size_t index = bx + (by + bz * bricks_y_) * bricks_x_;
+          brick_order[index] = {MortonEncode3(bx, by, bz), index};
+        }
+      }
+    }
+    std::sort(brick_order.begin(), brick_order.end());
+    brick_offset_.resize(num_bricks);
+    for (size_t slot = 0; slot < num_bricks; slot++) {
+      brick_offset_[brick_order[slot].second] = slot * brick_volume_;
+    }
+
+    buffer_.resize(num_bricks * brick_volume_, default_value);
+  }
+
+  ~BrickedGrid() = default;
+
+  ContentType &operator[](offset_t offset) {
+    return buffer_[offset];
+  }
+
+  const ContentType &operator[](offset_t offset) const {
+    return buffer_[offset];
+  }
+
+  offset_t offset(offset_t x, offset_t y) const {
+    return offset(x, y, 0);
+  }
+
+  offset_t offset(offset_t x, offset_t y, offset_t z) const {
+    offset_t brick = (x >> kBrickShift) +
+                     ((y >> kBrickShift) + (z >> kBrickShift) * bricks_y_) *
+                         bricks_x_;
+    return brick_offset_[brick] + local_x_[x & (BrickSize - 1)] +
+           local_y_[y & (BrickSize - 1)] + local_z_[z & (BrickSize - 1)];
+  }
+
+  ContentType &operator()(offset_t x, offset_t y) {
+    return buffer_[offset(x, y)];
+  }
+
+  const ContentType &operator()(offset_t x, offset_t y) const {
+    return buffer_[offset(x, y)];
+  }
+
+  ContentType &operator()(offset_t x, offset_t y, offset_t z) {
+    return buffer_[offset(x, y, z)];
+  }
+
+  const ContentType &operator()(offset_t x, offset_t y, offset_t z) const {
+    return buffer_[offset(x, y, z)];
+  }
+
+  size_t width() const {
+    return width_;
+  }
+
+  size_t height() const {
+    return height_;
+  }
+
+  size_t depth() const {
+    return depth_;
+  }
+
+  ContentType get(offset_t x, offset_t y, offset_t z) const {
+    return buffer_[offset(x, y, z)];
+  }
+
+  ContentType get_clamped(offset_t x, offset_t y, offset_t z) const {
+    return buffer_[offset(std::clamp(x, offset_t(0), offset_t(width_ - 1)),
+                          std::clamp(y, offset_t(0), offset_t(height_ - 1)),
+                          std::clamp(z, offset_t(0), offset_t(depth_ - 1)))];
+  }
+
+  template <class Scalar>
+  ContentType sample(Scalar x, Scalar y, Scalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    // Clamp each axis once instead of once per corner, then split the
+    // coordinates into a brick part and an in-brick Morton part.
+    offset_t x1 = std::clamp(x0 + 1, offset_t(0), offset_t(width_ - 1));
+    offset_t y1 = std::clamp(y0 + 1, offset_t(0), offset_t(height_ - 1));
+    offset_t z1 = std::clamp(z0 + 1, offset_t(0), offset_t(depth_ - 1));
+    x0 = std::clamp(x0, offset_t(0), offset_t(width_ - 1));
+    y0 = std::clamp(y0, offset_t(0), offset_t(height_ - 1));
+    z0 = std::clamp(z0, offset_t(0), offset_t(depth_ - 1));
+    offset_t bx0 = x0 >> kBrickShift;
+    offset_t bx1 = x1 >> kBrickShift;
+    offset_t by0 = (y0 >> kBrickShift) * bricks_x_;
+    offset_t by1 = (y1 >> kBrickShift) * bricks_x_;
+    offset_t bz0 = (z0 >> kBrickShift) * bricks_x_ * bricks_y_;
+    offset_t bz1 = (z1 >> kBrickShift) * bricks_x_ * bricks_y_;
+    offset_t lx0 = local_x_[x0 & (BrickSize - 1)];
+    offset_t lx1 = local_x_[x1 & (BrickSize - 1)];
+    offset_t ly0 = local_y_[y0 & (BrickSize - 1)];
+    offset_t ly1 = local_y_[y1 & (BrickSize - 1)];
+    offset_t lz0 = local_z_[z0 & (BrickSize - 1)];
+    offset_t lz1 = local_z_[z1 & (BrickSize - 1)];
+    ContentType c[8];
+    if (bx0 == bx1 && by0 == by1 && bz0 == bz1) {
+      // All 8 corners live in one brick, which is the common case.
+      const ContentType *brick =
+          buffer_.data() + brick_offset_[bx0 + by0 + bz0];
+      c[0] = brick[lx0 + ly0 + lz0];
+      c[1] = brick[lx1 + ly0 + lz0];
+      c[2] = brick[lx0 + ly1 + lz0];
+      c[3] = brick[lx1 + ly1 + lz0];
+      c[4] = brick[lx0 + ly0 + lz1];
+      c[5] = brick[lx1 + ly0 + lz1];
+      c[6] = brick[lx0 + ly1 + lz1];
+      c[7] = brick[lx1 + ly1 + lz1];
+    } else {
+      c[0] = buffer_[brick_offset_[bx0 + by0 + bz0] + lx0 + ly0 + lz0];
+      c[1] = buffer_[brick_offset_[bx1 + by0 + bz0] + lx1 + ly0 + lz0];
+      c[2] = buffer_[brick_offset_[bx0 + by1 + bz0] + lx0 + ly1 + lz0];
+      c[3] = buffer_[brick_offset_[bx1 + by1 + bz0] + lx1 + ly1 + lz0];
+      c[4] = buffer_[brick_offset_[bx0 + by0 + bz1] + lx0 + ly0 + lz1];
+      c[5] = buffer_[brick_offset_[bx1 + by0 + bz1] + lx1 + ly0 + lz1];
+      c[6] = buffer_[brick_offset_[bx0 + by1 + bz1] + lx0 + ly1 + lz1];
+      c[7] = buffer_[brick_offset_[bx1 + by1 + bz1] + lx1 + ly1 + lz1];
+    }
+    return c[0] * ((1 - x) * (1 - y) * (1 - z)) +
+           c[1] * (x * (1 - y) * (1 - z)) + c[2] * ((1 - x) * y * (1 - z)) +
+           c[3] * (x * y * (1 - z)) + c[4] * ((1 - x) * (1 - y) * z) +
+           c[5] * (x * (1 - y) * z) + c[6] * ((1 - x) * y * z) +
+           c[7] * (x * y * z);
+  }
+
+  ContentType *data() {
+    return buffer_.data();
+  }
+
+  const ContentType *data() const {
+    return buffer_.data();
+  }
+
+  std::vector<ContentType> &buffer() {
+    return buffer_;
+  }
+
+  const std::vector<ContentType> &buffer() const {
+    return buffer_;
+  }
+
+  size_t brick_volume() const {
+    return brick_volume_;
+  }
+
+  size_t num_bricks() const {
+    return brick_offset_.size();
+  }
+
+ private:
+  static constexpr int kBrickShift = MortonLog2(BrickSize);
+
+  std::vector<ContentType> buffer_;
+  std::vector<offset_t> brick_offset_;
+  offset_t local_x_[BrickSize];
+  offset_t local_y_[BrickSize];
+  offset_t local_z_[BrickSize];
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  size_t bricks_x_;
+  size_t bricks_y_;
+  size_t bricks_z_;
+  size_t brick_volume_;
+};
+
+template <typename ContentType, size_t BrickSize>
+struct IsDenseGrid<BrickedGrid<ContentType, BrickSize>> : std::true_type {};
+}  // namespace grassland::data_structure
@@ -0,0 +1,461 @@
+#pragma once
+#include "cstdio"
+#include "fstream"
+#include "grassland/data_structure/grid/grid_reduction.h"
+#include "grassland/data_structure/grid/linear_grid.h"
+#include "list"
+#include "mutex"
+#include "stdexcept"
+
+namespace grassland::data_structure {
+
+// Counters of the brick cache of a ChunkedGrid. A hit is an access to a brick
+// that was in memory, a miss loads it, from the file if it was written
+// before. Evictions of modified bricks write them to the file.
+struct ChunkedGridStats {
+  uint64_t hits{0};
+  uint64_t misses{0};
+  uint64_t evictions{0};
+  uint64_t bricks_written{0};
+  uint64_t bricks_read{0};
+
+  double hit_rate() const {
+    uint64_t accesses = hits + misses;
+    return accesses ? double(hits) / double(accesses) : 1.0;
+  }
+};
+
+// An out-of-core grid for fields larger than memory. The cells are split in
+// bricks of BrickSize^3 (flattened to the depth of 2D grids), stored in a
+// scratch file and paged in through a least recently used cache holding as
+// many bricks as fit in memory_budget bytes, at least 8. Bricks never
+// written hold the default value and take no room in the file. The file is
+// deleted with the grid. The constructor throws std::runtime_error when the
+// file cannot be created, and so do the accessors when a brick cannot be
+// written to or read back from it; the cache then still holds the brick
+// that was to be evicted.
+//
+// Cell accessors mirror LinearGrid, except that const operator() returns a
+// value. They lock the cache, so const accessors may be called from several
+// threads, but a reference returned by the non-const operator() only stays
+// valid until an access misses the cache. Passes over the whole grid should
+// use ForEachBrick, which visits every brick once and runs on the thread
+// pool, or ReadBlock to copy a box of cells at once.
+template <typename ContentType, size_t BrickSize = 32>
+class ChunkedGrid {
+  static_assert(std::is_trivially_copyable_v<ContentType>,
+                "ChunkedGrid stores cells as raw bytes");
+
+ public:
+  ChunkedGrid(const std::string &filename,
+              size_t width,
+              size_t height,
+              size_t depth,
+              size_t memory_budget,
+              const ContentType &default_value = ContentType{})
+      : filename_(filename),
+        width_(width),
+        height_(height),
+        depth_(depth),
+        default_value_(default_value) {
+    size_t size[3] = {width, height, depth};
+    for (int axis = 0; axis < 3; axis++) {
+      brick_size_[axis] = std::min(BrickSize, std::max<size_t>(size[axis], 1));
+      bricks_[axis] = (size[axis] + brick_size_[axis] - 1) / brick_size_[axis];
+    }
+    brick_volume_ = brick_size_[0] * brick_size_[1] * brick_size_[2];
+    size_t num_bricks = bricks_[0] * bricks_[1] * bricks_[2];
+    stored_.assign(num_bricks, false);
+    slot_of_brick_.assign(num_bricks, -1);
+    capacity_ = std::max<size_t>(
+        memory_budget / (brick_volume_ * sizeof(ContentType)), 8);
+    capacity_ = std::min(capacity_, std::max<size_t>(num_bricks, 1));
+    slots_.reserve(capacity_);
+    file_.open(filename, std::ios::in | std::ios::out | std::ios::binary |
+                             std::ios::trunc);
+    if (!file_) {
+      throw std::runtime_error("ChunkedGrid: cannot create " + filename);
+    }
+  }
+
+  ChunkedGrid(const ChunkedGrid &) = delete;
+  ChunkedGrid &operator=(const ChunkedGrid &) = delete;
+
+  ~ChunkedGrid() {
+    if (file_.is_open()) {
+      file_.close();
+      std::remove(filename_.c_str());
+    }
+  }
+
+  size_t width() const {
+    return width_;
+  }
+
+  size_t height() const {
+    return height_;
+  }
+
+  size_t depth() const {
+    return depth_;
+  }
+
+  ContentType &operator()(offset_t x, offset_t y, offset_t z) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot &slot = Acquire(BrickIndex(x, y, z));
+    slot.dirty = true;
+    return slot.data[LocalOffset(x, y, z)];
+  }
+
+  ContentType operator()(offset_t x, offset_t y, offset_t z) const {
+    return get(x, y, z);
+  }
+
+  ContentType &operator()(offset_t x, offset_t y) {
+    return (*this)(x, y, 0);
+  }
+
+  ContentType operator()(offset_t x, offset_t y) const {
+    return get(x, y, 0);
+  }
+
+  ContentType get(offset_t x, offset_t y, offset_t z) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Acquire(BrickIndex(x, y, z)).data[LocalOffset(x, y, z)];
+  }
+
+  ContentType get_clamped(offset_t x, offset_t y, offset_t z) const {
+    return get(std::clamp(x, offset_t(0), offset_t(width_ - 1)),
+               std::clamp(y, offset_t(0), offset_t(height_ - 1)),
+               std::clamp(z, offset_t(0), offset_t(depth_ - 1)));
+  }
+
+  void set(offset_t x, offset_t y, offset_t z, const ContentType &value) {
+    (*this)(x, y, z) = value;
+  }
+
+  // Trilinear interpolation clamped to the edge like LinearGrid::sample.
+  template <class Scalar>
+  ContentType sample(Scalar x, Scalar y, Scalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    ContentType c[8];
+    for (int corner = 0; corner < 8; corner++) {
+      c[corner] = get_clamped(x0 + (corner & 1), y0 + ((corner >> 1) & 1),
+                              z0 + (corner >> 2));
+    }
+    return c[0] * ((1 - x) * (1 - y) * (1 - z)) +
+           c[1] * (x * (1 - y) * (1 - z)) + c[2] * ((1 - x) * y * (1 - z)) +
+           c[3] * (x * y * (1 - z)) + c[4] * ((1 - x) * (1 - y) * z) +
+           c[5] * (x * (1 - y) * z) + c[6] * ((1 - x) * y * z) +
+           c[7] * (x * y * z);
+  }
+
+  // Calls func(x0, y0, z0, brick) once for every brick, where brick is a
+  // LinearGridView of the cells of the brick and (x0, y0, z0) the grid
+  // coordinates of its first cell. Bricks are loaded in batches filling the
+  // cache, then each batch runs in parallel on the global thread pool; func
+  // must only touch its brick and must not use the accessors of the grid.
+  // Every brick is marked as modified.
+  template <class Func>
+  void ForEachBrick(Func &&func) {
+    ForEachBrickImpl<ContentType>(this, true, func);
+  }
+
+  template <class Func>
+  void ForEachBrick(Func &&func) const {
+    ForEachBrickImpl<const ContentType>(this, false, func);
+  }
+
+  // Combines term(cell) over all cells with combine, brick by brick. The
+  // order of the combinations only depends on the grid size.
+  template <class T, class TermFunc, class CombineFunc>
+  T Reduce(const T &identity, TermFunc &&term, CombineFunc &&combine) const {
+    std::vector<T> partial(num_bricks(), identity);
+    ForEachBrick([&](offset_t x0, offset_t y0, offset_t z0,
+                     const LinearGridView<const ContentType> &brick) {
+      T result = identity;
+      for (offset_t z = 0; z < offset_t(brick.depth()); z++) {
+        for (offset_t y = 0; y < offset_t(brick.height()); y++) {
+          for (offset_t x = 0; x < offset_t(brick.width()); x++) {
+            result = combine(result, T(term(brick(x, y, z))));
+          }
+        }
+      }
+      partial[BrickIndex(x0, y0, z0)] = result;
+    });
+    T result = identity;
+    for (const T &value : partial) {
+      result = combine(result, value);
+    }
+    return result;
+  }
+
+  // Copies the cells of block->width() x block->height() x block->depth()
+  // starting at (x0, y0, z0) into block, brick by brick. Cells outside the
+  // grid are clamped to the edge.
+  void ReadBlock(offset_t x0,
+                 offset_t y0,
+                 offset_t z0,
+                 LinearGrid<ContentType> *block) const {
+    offset_t end[3] = {x0 + offset_t(block->width()),
+                       y0 + offset_t(block->height()),
+                       z0 + offset_t(block->depth())};
+    offset_t last[3] = {offset_t(width_) - 1, offset_t(height_) - 1,
+                        offset_t(depth_) - 1};
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (offset_t z = z0; z < end[2]; z++) {
+      offset_t cz = std::clamp(z, offset_t(0), last[2]);
+      for (offset_t y = y0; y < end[1]; y++) {
+        offset_t cy = std::clamp(y, offset_t(0), last[1]);
+        size_t current = num_bricks();
+        const ContentType *data = nullptr;
+        for (offset_t x = x0; x < end[0]; x++) {
+          offset_t cx = std::clamp(x, offset_t(0), last[0]);
+          size_t brick = BrickIndex(cx, cy, cz);
+          if (brick != current) {
+            data = Acquire(brick).data.data();
+            current = brick;
+          }
+          (*block)(x - x0, y - y0, z - z0) = data[LocalOffset(cx, cy, cz)];
+        }
+      }
+    }
+  }
+
+  // Writes the modified bricks in memory to the file.
+  void Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Slot &slot : slots_) {
+      if (slot.dirty) {
+        Store(slot);
+      }
+    }
+  }
+
+  ChunkedGridStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = ChunkedGridStats{};
+  }
+
+  size_t num_bricks() const {
+    return stored_.size();
+  }
+
+  // Number of bricks the cache holds.
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  size_t brick_width() const {
+    return brick_size_[0];
+  }
+
+  size_t brick_height() const {
+    return brick_size_[1];
+  }
+
+  size_t brick_depth() const {
+    return brick_size_[2];
+  }
+
+ private:
+  // The brick of a slot that holds none, after a failed read.
+  static constexpr size_t kNoBrick = ~size_t(0);
+
+  struct Slot {
+    size_t brick{kNoBrick};
+    bool dirty{false};
+    std::vector<ContentType> data;
+    std::list<size_t>::iterator lru;
+  };
+
+  size_t BrickIndex(offset_t x, offset_t y, offset_t z) const {
+    return size_t(x) / brick_size_[0] +
+           (size_t(y) / brick_size_[1] +
+            size_t(z) / brick_size_[2] * bricks_[1]) *
+               bricks_[0];
+  }
+
+  size_t LocalOffset(offset_t x, offset_t y, offset_t z) const {
+    return size_t(x) % brick_size_[0] +
+           (size_t(y) % brick_size_[1] +
+            size_t(z) % brick_size_[2] * brick_size_[1]) *
+               brick_size_[0];
+  }
+
+  // The slot holding brick, loading it and evicting the least recently used
+  // brick on a miss. Called with mutex_ held. When the evicted brick cannot
+  // be written it stays cached, when brick cannot be read the slot is left
+  // empty.
+  Slot &Acquire(size_t brick) const {
+    int64_t index = slot_of_brick_[brick];
+    if (index >= 0) {
+      stats_.hits++;
+      Slot &slot = slots_[index];
+      lru_.splice(lru_.begin(), lru_, slot.lru);
+      return slot;
+    }
+    stats_.misses++;
+    if (slots_.size() < capacity_) {
+      index = int64_t(slots_.size());
+      slots_.emplace_back();
+      slots_.back().data.resize(brick_volume_);
+      lru_.push_front(size_t(index));
+      slots_.back().lru = lru_.begin();
+    } else {
+      index = int64_t(lru_.back());
+      Slot &victim = slots_[index];
+      stats_.evictions++;
+      if (victim.dirty) {
+        Store(victim);
+      }
+      if (victim.brick != kNoBrick) {
+        slot_of_brick_[victim.brick] = -1;
+        victim.brick = kNoBrick;
+      }
+      lru_.splice(lru_.begin(), lru_, victim.lru);
+    }
+    Slot &slot = slots_[index];
+    if (stored_[brick]) {
+      Load(slot, brick);
+    } else {
+      std::fill(slot.data.begin(), slot.data.end(), default_value_);
+    }
+    slot.brick = brick;
+    slot.dirty = false;
+    slot_of_brick_[brick] = index;
+    return slot;
+  }
+
+  void Load(Slot &slot, size_t brick) const {
+    file_.seekg(std::streamoff(BrickBytes() * brick));
+    if (file_) {
+      file_.read(reinterpret_cast<char *>(slot.data.data()),
+                 std::streamsize(BrickBytes()));
+    }
+    if (!file_ || file_.gcount() != std::streamsize(BrickBytes())) {
+      file_.clear();
+      throw std::runtime_error("ChunkedGrid: cannot read a brick from " +
+                               filename_);
+    }
+    stats_.bricks_read++;
+  }
+
+  // Writes slot to the file, flushing so that a full disk is reported here
+  // and not on a later access.
+  void Store(Slot &slot) const {
+    file_.seekp(std::streamoff(BrickBytes() * slot.brick));
+    if (file_) {
+      file_.write(reinterpret_cast<const char *>(slot.data.data()),
+                  std::streamsize(BrickBytes()));
+    }
+    if (file_) {
+      file_.flush();
+    }
+    if (!file_) {
+      file_.clear();
+      throw std::runtime_error("ChunkedGrid: cannot write a brick to " +
+                               filename_);
+    }
+    stats_.bricks_written++;
+    stored_[slot.brick] = true;
+    slot.dirty = false;
+  }
+
+  size_t BrickBytes() const {
+    return brick_volume_ * sizeof(ContentType);
+  }
+
+  template <class Cell, class Self, class Func>
+  static void ForEachBrickImpl(Self *self, bool modify, Func &func) {
+    size_t num_bricks = self->num_bricks();
+    std::vector<std::pair<size_t, Slot *>> batch;
+    for (size_t begin = 0; begin < num_bricks; begin += self->capacity_) {
+      size_t end = std::min(begin + self->capacity_, num_bricks);
+      batch.clear();
+      {
+        // A batch fits in the cache, so loading it evicts no brick of it.
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        for (size_t brick = begin; brick < end; brick++) {
+          Slot &slot = self->Acquire(brick);
+          slot.dirty |= modify;
+          batch.emplace_back(brick, &slot);
+        }
+      }
+      ParallelFor(0, offset_t(batch.size()), 1,
+                  [&](int64_t batch_begin, int64_t batch_end) {
+                    for (int64_t i = batch_begin; i < batch_end; i++) {
+                      self->template VisitBrick<Cell>(
+                          batch[i].first, batch[i].second, func);
+                    }
+                  });
+    }
+  }
+
+  template <class Cell, class Func>
+  void VisitBrick(size_t brick, Slot *slot, Func &func) const {
+    offset_t origin[3] = {
+        offset_t(brick % bricks_[0] * brick_size_[0]),
+        offset_t(brick / bricks_[0] % bricks_[1] * brick_size_[1]),
+        offset_t(brick / (bricks_[0] * bricks_[1]) * brick_size_[2])};
+    LinearGridView<Cell> view(
+        std::min(brick_size_[0], width_ - origin[0]),
+        std::min(brick_size_[1], height_ - origin[1]),
+        std::min(brick_size_[2], depth_ - origin[2]), brick_size_[0],
+        brick_size_[0] * brick_size_[1], slot->data.data());
+    func(origin[0], origin[1], origin[2], view);
+  }
+
+  std::string filename_;
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  ContentType default_value_;
+  size_t brick_size_[3];
+  size_t bricks_[3];
+  size_t brick_volume_;
+  size_t capacity_;
+  mutable std::fstream file_;
+  mutable std::mutex mutex_;
+  // Whether the file holds a copy of the brick.
+  mutable std::vector<bool> stored_;
+  mutable std::vector<int64_t> slot_of_brick_;
+  // Slots never move once created, the list orders them by last use.
+  mutable std::vector<Slot> slots_;
+  mutable std::list<size_t> lru_;
+  mutable ChunkedGridStats stats_;
+};
+
+template <class ContentType, size_t BrickSize>
+ContentType Sum(const ChunkedGrid<ContentType, BrickSize> &grid) {
+  return grid.Reduce(
+      ContentType(0), [](const ContentType &value) { return value; },
+      ReduceSum<ContentType>());
+}
+
+template <class ContentType, size_t BrickSize>
+ContentType Min(const ChunkedGrid<ContentType, BrickSize> &grid) {
+  return grid.Reduce(
+      std::numeric_limits<ContentType>::max(),
+      [](const ContentType &value) { return value; },
+      ReduceMin<ContentType>());
+}
+
+template <class ContentType, size_t BrickSize>
+ContentType Max(const ChunkedGrid<ContentType, BrickSize> &grid) {
+  return grid.Reduce(
+      std::numeric_limits<ContentType>::lowest(),
+      [](const ContentType &value) { return value; },
+      ReduceMax<ContentType>());
+}
+}  // namespace grassland::data_structure
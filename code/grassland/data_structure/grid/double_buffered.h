@@ -0,0 +1,55 @@
+#pragma once
+#include "array"
+#include "grassland/data_structure/grid/grid_util.h"
+
+namespace grassland::data_structure {
+
+// Two grids for time stepping without reallocation: a step reads front()
+// and writes every cell of back(), e.g. through AdvectSemiLagrangian, then
+// swap() makes the result the new front. Swapping exchanges the roles of
+// the grids in O(1) and never moves or reallocates them, so pointers and
+// views into either grid stay valid.
+//
+//   DoubleBuffered<LinearGrid<float>> density(
+//       LinearGrid<float>(64, 64, 64, 0.0f),
+//       LinearGrid<float>(64, 64, 64, grid_uninitialized));
+//   AdvectSemiLagrangian(velocity, density.front(), dt, density.back());
+//   density.swap();
+template <typename GridType>
+class DoubleBuffered {
+ public:
+  DoubleBuffered(GridType front, GridType back)
+      : grids_{std::move(front), std::move(back)} {
+  }
+
+  // Both grids constructed from the same arguments.
+  template <class... Args>
+  explicit DoubleBuffered(const Args &...args)
+      : grids_{GridType(args...), GridType(args...)} {
+  }
+
+  GridType &front() {
+    return grids_[front_];
+  }
+
+  const GridType &front() const {
+    return grids_[front_];
+  }
+
+  GridType &back() {
+    return grids_[front_ ^ 1];
+  }
+
+  const GridType &back() const {
+    return grids_[front_ ^ 1];
+  }
+
+  void swap() noexcept {
+    front_ ^= 1;
+  }
+
+ private:
+  std::array<GridType, 2> grids_;
+  int front_{0};
+};
+}  // namespace grassland::data_structure
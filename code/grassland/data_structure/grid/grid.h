@@ -1,7 +1,18 @@
 #pragma once
+#include "grassland/data_structure/grid/bricked_grid.h"
+#include "grassland/data_structure/grid/chunked_grid.h"
+#include "grassland/data_structure/grid/double_buffered.h"
+#include "grassland/data_structure/grid/grid_interpolation.h"
+#include "grassland/data_structure/grid/grid_parallel.h"
+#include "grassland/data_structure/grid/grid_reduction.h"
+#include "grassland/data_structure/grid/grid_stencil.h"
 #include "grassland/data_structure/grid/linear_grid.h"
 #include "grassland/data_structure/grid/linear_grid_view.h"
 #include "grassland/data_structure/grid/mac_grid.h"
+#include "grassland/data_structure/grid/mac_grid_operators.h"
+#include "grassland/data_structure/grid/multi_channel_grid.h"
+#include "grassland/data_structure/grid/quantized_grid.h"
+#include "grassland/data_structure/grid/sparse_grid.h"
 
 #if defined(__CUDACC__)
 #include "grassland/data_structure/grid/linear_grid_cuda.h"
@@ -0,0 +1,62 @@
+#pragma once
+#include "grassland/data_structure/grid/grid_util.h"
+
+namespace grassland::data_structure {
+
+// Default number of cells handed to a thread at a time by the parallel grid
+// kernels, large enough to amortize scheduling and small enough to balance
+// 32 threads on a 128^3 grid.
+constexpr size_t kParallelGrain = 4096;
+
+// Calls func(x, y, z, value) for every cell of grid, where grid is any grid
+// type (or Field) with width()/height()/depth() and operator()(x, y, z).
+// Cells are split into runs of whole rows of about grain cells, i.e. z slabs
+// on large 3D grids, which run in parallel on the global thread pool. The
+// split does not depend on the number of threads, and func must only touch
+// the cell it is given. Grids that allocate on write, like SparseGrid, are
+// not supported.
+template <class GridType, class Func>
+void ParallelForEach(GridType &grid,
+                     Func &&func,
+                     size_t grain = kParallelGrain) {
+  offset_t width = grid.width(), height = grid.height();
+  offset_t num_rows = height * offset_t(grid.depth());
+  offset_t rows_per_chunk =
+      std::max<offset_t>(1, offset_t(grain) / std::max<offset_t>(width, 1));
+  ParallelFor(0, num_rows, rows_per_chunk,
+              [&](offset_t row_begin, offset_t row_end) {
+                for (offset_t row = row_begin; row < row_end; row++) {
+                  offset_t y = row % height, z = row / height;
+                  for (offset_t x = 0; x < width; x++) {
+                    func(x, y, z, grid(x, y, z));
+                  }
+                }
+              });
+}
+
+// Sets every cell of grid to func(x, y, z), in parallel.
+template <class GridType, class Func>
+void ParallelFill(GridType &grid, Func &&func, size_t grain = kParallelGrain) {
+  ParallelForEach(
+      grid,
+      [&](offset_t x, offset_t y, offset_t z, auto &&value) {
+        value = func(x, y, z);
+      },
+      grain);
+}
+
+// Sets every cell of result to func(value) of the same cell of grid, in
+// parallel. Both grids must have the same size.
+template <class GridType, class ResultGridType, class Func>
+void ParallelTransform(const GridType &grid,
+                       ResultGridType &result,
+                       Func &&func,
+                       size_t grain = kParallelGrain) {
+  ParallelForEach(
+      result,
+      [&](offset_t x, offset_t y, offset_t z, auto &&value) {
+        value = func(grid(x, y, z));
+      },
+      grain);
+}
+}  // namespace grassland::data_structure
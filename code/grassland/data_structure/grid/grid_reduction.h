@@ -0,0 +1,287 @@
+#pragma once
+#include "grassland/data_structure/grid/grid_parallel.h"
+#include "grassland/data_structure/grid/mac_grid.h"
+#include "limits"
+
+namespace grassland::data_structure {
+
+// Reductions over the cells of a grid (ghost layers excluded) and over the
+// three faces of a MACGrid. LinearGrid and LinearGridView rows are read
+// through a pointer; other grid types, like BrickedGrid or SparseGrid, are
+// read through operator() a cell at a time. Each row is reduced with
+// kReductionLanes independent accumulators, which the compiler keeps in
+// vector registers, and rows are grouped in chunks whose size only depends
+// on the grid width. The per-chunk partials are then combined by a fixed
+// pairwise tree, so results are bit-identical for any number of threads.
+//
+// The masked overloads only visit cells whose mask cell is non-zero; mask is
+// a grid of the same size, e.g. a LinearGrid<uint8_t>.
+
+constexpr size_t kReductionLanes = 8;
+
+constexpr size_t kReductionGrain = 16384;
+
+// Whether the cells of a row of GridType are adjacent in memory, so that
+// the row can be read through a pointer to its first cell.
+template <class GridType>
+struct IsRowContiguousGrid : std::false_type {};
+
+template <class ContentType>
+struct IsRowContiguousGrid<LinearGrid<ContentType>> : std::true_type {};
+
+template <class ContentType>
+struct IsRowContiguousGrid<LinearGridView<ContentType>> : std::true_type {};
+
+// A function of x returning cell (x, y, z) of grid.
+template <class GridType>
+auto GridRow(const GridType &grid, offset_t y, offset_t z) {
+  if constexpr (IsRowContiguousGrid<GridType>::value) {
+    const auto *row = &grid(0, y, z);
+    return [row](offset_t x) { return row[x]; };
+  } else {
+    return [&grid, y, z](offset_t x) { return grid(x, y, z); };
+  }
+}
+
+// Combines term(0), ..., term(n - 1) in a fixed order.
+template <class T, class TermFunc, class CombineFunc>
+T ReduceRow(offset_t n,
+            const T &identity,
+            TermFunc &&term,
+            CombineFunc &&combine) {
+  constexpr offset_t kLanes = kReductionLanes;
+  T acc[kLanes];
+  for (offset_t lane = 0; lane < kLanes; lane++) {
+    acc[lane] = identity;
+  }
+  offset_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (offset_t lane = 0; lane < kLanes; lane++) {
+      acc[lane] = combine(acc[lane], term(i + lane));
+    }
+  }
+  for (; i < n; i++) {
+    acc[i % kLanes] = combine(acc[i % kLanes], term(i));
+  }
+  for (offset_t width = kLanes / 2; width > 0; width /= 2) {
+    for (offset_t lane = 0; lane < width; lane++) {
+      acc[lane] = combine(acc[lane], acc[lane + width]);
+    }
+  }
+  return acc[0];
+}
+
+// Combines row_func(y, z) over all rows of a width x height x depth grid, in
+// parallel, with a reduction order that does not depend on the thread count.
+template <class T, class RowFunc, class CombineFunc>
+T ReduceRows(offset_t width,
+             offset_t height,
+             offset_t depth,
+             const T &identity,
+             RowFunc &&row_func,
+             CombineFunc &&combine) {
+  offset_t num_rows = height * depth;
+  if (num_rows <= 0) {
+    return identity;
+  }
+  offset_t rows_per_chunk = std::max<offset_t>(
+      1, offset_t(kReductionGrain) / std::max<offset_t>(width, 1));
+  offset_t num_chunks = (num_rows + rows_per_chunk - 1) / rows_per_chunk;
+  std::vector<T> partials(num_chunks, identity);
+  ParallelFor(0, num_chunks, 1, [&](offset_t chunk_begin, offset_t chunk_end) {
+    for (offset_t chunk = chunk_begin; chunk < chunk_end; chunk++) {
+      offset_t row_end = std::min(num_rows, (chunk + 1) * rows_per_chunk);
+      T partial = identity;
+      for (offset_t row = chunk * rows_per_chunk; row < row_end; row++) {
+        partial = combine(partial, row_func(row % height, row / height));
+      }
+      partials[chunk] = partial;
+    }
+  });
+  for (size_t size = partials.size(); size > 1; size = (size + 1) / 2) {
+    for (size_t i = 0; i < size / 2; i++) {
+      partials[i] = combine(partials[2 * i], partials[2 * i + 1]);
+    }
+    if (size % 2) {
+      partials[size / 2] = partials[size - 1];
+    }
+  }
+  return partials[0];
+}
+
+// Reduces term(value) over all cells, or over the cells selected by mask.
+template <class GridType, class TermFunc, class CombineFunc, class T>
+T ReduceGrid(const GridType &grid,
+             const T &identity,
+             TermFunc &&term,
+             CombineFunc &&combine) {
+  return ReduceRows(
+      grid.width(), grid.height(), grid.depth(), identity,
+      [&](offset_t y, offset_t z) {
+        auto row = GridRow(grid, y, z);
+        return ReduceRow(
+            grid.width(), identity,
+            [&](offset_t x) -> T { return term(row(x)); }, combine);
+      },
+      combine);
+}
+
+template <class GridType,
+          class MaskGridType,
+          class TermFunc,
+          class CombineFunc,
+          class T>
+T ReduceGrid(const GridType &grid,
+             const MaskGridType &mask,
+             const T &identity,
+             TermFunc &&term,
+             CombineFunc &&combine) {
+  return ReduceRows(
+      grid.width(), grid.height(), grid.depth(), identity,
+      [&](offset_t y, offset_t z) {
+        auto row = GridRow(grid, y, z);
+        auto mask_row = GridRow(mask, y, z);
+        return ReduceRow(
+            grid.width(), identity,
+            [&](offset_t x) -> T {
+              return mask_row(x) ? T(term(row(x))) : identity;
+            },
+            combine);
+      },
+      combine);
+}
+
+template <class T>
+struct ReduceSum {
+  T operator()(const T &a, const T &b) const {
+    return a + b;
+  }
+};
+
+template <class T>
+struct ReduceMin {
+  T operator()(const T &a, const T &b) const {
+    return b < a ? b : a;
+  }
+};
+
+template <class T>
+struct ReduceMax {
+  T operator()(const T &a, const T &b) const {
+    return a < b ? b : a;
+  }
+};
+
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> Sum(const GridType &grid, const MaskGridType &...mask) {
+  using T = GridValueType<GridType>;
+  return ReduceGrid(
+      grid, mask..., T(0), [](const T &value) { return value; },
+      ReduceSum<T>());
+}
+
+// Returns the largest value of T when no cell is visited.
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> Min(const GridType &grid, const MaskGridType &...mask) {
+  using T = GridValueType<GridType>;
+  return ReduceGrid(
+      grid, mask..., std::numeric_limits<T>::max(),
+      [](const T &value) { return value; }, ReduceMin<T>());
+}
+
+// Returns the lowest value of T when no cell is visited.
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> Max(const GridType &grid, const MaskGridType &...mask) {
+  using T = GridValueType<GridType>;
+  return ReduceGrid(
+      grid, mask..., std::numeric_limits<T>::lowest(),
+      [](const T &value) { return value; }, ReduceMax<T>());
+}
+
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> MaxAbs(const GridType &grid,
+                               const MaskGridType &...mask) {
+  using T = GridValueType<GridType>;
+  return ReduceGrid(
+      grid, mask..., T(0), [](const T &value) { return std::abs(value); },
+      ReduceMax<T>());
+}
+
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> SquaredNorm(const GridType &grid,
+                                    const MaskGridType &...mask) {
+  using T = GridValueType<GridType>;
+  return ReduceGrid(
+      grid, mask..., T(0), [](const T &value) { return value * value; },
+      ReduceSum<T>());
+}
+
+template <class GridType, class... MaskGridType>
+GridValueType<GridType> L2Norm(const GridType &grid,
+                               const MaskGridType &...mask) {
+  return std::sqrt(SquaredNorm(grid, mask...));
+}
+
+// Sum of a(x, y, z) * b(x, y, z), a and b having the same size.
+template <class GridType, class OtherGridType>
+GridValueType<GridType> Dot(const GridType &a, const OtherGridType &b) {
+  using T = GridValueType<GridType>;
+  return ReduceRows(
+      a.width(), a.height(), a.depth(), T(0),
+      [&](offset_t y, offset_t z) {
+        auto row_a = GridRow(a, y, z);
+        auto row_b = GridRow(b, y, z);
+        return ReduceRow(
+            a.width(), T(0),
+            [&](offset_t x) -> T { return row_a(x) * row_b(x); },
+            ReduceSum<T>());
+      },
+      ReduceSum<T>());
+}
+
+template <class GridType, class OtherGridType, class MaskGridType>
+GridValueType<GridType> Dot(const GridType &a,
+                            const OtherGridType &b,
+                            const MaskGridType &mask) {
+  using T = GridValueType<GridType>;
+  return ReduceRows(
+      a.width(), a.height(), a.depth(), T(0),
+      [&](offset_t y, offset_t z) {
+        auto row_a = GridRow(a, y, z);
+        auto row_b = GridRow(b, y, z);
+        auto mask_row = GridRow(mask, y, z);
+        return ReduceRow(
+            a.width(), T(0),
+            [&](offset_t x) -> T {
+              return mask_row(x) ? T(row_a(x) * row_b(x)) : T(0);
+            },
+            ReduceSum<T>());
+      },
+      ReduceSum<T>());
+}
+
+// Largest face velocity magnitude along any axis, as needed for a CFL time
+// step limit.
+template <class ContentType, class BaseGridType>
+ContentType MaxAbs(const MACGrid<ContentType, BaseGridType> &grid) {
+  return std::max(std::max(MaxAbs(grid.u()), MaxAbs(grid.v())),
+                  MaxAbs(grid.w()));
+}
+
+template <class ContentType, class BaseGridType>
+ContentType SquaredNorm(const MACGrid<ContentType, BaseGridType> &grid) {
+  return SquaredNorm(grid.u()) + SquaredNorm(grid.v()) +
+         SquaredNorm(grid.w());
+}
+
+template <class ContentType, class BaseGridType>
+ContentType L2Norm(const MACGrid<ContentType, BaseGridType> &grid) {
+  return std::sqrt(SquaredNorm(grid));
+}
+
+template <class ContentType, class BaseGridType>
+ContentType Dot(const MACGrid<ContentType, BaseGridType> &a,
+                const MACGrid<ContentType, BaseGridType> &b) {
+  return Dot(a.u(), b.u()) + Dot(a.v(), b.v()) + Dot(a.w(), b.w());
+}
+}  // namespace grassland::data_structure
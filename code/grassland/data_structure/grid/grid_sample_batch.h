@@ -0,0 +1,359 @@
+#pragma once
+
+#include "grassland/data_structure/grid/grid_util.h"
+
+#if !defined(__CUDACC__) && (defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+namespace grassland::data_structure {
+
+// Trilinear sampling of n points from a dense x-fastest grid, with the same
+// clamp-to-edge semantics as LinearGrid::sample. Positions are given as
+// separate coordinate arrays so that a vector register holds one coordinate
+// of several points.
+template <typename ContentType, typename Scalar>
+void SampleTrilinearBatchScalar(const ContentType *data,
+                                size_t width,
+                                size_t height,
+                                size_t depth,
+                                size_t y_stride,
+                                size_t z_stride,
+                                const Scalar *xs,
+                                const Scalar *ys,
+                                const Scalar *zs,
+                                ContentType *out,
+                                size_t n) {
+  offset_t last_x = offset_t(width) - 1;
+  offset_t last_y = offset_t(height) - 1;
+  offset_t last_z = offset_t(depth) - 1;
+  for (size_t i = 0; i < n; i++) {
+    Scalar x = xs[i], y = ys[i], z = zs[i];
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    offset_t ox0 = std::clamp(x0, offset_t(0), last_x);
+    offset_t ox1 = std::clamp(x0 + 1, offset_t(0), last_x);
+    offset_t oy0 = std::clamp(y0, offset_t(0), last_y) * y_stride;
+    offset_t oy1 = std::clamp(y0 + 1, offset_t(0), last_y) * y_stride;
+    offset_t oz0 = std::clamp(z0, offset_t(0), last_z) * z_stride;
+    offset_t oz1 = std::clamp(z0 + 1, offset_t(0), last_z) * z_stride;
+    out[i] = data[ox0 + oy0 + oz0] * ((1 - x) * (1 - y) * (1 - z)) +
+             data[ox1 + oy0 + oz0] * (x * (1 - y) * (1 - z)) +
+             data[ox0 + oy1 + oz0] * ((1 - x) * y * (1 - z)) +
+             data[ox1 + oy1 + oz0] * (x * y * (1 - z)) +
+             data[ox0 + oy0 + oz1] * ((1 - x) * (1 - y) * z) +
+             data[ox1 + oy0 + oz1] * (x * (1 - y) * z) +
+             data[ox0 + oy1 + oz1] * ((1 - x) * y * z) +
+             data[ox1 + oy1 + oz1] * (x * y * z);
+  }
+}
+
+#if !defined(__CUDACC__) && defined(__AVX512F__)
+// 16 float samples per iteration: floors, clamps and offsets are computed in
+// 32-bit integer lanes and the 8 corners are fetched with gathers.
+inline size_t SampleTrilinearBatchAVX512(const float *data,
+                                         size_t width,
+                                         size_t height,
+                                         size_t depth,
+                                         size_t y_stride,
+                                         size_t z_stride,
+                                         const float *xs,
+                                         const float *ys,
+                                         const float *zs,
+                                         float *out,
+                                         size_t n) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i one_i = _mm512_set1_epi32(1);
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512i last_x = _mm512_set1_epi32(int32_t(width) - 1);
+  const __m512i last_y = _mm512_set1_epi32(int32_t(height) - 1);
+  const __m512i last_z = _mm512_set1_epi32(int32_t(depth) - 1);
+  const __m512i stride_y = _mm512_set1_epi32(int32_t(y_stride));
+  const __m512i stride_z = _mm512_set1_epi32(int32_t(z_stride));
+  const __m512 low = _mm512_set1_ps(-1.0f);
+  const __m512 high_x = _mm512_set1_ps(float(width));
+  const __m512 high_y = _mm512_set1_ps(float(height));
+  const __m512 high_z = _mm512_set1_ps(float(depth));
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    // Coordinates beyond [-1, size] sample the edge cell either way; clamping
+    // them first keeps the int32 conversion in range.
+    __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(xs + i), low),
+                             high_x);
+    __m512 y = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(ys + i), low),
+                             high_y);
+    __m512 z = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(zs + i), low),
+                             high_z);
+    __m512 fx = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF);
+    __m512 fy = _mm512_roundscale_ps(y, _MM_FROUND_TO_NEG_INF);
+    __m512 fz = _mm512_roundscale_ps(z, _MM_FROUND_TO_NEG_INF);
+    __m512i ix0 = _mm512_cvttps_epi32(fx);
+    __m512i iy0 = _mm512_cvttps_epi32(fy);
+    __m512i iz0 = _mm512_cvttps_epi32(fz);
+    x = _mm512_sub_ps(x, fx);
+    y = _mm512_sub_ps(y, fy);
+    z = _mm512_sub_ps(z, fz);
+    __m512i ox0 = _mm512_min_epi32(_mm512_max_epi32(ix0, zero), last_x);
+    __m512i ox1 = _mm512_min_epi32(
+        _mm512_max_epi32(_mm512_add_epi32(ix0, one_i), zero), last_x);
+    __m512i oy0 = _mm512_mullo_epi32(
+        _mm512_min_epi32(_mm512_max_epi32(iy0, zero), last_y), stride_y);
+    __m512i oy1 = _mm512_mullo_epi32(
+        _mm512_min_epi32(
+            _mm512_max_epi32(_mm512_add_epi32(iy0, one_i), zero), last_y),
+        stride_y);
+    __m512i oz0 = _mm512_mullo_epi32(
+        _mm512_min_epi32(_mm512_max_epi32(iz0, zero), last_z), stride_z);
+    __m512i oz1 = _mm512_mullo_epi32(
+        _mm512_min_epi32(
+            _mm512_max_epi32(_mm512_add_epi32(iz0, one_i), zero), last_z),
+        stride_z);
+    __m512i o00 = _mm512_add_epi32(oy0, oz0);
+    __m512i o10 = _mm512_add_epi32(oy1, oz0);
+    __m512i o01 = _mm512_add_epi32(oy0, oz1);
+    __m512i o11 = _mm512_add_epi32(oy1, oz1);
+    __m512 c000 = _mm512_i32gather_ps(_mm512_add_epi32(ox0, o00), data, 4);
+    __m512 c100 = _mm512_i32gather_ps(_mm512_add_epi32(ox1, o00), data, 4);
+    __m512 c010 = _mm512_i32gather_ps(_mm512_add_epi32(ox0, o10), data, 4);
+    __m512 c110 = _mm512_i32gather_ps(_mm512_add_epi32(ox1, o10), data, 4);
+    __m512 c001 = _mm512_i32gather_ps(_mm512_add_epi32(ox0, o01), data, 4);
+    __m512 c101 = _mm512_i32gather_ps(_mm512_add_epi32(ox1, o01), data, 4);
+    __m512 c011 = _mm512_i32gather_ps(_mm512_add_epi32(ox0, o11), data, 4);
+    __m512 c111 = _mm512_i32gather_ps(_mm512_add_epi32(ox1, o11), data, 4);
+    // Interpolate along x, then y, then z.
+    __m512 wx = _mm512_sub_ps(one, x);
+    __m512 c00 = _mm512_fmadd_ps(c100, x, _mm512_mul_ps(c000, wx));
+    __m512 c10 = _mm512_fmadd_ps(c110, x, _mm512_mul_ps(c010, wx));
+    __m512 c01 = _mm512_fmadd_ps(c101, x, _mm512_mul_ps(c001, wx));
+    __m512 c11 = _mm512_fmadd_ps(c111, x, _mm512_mul_ps(c011, wx));
+    __m512 wy = _mm512_sub_ps(one, y);
+    __m512 c0 = _mm512_fmadd_ps(c10, y, _mm512_mul_ps(c00, wy));
+    __m512 c1 = _mm512_fmadd_ps(c11, y, _mm512_mul_ps(c01, wy));
+    __m512 wz = _mm512_sub_ps(one, z);
+    _mm512_storeu_ps(out + i, _mm512_fmadd_ps(c1, z, _mm512_mul_ps(c0, wz)));
+  }
+  return i;
+}
+#endif
+
+#if !defined(__CUDACC__) && defined(__AVX2__)
+// 8 float samples per iteration, same scheme as the AVX-512 version.
+inline size_t SampleTrilinearBatchAVX2(const float *data,
+                                       size_t width,
+                                       size_t height,
+                                       size_t depth,
+                                       size_t y_stride,
+                                       size_t z_stride,
+                                       const float *xs,
+                                       const float *ys,
+                                       const float *zs,
+                                       float *out,
+                                       size_t n) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one_i = _mm256_set1_epi32(1);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256i last_x = _mm256_set1_epi32(int32_t(width) - 1);
+  const __m256i last_y = _mm256_set1_epi32(int32_t(height) - 1);
+  const __m256i last_z = _mm256_set1_epi32(int32_t(depth) - 1);
+  const __m256i stride_y = _mm256_set1_epi32(int32_t(y_stride));
+  const __m256i stride_z = _mm256_set1_epi32(int32_t(z_stride));
+  const __m256 low = _mm256_set1_ps(-1.0f);
+  const __m256 high_x = _mm256_set1_ps(float(width));
+  const __m256 high_y = _mm256_set1_ps(float(height));
+  const __m256 high_z = _mm256_set1_ps(float(depth));
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(xs + i), low),
+                             high_x);
+    __m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(ys + i), low),
+                             high_y);
+    __m256 z = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(zs + i), low),
+                             high_z);
+    __m256 fx = _mm256_floor_ps(x);
+    __m256 fy = _mm256_floor_ps(y);
+    __m256 fz = _mm256_floor_ps(z);
+    __m256i ix0 = _mm256_cvttps_epi32(fx);
+    __m256i iy0 = _mm256_cvttps_epi32(fy);
+    __m256i iz0 = _mm256_cvttps_epi32(fz);
+    x = _mm256_sub_ps(x, fx);
+    y = _mm256_sub_ps(y, fy);
+    z = _mm256_sub_ps(z, fz);
+    __m256i ox0 = _mm256_min_epi32(_mm256_max_epi32(ix0, zero), last_x);
+    __m256i ox1 = _mm256_min_epi32(
+        _mm256_max_epi32(_mm256_add_epi32(ix0, one_i), zero), last_x);
+    __m256i oy0 = _mm256_mullo_epi32(
+        _mm256_min_epi32(_mm256_max_epi32(iy0, zero), last_y), stride_y);
+    __m256i oy1 = _mm256_mullo_epi32(
+        _mm256_min_epi32(
+            _mm256_max_epi32(_mm256_add_epi32(iy0, one_i), zero), last_y),
+        stride_y);
+    __m256i oz0 = _mm256_mullo_epi32(
+        _mm256_min_epi32(_mm256_max_epi32(iz0, zero), last_z), stride_z);
+    __m256i oz1 = _mm256_mullo_epi32(
+        _mm256_min_epi32(
+            _mm256_max_epi32(_mm256_add_epi32(iz0, one_i), zero), last_z),
+        stride_z);
+    __m256i o00 = _mm256_add_epi32(oy0, oz0);
+    __m256i o10 = _mm256_add_epi32(oy1, oz0);
+    __m256i o01 = _mm256_add_epi32(oy0, oz1);
+    __m256i o11 = _mm256_add_epi32(oy1, oz1);
+    __m256 c000 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox0, o00), 4);
+    __m256 c100 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox1, o00), 4);
+    __m256 c010 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox0, o10), 4);
+    __m256 c110 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox1, o10), 4);
+    __m256 c001 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox0, o01), 4);
+    __m256 c101 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox1, o01), 4);
+    __m256 c011 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox0, o11), 4);
+    __m256 c111 = _mm256_i32gather_ps(data, _mm256_add_epi32(ox1, o11), 4);
+    __m256 wx = _mm256_sub_ps(one, x);
+    __m256 c00 = _mm256_add_ps(_mm256_mul_ps(c000, wx), _mm256_mul_ps(c100, x));
+    __m256 c10 = _mm256_add_ps(_mm256_mul_ps(c010, wx), _mm256_mul_ps(c110, x));
+    __m256 c01 = _mm256_add_ps(_mm256_mul_ps(c001, wx), _mm256_mul_ps(c101, x));
+    __m256 c11 = _mm256_add_ps(_mm256_mul_ps(c011, wx), _mm256_mul_ps(c111, x));
+    __m256 wy = _mm256_sub_ps(one, y);
+    __m256 c0 = _mm256_add_ps(_mm256_mul_ps(c00, wy), _mm256_mul_ps(c10, y));
+    __m256 c1 = _mm256_add_ps(_mm256_mul_ps(c01, wy), _mm256_mul_ps(c11, y));
+    __m256 wz = _mm256_sub_ps(one, z);
+    _mm256_storeu_ps(
+        out + i, _mm256_add_ps(_mm256_mul_ps(c0, wz), _mm256_mul_ps(c1, z)));
+  }
+  return i;
+}
+
+// 4 double samples per iteration.
+inline size_t SampleTrilinearBatchAVX2(const double *data,
+                                       size_t width,
+                                       size_t height,
+                                       size_t depth,
+                                       size_t y_stride,
+                                       size_t z_stride,
+                                       const double *xs,
+                                       const double *ys,
+                                       const double *zs,
+                                       double *out,
+                                       size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one_i = _mm_set1_epi32(1);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m128i last_x = _mm_set1_epi32(int32_t(width) - 1);
+  const __m128i last_y = _mm_set1_epi32(int32_t(height) - 1);
+  const __m128i last_z = _mm_set1_epi32(int32_t(depth) - 1);
+  const __m128i stride_y = _mm_set1_epi32(int32_t(y_stride));
+  const __m128i stride_z = _mm_set1_epi32(int32_t(z_stride));
+  const __m256d low = _mm256_set1_pd(-1.0);
+  const __m256d high_x = _mm256_set1_pd(double(width));
+  const __m256d high_y = _mm256_set1_pd(double(height));
+  const __m256d high_z = _mm256_set1_pd(double(depth));
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(xs + i), low),
+                              high_x);
+    __m256d y = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(ys + i), low),
+                              high_y);
+    __m256d z = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(zs + i), low),
+                              high_z);
+    __m256d fx = _mm256_floor_pd(x);
+    __m256d fy = _mm256_floor_pd(y);
+    __m256d fz = _mm256_floor_pd(z);
+    __m128i ix0 = _mm256_cvttpd_epi32(fx);
+    __m128i iy0 = _mm256_cvttpd_epi32(fy);
+    __m128i iz0 = _mm256_cvttpd_epi32(fz);
+    x = _mm256_sub_pd(x, fx);
+    y = _mm256_sub_pd(y, fy);
+    z = _mm256_sub_pd(z, fz);
+    __m128i ox0 = _mm_min_epi32(_mm_max_epi32(ix0, zero), last_x);
+    __m128i ox1 =
+        _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(ix0, one_i), zero), last_x);
+    __m128i oy0 =
+        _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(iy0, zero), last_y),
+                        stride_y);
+    __m128i oy1 = _mm_mullo_epi32(
+        _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iy0, one_i), zero), last_y),
+        stride_y);
+    __m128i oz0 =
+        _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(iz0, zero), last_z),
+                        stride_z);
+    __m128i oz1 = _mm_mullo_epi32(
+        _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iz0, one_i), zero), last_z),
+        stride_z);
+    __m128i o00 = _mm_add_epi32(oy0, oz0);
+    __m128i o10 = _mm_add_epi32(oy1, oz0);
+    __m128i o01 = _mm_add_epi32(oy0, oz1);
+    __m128i o11 = _mm_add_epi32(oy1, oz1);
+    __m256d c000 = _mm256_i32gather_pd(data, _mm_add_epi32(ox0, o00), 8);
+    __m256d c100 = _mm256_i32gather_pd(data, _mm_add_epi32(ox1, o00), 8);
+    __m256d c010 = _mm256_i32gather_pd(data, _mm_add_epi32(ox0, o10), 8);
+    __m256d c110 = _mm256_i32gather_pd(data, _mm_add_epi32(ox1, o10), 8);
+    __m256d c001 = _mm256_i32gather_pd(data, _mm_add_epi32(ox0, o01), 8);
+    __m256d c101 = _mm256_i32gather_pd(data, _mm_add_epi32(ox1, o01), 8);
+    __m256d c011 = _mm256_i32gather_pd(data, _mm_add_epi32(ox0, o11), 8);
+    __m256d c111 = _mm256_i32gather_pd(data, _mm_add_epi32(ox1, o11), 8);
+    __m256d wx = _mm256_sub_pd(one, x);
+    __m256d c00 =
+        _mm256_add_pd(_mm256_mul_pd(c000, wx), _mm256_mul_pd(c100, x));
+    __m256d c10 =
+        _mm256_add_pd(_mm256_mul_pd(c010, wx), _mm256_mul_pd(c110, x));
+    __m256d c01 =
+        _mm256_add_pd(_mm256_mul_pd(c001, wx), _mm256_mul_pd(c101, x));
+    __m256d c11 =
+        _mm256_add_pd(_mm256_mul_pd(c011, wx), _mm256_mul_pd(c111, x));
+    __m256d wy = _mm256_sub_pd(one, y);
+    __m256d c0 = _mm256_add_pd(_mm256_mul_pd(c00, wy), _mm256_mul_pd(c10, y));
+    __m256d c1 = _mm256_add_pd(_mm256_mul_pd(c01, wy), _mm256_mul_pd(c11, y));
+    __m256d wz = _mm256_sub_pd(one, z);
+    _mm256_storeu_pd(
+        out + i, _mm256_add_pd(_mm256_mul_pd(c0, wz), _mm256_mul_pd(c1, z)));
+  }
+  return i;
+}
+#endif
+
+// Picks the widest vector kernel available for the content and coordinate
+// types, and finishes the remainder with the scalar loop. The vector kernels
+// clamp coordinates to [-1, size] and compute offsets in 32-bit lanes, so
+// grids with 2^31 or more cells take the scalar path. The vector kernels
+// clamp a NaN coordinate to -1, so its result depends on the path taken.
+template <typename ContentType, typename Scalar>
+void SampleTrilinearBatch(const ContentType *data,
+                          size_t width,
+                          size_t height,
+                          size_t depth,
+                          size_t y_stride,
+                          size_t z_stride,
+                          const Scalar *xs,
+                          const Scalar *ys,
+                          const Scalar *zs,
+                          ContentType *out,
+                          size_t n) {
+  size_t done = 0;
+#if !defined(__CUDACC__) && (defined(__AVX2__) || defined(__AVX512F__))
+  bool fits_int32 =
+      (depth - 1) * z_stride + (height - 1) * y_stride + width <
+      size_t(std::numeric_limits<int32_t>::max());
+  if constexpr (std::is_same_v<ContentType, Scalar> &&
+                (std::is_same_v<Scalar, float> ||
+                 std::is_same_v<Scalar, double>)) {
+    if (fits_int32) {
+#if defined(__AVX512F__)
+      if constexpr (std::is_same_v<Scalar, float>) {
+        done = SampleTrilinearBatchAVX512(data, width, height, depth, y_stride,
+                                          z_stride, xs, ys, zs, out, n);
+      }
+#endif
+#if defined(__AVX2__)
+      done += SampleTrilinearBatchAVX2(data, width, height, depth, y_stride,
+                                       z_stride, xs + done, ys + done,
+                                       zs + done, out + done, n - done);
+#endif
+    }
+  }
+#endif
+  SampleTrilinearBatchScalar(data, width, height, depth, y_stride, z_stride,
+                             xs + done, ys + done, zs + done, out + done,
+                             n - done);
+}
+}  // namespace grassland::data_structure
@@ -0,0 +1,46 @@
+#pragma once
+#include "grassland/data_structure/grid/linear_grid.h"
+
+namespace grassland::data_structure {
+
+// Writes the 7-point Laplacian of grid, multiplied by scale (usually
+// 1 / dx^2), to the cells of result, which must have the same size. With at
+// least one ghost layer the neighbours across the boundary are ghost cells,
+// as filled by the last UpdateGhosts(), and the inner loop has no branches.
+// Without ghost layers the neighbours are clamped to the edge.
+template <typename ContentType, typename Scalar>
+void Laplacian(const LinearGrid<ContentType> &grid,
+               Scalar scale,
+               LinearGrid<ContentType> &result) {
+  offset_t width = grid.width(), height = grid.height(), depth = grid.depth();
+  if (!grid.ghost_layers()) {
+    for (offset_t k = 0; k < depth; k++) {
+      for (offset_t j = 0; j < height; j++) {
+        for (offset_t i = 0; i < width; i++) {
+          result(i, j, k) =
+              (grid.get_clamped(i - 1, j, k) + grid.get_clamped(i + 1, j, k) +
+               grid.get_clamped(i, j - 1, k) + grid.get_clamped(i, j + 1, k) +
+               grid.get_clamped(i, j, k - 1) + grid.get_clamped(i, j, k + 1) -
+               grid(i, j, k) * Scalar(6)) *
+              scale;
+        }
+      }
+    }
+    return;
+  }
+
+  offset_t y_stride = grid.y_stride(), z_stride = grid.z_stride();
+  for (offset_t k = 0; k < depth; k++) {
+    for (offset_t j = 0; j < height; j++) {
+      const ContentType *row = grid.data() + grid.offset(0, j, k);
+      ContentType *result_row = result.data() + result.offset(0, j, k);
+      for (offset_t i = 0; i < width; i++) {
+        result_row[i] = (row[i - 1] + row[i + 1] + row[i - y_stride] +
+                         row[i + y_stride] + row[i - z_stride] +
+                         row[i + z_stride] - row[i] * Scalar(6)) *
+                        scale;
+      }
+    }
+  }
+}
+}  // namespace grassland::data_structure
@@ -2,7 +2,165 @@
 #include "Eigen/Eigen"
 #include "algorithm"
 #include "grassland/data_structure/data_structure_util.h"
+#include "memory"
+#include "new"
 
 namespace grassland::data_structure {
 typedef int64_t offset_t;
+
+// How the ghost layers around a padded grid are filled: with the nearest
+// interior cell, with the cell on the opposite side of the grid, or with a
+// fixed value.
+enum class grid_boundary_type { clamp = 0, periodic, constant };
+
+// Tag for the grid constructors that leave the cells uninitialized, for
+// grids whose every cell is written before it is read, like the result of a
+// time step.
+struct grid_uninitialized_t {
+  explicit grid_uninitialized_t() = default;
+};
+inline constexpr grid_uninitialized_t grid_uninitialized{};
+
+// The type a const grid returns for a cell.
+template <class GridType>
+using GridValueType = std::decay_t<decltype(std::declval<const GridType &>()(
+    offset_t(0), offset_t(0), offset_t(0)))>;
+
+// A zero ContentType. Unlike ContentType{}, it is also initialized for the
+// fixed-size Eigen types, whose default constructor leaves the
+// coefficients indeterminate.
+template <class ContentType>
+ContentType GridZeroValue() {
+  if constexpr (std::is_base_of_v<Eigen::DenseBase<ContentType>,
+                                  ContentType>) {
+    return ContentType::Zero();
+  } else {
+    return ContentType{};
+  }
+}
+
+template <class GridType, class = void>
+struct HasGhostLayers : std::false_type {};
+
+template <class GridType>
+struct HasGhostLayers<
+    GridType,
+    std::void_t<decltype(std::declval<const GridType &>().ghost_layers())>>
+    : std::true_type {};
+
+// The number of ghost layers around grid, 0 for grid types without them.
+template <class GridType>
+offset_t GridGhostLayers(const GridType &grid) {
+  if constexpr (HasGhostLayers<GridType>::value) {
+    return offset_t(grid.ghost_layers());
+  } else {
+    return 0;
+  }
 }
+
+// Whether GridType stores every cell up front, so that writing a cell never
+// allocates or moves other cells and threads may write different cells at
+// once. Specialized next to each dense grid type.
+template <class GridType>
+struct IsDenseGrid : std::false_type {};
+
+constexpr int MortonLog2(size_t value) {
+  return value <= 1 ? 0 : 1 + MortonLog2(value >> 1);
+}
+
+// Inserts two zero bits after each of the lower 21 bits of v.
+inline uint64_t MortonSpreadBits3(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | (v << 32)) & 0x1f00000000ffffull;
+  v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+  v = (v | (v << 8)) & 0x100f00f00f00f00full;
+  v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+  v = (v | (v << 2)) & 0x1249249249249249ull;
+  return v;
+}
+
+// Inserts one zero bit after each of the lower 32 bits of v.
+inline uint64_t MortonSpreadBits2(uint64_t v) {
+  v &= 0xffffffff;
+  v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+  v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+  v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+  v = (v | (v << 2)) & 0x3333333333333333ull;
+  v = (v | (v << 1)) & 0x5555555555555555ull;
+  return v;
+}
+
+inline uint64_t MortonEncode3(uint64_t x, uint64_t y, uint64_t z) {
+  return MortonSpreadBits3(x) | (MortonSpreadBits3(y) << 1) |
+         (MortonSpreadBits3(z) << 2);
+}
+
+// Allocator returning memory aligned to Alignment bytes, e.g. a cache line or
+// an AVX-512 register, for std::vector.
+template <class T, size_t Alignment>
+struct AlignedAllocator {
+  static_assert(Alignment >= alignof(T) &&
+                    (Alignment & (Alignment - 1)) == 0,
+                "Alignment must be a power of two");
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {
+  }
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const {
+    return true;
+  }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+    return false;
+  }
+};
+
+// std::allocator whose construct() without arguments default-initializes
+// instead of value-initializing, so std::vector::resize(n) leaves trivial
+// elements uninitialized instead of zeroing them in a separate pass.
+template <class T>
+struct DefaultInitAllocator : std::allocator<T> {
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = DefaultInitAllocator<U>;
+  };
+
+  DefaultInitAllocator() = default;
+
+  template <class U>
+  DefaultInitAllocator(const DefaultInitAllocator<U> &) {
+  }
+
+  template <class U>
+  void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <class U, class... Args>
+  void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+};
+}  // namespace grassland::data_structure
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "grassland/data_structure/grid/grid_sample_batch.h"
 #include "grassland/data_structure/grid/grid_util.h"
 #include "grassland/data_structure/grid/linear_grid_view.h"
 
@@ -7,6 +8,9 @@ namespace grassland::data_structure {
 template <typename ContentType>
 class LinearGrid {
  public:
+  // Resizing the buffer without a value leaves trivial cells uninitialized.
+  using Buffer = std::vector<ContentType, DefaultInitAllocator<ContentType>>;
+
   LinearGrid(size_t width,
              size_t height,
              const ContentType &default_value = ContentType{})
@@ -17,17 +21,97 @@ class LinearGrid {
              size_t height,
              size_t depth,
              const ContentType &default_value = ContentType{})
+      : LinearGrid(width,
+                   height,
+                   depth,
+                   0,
+                   grid_boundary_type::clamp,
+                   default_value) {
+  }
+
+  // A grid padded with ghost_layers layers of cells on every side. Cells keep
+  // their coordinates, ghost cells are addressed with coordinates in
+  // [-ghost_layers, 0) and [size, size + ghost_layers). The ghost layers are
+  // filled according to boundary when the grid is created and whenever
+  // UpdateGhosts() is called, so sampling and stencils read them instead of
+  // clamping their coordinates.
+  LinearGrid(size_t width,
+             size_t height,
+             size_t depth,
+             size_t ghost_layers,
+             grid_boundary_type boundary,
+             const ContentType &default_value = GridZeroValue<ContentType>(),
+             const ContentType &boundary_value = GridZeroValue<ContentType>())
+      : LinearGrid(width,
+                   height,
+                   depth,
+                   ghost_layers,
+                   boundary,
+                   grid_uninitialized,
+                   boundary_value) {
+    std::fill(buffer_.begin(), buffer_.end(), default_value);
+    UpdateGhosts();
+  }
+
+  // Grids whose cells are left uninitialized (default-initialized for
+  // class types), for results that are written in full before being read.
+  // It saves the pass over the memory filling it with a default value.
+  LinearGrid(size_t width, size_t height, size_t depth, grid_uninitialized_t)
+      : LinearGrid(width,
+                   height,
+                   depth,
+                   0,
+                   grid_boundary_type::clamp,
+                   grid_uninitialized) {
+  }
+
+  // The ghost layers are uninitialized as well until UpdateGhosts().
+  LinearGrid(size_t width,
+             size_t height,
+             size_t depth,
+             size_t ghost_layers,
+             grid_boundary_type boundary,
+             grid_uninitialized_t,
+             const ContentType &boundary_value = GridZeroValue<ContentType>())
       : width_(width),
         height_(height),
         depth_(depth),
-        buffer_(width * height * depth, default_value),
         x_stride_(1),
-        y_stride_(width),
-        z_stride_(width * height) {
+        y_stride_(width + 2 * ghost_layers),
+        z_stride_((width + 2 * ghost_layers) * (height + 2 * ghost_layers)),
+        ghost_layers_(ghost_layers),
+        origin_(ghost_layers * (x_stride_ + y_stride_ + z_stride_)),
+        boundary_(boundary),
+        boundary_value_(boundary_value) {
+    buffer_.resize(z_stride_ * (depth + 2 * ghost_layers));
   }
 
+  LinearGrid(const LinearGrid &) = default;
+  LinearGrid(LinearGrid &&) noexcept = default;
+  LinearGrid &operator=(const LinearGrid &) = default;
+  LinearGrid &operator=(LinearGrid &&) noexcept = default;
   ~LinearGrid() = default;
 
+  // Exchanges the storage and shape of the grids without copying cells.
+  void swap(LinearGrid &other) noexcept {
+    using std::swap;
+    swap(buffer_, other.buffer_);
+    swap(width_, other.width_);
+    swap(height_, other.height_);
+    swap(depth_, other.depth_);
+    swap(x_stride_, other.x_stride_);
+    swap(y_stride_, other.y_stride_);
+    swap(z_stride_, other.z_stride_);
+    swap(ghost_layers_, other.ghost_layers_);
+    swap(origin_, other.origin_);
+    swap(boundary_, other.boundary_);
+    swap(boundary_value_, other.boundary_value_);
+  }
+
+  friend void swap(LinearGrid &a, LinearGrid &b) noexcept {
+    a.swap(b);
+  }
+
   ContentType &operator[](offset_t offset) {
     return buffer_[offset];
   }
@@ -37,27 +121,27 @@ class LinearGrid {
   }
 
   offset_t offset(offset_t x, offset_t y) const {
-    return x * x_stride_ + y * y_stride_;
+    return origin_ + x * x_stride_ + y * y_stride_;
   }
 
   offset_t offset(offset_t x, offset_t y, offset_t z) const {
-    return x * x_stride_ + y * y_stride_ + z * z_stride_;
+    return origin_ + x * x_stride_ + y * y_stride_ + z * z_stride_;
   }
 
   ContentType &operator()(offset_t x, offset_t y) {
-    return buffer_[x * x_stride_ + y * y_stride_];
+    return buffer_[offset(x, y)];
   }
 
   const ContentType &operator()(offset_t x, offset_t y) const {
-    return buffer_[x * x_stride_ + y * y_stride_];
+    return buffer_[offset(x, y)];
   }
 
   ContentType &operator()(offset_t x, offset_t y, offset_t z) {
-    return buffer_[x * x_stride_ + y * y_stride_ + z * z_stride_];
+    return buffer_[offset(x, y, z)];
   }
 
   const ContentType &operator()(offset_t x, offset_t y, offset_t z) const {
-    return buffer_[x * x_stride_ + y * y_stride_ + z * z_stride_];
+    return buffer_[offset(x, y, z)];
   }
 
   size_t width() const {
@@ -90,16 +174,193 @@ class LinearGrid {
     x -= x0;
     y -= y0;
     z -= z0;
-    return get_clamped(x0, y0, z0) * ((1 - x) * (1 - y) * (1 - z)) +
-           get_clamped(x0 + 1, y0, z0) * (x * (1 - y) * (1 - z)) +
-           get_clamped(x0, y0 + 1, z0) * ((1 - x) * y * (1 - z)) +
-           get_clamped(x0 + 1, y0 + 1, z0) * (x * y * (1 - z)) +
-           get_clamped(x0, y0, z0 + 1) * ((1 - x) * (1 - y) * z) +
-           get_clamped(x0 + 1, y0, z0 + 1) * (x * (1 - y) * z) +
-           get_clamped(x0, y0 + 1, z0 + 1) * ((1 - x) * y * z) +
-           get_clamped(x0 + 1, y0 + 1, z0 + 1) * (x * y * z);
+    offset_t x1 = x0 + 1;
+    offset_t y1 = y0 + 1;
+    offset_t z1 = z0 + 1;
+    // Corners inside the grid or its ghost layers are read directly, the
+    // others are clamped to the outermost layer, once per axis.
+    offset_t lo = -offset_t(ghost_layers_);
+    offset_t hi_x = offset_t(width_ + ghost_layers_) - 1;
+    offset_t hi_y = offset_t(height_ + ghost_layers_) - 1;
+    offset_t hi_z = offset_t(depth_ + ghost_layers_) - 1;
+    if (x0 < lo || y0 < lo || z0 < lo || x1 > hi_x || y1 > hi_y ||
+        z1 > hi_z) {
+      x0 = std::clamp(x0, lo, hi_x);
+      x1 = std::clamp(x1, lo, hi_x);
+      y0 = std::clamp(y0, lo, hi_y);
+      y1 = std::clamp(y1, lo, hi_y);
+      z0 = std::clamp(z0, lo, hi_z);
+      z1 = std::clamp(z1, lo, hi_z);
+    }
+    const ContentType *origin = buffer_.data() + origin_;
+    y0 *= y_stride_;
+    y1 *= y_stride_;
+    z0 *= z_stride_;
+    z1 *= z_stride_;
+    return origin[x0 + y0 + z0] * ((1 - x) * (1 - y) * (1 - z)) +
+           origin[x1 + y0 + z0] * (x * (1 - y) * (1 - z)) +
+           origin[x0 + y1 + z0] * ((1 - x) * y * (1 - z)) +
+           origin[x1 + y1 + z0] * (x * y * (1 - z)) +
+           origin[x0 + y0 + z1] * ((1 - x) * (1 - y) * z) +
+           origin[x1 + y0 + z1] * (x * (1 - y) * z) +
+           origin[x0 + y1 + z1] * ((1 - x) * y * z) +
+           origin[x1 + y1 + z1] * (x * y * z);
+  }
+
+  // Samples n points at once, see SampleTrilinearBatch. Results match
+  // sample() up to floating point rounding for any non-NaN coordinates,
+  // including ones far outside the grid.
+  template <class Scalar>
+  void sample_batch(const Scalar *xs,
+                    const Scalar *ys,
+                    const Scalar *zs,
+                    ContentType *out,
+                    size_t n) const {
+    if (!ghost_layers_) {
+      SampleTrilinearBatch(buffer_.data(), width_, height_, depth_, y_stride_,
+                           z_stride_, xs, ys, zs, out, n);
+      return;
+    }
+    // Sample the whole padded storage so that ghost cells are read like in
+    // sample(), shifting the positions block by block.
+    constexpr size_t kBlock = 256;
+    Scalar shifted_x[kBlock], shifted_y[kBlock], shifted_z[kBlock];
+    Scalar shift = Scalar(ghost_layers_);
+    for (size_t begin = 0; begin < n; begin += kBlock) {
+      size_t count = std::min(kBlock, n - begin);
+      for (size_t i = 0; i < count; i++) {
+        shifted_x[i] = xs[begin + i] + shift;
+        shifted_y[i] = ys[begin + i] + shift;
+        shifted_z[i] = zs[begin + i] + shift;
+      }
+      SampleTrilinearBatch(buffer_.data(), width_ + 2 * ghost_layers_,
+                           height_ + 2 * ghost_layers_,
+                           depth_ + 2 * ghost_layers_, y_stride_, z_stride_,
+                           shifted_x, shifted_y, shifted_z, out + begin,
+                           count);
+    }
+  }
+
+  // Samples with the given kernel, reading ghost layers like sample(), see
+  // SampleInterpolated.
+  template <class Scalar>
+  ContentType sample(Scalar x,
+                     Scalar y,
+                     Scalar z,
+                     grid_interpolation_type interpolation) const {
+    if (interpolation == grid_interpolation_type::linear) {
+      return sample(x, y, z);
+    }
+    return SampleInterpolated(*this, interpolation, x, y, z,
+                              offset_t(ghost_layers_));
+  }
+
+  // Samples with the given kernel and writes the derivatives along x, y and
+  // z in cell units to gradient, see SampleInterpolatedGradient.
+  template <class Scalar>
+  ContentType sample_gradient(Scalar x,
+                              Scalar y,
+                              Scalar z,
+                              grid_interpolation_type interpolation,
+                              ContentType *gradient) const {
+    return SampleInterpolatedGradient(*this, interpolation, x, y, z, gradient,
+                                      offset_t(ghost_layers_));
+  }
+
+  // Also writes the second derivatives, row-major 3 x 3, to hessian, see
+  // SampleInterpolatedHessian.
+  template <class Scalar>
+  ContentType sample_hessian(Scalar x,
+                             Scalar y,
+                             Scalar z,
+                             grid_interpolation_type interpolation,
+                             ContentType *gradient,
+                             ContentType *hessian) const {
+    return SampleInterpolatedHessian(*this, interpolation, x, y, z, gradient,
+                                     hessian, offset_t(ghost_layers_));
+  }
+
+  template <class Scalar>
+  void sample_batch(const Scalar *xs,
+                    const Scalar *ys,
+                    const Scalar *zs,
+                    ContentType *out,
+                    size_t n,
+                    grid_interpolation_type interpolation) const {
+    if (interpolation == grid_interpolation_type::linear) {
+      sample_batch(xs, ys, zs, out, n);
+    } else {
+      SampleInterpolatedBatch(*this, interpolation, xs, ys, zs, out, n,
+                              offset_t(ghost_layers_));
+    }
   }
 
+  // Refills the ghost layers from the interior according to boundary(). Call
+  // it after writing the interior and before sampling or running a stencil
+  // that reads across the boundary.
+  void UpdateGhosts() {
+    if (!ghost_layers_) {
+      return;
+    }
+    offset_t g = ghost_layers_;
+    offset_t width = width_, height = height_, depth = depth_;
+    auto fill = [&](offset_t x_begin, offset_t x_end, offset_t y, offset_t z) {
+      for (offset_t x = x_begin; x < x_end; x++) {
+        if (boundary_ == grid_boundary_type::constant) {
+          buffer_[offset(x, y, z)] = boundary_value_;
+        } else {
+          buffer_[offset(x, y, z)] =
+              buffer_[offset(GhostSource(x, width), GhostSource(y, height),
+                             GhostSource(z, depth))];
+        }
+      }
+    };
+    for (offset_t z = -g; z < depth + g; z++) {
+      for (offset_t y = -g; y < height + g; y++) {
+        if (z < 0 || z >= depth || y < 0 || y >= height) {
+          fill(-g, width + g, y, z);
+        } else {
+          fill(-g, 0, y, z);
+          fill(width, width + g, y, z);
+        }
+      }
+    }
+  }
+
+  size_t ghost_layers() const {
+    return ghost_layers_;
+  }
+
+  grid_boundary_type boundary() const {
+    return boundary_;
+  }
+
+  const ContentType &boundary_value() const {
+    return boundary_value_;
+  }
+
+  // Takes effect at the next UpdateGhosts().
+  void set_boundary(grid_boundary_type boundary,
+                    const ContentType &boundary_value =
+                        GridZeroValue<ContentType>()) {
+    boundary_ = boundary;
+    boundary_value_ = boundary_value;
+  }
+
+  size_t x_stride() const {
+    return x_stride_;
+  }
+
+  size_t y_stride() const {
+    return y_stride_;
+  }
+
+  size_t z_stride() const {
+    return z_stride_;
+  }
+
+  // data() and buffer() cover the whole storage, ghost layers included; cell
+  // (x, y, z) is at offset(x, y, z).
   ContentType *data() {
     return buffer_.data();
   }
@@ -108,16 +369,20 @@ class LinearGrid {
     return buffer_.data();
   }
 
-  std::vector<ContentType> &buffer() {
+  // A Buffer, not a std::vector<ContentType>: the allocator differs, so
+  // bind it with auto or LinearGrid::Buffer, and compare or assign it to a
+  // std::vector through its iterators.
+  Buffer &buffer() {
     return buffer_;
   }
 
-  const std::vector<ContentType> &buffer() const {
+  const Buffer &buffer() const {
     return buffer_;
   }
 
   LinearGridView<ContentType> view() {
-    return {width_, height_, depth_, buffer_.data()};
+    return LinearGridView<ContentType>(width_, height_, depth_, y_stride_,
+                                       z_stride_, buffer_.data() + origin_);
   }
 
   operator LinearGridView<ContentType>() {
@@ -125,12 +390,26 @@ class LinearGrid {
   }
 
  private:
-  std::vector<ContentType> buffer_;
+  offset_t GhostSource(offset_t i, offset_t size) const {
+    if (boundary_ == grid_boundary_type::periodic) {
+      return ((i % size) + size) % size;
+    }
+    return std::clamp(i, offset_t(0), size - 1);
+  }
+
+  Buffer buffer_;
   size_t width_;
   size_t height_;
   size_t depth_;
   size_t x_stride_;
   size_t y_stride_;
   size_t z_stride_;
+  size_t ghost_layers_;
+  offset_t origin_;
+  grid_boundary_type boundary_;
+  ContentType boundary_value_;
 };
+
+template <typename ContentType>
+struct IsDenseGrid<LinearGrid<ContentType>> : std::true_type {};
 }  // namespace grassland::data_structure
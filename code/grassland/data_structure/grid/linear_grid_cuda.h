@@ -23,9 +23,15 @@ class LinearGridCUDA {
         buffer_(width * height * depth, default_value),
         x_stride_(1),
         y_stride_(width),
-        z_stride_(width * height) {
+        z_stride_(width * height),
+        ghost_layers_(0),
+        origin_(0),
+        boundary_(grid_boundary_type::clamp),
+        boundary_value_(default_value) {
   }
 
+  // Copies the whole storage of grid, ghost layers included, keeping its
+  // layout: cell (x, y, z) is at offset(x, y, z) on the device as well.
   LinearGridCUDA(const LinearGrid<ContentType> &grid)
       : width_(grid.width()),
         height_(grid.height()),
@@ -33,17 +39,21 @@ class LinearGridCUDA {
         buffer_(grid.buffer()),
         x_stride_(grid.x_stride()),
         y_stride_(grid.y_stride()),
-        z_stride_(grid.z_stride()) {
+        z_stride_(grid.z_stride()),
+        ghost_layers_(grid.ghost_layers()),
+        origin_(grid.offset(0, 0, 0)),
+        boundary_(grid.boundary()),
+        boundary_value_(grid.boundary_value()) {
   }
 
   ~LinearGridCUDA() = default;
 
   offset_t offset(offset_t x, offset_t y) const {
-    return x * x_stride_ + y * y_stride_;
+    return origin_ + x * x_stride_ + y * y_stride_;
   }
 
   offset_t offset(offset_t x, offset_t y, offset_t z) const {
-    return x * x_stride_ + y * y_stride_ + z * z_stride_;
+    return origin_ + x * x_stride_ + y * y_stride_ + z * z_stride_;
   }
 
   size_t width() const {
@@ -66,6 +76,10 @@ class LinearGridCUDA {
     return buffer_.data().get();
   }
 
+  size_t ghost_layers() const {
+    return ghost_layers_;
+  }
+
   thrust::device_vector<ContentType> &buffer() {
     return buffer_;
   }
@@ -75,7 +89,9 @@ class LinearGridCUDA {
   }
 
   LinearGridView<ContentType> view() {
-    return {width_, height_, depth_, buffer_.data().get()};
+    return LinearGridView<ContentType>(width_, height_, depth_, y_stride_,
+                                       z_stride_,
+                                       buffer_.data().get() + origin_);
   }
 
   operator LinearGridView<ContentType>() {
@@ -83,7 +99,9 @@ class LinearGridCUDA {
   }
 
   LinearGrid<ContentType> to_host() const {
-    LinearGrid<ContentType> grid(width_, height_, depth_);
+    LinearGrid<ContentType> grid(width_, height_, depth_, ghost_layers_,
+                                 boundary_, grid_uninitialized,
+                                 boundary_value_);
     thrust::copy(buffer_.begin(), buffer_.end(), grid.buffer().begin());
     return grid;
   }
@@ -100,5 +118,9 @@ class LinearGridCUDA {
   size_t x_stride_;
   size_t y_stride_;
   size_t z_stride_;
+  size_t ghost_layers_;
+  offset_t origin_;
+  grid_boundary_type boundary_;
+  ContentType boundary_value_;
 };
 }  // namespace grassland::data_structure
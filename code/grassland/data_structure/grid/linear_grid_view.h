@@ -1,4 +1,6 @@
 #pragma once
+#include "grassland/data_structure/grid/grid_interpolation.h"
+#include "grassland/data_structure/grid/grid_sample_batch.h"
 #include "grassland/data_structure/grid/grid_util.h"
 
 namespace grassland::data_structure {
@@ -10,15 +12,33 @@ class LinearGridView {
   }
 
   LinearGridView(size_t width, size_t height, size_t depth, ContentType *data)
-      : width_(width),
+      : data_(data),
+        width_(width),
         height_(height),
         depth_(depth),
-        data_(data),
         x_stride_(1),
         y_stride_(width),
         z_stride_(width * height) {
   }
 
+  // A view of a grid whose rows and slices are y_stride and z_stride elements
+  // apart, e.g. the interior of a LinearGrid with ghost layers. data points to
+  // cell (0, 0, 0).
+  LinearGridView(size_t width,
+                 size_t height,
+                 size_t depth,
+                 size_t y_stride,
+                 size_t z_stride,
+                 ContentType *data)
+      : data_(data),
+        width_(width),
+        height_(height),
+        depth_(depth),
+        x_stride_(1),
+        y_stride_(y_stride),
+        z_stride_(z_stride) {
+  }
+
   LM_DEVICE_FUNC ContentType &operator[](offset_t offset) {
     return data_[offset];
   }
@@ -95,6 +115,71 @@ class LinearGridView {
            get_clamped(x0 + 1, y0 + 1, z0 + 1) * (x * y * z);
   }
 
+  // Samples with the given kernel, see SampleInterpolated.
+  template <class Scalar>
+  ContentType sample(Scalar x,
+                     Scalar y,
+                     Scalar z,
+                     grid_interpolation_type interpolation) const {
+    if (interpolation == grid_interpolation_type::linear) {
+      return sample(x, y, z);
+    }
+    return SampleInterpolated(*this, interpolation, x, y, z);
+  }
+
+  // Samples with the given kernel and writes the derivatives along x, y and
+  // z in cell units to gradient, see SampleInterpolatedGradient.
+  template <class Scalar>
+  ContentType sample_gradient(
+      Scalar x,
+      Scalar y,
+      Scalar z,
+      grid_interpolation_type interpolation,
+      std::remove_const_t<ContentType> *gradient) const {
+    return SampleInterpolatedGradient(*this, interpolation, x, y, z,
+                                      gradient);
+  }
+
+  // Also writes the second derivatives, row-major 3 x 3, to hessian, see
+  // SampleInterpolatedHessian.
+  template <class Scalar>
+  ContentType sample_hessian(Scalar x,
+                             Scalar y,
+                             Scalar z,
+                             grid_interpolation_type interpolation,
+                             std::remove_const_t<ContentType> *gradient,
+                             std::remove_const_t<ContentType> *hessian) const {
+    return SampleInterpolatedHessian(*this, interpolation, x, y, z, gradient,
+                                     hessian);
+  }
+
+  // Samples n points at once, see SampleTrilinearBatch. Results match
+  // sample() up to floating point rounding for any non-NaN coordinates,
+  // including ones far outside the grid.
+  template <class Scalar>
+  void sample_batch(const Scalar *xs,
+                    const Scalar *ys,
+                    const Scalar *zs,
+                    ContentType *out,
+                    size_t n) const {
+    SampleTrilinearBatch(data_, width_, height_, depth_, y_stride_, z_stride_,
+                         xs, ys, zs, out, n);
+  }
+
+  template <class Scalar>
+  void sample_batch(const Scalar *xs,
+                    const Scalar *ys,
+                    const Scalar *zs,
+                    ContentType *out,
+                    size_t n,
+                    grid_interpolation_type interpolation) const {
+    if (interpolation == grid_interpolation_type::linear) {
+      sample_batch(xs, ys, zs, out, n);
+    } else {
+      SampleInterpolatedBatch(*this, interpolation, xs, ys, zs, out, n);
+    }
+  }
+
   LM_DEVICE_FUNC ContentType *data() {
     return data_;
   }
@@ -124,4 +209,7 @@ class LinearGridView {
   size_t y_stride_;
   size_t z_stride_;
 };
+
+template <typename ContentType>
+struct IsDenseGrid<LinearGridView<ContentType>> : std::true_type {};
 }  // namespace grassland::data_structure
@@ -29,6 +29,13 @@ class MACGrid {
         w_(width, height, depth + 1, default_value_w) {
   }
 
+  // Face values left uninitialized, see LinearGrid.
+  MACGrid(size_t width, size_t height, size_t depth, grid_uninitialized_t)
+      : u_(width + 1, height, depth, grid_uninitialized),
+        v_(width, height + 1, depth, grid_uninitialized),
+        w_(width, height, depth + 1, grid_uninitialized) {
+  }
+
   template <class OtherBaseGridType>
   MACGrid(MACGrid<ContentType, OtherBaseGridType> &other) {
     u_ = other.u();
@@ -36,6 +43,18 @@ class MACGrid {
     w_ = other.w();
   }
 
+  // Exchanges the face grids without copying them.
+  void swap(MACGrid &other) noexcept {
+    using std::swap;
+    swap(u_, other.u_);
+    swap(v_, other.v_);
+    swap(w_, other.w_);
+  }
+
+  friend void swap(MACGrid &a, MACGrid &b) noexcept {
+    a.swap(b);
+  }
+
   BaseGridType &u() {
     return u_;
   }
@@ -62,17 +81,42 @@ class MACGrid {
 
   template <class Scalar>
   ContentType sample_u(Scalar x, Scalar y, Scalar z) const {
-    return u_.sample(x, y - 0.5, z - 0.5);
+    return u_.sample(x, y - Scalar(0.5), z - Scalar(0.5));
   }
 
   template <class Scalar>
   ContentType sample_v(Scalar x, Scalar y, Scalar z) const {
-    return v_.sample(x - 0.5, y, z - 0.5);
+    return v_.sample(x - Scalar(0.5), y, z - Scalar(0.5));
   }
 
   template <class Scalar>
   ContentType sample_w(Scalar x, Scalar y, Scalar z) const {
-    return w_.sample(x - 0.5, y - 0.5, z);
+    return w_.sample(x - Scalar(0.5), y - Scalar(0.5), z);
+  }
+
+  // The velocity at (x, y, z), equal to (sample_u, sample_v, sample_w) but
+  // computing the floors and fractions of the two staggerings of each axis
+  // once for all three components.
+  template <class Scalar>
+  Eigen::Matrix<ContentType, 3, 1> sample_velocity(Scalar x,
+                                                   Scalar y,
+                                                   Scalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    Scalar xh = x - Scalar(0.5), yh = y - Scalar(0.5), zh = z - Scalar(0.5);
+    offset_t xh0 = static_cast<offset_t>(std::floor(xh));
+    offset_t yh0 = static_cast<offset_t>(std::floor(yh));
+    offset_t zh0 = static_cast<offset_t>(std::floor(zh));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    xh -= xh0;
+    yh -= yh0;
+    zh -= zh0;
+    return {SampleComponent(u_, x0, yh0, zh0, x, yh, zh),
+            SampleComponent(v_, xh0, y0, zh0, xh, y, zh),
+            SampleComponent(w_, xh0, yh0, z0, xh, yh, z)};
   }
 
   size_t width() const {
@@ -88,6 +132,37 @@ class MACGrid {
   }
 
  private:
+  // Trilinear interpolation in grid, with the same clamping and operation
+  // order as LinearGrid::sample: corners in the ghost layers of the face
+  // grid are read, the others are clamped to its outermost layer.
+  template <class Scalar>
+  static ContentType SampleComponent(const BaseGridType &grid,
+                                     offset_t x0,
+                                     offset_t y0,
+                                     offset_t z0,
+                                     Scalar x,
+                                     Scalar y,
+                                     Scalar z) {
+    offset_t lo = -GridGhostLayers(grid);
+    offset_t last_x = offset_t(grid.width()) - 1 - lo;
+    offset_t last_y = offset_t(grid.height()) - 1 - lo;
+    offset_t last_z = offset_t(grid.depth()) - 1 - lo;
+    offset_t x1 = std::clamp(x0 + 1, lo, last_x);
+    offset_t y1 = std::clamp(y0 + 1, lo, last_y);
+    offset_t z1 = std::clamp(z0 + 1, lo, last_z);
+    x0 = std::clamp(x0, lo, last_x);
+    y0 = std::clamp(y0, lo, last_y);
+    z0 = std::clamp(z0, lo, last_z);
+    return grid(x0, y0, z0) * ((1 - x) * (1 - y) * (1 - z)) +
+           grid(x1, y0, z0) * (x * (1 - y) * (1 - z)) +
+           grid(x0, y1, z0) * ((1 - x) * y * (1 - z)) +
+           grid(x1, y1, z0) * (x * y * (1 - z)) +
+           grid(x0, y0, z1) * ((1 - x) * (1 - y) * z) +
+           grid(x1, y0, z1) * (x * (1 - y) * z) +
+           grid(x0, y1, z1) * ((1 - x) * y * z) +
+           grid(x1, y1, z1) * (x * y * z);
+  }
+
   BaseGridType u_;
   BaseGridType v_;
   BaseGridType w_;
@@ -0,0 +1,265 @@
+#pragma once
+#include "grassland/data_structure/grid/grid_parallel.h"
+#include "grassland/data_structure/grid/mac_grid.h"
+
+namespace grassland::data_structure {
+
+// Staggered operators on MACGrid, parallelized over z slabs with
+// ParallelForEach. Positions are in cell units: cell (i, j, k) spans
+// [i, i + 1] x [j, j + 1] x [k, k + 1], so its centre is at (i + 0.5, j + 0.5,
+// k + 0.5) and u(i, j, k) lives at (i, j + 0.5, k + 0.5). Time steps passed
+// to the advection functions are divided by the cell size, so that
+// velocity * dt is a displacement in cells.
+
+// Writes the divergence of velocity, multiplied by inv_dx, to the cells of
+// divergence, which must be width() x height() x depth() of velocity.
+template <class ContentType,
+          class BaseGridType,
+          class DivergenceGridType,
+          class Scalar>
+void Divergence(const MACGrid<ContentType, BaseGridType> &velocity,
+                Scalar inv_dx,
+                DivergenceGridType &divergence) {
+  const BaseGridType &u = velocity.u();
+  const BaseGridType &v = velocity.v();
+  const BaseGridType &w = velocity.w();
+  ParallelForEach(divergence, [&](offset_t x, offset_t y, offset_t z,
+                                  auto &value) {
+    value = ((u(x + 1, y, z) - u(x, y, z)) + (v(x, y + 1, z) - v(x, y, z)) +
+             (w(x, y, z + 1) - w(x, y, z))) *
+            inv_dx;
+  });
+}
+
+// Subtracts scale * (p(i, j, k) - p(i - 1, j, k)) from u(i, j, k) and the
+// same along y and z, where scale is usually dt / (density * dx). Only faces
+// between two cells are updated, faces on the domain boundary are left to
+// the caller's boundary conditions.
+template <class ContentType,
+          class BaseGridType,
+          class PressureGridType,
+          class Scalar>
+void SubtractPressureGradient(MACGrid<ContentType, BaseGridType> &velocity,
+                              const PressureGridType &pressure,
+                              Scalar scale) {
+  offset_t width = velocity.width();
+  offset_t height = velocity.height();
+  offset_t depth = velocity.depth();
+  ParallelForEach(velocity.u(), [&](offset_t x, offset_t y, offset_t z,
+                                    ContentType &value) {
+    if (x > 0 && x < width) {
+      value -= (pressure(x, y, z) - pressure(x - 1, y, z)) * scale;
+    }
+  });
+  ParallelForEach(velocity.v(), [&](offset_t x, offset_t y, offset_t z,
+                                    ContentType &value) {
+    if (y > 0 && y < height) {
+      value -= (pressure(x, y, z) - pressure(x, y - 1, z)) * scale;
+    }
+  });
+  ParallelForEach(velocity.w(), [&](offset_t x, offset_t y, offset_t z,
+                                    ContentType &value) {
+    if (z > 0 && z < depth) {
+      value -= (pressure(x, y, z) - pressure(x, y, z - 1)) * scale;
+    }
+  });
+}
+
+// Where a particle at pos came from dt ago, by a midpoint (RK2) step
+// backwards through velocity.
+template <class ContentType, class BaseGridType, class Scalar>
+Eigen::Matrix<ContentType, 3, 1> TraceBack(
+    const MACGrid<ContentType, BaseGridType> &velocity,
+    const Eigen::Matrix<ContentType, 3, 1> &pos,
+    Scalar dt) {
+  ContentType half_dt = ContentType(0.5) * ContentType(dt);
+  Eigen::Matrix<ContentType, 3, 1> mid =
+      pos - half_dt * velocity.sample_velocity(pos[0], pos[1], pos[2]);
+  return pos - ContentType(dt) * velocity.sample_velocity(mid[0], mid[1],
+                                                          mid[2]);
+}
+
+// Semi-Lagrangian advection of a grid whose cell (0, 0, 0) sits at offset,
+// e.g. (0.5, 0.5, 0.5) for cell-centred values or (0, 0.5, 0.5) for u.
+template <class ContentType, class BaseGridType, class GridType, class Scalar>
+void AdvectStaggeredSemiLagrangian(
+    const MACGrid<ContentType, BaseGridType> &velocity,
+    const GridType &source,
+    const Eigen::Matrix<ContentType, 3, 1> &offset,
+    Scalar dt,
+    GridType &result) {
+  ParallelForEach(result, [&](offset_t x, offset_t y, offset_t z,
+                              auto &value) {
+    Eigen::Matrix<ContentType, 3, 1> pos(x, y, z);
+    pos += offset;
+    pos = TraceBack(velocity, pos, dt) - offset;
+    value = source.sample(pos[0], pos[1], pos[2]);
+  });
+}
+
+// MacCormack advection: a semi-Lagrangian step forward, one backward, and a
+// correction by half the round-trip error, clamped to the values the
+// forward step interpolated between so that no new extrema appear. forward
+// and upper are scratch grids of the size of result, overwritten: the
+// forward pass keeps its values in forward and the clamp bounds in result
+// and upper, so every departure point is traced once. The backward pass
+// samples forward near the walls as well, so a forward with ghost layers
+// has them refilled by its UpdateGhosts() in between, following its own
+// boundary().
+template <class ContentType,
+          class BaseGridType,
+          class GridType,
+          class ScratchGridType,
+          class Scalar>
+void AdvectStaggeredMacCormack(
+    const MACGrid<ContentType, BaseGridType> &velocity,
+    const GridType &source,
+    const Eigen::Matrix<ContentType, 3, 1> &offset,
+    Scalar dt,
+    GridType &result,
+    ScratchGridType &forward,
+    ScratchGridType &upper) {
+  ParallelForEach(forward, [&](offset_t x, offset_t y, offset_t z,
+                               auto &value) {
+    Eigen::Matrix<ContentType, 3, 1> pos(x, y, z);
+    pos += offset;
+    pos = TraceBack(velocity, pos, dt) - offset;
+    value = source.sample(pos[0], pos[1], pos[2]);
+    // The corners sample() read, ghost layers included.
+    offset_t first = -GridGhostLayers(source);
+    offset_t last[3] = {offset_t(source.width()) - 1 - first,
+                        offset_t(source.height()) - 1 - first,
+                        offset_t(source.depth()) - 1 - first};
+    offset_t x0 = static_cast<offset_t>(std::floor(pos[0]));
+    offset_t y0 = static_cast<offset_t>(std::floor(pos[1]));
+    offset_t z0 = static_cast<offset_t>(std::floor(pos[2]));
+    auto corner_at = [&](offset_t cx, offset_t cy, offset_t cz) {
+      return source(std::clamp(cx, first, last[0]),
+                    std::clamp(cy, first, last[1]),
+                    std::clamp(cz, first, last[2]));
+    };
+    auto lo = corner_at(x0, y0, z0);
+    auto hi = lo;
+    for (offset_t corner = 1; corner < 8; corner++) {
+      auto corner_value = corner_at(x0 + (corner & 1),
+                                    y0 + ((corner >> 1) & 1),
+                                    z0 + (corner >> 2));
+      lo = std::min(lo, corner_value);
+      hi = std::max(hi, corner_value);
+    }
+    result(x, y, z) = lo;
+    upper(x, y, z) = hi;
+  });
+  if constexpr (HasGhostLayers<ScratchGridType>::value) {
+    forward.UpdateGhosts();
+  }
+  ParallelForEach(result, [&](offset_t x, offset_t y, offset_t z,
+                              auto &value) {
+    Eigen::Matrix<ContentType, 3, 1> pos(x, y, z);
+    pos += offset;
+    pos = TraceBack(velocity, pos, -dt) - offset;
+    auto backward = forward.sample(pos[0], pos[1], pos[2]);
+    value = std::clamp(
+        forward(x, y, z) + (source(x, y, z) - backward) * ContentType(0.5),
+        value, upper(x, y, z));
+  });
+}
+
+// As above with scratch grids allocated for the call.
+template <class ContentType, class BaseGridType, class GridType, class Scalar>
+void AdvectStaggeredMacCormack(
+    const MACGrid<ContentType, BaseGridType> &velocity,
+    const GridType &source,
+    const Eigen::Matrix<ContentType, 3, 1> &offset,
+    Scalar dt,
+    GridType &result) {
+  GridType forward(result.width(), result.height(), result.depth(),
+                   grid_uninitialized);
+  GridType upper(result.width(), result.height(), result.depth(),
+                 grid_uninitialized);
+  AdvectStaggeredMacCormack(velocity, source, offset, dt, result, forward,
+                            upper);
+}
+
+// Advects the cell-centred grid source through velocity into result.
+template <class ContentType, class BaseGridType, class GridType, class Scalar>
+void AdvectSemiLagrangian(const MACGrid<ContentType, BaseGridType> &velocity,
+                          const GridType &source,
+                          Scalar dt,
+                          GridType &result) {
+  AdvectStaggeredSemiLagrangian(velocity, source,
+                                Eigen::Matrix<ContentType, 3, 1>(0.5, 0.5, 0.5),
+                                dt, result);
+}
+
+// Advects the face velocities source (usually velocity itself) through
+// velocity into result.
+template <class ContentType, class BaseGridType, class Scalar>
+void AdvectSemiLagrangian(const MACGrid<ContentType, BaseGridType> &velocity,
+                          const MACGrid<ContentType, BaseGridType> &source,
+                          Scalar dt,
+                          MACGrid<ContentType, BaseGridType> &result) {
+  using Vector = Eigen::Matrix<ContentType, 3, 1>;
+  AdvectStaggeredSemiLagrangian(velocity, source.u(), Vector(0, 0.5, 0.5),
+                                dt, result.u());
+  AdvectStaggeredSemiLagrangian(velocity, source.v(), Vector(0.5, 0, 0.5),
+                                dt, result.v());
+  AdvectStaggeredSemiLagrangian(velocity, source.w(), Vector(0.5, 0.5, 0),
+                                dt, result.w());
+}
+
+// Advects with AdvectStaggeredMacCormack. Solvers that advect every time
+// step keep forward and upper, grids of the size of result, across steps so
+// that the advection allocates nothing.
+template <class ContentType, class BaseGridType, class GridType, class Scalar>
+void AdvectMacCormack(const MACGrid<ContentType, BaseGridType> &velocity,
+                      const GridType &source,
+                      Scalar dt,
+                      GridType &result,
+                      GridType &forward,
+                      GridType &upper) {
+  AdvectStaggeredMacCormack(velocity, source,
+                            Eigen::Matrix<ContentType, 3, 1>(0.5, 0.5, 0.5),
+                            dt, result, forward, upper);
+}
+
+template <class ContentType, class BaseGridType, class Scalar>
+void AdvectMacCormack(const MACGrid<ContentType, BaseGridType> &velocity,
+                      const MACGrid<ContentType, BaseGridType> &source,
+                      Scalar dt,
+                      MACGrid<ContentType, BaseGridType> &result,
+                      MACGrid<ContentType, BaseGridType> &forward,
+                      MACGrid<ContentType, BaseGridType> &upper) {
+  using Vector = Eigen::Matrix<ContentType, 3, 1>;
+  AdvectStaggeredMacCormack(velocity, source.u(), Vector(0, 0.5, 0.5), dt,
+                            result.u(), forward.u(), upper.u());
+  AdvectStaggeredMacCormack(velocity, source.v(), Vector(0.5, 0, 0.5), dt,
+                            result.v(), forward.v(), upper.v());
+  AdvectStaggeredMacCormack(velocity, source.w(), Vector(0.5, 0.5, 0), dt,
+                            result.w(), forward.w(), upper.w());
+}
+
+template <class ContentType, class BaseGridType, class GridType, class Scalar>
+void AdvectMacCormack(const MACGrid<ContentType, BaseGridType> &velocity,
+                      const GridType &source,
+                      Scalar dt,
+                      GridType &result) {
+  GridType forward(result.width(), result.height(), result.depth(),
+                   grid_uninitialized);
+  GridType upper(result.width(), result.height(), result.depth(),
+                 grid_uninitialized);
+  AdvectMacCormack(velocity, source, dt, result, forward, upper);
+}
+
+template <class ContentType, class BaseGridType, class Scalar>
+void AdvectMacCormack(const MACGrid<ContentType, BaseGridType> &velocity,
+                      const MACGrid<ContentType, BaseGridType> &source,
+                      Scalar dt,
+                      MACGrid<ContentType, BaseGridType> &result) {
+  MACGrid<ContentType, BaseGridType> forward(
+      result.width(), result.height(), result.depth(), grid_uninitialized);
+  MACGrid<ContentType, BaseGridType> upper(
+      result.width(), result.height(), result.depth(), grid_uninitialized);
+  AdvectMacCormack(velocity, source, dt, result, forward, upper);
+}
+}  // namespace grassland::data_structure
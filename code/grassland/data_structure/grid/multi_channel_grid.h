@@ -0,0 +1,228 @@
+#pragma once
+#include "grassland/data_structure/grid/grid_util.h"
+#include "grassland/data_structure/grid/linear_grid_view.h"
+
+namespace grassland::data_structure {
+
+// Planes of MultiChannelGrid start at multiples of this many bytes, one
+// cache line and one AVX-512 register.
+constexpr size_t kChannelAlignment = 64;
+
+// A grid of Channels-component vectors stored as structure of arrays: every
+// channel is a plane of its own with the layout of a LinearGrid, aligned to
+// kChannelAlignment bytes. Kernels touching a single component read only
+// its plane, e.g. through channel(c), and run over contiguous scalars the
+// compiler can vectorize. Cells are still read and written as a whole
+// through get()/set(), operator() and sample(), which interpolates all
+// channels with one set of weights.
+template <typename Scalar, int Channels>
+class MultiChannelGrid {
+ public:
+  using Vector = Eigen::Matrix<Scalar, Channels, 1>;
+
+  // Proxy for a cell returned by the non-const operator(). It converts to
+  // and is assignable from Vector, and operator[] gives the components.
+  class Reference {
+   public:
+    Reference(MultiChannelGrid *grid, offset_t offset)
+        : grid_(grid), offset_(offset) {
+    }
+
+    operator Vector() const {
+      return grid_->get(offset_);
+    }
+
+    Reference &operator=(const Vector &value) {
+      grid_->set(offset_, value);
+      return *this;
+    }
+
+    Reference &operator=(const Reference &other) {
+      return *this = Vector(other);
+    }
+
+    Reference &operator+=(const Vector &value) {
+      return *this = Vector(*this) + value;
+    }
+
+    Reference &operator-=(const Vector &value) {
+      return *this = Vector(*this) - value;
+    }
+
+    Scalar &operator[](int channel) {
+      return grid_->channel_data(channel)[offset_];
+    }
+
+    Scalar operator[](int channel) const {
+      return grid_->channel_data(channel)[offset_];
+    }
+
+   private:
+    MultiChannelGrid *grid_;
+    offset_t offset_;
+  };
+
+  MultiChannelGrid(size_t width,
+                   size_t height,
+                   const Vector &default_value = Vector::Zero())
+      : MultiChannelGrid(width, height, 1, default_value) {
+  }
+
+  MultiChannelGrid(size_t width,
+                   size_t height,
+                   size_t depth,
+                   const Vector &default_value = Vector::Zero())
+      : width_(width),
+        height_(height),
+        depth_(depth),
+        y_stride_(width),
+        z_stride_(width * height) {
+    constexpr size_t kPlaneAlignment = kChannelAlignment / sizeof(Scalar);
+    plane_stride_ = (width * height * depth + kPlaneAlignment - 1) /
+                    kPlaneAlignment * kPlaneAlignment;
+    buffer_.resize(plane_stride_ * Channels);
+    for (int c = 0; c < Channels; c++) {
+      std::fill(channel_data(c), channel_data(c) + plane_stride_,
+                default_value[c]);
+    }
+  }
+
+  size_t width() const {
+    return width_;
+  }
+
+  size_t height() const {
+    return height_;
+  }
+
+  size_t depth() const {
+    return depth_;
+  }
+
+  // Offset of cell (x, y, z) within every plane.
+  offset_t offset(offset_t x, offset_t y, offset_t z) const {
+    return x + y * y_stride_ + z * z_stride_;
+  }
+
+  Vector get(offset_t offset) const {
+    Vector value;
+    for (int c = 0; c < Channels; c++) {
+      value[c] = channel_data(c)[offset];
+    }
+    return value;
+  }
+
+  Vector get(offset_t x, offset_t y, offset_t z) const {
+    return get(offset(x, y, z));
+  }
+
+  Vector get_clamped(offset_t x, offset_t y, offset_t z) const {
+    return get(std::clamp(x, offset_t(0), offset_t(width_ - 1)),
+               std::clamp(y, offset_t(0), offset_t(height_ - 1)),
+               std::clamp(z, offset_t(0), offset_t(depth_ - 1)));
+  }
+
+  void set(offset_t offset, const Vector &value) {
+    for (int c = 0; c < Channels; c++) {
+      channel_data(c)[offset] = value[c];
+    }
+  }
+
+  void set(offset_t x, offset_t y, offset_t z, const Vector &value) {
+    set(offset(x, y, z), value);
+  }
+
+  Vector operator()(offset_t x, offset_t y, offset_t z) const {
+    return get(x, y, z);
+  }
+
+  Reference operator()(offset_t x, offset_t y, offset_t z) {
+    return Reference(this, offset(x, y, z));
+  }
+
+  // Trilinear interpolation clamped to the edge like LinearGrid::sample.
+  // The corner offsets and weights are computed once for all channels.
+  template <class SampleScalar>
+  Vector sample(SampleScalar x, SampleScalar y, SampleScalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    offset_t last_x = offset_t(width_) - 1;
+    offset_t last_y = offset_t(height_) - 1;
+    offset_t last_z = offset_t(depth_) - 1;
+    offset_t ox0 = std::clamp(x0, offset_t(0), last_x);
+    offset_t ox1 = std::clamp(x0 + 1, offset_t(0), last_x);
+    offset_t oy0 = std::clamp(y0, offset_t(0), last_y) * y_stride_;
+    offset_t oy1 = std::clamp(y0 + 1, offset_t(0), last_y) * y_stride_;
+    offset_t oz0 = std::clamp(z0, offset_t(0), last_z) * z_stride_;
+    offset_t oz1 = std::clamp(z0 + 1, offset_t(0), last_z) * z_stride_;
+    const offset_t offsets[8] = {ox0 + oy0 + oz0, ox1 + oy0 + oz0,
+                                 ox0 + oy1 + oz0, ox1 + oy1 + oz0,
+                                 ox0 + oy0 + oz1, ox1 + oy0 + oz1,
+                                 ox0 + oy1 + oz1, ox1 + oy1 + oz1};
+    const Scalar weights[8] = {
+        Scalar((1 - x) * (1 - y) * (1 - z)), Scalar(x * (1 - y) * (1 - z)),
+        Scalar((1 - x) * y * (1 - z)),       Scalar(x * y * (1 - z)),
+        Scalar((1 - x) * (1 - y) * z),       Scalar(x * (1 - y) * z),
+        Scalar((1 - x) * y * z),             Scalar(x * y * z)};
+    Vector result;
+    for (int c = 0; c < Channels; c++) {
+      const Scalar *plane = channel_data(c);
+      Scalar value = plane[offsets[0]] * weights[0];
+      for (int corner = 1; corner < 8; corner++) {
+        value += plane[offsets[corner]] * weights[corner];
+      }
+      result[c] = value;
+    }
+    return result;
+  }
+
+  // Plane of channel c, cell (x, y, z) at offset(x, y, z).
+  Scalar *channel_data(int c) {
+    return buffer_.data() + c * plane_stride_;
+  }
+
+  const Scalar *channel_data(int c) const {
+    return buffer_.data() + c * plane_stride_;
+  }
+
+  // Channel c as a grid of its own, usable with the scalar grid kernels.
+  LinearGridView<Scalar> channel(int c) {
+    return LinearGridView<Scalar>(width_, height_, depth_, y_stride_,
+                                  z_stride_, channel_data(c));
+  }
+
+  LinearGridView<const Scalar> channel(int c) const {
+    return LinearGridView<const Scalar>(width_, height_, depth_, y_stride_,
+                                        z_stride_, channel_data(c));
+  }
+
+  size_t y_stride() const {
+    return y_stride_;
+  }
+
+  size_t z_stride() const {
+    return z_stride_;
+  }
+
+  // Distance between the planes in elements.
+  size_t plane_stride() const {
+    return plane_stride_;
+  }
+
+ private:
+  std::vector<Scalar, AlignedAllocator<Scalar, kChannelAlignment>> buffer_;
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  size_t y_stride_;
+  size_t z_stride_;
+  size_t plane_stride_;
+};
+
+template <typename Scalar, int Channels>
+struct IsDenseGrid<MultiChannelGrid<Scalar, Channels>> : std::true_type {};
+}  // namespace grassland::data_structure
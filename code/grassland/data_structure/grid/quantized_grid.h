@@ -0,0 +1,425 @@
+#pragma once
+#include "cstring"
+#include "grassland/data_structure/grid/grid_parallel.h"
+#include "grassland/data_structure/grid/linear_grid.h"
+#include "limits"
+#include "stdexcept"
+
+#if !defined(__CUDACC__) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace grassland::data_structure {
+
+// Conversions between float and IEEE 754 binary16, rounding to nearest even.
+// They use the F16C instructions when the compiler targets them and exact
+// bit manipulation otherwise.
+inline uint16_t FloatToHalfBits(float value) {
+#if !defined(__CUDACC__) && defined(__F16C__)
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  constexpr uint32_t kInfinity = 255u << 23;
+  constexpr uint32_t kHalfOverflow = (127u + 16u) << 23;
+  constexpr uint32_t kHalfNormalMin = 113u << 23;
+  constexpr uint32_t kDenormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint16_t result;
+  if (bits >= kHalfOverflow) {
+    result = bits > kInfinity ? 0x7e00 : 0x7c00;
+  } else if (bits < kHalfNormalMin) {
+    // Adding the magic number lets the FPU round the subnormal mantissa.
+    float magic, shifted;
+    std::memcpy(&magic, &kDenormMagic, sizeof(magic));
+    std::memcpy(&shifted, &bits, sizeof(shifted));
+    shifted += magic;
+    std::memcpy(&bits, &shifted, sizeof(bits));
+    result = uint16_t(bits - kDenormMagic);
+  } else {
+    uint32_t mantissa_odd = (bits >> 13) & 1u;
+    bits += ((15u - 127u) << 23) + 0xfffu + mantissa_odd;
+    result = uint16_t(bits >> 13);
+  }
+  return result | uint16_t(sign >> 16);
+#endif
+}
+
+inline float HalfBitsToFloat(uint16_t half) {
+#if !defined(__CUDACC__) && defined(__F16C__)
+  return _cvtsh_ss(half);
+#else
+  constexpr uint32_t kShiftedExponent = 0x7c00u << 13;
+  constexpr uint32_t kMagic = 113u << 23;
+  uint32_t bits = uint32_t(half & 0x7fffu) << 13;
+  uint32_t exponent = bits & kShiftedExponent;
+  bits += (127u - 15u) << 23;
+  if (exponent == kShiftedExponent) {
+    bits += (128u - 16u) << 23;
+  } else if (exponent == 0) {
+    float value, magic;
+    bits += 1u << 23;
+    std::memcpy(&value, &bits, sizeof(value));
+    std::memcpy(&magic, &kMagic, sizeof(magic));
+    value -= magic;
+    std::memcpy(&bits, &value, sizeof(bits));
+  }
+  bits |= uint32_t(half & 0x8000u) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+#endif
+}
+
+// IEEE 754 half precision storage type, converting to and from float. It has
+// 11 significant bits, i.e. a relative error of at most 2^-11, and a largest
+// finite value of 65504.
+class Half {
+ public:
+  Half() = default;
+
+  Half(float value) : bits_(FloatToHalfBits(value)) {
+  }
+
+  operator float() const {
+    return HalfBitsToFloat(bits_);
+  }
+
+  uint16_t bits() const {
+    return bits_;
+  }
+
+  static Half FromBits(uint16_t bits) {
+    Half half;
+    half.bits_ = bits;
+    return half;
+  }
+
+ private:
+  uint16_t bits_{0};
+};
+
+// Codecs turn full precision values into the storage_type of a
+// QuantizedGrid and back.
+struct HalfCodec {
+  using storage_type = Half;
+
+  template <class ContentType>
+  ContentType Decode(Half code) const {
+    return ContentType(float(code));
+  }
+
+  template <class ContentType>
+  Half Encode(const ContentType &value) const {
+    return Half(float(value));
+  }
+
+  template <class ContentType>
+  static HalfCodec FromRange(const ContentType &, const ContentType &) {
+    return {};
+  }
+};
+
+// Fixed point values offset + scale * code with an unsigned integer code.
+// Values inside the range are off by at most scale / 2, values outside it
+// are clamped. The default range is [0, 1]. offset and scale are kept in
+// Scalar, which should be the ContentType of the grid: a float offset would
+// round away the precision of double values far from zero.
+template <class StorageType, class Scalar = float>
+struct FixedPointCodec {
+  static_assert(std::is_integral_v<StorageType> &&
+                    std::is_unsigned_v<StorageType>,
+                "Fixed point codes must be unsigned integers");
+  using storage_type = StorageType;
+
+  static constexpr Scalar kMaxCode =
+      Scalar(std::numeric_limits<StorageType>::max());
+
+  Scalar offset{0};
+  Scalar scale{Scalar(1) / kMaxCode};
+
+  template <class ContentType>
+  ContentType Decode(StorageType code) const {
+    return ContentType(offset) + ContentType(scale) * ContentType(code);
+  }
+
+  template <class ContentType>
+  StorageType Encode(const ContentType &value) const {
+    Scalar code = std::round((Scalar(value) - offset) / scale);
+    return StorageType(std::clamp(code, Scalar(0), kMaxCode));
+  }
+
+  // The codec spreading its codes evenly over [lo, hi].
+  template <class ContentType>
+  static FixedPointCodec FromRange(const ContentType &lo,
+                                   const ContentType &hi) {
+    FixedPointCodec codec;
+    codec.offset = Scalar(lo);
+    codec.scale = hi > lo ? Scalar(hi - lo) / kMaxCode : Scalar(1);
+    return codec;
+  }
+
+  Scalar max_error() const {
+    return Scalar(0.5) * scale;
+  }
+};
+
+template <class Scalar = float>
+using Fixed8Codec = FixedPointCodec<uint8_t, Scalar>;
+
+template <class Scalar = float>
+using Fixed16Codec = FixedPointCodec<uint16_t, Scalar>;
+
+// A grid of ContentType (float or double) values stored in the compact
+// storage_type of Codec, e.g. 2 bytes per cell with HalfCodec or
+// Fixed16Codec<ContentType> and 1 byte with Fixed8Codec<ContentType>. get(),
+// sample() and the const operator() decode on the fly and return
+// ContentType, the non-const operator() returns a Reference that encodes what
+// is assigned to it.
+//
+// Fixed point grids have one codec for the whole grid, or one per brick of
+// brick_size^3 cells fitted to the values of that brick, which keeps the
+// error small where the values vary little. The codes live in a
+// StorageGridType with the layout of a LinearGrid, by default a LinearGrid
+// and possibly a LinearGridView, e.g. of a memory mapped file.
+template <class ContentType,
+          class Codec,
+          class StorageGridType = LinearGrid<typename Codec::storage_type>>
+class QuantizedGrid {
+ public:
+  using storage_type = typename Codec::storage_type;
+
+  class Reference {
+   public:
+    Reference(QuantizedGrid *grid, offset_t x, offset_t y, offset_t z)
+        : grid_(grid), x_(x), y_(y), z_(z) {
+    }
+
+    operator ContentType() const {
+      return grid_->get(x_, y_, z_);
+    }
+
+    Reference &operator=(const ContentType &value) {
+      grid_->set(x_, y_, z_, value);
+      return *this;
+    }
+
+    Reference &operator=(const Reference &other) {
+      return *this = ContentType(other);
+    }
+
+    Reference &operator+=(const ContentType &value) {
+      return *this = ContentType(*this) + value;
+    }
+
+    Reference &operator-=(const ContentType &value) {
+      return *this = ContentType(*this) - value;
+    }
+
+   private:
+    QuantizedGrid *grid_;
+    offset_t x_;
+    offset_t y_;
+    offset_t z_;
+  };
+
+  QuantizedGrid(size_t width,
+                size_t height,
+                size_t depth,
+                const ContentType &default_value = ContentType{},
+                const Codec &codec = Codec{})
+      : storage_(width, height, depth, codec.Encode(default_value)),
+        codecs_{codec} {
+  }
+
+  // Quantizes source, any grid with width()/height()/depth() and
+  // operator()(x, y, z). brick_size must be 0, for a single codec fitted to
+  // the whole grid, or a power of two, otherwise std::invalid_argument is
+  // thrown.
+  template <class SourceGridType>
+  explicit QuantizedGrid(const SourceGridType &source, size_t brick_size = 0)
+      : storage_(source.width(), source.height(), source.depth()) {
+    SetBrickSize(brick_size);
+    offset_t num_bricks = bricks_x_ * bricks_y_ * bricks_z_;
+    std::vector<ContentType> lo(num_bricks,
+                                std::numeric_limits<ContentType>::max());
+    std::vector<ContentType> hi(num_bricks,
+                                std::numeric_limits<ContentType>::lowest());
+    for (offset_t z = 0; z < offset_t(depth()); z++) {
+      for (offset_t y = 0; y < offset_t(height()); y++) {
+        for (offset_t x = 0; x < offset_t(width()); x++) {
+          ContentType value = source(x, y, z);
+          offset_t brick = brick_index(x, y, z);
+          lo[brick] = std::min(lo[brick], value);
+          hi[brick] = std::max(hi[brick], value);
+        }
+      }
+    }
+    codecs_.resize(num_bricks);
+    for (offset_t brick = 0; brick < num_bricks; brick++) {
+      codecs_[brick] = Codec::FromRange(lo[brick], hi[brick]);
+    }
+    ParallelForEach(storage_, [&](offset_t x, offset_t y, offset_t z,
+                                  storage_type &code) {
+      code = codec(x, y, z).Encode(ContentType(source(x, y, z)));
+    });
+  }
+
+  // Wraps codes written before, e.g. mapped from a file, together with the
+  // codecs they were encoded with: one, or one per brick in x-fastest order.
+  QuantizedGrid(const StorageGridType &storage,
+                const std::vector<Codec> &codecs,
+                size_t brick_size = 0)
+      : storage_(storage), codecs_(codecs) {
+    SetBrickSize(brick_size);
+  }
+
+  size_t width() const {
+    return storage_.width();
+  }
+
+  size_t height() const {
+    return storage_.height();
+  }
+
+  size_t depth() const {
+    return storage_.depth();
+  }
+
+  ContentType get(offset_t x, offset_t y, offset_t z) const {
+    return codec(x, y, z).template Decode<ContentType>(storage_(x, y, z));
+  }
+
+  ContentType get_clamped(offset_t x, offset_t y, offset_t z) const {
+    return get(std::clamp(x, offset_t(0), offset_t(width()) - 1),
+               std::clamp(y, offset_t(0), offset_t(height()) - 1),
+               std::clamp(z, offset_t(0), offset_t(depth()) - 1));
+  }
+
+  void set(offset_t x, offset_t y, offset_t z, const ContentType &value) {
+    storage_(x, y, z) = codec(x, y, z).Encode(value);
+  }
+
+  ContentType operator()(offset_t x, offset_t y, offset_t z) const {
+    return get(x, y, z);
+  }
+
+  Reference operator()(offset_t x, offset_t y, offset_t z) {
+    return Reference(this, x, y, z);
+  }
+
+  // Trilinear interpolation of the decoded values, clamped to the edge like
+  // LinearGrid::sample.
+  template <class Scalar>
+  ContentType sample(Scalar x, Scalar y, Scalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    offset_t last_x = offset_t(width()) - 1;
+    offset_t last_y = offset_t(height()) - 1;
+    offset_t last_z = offset_t(depth()) - 1;
+    offset_t x1 = std::clamp(x0 + 1, offset_t(0), last_x);
+    offset_t y1 = std::clamp(y0 + 1, offset_t(0), last_y);
+    offset_t z1 = std::clamp(z0 + 1, offset_t(0), last_z);
+    x0 = std::clamp(x0, offset_t(0), last_x);
+    y0 = std::clamp(y0, offset_t(0), last_y);
+    z0 = std::clamp(z0, offset_t(0), last_z);
+    // Corners in one brick, always the case with a single codec, share the
+    // codec lookup.
+    if (brick_index(x0, y0, z0) == brick_index(x1, y1, z1)) {
+      const Codec &corner_codec = codec(x0, y0, z0);
+      return Interpolate(
+          [&](offset_t cx, offset_t cy, offset_t cz) {
+            return corner_codec.template Decode<ContentType>(
+                storage_(cx, cy, cz));
+          },
+          x0, y0, z0, x1, y1, z1, x, y, z);
+    }
+    return Interpolate(
+        [&](offset_t cx, offset_t cy, offset_t cz) {
+          return get(cx, cy, cz);
+        },
+        x0, y0, z0, x1, y1, z1, x, y, z);
+  }
+
+  // The codec cell (x, y, z) is encoded with.
+  const Codec &codec(offset_t x, offset_t y, offset_t z) const {
+    return codecs_[brick_index(x, y, z)];
+  }
+
+  const std::vector<Codec> &codecs() const {
+    return codecs_;
+  }
+
+  size_t brick_size() const {
+    return brick_size_;
+  }
+
+  StorageGridType &storage() {
+    return storage_;
+  }
+
+  const StorageGridType &storage() const {
+    return storage_;
+  }
+
+ private:
+  template <class DecodeFunc, class Scalar>
+  static ContentType Interpolate(DecodeFunc &&decode,
+                                 offset_t x0,
+                                 offset_t y0,
+                                 offset_t z0,
+                                 offset_t x1,
+                                 offset_t y1,
+                                 offset_t z1,
+                                 Scalar x,
+                                 Scalar y,
+                                 Scalar z) {
+    return decode(x0, y0, z0) * ((1 - x) * (1 - y) * (1 - z)) +
+           decode(x1, y0, z0) * (x * (1 - y) * (1 - z)) +
+           decode(x0, y1, z0) * ((1 - x) * y * (1 - z)) +
+           decode(x1, y1, z0) * (x * y * (1 - z)) +
+           decode(x0, y0, z1) * ((1 - x) * (1 - y) * z) +
+           decode(x1, y0, z1) * (x * (1 - y) * z) +
+           decode(x0, y1, z1) * ((1 - x) * y * z) +
+           decode(x1, y1, z1) * (x * y * z);
+  }
+
+  void SetBrickSize(size_t brick_size) {
+    if (brick_size & (brick_size - 1)) {
+      throw std::invalid_argument(
+          "QuantizedGrid: brick_size must be 0 or a power of two");
+    }
+    brick_size_ = brick_size;
+    brick_shift_ = 0;
+    if (brick_size) {
+      while ((size_t(1) << brick_shift_) < brick_size) {
+        brick_shift_++;
+      }
+      bricks_x_ = (offset_t(width()) + brick_size - 1) >> brick_shift_;
+      bricks_y_ = (offset_t(height()) + brick_size - 1) >> brick_shift_;
+      bricks_z_ = (offset_t(depth()) + brick_size - 1) >> brick_shift_;
+    }
+  }
+
+  offset_t brick_index(offset_t x, offset_t y, offset_t z) const {
+    if (!brick_size_) {
+      return 0;
+    }
+    return (x >> brick_shift_) +
+           bricks_x_ * ((y >> brick_shift_) + bricks_y_ * (z >> brick_shift_));
+  }
+
+  StorageGridType storage_;
+  std::vector<Codec> codecs_;
+  size_t brick_size_{0};
+  int brick_shift_{0};
+  offset_t bricks_x_{1};
+  offset_t bricks_y_{1};
+  offset_t bricks_z_{1};
+};
+}  // namespace grassland::data_structure
@@ -0,0 +1,360 @@
+#pragma once
+
+#include "grassland/data_structure/grid/grid_util.h"
+#include "memory"
+
+namespace grassland::data_structure {
+
+// A sparse grid in the spirit of OpenVDB, for narrow-band fields where only a
+// thin shell of cells is ever touched. Cells are grouped into leaves of
+// LeafSize^3 values, leaves are grouped into internal nodes of InternalSize^3
+// leaves, and a dense root table over the grid extent points to the internal
+// nodes. Nodes are allocated on the first non-const access; everything else
+// reads as the background value.
+//
+// References returned by operator() stay valid until the grid is destroyed or
+// pruned, as leaves never move once allocated.
+template <typename ContentType, size_t LeafSize = 8, size_t InternalSize = 16>
+class SparseGrid {
+  static_assert(LeafSize >= 2 && (LeafSize & (LeafSize - 1)) == 0,
+                "LeafSize must be a power of two");
+  static_assert(InternalSize >= 2 && (InternalSize & (InternalSize - 1)) == 0,
+                "InternalSize must be a power of two");
+
+ public:
+  static constexpr size_t kLeafVolume = LeafSize * LeafSize * LeafSize;
+
+  struct Leaf {
+    offset_t origin[3];
+    ContentType values[kLeafVolume];
+  };
+
+  SparseGrid(size_t width,
+             size_t height,
+             const ContentType &background = ContentType{})
+      : SparseGrid(width, height, 1, background) {
+  }
+
+  SparseGrid(size_t width,
+             size_t height,
+             size_t depth,
+             const ContentType &background = ContentType{})
+      : width_(width), height_(height), depth_(depth), background_(background) {
+    root_x_ = (width_ + kInternalExtent - 1) / kInternalExtent;
+    root_y_ = (height_ + kInternalExtent - 1) / kInternalExtent;
+    root_z_ = (depth_ + kInternalExtent - 1) / kInternalExtent;
+    root_.assign(root_x_ * root_y_ * root_z_, -1);
+  }
+
+  SparseGrid(const SparseGrid &other)
+      : width_(other.width_),
+        height_(other.height_),
+        depth_(other.depth_),
+        background_(other.background_),
+        root_x_(other.root_x_),
+        root_y_(other.root_y_),
+        root_z_(other.root_z_),
+        root_(other.root_) {
+    internals_.reserve(other.internals_.size());
+    for (const auto &internal : other.internals_) {
+      internals_.push_back(std::make_unique<InternalNode>(*internal));
+    }
+    leaves_.reserve(other.leaves_.size());
+    for (const auto &leaf : other.leaves_) {
+      leaves_.push_back(std::make_unique<Leaf>(*leaf));
+    }
+  }
+
+  SparseGrid(SparseGrid &&other) = default;
+
+  SparseGrid &operator=(const SparseGrid &other) {
+    if (this != &other) {
+      *this = SparseGrid(other);
+    }
+    return *this;
+  }
+
+  SparseGrid &operator=(SparseGrid &&other) = default;
+
+  ~SparseGrid() = default;
+
+  ContentType &operator()(offset_t x, offset_t y) {
+    return operator()(x, y, 0);
+  }
+
+  const ContentType &operator()(offset_t x, offset_t y) const {
+    return operator()(x, y, 0);
+  }
+
+  ContentType &operator()(offset_t x, offset_t y, offset_t z) {
+    return touch_leaf(x, y, z)->values[leaf_offset(x, y, z)];
+  }
+
+  const ContentType &operator()(offset_t x, offset_t y, offset_t z) const {
+    const Leaf *leaf = find_leaf(x, y, z);
+    if (!leaf) {
+      return background_;
+    }
+    return leaf->values[leaf_offset(x, y, z)];
+  }
+
+  size_t width() const {
+    return width_;
+  }
+
+  size_t height() const {
+    return height_;
+  }
+
+  size_t depth() const {
+    return depth_;
+  }
+
+  const ContentType &background() const {
+    return background_;
+  }
+
+  ContentType get(offset_t x, offset_t y, offset_t z) const {
+    return operator()(x, y, z);
+  }
+
+  ContentType get_clamped(offset_t x, offset_t y, offset_t z) const {
+    return operator()(std::clamp(x, offset_t(0), offset_t(width_ - 1)),
+                      std::clamp(y, offset_t(0), offset_t(height_ - 1)),
+                      std::clamp(z, offset_t(0), offset_t(depth_ - 1)));
+  }
+
+  template <class Scalar>
+  ContentType sample(Scalar x, Scalar y, Scalar z) const {
+    offset_t x0 = static_cast<offset_t>(std::floor(x));
+    offset_t y0 = static_cast<offset_t>(std::floor(y));
+    offset_t z0 = static_cast<offset_t>(std::floor(z));
+    x -= x0;
+    y -= y0;
+    z -= z0;
+    offset_t x1 = std::clamp(x0 + 1, offset_t(0), offset_t(width_ - 1));
+    offset_t y1 = std::clamp(y0 + 1, offset_t(0), offset_t(height_ - 1));
+    offset_t z1 = std::clamp(z0 + 1, offset_t(0), offset_t(depth_ - 1));
+    x0 = std::clamp(x0, offset_t(0), offset_t(width_ - 1));
+    y0 = std::clamp(y0, offset_t(0), offset_t(height_ - 1));
+    z0 = std::clamp(z0, offset_t(0), offset_t(depth_ - 1));
+    ContentType c[8];
+    if ((x0 ^ x1) < offset_t(LeafSize) && (y0 ^ y1) < offset_t(LeafSize) &&
+        (z0 ^ z1) < offset_t(LeafSize)) {
+      // All 8 corners share a leaf, so the tree is walked only once.
+      const Leaf *leaf = find_leaf(x0, y0, z0);
+      if (!leaf) {
+        return background_;
+      }
+      c[0] = leaf->values[leaf_offset(x0, y0, z0)];
+      c[1] = leaf->values[leaf_offset(x1, y0, z0)];
+      c[2] = leaf->values[leaf_offset(x0, y1, z0)];
+      c[3] = leaf->values[leaf_offset(x1, y1, z0)];
+      c[4] = leaf->values[leaf_offset(x0, y0, z1)];
+      c[5] = leaf->values[leaf_offset(x1, y0, z1)];
+      c[6] = leaf->values[leaf_offset(x0, y1, z1)];
+      c[7] = leaf->values[leaf_offset(x1, y1, z1)];
+    } else {
+      c[0] = operator()(x0, y0, z0);
+      c[1] = operator()(x1, y0, z0);
+      c[2] = operator()(x0, y1, z0);
+      c[3] = operator()(x1, y1, z0);
+      c[4] = operator()(x0, y0, z1);
+      c[5] = operator()(x1, y0, z1);
+      c[6] = operator()(x0, y1, z1);
+      c[7] = operator()(x1, y1, z1);
+    }
+    return c[0] * ((1 - x) * (1 - y) * (1 - z)) +
+           c[1] * (x * (1 - y) * (1 - z)) + c[2] * ((1 - x) * y * (1 - z)) +
+           c[3] * (x * y * (1 - z)) + c[4] * ((1 - x) * (1 - y) * z) +
+           c[5] * (x * (1 - y) * z) + c[6] * ((1 - x) * y * z) +
+           c[7] * (x * y * z);
+  }
+
+  bool is_active(offset_t x, offset_t y, offset_t z) const {
+    return find_leaf(x, y, z) != nullptr;
+  }
+
+  // Allocates the leaf containing (x, y, z) if needed, filled with the
+  // background value.
+  void activate(offset_t x, offset_t y, offset_t z) {
+    touch_leaf(x, y, z);
+  }
+
+  size_t num_leaves() const {
+    return leaves_.size();
+  }
+
+  Leaf &leaf(size_t index) {
+    return *leaves_[index];
+  }
+
+  const Leaf &leaf(size_t index) const {
+    return *leaves_[index];
+  }
+
+  size_t leaf_size() const {
+    return LeafSize;
+  }
+
+  size_t memory_usage() const {
+    return leaves_.size() * sizeof(Leaf) +
+           internals_.size() * sizeof(InternalNode) +
+           root_.size() * sizeof(int32_t);
+  }
+
+  // Calls func(x, y, z, value) for every cell of every allocated leaf, leaf by
+  // leaf. Cells of boundary leaves that fall outside the grid are skipped.
+  // This is the cost-proportional-to-surface way to visit a narrow band.
+  template <class Func>
+  void ForEachActive(Func &&func) {
+    for (auto &leaf : leaves_) {
+      ForEachLeafCell(*leaf, func);
+    }
+  }
+
+  template <class Func>
+  void ForEachActive(Func &&func) const {
+    for (const auto &leaf : leaves_) {
+      ForEachLeafCell(static_cast<const Leaf &>(*leaf), func);
+    }
+  }
+
+  // Calls func(leaf) for every allocated leaf.
+  template <class Func>
+  void ForEachLeaf(Func &&func) {
+    for (auto &leaf : leaves_) {
+      func(*leaf);
+    }
+  }
+
+  template <class Func>
+  void ForEachLeaf(Func &&func) const {
+    for (const auto &leaf : leaves_) {
+      func(static_cast<const Leaf &>(*leaf));
+    }
+  }
+
+  // Releases leaves whose values are all within tolerance of the background.
+  // Returns the number of released leaves.
+  template <class Scalar = double>
+  size_t Prune(Scalar tolerance = 0) {
+    size_t released = 0;
+    for (size_t i = 0; i < leaves_.size();) {
+      Leaf &leaf = *leaves_[i];
+      bool uniform = true;
+      for (size_t j = 0; j < kLeafVolume && uniform; j++) {
+        uniform = std::abs(leaf.values[j] - background_) <= tolerance;
+      }
+      if (!uniform) {
+        i++;
+        continue;
+      }
+      int32_t &slot = leaf_slot(leaf.origin[0], leaf.origin[1], leaf.origin[2]);
+      slot = -1;
+      if (i + 1 != leaves_.size()) {
+        std::swap(leaves_[i], leaves_.back());
+        const Leaf &moved = *leaves_[i];
+        leaf_slot(moved.origin[0], moved.origin[1], moved.origin[2]) =
+            static_cast<int32_t>(i);
+      }
+      leaves_.pop_back();
+      released++;
+    }
+    return released;
+  }
+
+ private:
+  static constexpr int kLeafShift = MortonLog2(LeafSize);
+  static constexpr int kInternalShift = MortonLog2(InternalSize);
+  static constexpr size_t kInternalExtent = LeafSize * InternalSize;
+
+  struct InternalNode {
+    int32_t leaves[InternalSize * InternalSize * InternalSize];
+  };
+
+  static offset_t leaf_offset(offset_t x, offset_t y, offset_t z) {
+    return (x & (LeafSize - 1)) +
+           ((y & (LeafSize - 1)) + (z & (LeafSize - 1)) * LeafSize) *
+               LeafSize;
+  }
+
+  static offset_t internal_offset(offset_t x, offset_t y, offset_t z) {
+    constexpr offset_t mask = InternalSize - 1;
+    return ((x >> kLeafShift) & mask) +
+           (((y >> kLeafShift) & mask) + ((z >> kLeafShift) & mask) *
+                                             offset_t(InternalSize)) *
+               offset_t(InternalSize);
+  }
+
+  offset_t root_offset(offset_t x, offset_t y, offset_t z) const {
+    constexpr int shift = kLeafShift + kInternalShift;
+    return (x >> shift) + ((y >> shift) + (z >> shift) * root_y_) * root_x_;
+  }
+
+  const Leaf *find_leaf(offset_t x, offset_t y, offset_t z) const {
+    int32_t internal = root_[root_offset(x, y, z)];
+    if (internal < 0) {
+      return nullptr;
+    }
+    int32_t leaf = internals_[internal]->leaves[internal_offset(x, y, z)];
+    if (leaf < 0) {
+      return nullptr;
+    }
+    return leaves_[leaf].get();
+  }
+
+  int32_t &leaf_slot(offset_t x, offset_t y, offset_t z) {
+    int32_t &internal = root_[root_offset(x, y, z)];
+    if (internal < 0) {
+      internal = static_cast<int32_t>(internals_.size());
+      internals_.push_back(std::make_unique<InternalNode>());
+      std::fill(std::begin(internals_.back()->leaves),
+                std::end(internals_.back()->leaves), -1);
+    }
+    return internals_[internal]->leaves[internal_offset(x, y, z)];
+  }
+
+  Leaf *touch_leaf(offset_t x, offset_t y, offset_t z) {
+    int32_t &slot = leaf_slot(x, y, z);
+    if (slot < 0) {
+      slot = static_cast<int32_t>(leaves_.size());
+      leaves_.push_back(std::make_unique<Leaf>());
+      Leaf &leaf = *leaves_.back();
+      leaf.origin[0] = x & ~offset_t(LeafSize - 1);
+      leaf.origin[1] = y & ~offset_t(LeafSize - 1);
+      leaf.origin[2] = z & ~offset_t(LeafSize - 1);
+      std::fill(std::begin(leaf.values), std::end(leaf.values), background_);
+    }
+    return leaves_[slot].get();
+  }
+
+  template <class LeafType, class Func>
+  void ForEachLeafCell(LeafType &leaf, Func &func) const {
+    offset_t end_x = std::min(leaf.origin[0] + offset_t(LeafSize),
+                              offset_t(width_));
+    offset_t end_y = std::min(leaf.origin[1] + offset_t(LeafSize),
+                              offset_t(height_));
+    offset_t end_z = std::min(leaf.origin[2] + offset_t(LeafSize),
+                              offset_t(depth_));
+    for (offset_t z = leaf.origin[2]; z < end_z; z++) {
+      for (offset_t y = leaf.origin[1]; y < end_y; y++) {
+        for (offset_t x = leaf.origin[0]; x < end_x; x++) {
+          func(x, y, z, leaf.values[leaf_offset(x, y, z)]);
+        }
+      }
+    }
+  }
+
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  ContentType background_;
+  size_t root_x_;
+  size_t root_y_;
+  size_t root_z_;
+  std::vector<int32_t> root_;
+  std::vector<std::unique_ptr<InternalNode>> internals_;
+  std::vector<std::unique_ptr<Leaf>> leaves_;
+};
+}  // namespace grassland::data_structure
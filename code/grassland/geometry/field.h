@@ -84,11 +84,13 @@ class Field {
     set_transform(CreateTransform(delta, offset));
   }
 
-  ContentType &operator()(offset_t x, offset_t y, offset_t z) {
+  // A reference to the cell, or whatever the grid returns instead, e.g. a
+  // decoded value or a proxy for QuantizedGrid.
+  decltype(auto) operator()(offset_t x, offset_t y, offset_t z) {
     return grid_(x, y, z);
   }
 
-  const ContentType &operator()(offset_t x, offset_t y, offset_t z) const {
+  decltype(auto) operator()(offset_t x, offset_t y, offset_t z) const {
     return grid_(x, y, z);
   }
 
@@ -112,6 +114,154 @@ class Field {
                         pos_transformed[2]);
   }
 
+  // Samples at pos with the given kernel, see
+  // data_structure::grid_interpolation_type.
+  ContentType Sample(
+      const Vector3<Scalar> &pos,
+      data_structure::grid_interpolation_type interpolation =
+          data_structure::grid_interpolation_type::linear) const {
+    Vector3<Scalar> pos_transformed = inv_transform_ * pos.homogeneous();
+    return SampleGrid(pos_transformed[0], pos_transformed[1],
+                      pos_transformed[2], interpolation);
+  }
+
+  // Samples at pos and writes the gradient of the interpolant with respect
+  // to the world position to gradient. The derivatives are computed from the
+  // same cells as the value, see data_structure::SampleInterpolatedGradient,
+  // and mapped to world space by the chain rule through the inverse
+  // transform. ContentType must be a scalar.
+  ContentType SampleWithGradient(
+      const Vector3<Scalar> &pos,
+      Vector3<Scalar> *gradient,
+      data_structure::grid_interpolation_type interpolation =
+          data_structure::grid_interpolation_type::linear) const {
+    Vector3<Scalar> grid_pos = inv_transform_ * pos.homogeneous();
+    ContentType grid_gradient[3];
+    ContentType value = SampleGridGradient(grid_pos, interpolation,
+                                           grid_gradient, nullptr);
+    *gradient = GradientToWorld(grid_gradient);
+    return value;
+  }
+
+  // Like SampleWithGradient, and also writes the Hessian with respect to the
+  // world position to hessian.
+  ContentType SampleWithHessian(
+      const Vector3<Scalar> &pos,
+      Vector3<Scalar> *gradient,
+      Matrix3<Scalar> *hessian,
+      data_structure::grid_interpolation_type interpolation =
+          data_structure::grid_interpolation_type::linear) const {
+    Vector3<Scalar> grid_pos = inv_transform_ * pos.homogeneous();
+    ContentType grid_gradient[3];
+    ContentType grid_hessian[9];
+    ContentType value = SampleGridGradient(grid_pos, interpolation,
+                                           grid_gradient, grid_hessian);
+    *gradient = GradientToWorld(grid_gradient);
+    Matrix3<Scalar> h;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        h(i, j) = Scalar(grid_hessian[i * 3 + j]);
+      }
+    }
+    Matrix3<Scalar> linear = inv_transform_.template block<3, 3>(0, 0);
+    *hessian = linear.transpose() * h * linear;
+    return value;
+  }
+
+  void SampleWithGradientBatch(
+      const Vector3<Scalar> *positions,
+      ContentType *values,
+      Vector3<Scalar> *gradients,
+      size_t n,
+      data_structure::grid_interpolation_type interpolation =
+          data_structure::grid_interpolation_type::linear) const {
+    for (size_t i = 0; i < n; i++) {
+      values[i] = SampleWithGradient(positions[i], gradients + i,
+                                     interpolation);
+    }
+  }
+
+  void SampleWithHessianBatch(
+      const Vector3<Scalar> *positions,
+      ContentType *values,
+      Vector3<Scalar> *gradients,
+      Matrix3<Scalar> *hessians,
+      size_t n,
+      data_structure::grid_interpolation_type interpolation =
+          data_structure::grid_interpolation_type::linear) const {
+    for (size_t i = 0; i < n; i++) {
+      values[i] = SampleWithHessian(positions[i], gradients + i, hessians + i,
+                                    interpolation);
+    }
+  }
+
+  // Samples n world positions at once. Positions are transformed to grid
+  // space in blocks, a point at a time, and handed to the grid's
+  // sample_batch when it has one, which computes the trilinear weights a
+  // vector register at a time. Other kernels go to the grid's interpolating
+  // sample_batch, or to data_structure::SampleInterpolatedBatch.
+  void SampleBatch(const Vector3<Scalar> *positions,
+                   ContentType *out,
+                   size_t n,
+                   data_structure::grid_interpolation_type interpolation =
+                       data_structure::grid_interpolation_type::linear) const {
+    Scalar xs[kSampleBatchBlock];
+    Scalar ys[kSampleBatchBlock];
+    Scalar zs[kSampleBatchBlock];
+    for (size_t begin = 0; begin < n; begin += kSampleBatchBlock) {
+      size_t count = std::min(n - begin, kSampleBatchBlock);
+      for (size_t i = 0; i < count; i++) {
+        xs[i] = positions[begin + i][0];
+        ys[i] = positions[begin + i][1];
+        zs[i] = positions[begin + i][2];
+      }
+      SampleGridBatch(xs, ys, zs, out + begin, count, interpolation);
+    }
+  }
+
+  void SampleBatch(const Scalar *xs,
+                   const Scalar *ys,
+                   const Scalar *zs,
+                   ContentType *out,
+                   size_t n,
+                   data_structure::grid_interpolation_type interpolation =
+                       data_structure::grid_interpolation_type::linear) const {
+    Scalar gxs[kSampleBatchBlock];
+    Scalar gys[kSampleBatchBlock];
+    Scalar gzs[kSampleBatchBlock];
+    for (size_t begin = 0; begin < n; begin += kSampleBatchBlock) {
+      size_t count = std::min(n - begin, kSampleBatchBlock);
+      std::copy(xs + begin, xs + begin + count, gxs);
+      std::copy(ys + begin, ys + begin + count, gys);
+      std::copy(zs + begin, zs + begin + count, gzs);
+      SampleGridBatch(gxs, gys, gzs, out + begin, count, interpolation);
+    }
+  }
+
+  // Sets every cell to func(world position of the cell), in parallel on
+  // dense grids, see data_structure::ParallelForEach. Grids that allocate on
+  // write, like SparseGrid, are filled serially.
+  template <class Func>
+  void FillFromFunction(Func &&func,
+                        size_t grain = data_structure::kParallelGrain) {
+    if constexpr (data_structure::IsDenseGrid<GridType>::value) {
+      data_structure::ParallelFill(
+          grid_,
+          [&](offset_t x, offset_t y, offset_t z) {
+            return func(get_position(x, y, z));
+          },
+          grain);
+    } else {
+      for (offset_t z = 0; z < offset_t(depth()); z++) {
+        for (offset_t y = 0; y < offset_t(height()); y++) {
+          for (offset_t x = 0; x < offset_t(width()); x++) {
+            grid_(x, y, z) = func(get_position(x, y, z));
+          }
+        }
+      }
+    }
+  }
+
   size_t width() const {
     return grid_.width();
   }
@@ -151,6 +301,131 @@ class Field {
   }
 
  private:
+  static constexpr size_t kSampleBatchBlock = 256;
+
+  template <class G, class = void>
+  struct HasSampleBatch : std::false_type {};
+
+  template <class G>
+  struct HasSampleBatch<
+      G,
+      std::void_t<decltype(std::declval<const G &>().sample_batch(
+          std::declval<const Scalar *>(), std::declval<const Scalar *>(),
+          std::declval<const Scalar *>(), std::declval<ContentType *>(),
+          size_t{}))>> : std::true_type {};
+
+  template <class G, class = void>
+  struct HasInterpolatedSampleBatch : std::false_type {};
+
+  template <class G>
+  struct HasInterpolatedSampleBatch<
+      G,
+      std::void_t<decltype(std::declval<const G &>().sample_batch(
+          std::declval<const Scalar *>(), std::declval<const Scalar *>(),
+          std::declval<const Scalar *>(), std::declval<ContentType *>(),
+          size_t{}, data_structure::grid_interpolation_type::linear))>>
+      : std::true_type {};
+
+  template <class G, class = void>
+  struct HasInterpolatedSample : std::false_type {};
+
+  template <class G>
+  struct HasInterpolatedSample<
+      G,
+      std::void_t<decltype(std::declval<const G &>().sample(
+          Scalar{}, Scalar{}, Scalar{},
+          data_structure::grid_interpolation_type::linear))>>
+      : std::true_type {};
+
+  // Samples the grid at a grid space position, through the grid's own
+  // interpolating sample() when it has one, so that e.g. ghost layers are
+  // read.
+  ContentType SampleGrid(
+      Scalar x,
+      Scalar y,
+      Scalar z,
+      data_structure::grid_interpolation_type interpolation) const {
+    if (interpolation == data_structure::grid_interpolation_type::linear) {
+      return grid_.sample(x, y, z);
+    }
+    if constexpr (HasInterpolatedSample<GridType>::value) {
+      return grid_.sample(x, y, z, interpolation);
+    } else {
+      return data_structure::SampleInterpolated(grid_, interpolation, x, y, z);
+    }
+  }
+
+  // Grid space derivatives at a grid space position, with the Hessian only
+  // when hessian is not null.
+  ContentType SampleGridGradient(
+      const Vector3<Scalar> &pos,
+      data_structure::grid_interpolation_type interpolation,
+      ContentType *gradient,
+      ContentType *hessian) const {
+    static_assert(std::is_arithmetic_v<ContentType>,
+                  "Derivatives need a scalar ContentType");
+    if constexpr (HasInterpolatedSample<GridType>::value) {
+      if (hessian) {
+        return grid_.sample_hessian(pos[0], pos[1], pos[2], interpolation,
+                                    gradient, hessian);
+      }
+      return grid_.sample_gradient(pos[0], pos[1], pos[2], interpolation,
+                                   gradient);
+    } else {
+      if (hessian) {
+        return data_structure::SampleInterpolatedHessian(
+            grid_, interpolation, pos[0], pos[1], pos[2], gradient, hessian);
+      }
+      return data_structure::SampleInterpolatedGradient(
+          grid_, interpolation, pos[0], pos[1], pos[2], gradient);
+    }
+  }
+
+  Vector3<Scalar> GradientToWorld(const ContentType *gradient) const {
+    return inv_transform_.template block<3, 3>(0, 0).transpose() *
+           Vector3<Scalar>(Scalar(gradient[0]), Scalar(gradient[1]),
+                           Scalar(gradient[2]));
+  }
+
+  // Transforms a block of world positions to grid space in place and samples
+  // them.
+  void SampleGridBatch(Scalar *xs,
+                       Scalar *ys,
+                       Scalar *zs,
+                       ContentType *out,
+                       size_t n,
+                       data_structure::grid_interpolation_type interpolation)
+      const {
+    const Matrix<Scalar, 3, 4> &m = inv_transform_;
+    for (size_t i = 0; i < n; i++) {
+      Scalar x = xs[i], y = ys[i], z = zs[i];
+      xs[i] = m(0, 0) * x + m(0, 1) * y + m(0, 2) * z + m(0, 3);
+      ys[i] = m(1, 0) * x + m(1, 1) * y + m(1, 2) * z + m(1, 3);
+      zs[i] = m(2, 0) * x + m(2, 1) * y + m(2, 2) * z + m(2, 3);
+    }
+    if (interpolation != data_structure::grid_interpolation_type::linear) {
+      // A grid with its own interpolating sample() but no batch version
+      // may read more than operator() does, e.g. ghost layers, so it is
+      // sampled point by point.
+      if constexpr (HasInterpolatedSampleBatch<GridType>::value) {
+        grid_.sample_batch(xs, ys, zs, out, n, interpolation);
+      } else if constexpr (HasInterpolatedSample<GridType>::value) {
+        for (size_t i = 0; i < n; i++) {
+          out[i] = grid_.sample(xs[i], ys[i], zs[i], interpolation);
+        }
+      } else {
+        data_structure::SampleInterpolatedBatch(grid_, interpolation, xs, ys,
+                                                zs, out, n);
+      }
+    } else if constexpr (HasSampleBatch<GridType>::value) {
+      grid_.sample_batch(xs, ys, zs, out, n);
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        out[i] = grid_.sample(xs[i], ys[i], zs[i]);
+      }
+    }
+  }
+
   GridType grid_;
   Matrix<Scalar, 3, 4> transform_;
   Matrix<Scalar, 3, 4> inv_transform_;
@@ -0,0 +1,306 @@
+#pragma once
+#include "cstring"
+#include "fstream"
+#include "grassland/geometry/field.h"
+
+namespace grassland::geometry {
+
+// Binary field files. A file starts with a FieldFileHeader; the cells follow
+// at payload_offset as raw elements in the byte order of the machine that
+// wrote them, cell (x, y, z) at element x * x_stride + y * y_stride + z *
+// z_stride. The header and payload are never byte-swapped: the header's
+// byte_order_mark holds kFieldFileByteOrderMark as written, and readers
+// reject files whose mark does not match theirs. payload_offset is a
+// multiple of kFieldFileAlignment, so a memory mapped payload is page aligned
+// and can be used in place, see MmapField.
+
+enum class field_element_type : uint32_t {
+  opaque = 0,
+  int8,
+  uint8,
+  int16,
+  uint16,
+  int32,
+  uint32,
+  int64,
+  uint64,
+  float32,
+  float64
+};
+
+constexpr char kFieldFileMagic[8] = {'L', 'M', 'F', 'I', 'E', 'L', 'D', '\0'};
+constexpr uint32_t kFieldFileVersion = 1;
+constexpr uint32_t kFieldFileByteOrderMark = 0x01020304;
+constexpr uint64_t kFieldFileAlignment = 4096;
+
+struct FieldFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order_mark;
+  uint32_t header_size;
+  // Type and number of the scalars making up one element, e.g. float32 and 3
+  // for Vector3<float>.
+  uint32_t element_type;
+  uint32_t element_components;
+  uint32_t element_size;
+  uint64_t width;
+  uint64_t height;
+  uint64_t depth;
+  uint64_t x_stride;
+  uint64_t y_stride;
+  uint64_t z_stride;
+  uint64_t payload_offset;
+  uint64_t payload_size;
+  // Grid to world transform, 3x4 row-major.
+  double transform[12];
+};
+
+static_assert(sizeof(FieldFileHeader) == 192,
+              "FieldFileHeader must not contain padding");
+
+template <class T>
+constexpr field_element_type FieldScalarType() {
+  if constexpr (std::is_same_v<T, float>) {
+    return field_element_type::float32;
+  } else if constexpr (std::is_same_v<T, double>) {
+    return field_element_type::float64;
+  } else if constexpr (std::is_integral_v<T> && sizeof(T) == 1) {
+    return std::is_signed_v<T> ? field_element_type::int8
+                               : field_element_type::uint8;
+  } else if constexpr (std::is_integral_v<T> && sizeof(T) == 2) {
+    return std::is_signed_v<T> ? field_element_type::int16
+                               : field_element_type::uint16;
+  } else if constexpr (std::is_integral_v<T> && sizeof(T) == 4) {
+    return std::is_signed_v<T> ? field_element_type::int32
+                               : field_element_type::uint32;
+  } else if constexpr (std::is_integral_v<T> && sizeof(T) == 8) {
+    return std::is_signed_v<T> ? field_element_type::int64
+                               : field_element_type::uint64;
+  } else {
+    return field_element_type::opaque;
+  }
+}
+
+template <class T>
+struct FieldElementTraits {
+  static constexpr field_element_type type = FieldScalarType<T>();
+  static constexpr uint32_t components = 1;
+};
+
+template <class T, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+struct FieldElementTraits<
+    Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>> {
+  static_assert(Rows > 0 && Cols > 0, "Field elements must have fixed size");
+  static constexpr field_element_type type = FieldScalarType<T>();
+  static constexpr uint32_t components = Rows * Cols;
+};
+
+// Returns 0 if header describes a file of file_size bytes holding elements
+// of type ContentType, else logs the problem and returns -1.
+template <class ContentType>
+int ValidateFieldFileHeader(const FieldFileHeader &header,
+                            uint64_t file_size,
+                            const std::string &filename) {
+  if (std::memcmp(header.magic, kFieldFileMagic, sizeof(kFieldFileMagic))) {
+    LogError("{} is not a field file", filename);
+    return -1;
+  }
+  if (header.version != kFieldFileVersion ||
+      header.byte_order_mark != kFieldFileByteOrderMark ||
+      header.header_size < sizeof(FieldFileHeader)) {
+    LogError("{}: unsupported field file version {} or byte order", filename,
+             header.version);
+    return -1;
+  }
+  if (header.element_type !=
+          uint32_t(FieldElementTraits<ContentType>::type) ||
+      header.element_components !=
+          FieldElementTraits<ContentType>::components ||
+      header.element_size != sizeof(ContentType)) {
+    LogError("{}: element type {} x {} ({} bytes) does not match", filename,
+             header.element_type, header.element_components,
+             header.element_size);
+    return -1;
+  }
+  // The header is untrusted: every product and sum below is bounded before
+  // it is formed, so that no field can make them wrap around.
+  if (!header.width || !header.height || !header.depth ||
+      header.x_stride != 1 || header.y_stride < header.width ||
+      header.z_stride / header.height < header.y_stride ||
+      header.payload_offset % alignof(ContentType)) {
+    LogError("{}: invalid layout", filename);
+    return -1;
+  }
+  uint64_t elements = header.payload_size / sizeof(ContentType);
+  if (header.payload_offset > file_size ||
+      header.payload_size > file_size - header.payload_offset ||
+      header.width > elements ||
+      header.height - 1 > (elements - header.width) / header.y_stride) {
+    LogError("{}: file is truncated", filename);
+    return -1;
+  }
+  uint64_t slice_extent = (header.height - 1) * header.y_stride + header.width;
+  if (header.depth - 1 > (elements - slice_extent) / header.z_stride) {
+    LogError("{}: file is truncated", filename);
+    return -1;
+  }
+  return 0;
+}
+
+// Writes the cells of any grid type with width/height/depth and
+// operator()(x, y, z), densely packed, with transform as grid to world
+// transform. Returns 0 on success and -1 on failure.
+template <class GridType>
+int SaveFieldFile(const std::string &filename,
+                  const GridType &grid,
+                  const Matrix<double, 3, 4> &transform) {
+  using ContentType = std::decay_t<decltype(grid(0, 0, 0))>;
+  FieldFileHeader header{};
+  std::memcpy(header.magic, kFieldFileMagic, sizeof(kFieldFileMagic));
+  header.version = kFieldFileVersion;
+  header.byte_order_mark = kFieldFileByteOrderMark;
+  header.header_size = sizeof(FieldFileHeader);
+  header.element_type = uint32_t(FieldElementTraits<ContentType>::type);
+  header.element_components = FieldElementTraits<ContentType>::components;
+  header.element_size = sizeof(ContentType);
+  header.width = grid.width();
+  header.height = grid.height();
+  header.depth = grid.depth();
+  header.x_stride = 1;
+  header.y_stride = header.width;
+  header.z_stride = header.width * header.height;
+  header.payload_offset = kFieldFileAlignment;
+  header.payload_size =
+      header.width * header.height * header.depth * sizeof(ContentType);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      header.transform[i * 4 + j] = transform(i, j);
+    }
+  }
+
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    LogError("Failed to open {} for writing", filename);
+    return -1;
+  }
+  std::vector<char> padding(header.payload_offset - sizeof(header), 0);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(padding.data(), padding.size());
+  std::vector<ContentType> row(header.width);
+  for (offset_t z = 0; z < offset_t(header.depth); z++) {
+    for (offset_t y = 0; y < offset_t(header.height); y++) {
+      for (offset_t x = 0; x < offset_t(header.width); x++) {
+        row[x] = grid(x, y, z);
+      }
+      file.write(reinterpret_cast<const char *>(row.data()),
+                 row.size() * sizeof(ContentType));
+    }
+  }
+  if (!file.good()) {
+    LogError("Failed to write {}", filename);
+    return -1;
+  }
+  return 0;
+}
+
+template <typename ContentType, typename Scalar, typename GridType>
+int SaveField(const std::string &filename,
+              const Field<ContentType, Scalar, GridType> &field) {
+  return SaveFieldFile(filename, field.grid(),
+                       field.get_transform().template cast<double>());
+}
+
+template <class GridType>
+int SaveGrid(const std::string &filename, const GridType &grid) {
+  return SaveFieldFile(filename, grid, Matrix<double, 3, 4>::Identity());
+}
+
+// Reads a whole field file into a new Field backed by a LinearGrid. The
+// template arguments cannot be deduced through double_ptr, e.g.
+// LoadField<float, float>(filename, &field).
+template <typename ContentType, typename Scalar>
+int LoadField(
+    const std::string &filename,
+    double_ptr<
+        Field<ContentType, Scalar, data_structure::LinearGrid<ContentType>>>
+        pp_field) {
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    LogError("Failed to open {}", filename);
+    return -1;
+  }
+  uint64_t file_size = uint64_t(file.tellg());
+  FieldFileHeader header{};
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file.good() ||
+      ValidateFieldFileHeader<ContentType>(header, file_size, filename)) {
+    return -1;
+  }
+
+  Matrix<Scalar, 3, 4> transform;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      transform(i, j) = Scalar(header.transform[i * 4 + j]);
+    }
+  }
+  auto *field = pp_field.construct(header.width, header.height, header.depth,
+                                   transform);
+  auto &grid = field->grid();
+  for (offset_t z = 0; z < offset_t(header.depth); z++) {
+    for (offset_t y = 0; y < offset_t(header.height); y++) {
+      file.seekg(header.payload_offset +
+                 (y * header.y_stride + z * header.z_stride) *
+                     sizeof(ContentType));
+      file.read(reinterpret_cast<char *>(&grid(0, y, z)),
+                header.width * sizeof(ContentType));
+    }
+  }
+  if (!file.good()) {
+    LogError("Failed to read {}", filename);
+    return -1;
+  }
+  return 0;
+}
+
+// Maps a field file into memory and creates a Field whose LinearGridView
+// points into the mapping, so cells are only read from disk when they are
+// accessed. file owns the mapping and must outlive the field. Writes to the
+// field stay in memory and are not saved to the file.
+template <typename ContentType, typename Scalar>
+int MmapField(
+    const std::string &filename,
+    MappedFile &file,
+    double_ptr<
+        Field<ContentType, Scalar, data_structure::LinearGridView<ContentType>>>
+        pp_field) {
+  if (file.Open(filename)) {
+    LogError("Failed to map {}", filename);
+    return -1;
+  }
+  FieldFileHeader header{};
+  if (file.size() < sizeof(header)) {
+    LogError("{} is not a field file", filename);
+    file.Close();
+    return -1;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (ValidateFieldFileHeader<ContentType>(header, file.size(), filename)) {
+    file.Close();
+    return -1;
+  }
+
+  Matrix<Scalar, 3, 4> transform;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      transform(i, j) = Scalar(header.transform[i * 4 + j]);
+    }
+  }
+  data_structure::LinearGridView<ContentType> grid(
+      header.width, header.height, header.depth, header.y_stride,
+      header.z_stride,
+      reinterpret_cast<ContentType *>(file.data() + header.payload_offset));
+  pp_field.construct(transform, grid);
+  return 0;
+}
+}  // namespace grassland::geometry
@@ -0,0 +1,442 @@
+#pragma once
+#include "algorithm"
+#include "functional"
+#include "grassland/geometry/axis_aligned_bounding_box.h"
+#include "grassland/geometry/field.h"
+#include "grassland/geometry/ray.h"
+#include "grassland/util/thread_pool.h"
+#include "queue"
+
+namespace grassland::geometry {
+
+// A hierarchy of coarser versions of a scalar Field for conservative
+// queries. A cell of level l spans 2^l cells of the field along every axis,
+// level 0 being the cells between the samples of the field and the top
+// level a single cell covering all of it. Every level stores the minimum and
+// maximum of the samples in each of its cells, which bound the trilinear
+// interpolation of the field inside the cell, and the levels above 0 also
+// store the field downsampled to their corners.
+//
+// The queries descend from the top and only open cells whose [min, max]
+// meets the value range asked for, skipping the empty space in between.
+// Distances assume the axes of the transform are orthogonal. The pyramid
+// keeps a pointer to the field, call Update() after changing it.
+template <typename ContentType,
+          typename Scalar = float,
+          typename GridType = data_structure::LinearGrid<ContentType>>
+class FieldPyramid {
+ public:
+  static_assert(std::is_arithmetic_v<ContentType>,
+                "FieldPyramid needs a scalar field");
+
+  using FieldType = Field<ContentType, Scalar, GridType>;
+  using LevelGrid = data_structure::LinearGrid<ContentType>;
+
+  explicit FieldPyramid(const FieldType &field) : field_(&field) {
+    Update();
+  }
+
+  // Rebuilds every level from the field, one level after the other with the
+  // cells of a level computed in parallel.
+  void Update() {
+    levels_.clear();
+    offset_t nodes[3] = {offset_t(field_->width()),
+                         offset_t(field_->height()),
+                         offset_t(field_->depth())};
+    offset_t cells[3];
+    for (int axis = 0; axis < 3; axis++) {
+      cells[axis] = std::max(nodes[axis] - 1, offset_t(1));
+    }
+    const GridType &grid = field_->grid();
+    const offset_t empty[3] = {0, 0, 0};
+    levels_.push_back({CreateLevelGrid(empty), CreateLevelGrid(cells),
+                       CreateLevelGrid(cells)});
+    Level &base = levels_.back();
+    ParallelFor(0, cells[2], 1, [&](int64_t z_begin, int64_t z_end) {
+      for (offset_t k = z_begin; k < z_end; k++) {
+        for (offset_t j = 0; j < cells[1]; j++) {
+          for (offset_t i = 0; i < cells[0]; i++) {
+            ContentType lo = grid(i, j, k);
+            ContentType hi = lo;
+            for (int c = 1; c < 8; c++) {
+              ContentType value =
+                  grid(std::min(i + (c & 1), nodes[0] - 1),
+                       std::min(j + ((c >> 1) & 1), nodes[1] - 1),
+                       std::min(k + ((c >> 2) & 1), nodes[2] - 1));
+              lo = std::min(lo, value);
+              hi = std::max(hi, value);
+            }
+            base.min(i, j, k) = lo;
+            base.max(i, j, k) = hi;
+          }
+        }
+      }
+    });
+
+    while (cells[0] > 1 || cells[1] > 1 || cells[2] > 1) {
+      const offset_t fine_nodes[3] = {nodes[0], nodes[1], nodes[2]};
+      const offset_t fine_cells[3] = {cells[0], cells[1], cells[2]};
+      for (int axis = 0; axis < 3; axis++) {
+        nodes[axis] = nodes[axis] > 1 ? nodes[axis] / 2 + 1 : 1;
+        cells[axis] = (cells[axis] + 1) / 2;
+      }
+      const Level &fine = levels_.back();
+      Level coarse{CreateLevelGrid(nodes), CreateLevelGrid(cells),
+                   CreateLevelGrid(cells)};
+      const bool from_field = levels_.size() == 1;
+      // Full weighting: the corner and its fine neighbors weighted by
+      // (1/4, 1/2, 1/4) along every axis, clamped to the edge.
+      auto fine_sample = [&](offset_t x, offset_t y, offset_t z) {
+        x = std::clamp(x, offset_t(0), fine_nodes[0] - 1);
+        y = std::clamp(y, offset_t(0), fine_nodes[1] - 1);
+        z = std::clamp(z, offset_t(0), fine_nodes[2] - 1);
+        return from_field ? ContentType(grid(x, y, z))
+                          : fine.sample(x, y, z);
+      };
+      ParallelFor(0, nodes[2], 1, [&](int64_t z_begin, int64_t z_end) {
+        for (offset_t k = z_begin; k < z_end; k++) {
+          for (offset_t j = 0; j < nodes[1]; j++) {
+            for (offset_t i = 0; i < nodes[0]; i++) {
+              Scalar sum = 0;
+              for (offset_t dz = -1; dz <= 1; dz++) {
+                for (offset_t dy = -1; dy <= 1; dy++) {
+                  for (offset_t dx = -1; dx <= 1; dx++) {
+                    Scalar weight = Scalar(1) / ((1 << std::abs(dx)) *
+                                                 (1 << std::abs(dy)) *
+                                                 (1 << std::abs(dz)) * 8);
+                    sum += weight *
+                           fine_sample(2 * i + dx, 2 * j + dy, 2 * k + dz);
+                  }
+                }
+              }
+              coarse.sample(i, j, k) = ContentType(sum);
+            }
+          }
+        }
+      });
+      ParallelFor(0, cells[2], 1, [&](int64_t z_begin, int64_t z_end) {
+        for (offset_t k = z_begin; k < z_end; k++) {
+          for (offset_t j = 0; j < cells[1]; j++) {
+            for (offset_t i = 0; i < cells[0]; i++) {
+              ContentType lo = fine.min(2 * i, 2 * j, 2 * k);
+              ContentType hi = fine.max(2 * i, 2 * j, 2 * k);
+              for (int c = 1; c < 8; c++) {
+                offset_t x = std::min(2 * i + (c & 1), fine_cells[0] - 1);
+                offset_t y =
+                    std::min(2 * j + ((c >> 1) & 1), fine_cells[1] - 1);
+                offset_t z =
+                    std::min(2 * k + ((c >> 2) & 1), fine_cells[2] - 1);
+                lo = std::min(lo, fine.min(x, y, z));
+                hi = std::max(hi, fine.max(x, y, z));
+              }
+              coarse.min(i, j, k) = lo;
+              coarse.max(i, j, k) = hi;
+            }
+          }
+        }
+      });
+      levels_.push_back(std::move(coarse));
+    }
+  }
+
+  const FieldType &field() const {
+    return *field_;
+  }
+
+  size_t num_levels() const {
+    return levels_.size();
+  }
+
+  // The field downsampled to the corners of the cells of the level, corner
+  // (i, j, k) lying at grid position 2^level * (i, j, k). Empty for level 0,
+  // whose corners are the samples of the field.
+  const LevelGrid &sample(int level) const {
+    return levels_[level].sample;
+  }
+
+  // Bounds of the field over the cells of the level.
+  const LevelGrid &min(int level) const {
+    return levels_[level].min;
+  }
+
+  const LevelGrid &max(int level) const {
+    return levels_[level].max;
+  }
+
+  // The transform of the field with the spacing of the level.
+  Matrix<Scalar, 3, 4> level_transform(int level) const {
+    Matrix<Scalar, 3, 4> transform = field_->get_transform();
+    transform.template block<3, 3>(0, 0) *= Scalar(offset_t(1) << level);
+    return transform;
+  }
+
+  // Calls func(i, j, k) for the cells of the field whose values may meet
+  // [lo, hi], e.g. lo = hi = isolevel for the cells an isosurface may cross.
+  // The others are never visited.
+  template <class Func>
+  void ForEachCell(ContentType lo, ContentType hi, Func &&func) const {
+    Descend(
+        top(), 0, 0, 0, lo, hi,
+        [](const Vector3<Scalar> &, const Vector3<Scalar> &) { return true; },
+        [&](offset_t i, offset_t j, offset_t k) {
+          func(i, j, k);
+          return false;
+        });
+  }
+
+  // Whether the field may take a value in [lo, hi] inside the world space
+  // box, e.g. for a broad phase against the inside of a signed distance
+  // field with lo = lowest and hi = 0. False is exact, true is conservative.
+  bool MayContain(const AABB3<Scalar> &box,
+                  ContentType lo,
+                  ContentType hi) const {
+    Vector3<Scalar> box_min = Vector3<Scalar>::Constant(
+        std::numeric_limits<Scalar>::max());
+    Vector3<Scalar> box_max = -box_min;
+    for (int c = 0; c < 8; c++) {
+      Vector3<Scalar> corner((c & 1) ? box.max_bound[0] : box.min_bound[0],
+                             (c & 2) ? box.max_bound[1] : box.min_bound[1],
+                             (c & 4) ? box.max_bound[2] : box.min_bound[2]);
+      Vector3<Scalar> pos = field_->to_grid_position(corner);
+      box_min = box_min.cwiseMin(pos);
+      box_max = box_max.cwiseMax(pos);
+    }
+    return Descend(
+        top(), 0, 0, 0, lo, hi,
+        [&](const Vector3<Scalar> &cell_min, const Vector3<Scalar> &cell_max) {
+          return (cell_min.array() <= box_max.array()).all() &&
+                 (box_min.array() <= cell_max.array()).all();
+        },
+        [](offset_t, offset_t, offset_t) { return true; });
+  }
+
+  // A lower bound of the world space distance from pos to the points where
+  // the field may take a value in [lo, hi]: the distance to the nearest
+  // cell of the field whose values meet the range. Answers "is pos at least
+  // r away from the surface" with DistanceLowerBound(pos, 0, 0, r) >= r.
+  // The search gives up and returns max_distance once nothing nearer than
+  // max_distance is left.
+  Scalar DistanceLowerBound(
+      const Vector3<Scalar> &pos,
+      ContentType lo,
+      ContentType hi,
+      Scalar max_distance = std::numeric_limits<Scalar>::infinity()) const {
+    Vector3<Scalar> grid_pos = field_->to_grid_position(pos);
+    Matrix<Scalar, 3, 4> transform = field_->get_transform();
+    Vector3<Scalar> spacing(transform.col(0).norm(), transform.col(1).norm(),
+                            transform.col(2).norm());
+    auto distance = [&](int level, offset_t i, offset_t j, offset_t k) {
+      Vector3<Scalar> cell_min, cell_max;
+      CellBox(level, i, j, k, &cell_min, &cell_max);
+      Vector3<Scalar> gap = (cell_min - grid_pos)
+                                .cwiseMax(grid_pos - cell_max)
+                                .cwiseMax(Vector3<Scalar>::Zero());
+      return gap.cwiseProduct(spacing).norm();
+    };
+    struct Entry {
+      Scalar distance;
+      int level;
+      offset_t i, j, k;
+      bool operator>(const Entry &other) const {
+        return distance > other.distance;
+      }
+    };
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    int level = top();
+    if (Overlaps(level, 0, 0, 0, lo, hi)) {
+      heap.push({distance(level, 0, 0, 0), level, 0, 0, 0});
+    }
+    while (!heap.empty()) {
+      Entry entry = heap.top();
+      heap.pop();
+      if (entry.distance >= max_distance) {
+        break;
+      }
+      if (!entry.level) {
+        return entry.distance;
+      }
+      ForEachChild(entry.level, entry.i, entry.j, entry.k,
+                   [&](offset_t i, offset_t j, offset_t k) {
+                     if (Overlaps(entry.level - 1, i, j, k, lo, hi)) {
+                       heap.push({distance(entry.level - 1, i, j, k),
+                                  entry.level - 1, i, j, k});
+                     }
+                   });
+    }
+    return max_distance;
+  }
+
+  // Empty space skipping for ray marching: the smallest t in [t_min, t_max]
+  // at which the ray enters a cell of the field whose values may meet
+  // [lo, hi], stored in *t. Returns false when the ray meets no such cell,
+  // so the whole interval can be skipped.
+  bool FirstCandidate(const Ray3<Scalar> &ray,
+                      Scalar t_min,
+                      Scalar t_max,
+                      ContentType lo,
+                      ContentType hi,
+                      Scalar *t) const {
+    // Affine maps keep the ray parameter, so the ray is traced in grid space.
+    Vector3<Scalar> origin = field_->to_grid_position(ray.origin);
+    Vector3<Scalar> direction =
+        field_->get_inv_transform().template block<3, 3>(0, 0) *
+        ray.direction;
+    Vector3<Scalar> inv_direction = direction.cwiseInverse();
+    // The parameter interval of the ray inside the cell, empty if t_enter
+    // is greater than t_exit.
+    auto clip = [&](int level, offset_t i, offset_t j, offset_t k,
+                    Scalar *t_enter, Scalar *t_exit) {
+      Vector3<Scalar> cell_min, cell_max;
+      CellBox(level, i, j, k, &cell_min, &cell_max);
+      *t_enter = t_min;
+      *t_exit = t_max;
+      for (int axis = 0; axis < 3; axis++) {
+        if (direction[axis] == 0) {
+          if (origin[axis] < cell_min[axis] || origin[axis] > cell_max[axis]) {
+            *t_enter = std::numeric_limits<Scalar>::infinity();
+          }
+          continue;
+        }
+        Scalar t0 = (cell_min[axis] - origin[axis]) * inv_direction[axis];
+        Scalar t1 = (cell_max[axis] - origin[axis]) * inv_direction[axis];
+        *t_enter = std::max(*t_enter, std::min(t0, t1));
+        *t_exit = std::min(*t_exit, std::max(t0, t1));
+      }
+    };
+    // Children are visited by entry parameter, so the first hit is nearest:
+    // the intervals of disjoint cells along a ray do not overlap.
+    std::function<bool(int, offset_t, offset_t, offset_t, Scalar)> trace =
+        [&](int level, offset_t i, offset_t j, offset_t k, Scalar t_enter) {
+          if (!level) {
+            *t = t_enter;
+            return true;
+          }
+          std::pair<Scalar, int> children[8];
+          offset_t child_index[8][3];
+          int count = 0;
+          ForEachChild(level, i, j, k, [&](offset_t x, offset_t y, offset_t z) {
+            Scalar enter, exit;
+            clip(level - 1, x, y, z, &enter, &exit);
+            if (enter <= exit && Overlaps(level - 1, x, y, z, lo, hi)) {
+              child_index[count][0] = x;
+              child_index[count][1] = y;
+              child_index[count][2] = z;
+              // Insertion into the children sorted by entry parameter.
+              int c = count++;
+              for (; c > 0 && enter < children[c - 1].first; c--) {
+                children[c] = children[c - 1];
+              }
+              children[c] = {enter, count - 1};
+            }
+          });
+          for (int c = 0; c < count; c++) {
+            const offset_t *index = child_index[children[c].second];
+            if (trace(level - 1, index[0], index[1], index[2],
+                      children[c].first)) {
+              return true;
+            }
+          }
+          return false;
+        };
+    Scalar enter, exit;
+    clip(top(), 0, 0, 0, &enter, &exit);
+    return enter <= exit && Overlaps(top(), 0, 0, 0, lo, hi) &&
+           trace(top(), 0, 0, 0, enter);
+  }
+
+ private:
+  struct Level {
+    LevelGrid sample;
+    LevelGrid min;
+    LevelGrid max;
+  };
+
+  static LevelGrid CreateLevelGrid(const offset_t (&size)[3]) {
+    return LevelGrid(size_t(size[0]), size_t(size[1]), size_t(size[2]));
+  }
+
+  int top() const {
+    return int(levels_.size()) - 1;
+  }
+
+  bool Overlaps(int level,
+                offset_t i,
+                offset_t j,
+                offset_t k,
+                ContentType lo,
+                ContentType hi) const {
+    const Level &l = levels_[level];
+    return l.min(i, j, k) <= hi && lo <= l.max(i, j, k);
+  }
+
+  // The grid space box of a cell, clamped to the samples of the field.
+  void CellBox(int level,
+               offset_t i,
+               offset_t j,
+               offset_t k,
+               Vector3<Scalar> *cell_min,
+               Vector3<Scalar> *cell_max) const {
+    const offset_t index[3] = {i, j, k};
+    const offset_t last[3] = {offset_t(field_->width()) - 1,
+                              offset_t(field_->height()) - 1,
+                              offset_t(field_->depth()) - 1};
+    for (int axis = 0; axis < 3; axis++) {
+      (*cell_min)[axis] = Scalar(std::min(index[axis] << level, last[axis]));
+      (*cell_max)[axis] =
+          Scalar(std::min((index[axis] + 1) << level, last[axis]));
+    }
+  }
+
+  template <class Func>
+  void ForEachChild(int level,
+                    offset_t i,
+                    offset_t j,
+                    offset_t k,
+                    Func &&func) const {
+    const LevelGrid &fine = levels_[level - 1].min;
+    for (offset_t z = 2 * k; z < std::min(2 * k + 2, offset_t(fine.depth()));
+         z++) {
+      for (offset_t y = 2 * j;
+           y < std::min(2 * j + 2, offset_t(fine.height())); y++) {
+        for (offset_t x = 2 * i;
+             x < std::min(2 * i + 2, offset_t(fine.width())); x++) {
+          func(x, y, z);
+        }
+      }
+    }
+  }
+
+  // Depth first traversal of the cells meeting [lo, hi] whose grid space
+  // box passes overlap. visit(i, j, k) is called on the cells of level 0 and
+  // returns true to stop, which Descend returns.
+  template <class Overlap, class Visit>
+  bool Descend(int level,
+               offset_t i,
+               offset_t j,
+               offset_t k,
+               ContentType lo,
+               ContentType hi,
+               const Overlap &overlap,
+               const Visit &visit) const {
+    if (!Overlaps(level, i, j, k, lo, hi)) {
+      return false;
+    }
+    Vector3<Scalar> cell_min, cell_max;
+    CellBox(level, i, j, k, &cell_min, &cell_max);
+    if (!overlap(cell_min, cell_max)) {
+      return false;
+    }
+    if (!level) {
+      return visit(i, j, k);
+    }
+    bool stop = false;
+    ForEachChild(level, i, j, k, [&](offset_t x, offset_t y, offset_t z) {
+      stop = stop || Descend(level - 1, x, y, z, lo, hi, overlap, visit);
+    });
+    return stop;
+  }
+
+  const FieldType *field_;
+  std::vector<Level> levels_;
+};
+}  // namespace grassland::geometry
@@ -0,0 +1,340 @@
+#pragma once
+#include "array"
+#include "atomic"
+#include "functional"
+#include "grassland/geometry/field.h"
+#include "grassland/util/thread_pool.h"
+#include "limits"
+#include "queue"
+
+namespace grassland::geometry {
+
+enum class redistance_method { fast_sweeping = 0, fast_marching };
+
+template <typename Scalar>
+struct RedistanceSettings {
+  redistance_method method{redistance_method::fast_sweeping};
+  // Distances are clamped to [-band, band] in world units. Fast marching
+  // stops once it has passed the band, so a narrow band is much cheaper.
+  Scalar band{std::numeric_limits<Scalar>::infinity()};
+  // Rounds of 8 sweeps fast sweeping runs at most. It stops earlier when a
+  // round no longer lowers any distance by more than 0.05 cells.
+  int max_iterations{4};
+  // Edge length of the tiles fast sweeping hands to the threads.
+  int tile_size{16};
+};
+
+namespace detail {
+constexpr uint8_t kRedistanceFar = 0;
+constexpr uint8_t kRedistanceTrial = 1;
+constexpr uint8_t kRedistanceKnown = 2;
+
+// The upwind update of the Eikonal equation |grad u| = 1 on cells of size
+// h: the smallest u with sum_i ((u - a[i]) / h[i])^2 = 1 over the axes with
+// a[i] < u, where a[i] is the nearer neighbor along axis i. The sums of the
+// weights 1 / h^2 are inverted once, leaving a square root per term.
+template <typename Scalar>
+struct EikonalStencil {
+  explicit EikonalStencil(const Scalar (&h)[3]) {
+    for (int i = 0; i < 3; i++) {
+      this->h[i] = h[i];
+      w[i] = 1 / (h[i] * h[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+      pair_w[i] = w[(i + 1) % 3] + w[(i + 2) % 3];
+      inv_pair_w[i] = 1 / pair_w[i];
+    }
+    inv_w = 1 / (w[0] + w[1] + w[2]);
+    lower_bound = std::sqrt(inv_w);
+  }
+
+  Scalar Solve(const Scalar a[3]) const {
+    int i0 = 0, i1 = 1, i2 = 2;
+    if (a[i1] < a[i0]) {
+      std::swap(i0, i1);
+    }
+    if (a[i2] < a[i1]) {
+      std::swap(i1, i2);
+    }
+    if (a[i1] < a[i0]) {
+      std::swap(i0, i1);
+    }
+    Scalar u = a[i0] + h[i0];
+    if (u <= a[i1]) {
+      return u;
+    }
+    Scalar d01 = a[i0] - a[i1];
+    u = (w[i0] * a[i0] + w[i1] * a[i1] +
+         std::sqrt(pair_w[i2] - w[i0] * w[i1] * d01 * d01)) *
+        inv_pair_w[i2];
+    if (u <= a[i2]) {
+      return u;
+    }
+    Scalar d02 = a[i0] - a[i2];
+    Scalar d12 = a[i1] - a[i2];
+    Scalar discriminant = pair_w[i2] + w[i2] - w[i0] * w[i1] * d01 * d01 -
+                          w[i0] * w[i2] * d02 * d02 -
+                          w[i1] * w[i2] * d12 * d12;
+    return (w[i0] * a[i0] + w[i1] * a[i1] + w[i2] * a[i2] +
+            std::sqrt(std::max(discriminant, Scalar(0)))) *
+           inv_w;
+  }
+
+  Scalar h[3];
+  Scalar w[3];
+  // Sums of the weights of the two axes other than i, and their inverses.
+  Scalar pair_w[3];
+  Scalar inv_pair_w[3];
+  Scalar inv_w;
+  // No update is below min(a) + lower_bound.
+  Scalar lower_bound;
+};
+}  // namespace detail
+
+// Turns a level set into the signed distance to its zero crossing, in place.
+// Negative values are inside. Cells next to a sign change keep their distance
+// estimated from linear interpolation of the crossings along the axes, the
+// others are solved from the Eikonal equation with the cell spacing of the
+// transform, assumed to have orthogonal axes. Cells farther than
+// settings.band are clamped to +-band. A field without sign change is left
+// untouched.
+//
+// fast_sweeping runs Gauss-Seidel sweeps in the 8 axis orderings over the
+// whole grid. Each sweep visits tiles of settings.tile_size cells along
+// diagonal fronts, the tiles of a front are independent and run in parallel
+// on the global pool, and the result does not depend on the thread count.
+// fast_marching grows the distance from the surface in order with a heap on
+// one thread and stops at the band.
+//
+// Every cell of the field is rewritten in parallel, so the grid must be
+// dense: a narrow-band SparseGrid would be densified and could not be
+// written from several threads.
+template <typename Scalar, typename GridType>
+void Redistance(Field<Scalar, Scalar, GridType> &field,
+                const RedistanceSettings<Scalar> &settings = {}) {
+  static_assert(data_structure::IsDenseGrid<GridType>::value,
+                "Redistance needs a dense grid");
+  using data_structure::grid_boundary_type;
+  using data_structure::LinearGrid;
+  using data_structure::offset_t;
+  constexpr Scalar kInfinity = std::numeric_limits<Scalar>::infinity();
+  const offset_t width = field.width();
+  const offset_t height = field.height();
+  const offset_t depth = field.depth();
+  if (!width || !height || !depth) {
+    return;
+  }
+  Matrix<Scalar, 3, 4> transform = field.get_transform();
+  const Scalar h[3] = {transform.col(0).norm(), transform.col(1).norm(),
+                       transform.col(2).norm()};
+  const detail::EikonalStencil<Scalar> stencil(h);
+
+  // The level set, distances and states share one layout with a ghost layer,
+  // so the stencils below run on offsets without bounds checks. Ghost cells
+  // repeat the level set, are infinitely far and count as known.
+  LinearGrid<Scalar> phi(width, height, depth, 1, grid_boundary_type::clamp);
+  LinearGrid<Scalar> distance(width, height, depth, 1,
+                              grid_boundary_type::constant, kInfinity,
+                              kInfinity);
+  LinearGrid<uint8_t> state(width, height, depth, 1,
+                            grid_boundary_type::constant,
+                            detail::kRedistanceFar, detail::kRedistanceKnown);
+  const offset_t strides[3] = {1, offset_t(phi.y_stride()),
+                               offset_t(phi.z_stride())};
+  const GridType &grid = field.grid();
+  ParallelFor(0, depth, 1, [&](int64_t z_begin, int64_t z_end) {
+    for (offset_t z = z_begin; z < z_end; z++) {
+      for (offset_t y = 0; y < height; y++) {
+        for (offset_t x = 0; x < width; x++) {
+          phi(x, y, z) = grid(x, y, z);
+        }
+      }
+    }
+  });
+  phi.UpdateGhosts();
+
+  std::atomic<bool> has_interface{false};
+  ParallelFor(0, depth, 1, [&](int64_t z_begin, int64_t z_end) {
+    bool found = false;
+    for (offset_t z = z_begin; z < z_end; z++) {
+      for (offset_t y = 0; y < height; y++) {
+        for (offset_t x = 0; x < width; x++) {
+          offset_t offset = phi.offset(x, y, z);
+          Scalar value = phi[offset];
+          bool inside = value < 0;
+          Scalar inv_square_sum = 0;
+          bool crossing = false;
+          for (int axis = 0; axis < 3; axis++) {
+            Scalar nearest = kInfinity;
+            for (offset_t step : {-strides[axis], strides[axis]}) {
+              Scalar neighbor = phi[offset + step];
+              if ((neighbor < 0) != inside) {
+                nearest =
+                    std::min(nearest, h[axis] * value / (value - neighbor));
+              }
+            }
+            if (nearest < kInfinity) {
+              crossing = true;
+              inv_square_sum += 1 / (nearest * nearest);
+            }
+          }
+          if (crossing) {
+            distance[offset] = 1 / std::sqrt(inv_square_sum);
+            state[offset] = detail::kRedistanceKnown;
+            found = true;
+          }
+        }
+      }
+    }
+    if (found) {
+      has_interface = true;
+    }
+  });
+  if (!has_interface) {
+    return;
+  }
+
+  if (settings.method == redistance_method::fast_marching) {
+    using Entry = std::pair<Scalar, offset_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    // Nearer known neighbor of a cell along every axis.
+    auto known_neighbors = [&](offset_t offset, Scalar a[3]) {
+      for (int axis = 0; axis < 3; axis++) {
+        a[axis] = kInfinity;
+        for (offset_t step : {-strides[axis], strides[axis]}) {
+          if (state[offset + step] == detail::kRedistanceKnown) {
+            a[axis] = std::min(a[axis], distance[offset + step]);
+          }
+        }
+      }
+    };
+    auto update_neighbors = [&](offset_t offset) {
+      for (int axis = 0; axis < 3; axis++) {
+        for (offset_t step : {-strides[axis], strides[axis]}) {
+          offset_t neighbor = offset + step;
+          if (state[neighbor] == detail::kRedistanceKnown) {
+            continue;
+          }
+          Scalar a[3];
+          known_neighbors(neighbor, a);
+          Scalar u = stencil.Solve(a);
+          if (u < distance[neighbor]) {
+            distance[neighbor] = u;
+            state[neighbor] = detail::kRedistanceTrial;
+            heap.emplace(u, neighbor);
+          }
+        }
+      }
+    };
+    for (offset_t z = 0; z < depth; z++) {
+      for (offset_t y = 0; y < height; y++) {
+        for (offset_t x = 0; x < width; x++) {
+          offset_t offset = distance.offset(x, y, z);
+          if (state[offset] == detail::kRedistanceKnown) {
+            update_neighbors(offset);
+          }
+        }
+      }
+    }
+    while (!heap.empty()) {
+      auto [u, offset] = heap.top();
+      heap.pop();
+      if (state[offset] == detail::kRedistanceKnown ||
+          u > distance[offset]) {
+        continue;
+      }
+      if (u > settings.band) {
+        break;
+      }
+      state[offset] = detail::kRedistanceKnown;
+      update_neighbors(offset);
+    }
+  } else {
+    const offset_t tile = std::max(settings.tile_size, 1);
+    const offset_t tiles[3] = {(width + tile - 1) / tile,
+                               (height + tile - 1) / tile,
+                               (depth + tile - 1) / tile};
+    // Tiles of the sweep in the positive direction grouped by front.
+    std::vector<std::vector<std::array<offset_t, 3>>> fronts(
+        tiles[0] + tiles[1] + tiles[2] - 2);
+    for (offset_t tz = 0; tz < tiles[2]; tz++) {
+      for (offset_t ty = 0; ty < tiles[1]; ty++) {
+        for (offset_t tx = 0; tx < tiles[0]; tx++) {
+          fronts[tx + ty + tz].push_back({tx, ty, tz});
+        }
+      }
+    }
+    const Scalar tolerance = Scalar(0.05) * std::min({h[0], h[1], h[2]});
+    const offset_t size[3] = {width, height, depth};
+    for (int iteration = 0; iteration < settings.max_iterations;
+         iteration++) {
+      std::atomic<bool> changed{false};
+      for (int ordering = 0; ordering < 8; ordering++) {
+        bool reverse[3] = {bool(ordering & 1), bool(ordering & 2),
+                           bool(ordering & 4)};
+        for (const auto &front : fronts) {
+          ParallelFor(0, front.size(), 1, [&](int64_t begin, int64_t end) {
+            bool tile_changed = false;
+            for (int64_t t = begin; t < end; t++) {
+              offset_t first[3], last[3], step[3];
+              for (int axis = 0; axis < 3; axis++) {
+                offset_t index = front[t][axis];
+                if (reverse[axis]) {
+                  index = tiles[axis] - 1 - index;
+                }
+                offset_t lo = index * tile;
+                offset_t hi = std::min(lo + tile, size[axis]) - 1;
+                first[axis] = reverse[axis] ? hi : lo;
+                last[axis] = reverse[axis] ? lo - 1 : hi + 1;
+                step[axis] = reverse[axis] ? -1 : 1;
+              }
+              for (offset_t z = first[2]; z != last[2]; z += step[2]) {
+                for (offset_t y = first[1]; y != last[1]; y += step[1]) {
+                  for (offset_t x = first[0]; x != last[0]; x += step[0]) {
+                    offset_t offset = distance.offset(x, y, z);
+                    if (state[offset] == detail::kRedistanceKnown) {
+                      continue;
+                    }
+                    const Scalar *d = &distance[offset];
+                    const Scalar a[3] = {
+                        std::min(d[-strides[0]], d[strides[0]]),
+                        std::min(d[-strides[1]], d[strides[1]]),
+                        std::min(d[-strides[2]], d[strides[2]])};
+                    if (std::min({a[0], a[1], a[2]}) + stencil.lower_bound >=
+                        *d) {
+                      continue;
+                    }
+                    Scalar u = stencil.Solve(a);
+                    if (u < *d) {
+                      tile_changed |= u < distance[offset] - tolerance;
+                      distance[offset] = u;
+                    }
+                  }
+                }
+              }
+            }
+            if (tile_changed) {
+              changed = true;
+            }
+          });
+        }
+      }
+      if (!changed) {
+        break;
+      }
+    }
+  }
+
+  ParallelFor(0, depth, 1, [&](int64_t z_begin, int64_t z_end) {
+    for (offset_t z = z_begin; z < z_end; z++) {
+      for (offset_t y = 0; y < height; y++) {
+        for (offset_t x = 0; x < width; x++) {
+          offset_t offset = distance.offset(x, y, z);
+          Scalar d = std::min(distance[offset], settings.band);
+          field(x, y, z) = phi[offset] < 0 ? -d : d;
+        }
+      }
+    }
+  });
+}
+}  // namespace grassland::geometry
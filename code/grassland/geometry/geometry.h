@@ -1,10 +1,15 @@
 #pragma once
+#include "grassland/geometry/anisotropic_point_to_mesh.h"
 #include "grassland/geometry/area_volume.h"
 #include "grassland/geometry/axis_aligned_bounding_box.h"
 #include "grassland/geometry/continuous_collision_detection.h"
 #include "grassland/geometry/field.h"
+#include "grassland/geometry/field_io.h"
+#include "grassland/geometry/field_pyramid.h"
+#include "grassland/geometry/field_redistance.h"
 #include "grassland/geometry/marching_cubes.h"
 #include "grassland/geometry/mesh.h"
+#include "grassland/geometry/point_hash_grid.h"
 #include "grassland/geometry/point_to_mesh.h"
 #include "grassland/geometry/ray.h"
 #include "grassland/geometry/spd_projection.h"
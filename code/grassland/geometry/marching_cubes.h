@@ -6,6 +6,7 @@
 #pragma once
 
 #include "grassland/geometry/field.h"
+#include "grassland/geometry/field_pyramid.h"
 #include "grassland/geometry/mesh.h"
 
 namespace grassland::geometry {
@@ -34,7 +35,7 @@ struct MarchingCubeConstructor {
   }
 
   void Construct(std::vector<Vector3<Scalar>> &vertices) {
-    int edge_table[256] = {
+    static const int edge_table[256] = {
         0x0,   0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905,
         0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00, 0x190, 0x99,  0x393, 0x29a,
         0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93,
@@ -61,7 +62,7 @@ struct MarchingCubeConstructor {
         0x895, 0x99c, 0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99,  0x190,
         0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c, 0x70c, 0x605,
         0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0};
-    int tri_table[256][16] = {
+    static const int tri_table[256][16] = {
         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
         {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
         {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
@@ -369,49 +370,197 @@ struct MarchingCubeConstructor {
   }
 };
 
+template <typename ContentType, typename Scalar, typename GridType>
+void MarchingCubesCell(const Field<ContentType, Scalar, GridType> &field,
+                       offset_t i,
+                       offset_t j,
+                       offset_t k,
+                       ContentType isolevel,
+                       std::vector<Vector3<Scalar>> &positions) {
+  MarchingCubeConstructor<ContentType, Scalar> constructor;
+  constructor.val[0] = field(i, j, k);
+  constructor.val[1] = field(i + 1, j, k);
+  constructor.val[2] = field(i + 1, j, k + 1);
+  constructor.val[3] = field(i, j, k + 1);
+  constructor.val[4] = field(i, j + 1, k);
+  constructor.val[5] = field(i + 1, j + 1, k);
+  constructor.val[6] = field(i + 1, j + 1, k + 1);
+  constructor.val[7] = field(i, j + 1, k + 1);
+  int below = 0;
+  for (int c = 0; c < 8; c++) {
+    below += constructor.val[c] < isolevel;
+  }
+  if (below == 0 || below == 8) {
+    return;
+  }
+  constructor.pos[0] = field.get_position(i, j, k);
+  constructor.pos[1] = field.get_position(i + 1, j, k);
+  constructor.pos[2] = field.get_position(i + 1, j, k + 1);
+  constructor.pos[3] = field.get_position(i, j, k + 1);
+  constructor.pos[4] = field.get_position(i, j + 1, k);
+  constructor.pos[5] = field.get_position(i + 1, j + 1, k);
+  constructor.pos[6] = field.get_position(i + 1, j + 1, k + 1);
+  constructor.pos[7] = field.get_position(i, j + 1, k + 1);
+  constructor.isolevel = isolevel;
+  constructor.Construct(positions);
+}
+
+template <typename Scalar>
+Mesh<Scalar> MarchingCubesMesh(const std::vector<Vector3<Scalar>> &positions) {
+  std::vector<uint32_t> indices(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    indices[i] = i;
+  }
+
+  Mesh<Scalar> mesh{positions.size(), indices.size(), indices.data(),
+                    positions.data()};
+  mesh.MergeVertices();
+  return mesh;
+}
+
 template <typename ContentType,
           typename Scalar = float,
           typename GridType = data_structure::LinearGrid<ContentType>>
 Mesh<Scalar> MarchingCubes(const Field<ContentType, Scalar, GridType> &field,
                            ContentType isolevel = 0) {
-  const GridType &grid = field.grid();
   std::vector<Vector3<Scalar>> positions;
 
   for (size_t i = 0; i < field.width() - 1; i++) {
     for (size_t j = 0; j < field.height() - 1; j++) {
       for (size_t k = 0; k < field.depth() - 1; k++) {
-        MarchingCubeConstructor<ContentType, Scalar> constructor;
-        constructor.val[0] = field(i, j, k);
-        constructor.val[1] = field(i + 1, j, k);
-        constructor.val[2] = field(i + 1, j, k + 1);
-        constructor.val[3] = field(i, j, k + 1);
-        constructor.val[4] = field(i, j + 1, k);
-        constructor.val[5] = field(i + 1, j + 1, k);
-        constructor.val[6] = field(i + 1, j + 1, k + 1);
-        constructor.val[7] = field(i, j + 1, k + 1);
-        constructor.pos[0] = field.get_position(i, j, k);
-        constructor.pos[1] = field.get_position(i + 1, j, k);
-        constructor.pos[2] = field.get_position(i + 1, j, k + 1);
-        constructor.pos[3] = field.get_position(i, j, k + 1);
-        constructor.pos[4] = field.get_position(i, j + 1, k);
-        constructor.pos[5] = field.get_position(i + 1, j + 1, k);
-        constructor.pos[6] = field.get_position(i + 1, j + 1, k + 1);
-        constructor.pos[7] = field.get_position(i, j + 1, k + 1);
-        constructor.isolevel = isolevel;
-        constructor.Construct(positions);
+        MarchingCubesCell(field, i, j, k, isolevel, positions);
       }
     }
   }
 
-  std::vector<uint32_t> indices(positions.size());
-  for (size_t i = 0; i < positions.size(); i++) {
-    indices[i] = i;
+  return MarchingCubesMesh(positions);
+}
+
+// Meshes an out-of-core grid brick by brick: each brick is copied with a
+// margin of one cell into a LinearGrid and meshed as a field of its own.
+// Bricks are visited in index order, so with a cache holding a layer of
+// bricks every brick is loaded once. transform maps grid coordinates to
+// world space like the transform of a Field.
+template <typename ContentType, size_t BrickSize, typename Scalar>
+Mesh<Scalar> MarchingCubes(
+    const data_structure::ChunkedGrid<ContentType, BrickSize> &grid,
+    const Matrix<Scalar, 3, 4> &transform,
+    ContentType isolevel = 0) {
+  std::vector<Vector3<Scalar>> positions;
+  offset_t size[3] = {offset_t(grid.width()), offset_t(grid.height()),
+                      offset_t(grid.depth())};
+  if (size[0] < 2 || size[1] < 2 || size[2] < 2) {
+    return MarchingCubesMesh(positions);
   }
+  offset_t brick[3] = {offset_t(grid.brick_width()),
+                       offset_t(grid.brick_height()),
+                       offset_t(grid.brick_depth())};
+  Field<ContentType, Scalar> block(brick[0] + 1, brick[1] + 1, brick[2] + 1,
+                                   transform);
+  for (offset_t z0 = 0; z0 < size[2] - 1; z0 += brick[2]) {
+    for (offset_t y0 = 0; y0 < size[1] - 1; y0 += brick[1]) {
+      for (offset_t x0 = 0; x0 < size[0] - 1; x0 += brick[0]) {
+        Matrix<Scalar, 3, 4> block_transform = transform;
+        block_transform.col(3) +=
+            transform.template block<3, 3>(0, 0) * Vector3<Scalar>(x0, y0, z0);
+        block.set_transform(block_transform);
+        grid.ReadBlock(x0, y0, z0, &block.grid());
+        offset_t end[3] = {std::min(brick[0], size[0] - 1 - x0),
+                           std::min(brick[1], size[1] - 1 - y0),
+                           std::min(brick[2], size[2] - 1 - z0)};
+        for (offset_t i = 0; i < end[0]; i++) {
+          for (offset_t j = 0; j < end[1]; j++) {
+            for (offset_t k = 0; k < end[2]; k++) {
+              MarchingCubesCell(block, i, j, k, isolevel, positions);
+            }
+          }
+        }
+      }
+    }
+  }
+  return MarchingCubesMesh(positions);
+}
 
-  Mesh<Scalar> mesh{positions.size(), indices.size(), indices.data(),
-                    positions.data()};
-  mesh.MergeVertices();
-  return mesh;
+// Only visits the cells whose range in the pyramid holds the isolevel, the
+// others produce no triangles. The triangles come out in the order of the
+// pyramid traversal instead of the order of the cells.
+template <typename ContentType, typename Scalar, typename GridType>
+Mesh<Scalar> MarchingCubes(
+    const FieldPyramid<ContentType, Scalar, GridType> &pyramid,
+    ContentType isolevel = 0) {
+  const auto &field = pyramid.field();
+  std::vector<Vector3<Scalar>> positions;
+  if (field.width() > 1 && field.height() > 1 && field.depth() > 1) {
+    pyramid.ForEachCell(isolevel, isolevel,
+                        [&](offset_t i, offset_t j, offset_t k) {
+                          MarchingCubesCell(field, i, j, k, isolevel,
+                                            positions);
+                        });
+  }
+  return MarchingCubesMesh(positions);
+}
+
+// Sparse fields only visit the cells touching an allocated leaf, so the cost
+// scales with the area of the narrow band instead of the volume of the
+// bounding box. A cell straddling several leaves is emitted once, by the
+// first allocated leaf in corner order.
+template <typename ContentType,
+          typename Scalar,
+          size_t LeafSize,
+          size_t InternalSize>
+Mesh<Scalar> MarchingCubes(
+    const Field<ContentType,
+                Scalar,
+                data_structure::SparseGrid<ContentType, LeafSize, InternalSize>>
+        &field,
+    ContentType isolevel = 0) {
+  const auto &grid = field.grid();
+  std::vector<Vector3<Scalar>> positions;
+  offset_t leaf_size = LeafSize;
+  offset_t last_x = offset_t(field.width()) - 2;
+  offset_t last_y = offset_t(field.height()) - 2;
+  offset_t last_z = offset_t(field.depth()) - 2;
+
+  for (size_t l = 0; l < grid.num_leaves(); l++) {
+    const auto &leaf = grid.leaf(l);
+    offset_t begin_x = std::max(leaf.origin[0] - 1, offset_t(0));
+    offset_t begin_y = std::max(leaf.origin[1] - 1, offset_t(0));
+    offset_t begin_z = std::max(leaf.origin[2] - 1, offset_t(0));
+    offset_t end_x = std::min(leaf.origin[0] + leaf_size - 1, last_x);
+    offset_t end_y = std::min(leaf.origin[1] + leaf_size - 1, last_y);
+    offset_t end_z = std::min(leaf.origin[2] + leaf_size - 1, last_z);
+    for (offset_t i = begin_x; i <= end_x; i++) {
+      for (offset_t j = begin_y; j <= end_y; j++) {
+        for (offset_t k = begin_z; k <= end_z; k++) {
+          bool interior = i >= leaf.origin[0] && j >= leaf.origin[1] &&
+                          k >= leaf.origin[2] &&
+                          i + 1 < leaf.origin[0] + leaf_size &&
+                          j + 1 < leaf.origin[1] + leaf_size &&
+                          k + 1 < leaf.origin[2] + leaf_size;
+          if (!interior) {
+            bool owned = false;
+            for (int c = 0; c < 8; c++) {
+              offset_t x = i + (c & 1);
+              offset_t y = j + ((c >> 1) & 1);
+              offset_t z = k + ((c >> 2) & 1);
+              if (grid.is_active(x, y, z)) {
+                owned = x - x % leaf_size == leaf.origin[0] &&
+                        y - y % leaf_size == leaf.origin[1] &&
+                        z - z % leaf_size == leaf.origin[2];
+                break;
+              }
+            }
+            if (!owned) {
+              continue;
+            }
+          }
+          MarchingCubesCell(field, i, j, k, isolevel, positions);
+        }
+      }
+    }
+  }
+
+  return MarchingCubesMesh(positions);
 }
 
 }  // namespace grassland::geometry
@@ -0,0 +1,116 @@
+#pragma once
+#include "algorithm"
+#include "grassland/geometry/geometry_util.h"
+#include "grassland/util/thread_pool.h"
+
+namespace grassland::geometry {
+
+// Points hashed into cubic cells of cell_size for fixed-radius neighbour
+// queries, with compact hashing (Ihmsen et al. 2011): cells are hashed into
+// a table of about twice as many buckets as points, so memory does not
+// depend on the extent of the points, and the points are sorted by bucket
+// with a counting sort. Queries only read, so any number of threads can
+// run them at once.
+template <typename Scalar>
+class PointHashGrid {
+ public:
+  PointHashGrid(const Vector3<Scalar> *points,
+                size_t n_points,
+                Scalar cell_size)
+      : cell_size_(cell_size), inv_cell_size_(Scalar(1) / cell_size) {
+    num_buckets_ = 1;
+    while (num_buckets_ < 2 * n_points) {
+      num_buckets_ <<= 1;
+    }
+    std::vector<uint32_t> keys(n_points);
+    ParallelFor(0, int64_t(n_points), 4096, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        int64_t cell[3];
+        Cell(points[i], cell);
+        keys[i] = Bucket(cell[0], cell[1], cell[2]);
+      }
+    });
+    bucket_offsets_.assign(num_buckets_ + 1, 0);
+    for (uint32_t key : keys) {
+      bucket_offsets_[key + 1]++;
+    }
+    for (size_t bucket = 0; bucket < num_buckets_; bucket++) {
+      bucket_offsets_[bucket + 1] += bucket_offsets_[bucket];
+    }
+    indices_.resize(n_points);
+    sorted_points_.resize(n_points);
+    std::vector<size_t> next(bucket_offsets_.begin(),
+                             bucket_offsets_.end() - 1);
+    for (size_t i = 0; i < n_points; i++) {
+      size_t slot = next[keys[i]]++;
+      indices_[slot] = uint32_t(i);
+      sorted_points_[slot] = points[i];
+    }
+  }
+
+  // Calls func(index, squared_distance) for every point within radius of
+  // pos, which must not exceed the cell size. Points come in bucket order,
+  // which only depends on the points.
+  template <class Func>
+  void ForEachNeighbour(const Vector3<Scalar> &pos,
+                        Scalar radius,
+                        Func &&func) const {
+    int64_t cell[3];
+    Cell(pos, cell);
+    uint32_t buckets[27];
+    int n = 0;
+    for (int64_t z = -1; z <= 1; z++) {
+      for (int64_t y = -1; y <= 1; y++) {
+        for (int64_t x = -1; x <= 1; x++) {
+          buckets[n++] = Bucket(cell[0] + x, cell[1] + y, cell[2] + z);
+        }
+      }
+    }
+    // Neighbouring cells may share a bucket.
+    std::sort(buckets, buckets + n);
+    n = int(std::unique(buckets, buckets + n) - buckets);
+    Scalar radius_squared = radius * radius;
+    for (int b = 0; b < n; b++) {
+      for (size_t i = bucket_offsets_[buckets[b]];
+           i < bucket_offsets_[buckets[b] + 1]; i++) {
+        Scalar distance_squared = (sorted_points_[i] - pos).squaredNorm();
+        if (distance_squared <= radius_squared) {
+          func(indices_[i], distance_squared);
+        }
+      }
+    }
+  }
+
+  size_t num_points() const {
+    return indices_.size();
+  }
+
+  size_t num_buckets() const {
+    return num_buckets_;
+  }
+
+  Scalar cell_size() const {
+    return cell_size_;
+  }
+
+ private:
+  void Cell(const Vector3<Scalar> &pos, int64_t cell[3]) const {
+    for (int axis = 0; axis < 3; axis++) {
+      cell[axis] = static_cast<int64_t>(std::floor(pos[axis] * inv_cell_size_));
+    }
+  }
+
+  uint32_t Bucket(int64_t x, int64_t y, int64_t z) const {
+    uint64_t hash = (uint64_t(x) * 73856093u) ^ (uint64_t(y) * 19349663u) ^
+                    (uint64_t(z) * 83492791u);
+    return uint32_t(hash & (num_buckets_ - 1));
+  }
+
+  Scalar cell_size_;
+  Scalar inv_cell_size_;
+  size_t num_buckets_;
+  std::vector<size_t> bucket_offsets_;
+  std::vector<uint32_t> indices_;
+  std::vector<Vector3<Scalar>> sorted_points_;
+};
+}  // namespace grassland::geometry
@@ -1,50 +1,209 @@
 #pragma once
+#include "algorithm"
+#include "array"
 #include "grassland/geometry/axis_aligned_bounding_box.h"
 #include "grassland/geometry/marching_cubes.h"
+#include "grassland/util/thread_pool.h"
 
 namespace grassland::geometry {
-template <typename Scalar>
-Mesh<Scalar> PointToMesh(const Vector3<Scalar> *points,
-                         size_t n_points,
-                         Scalar radius,
-                         size_t n_subdivisions = 1,
-                         Scalar margin = 2.0,
-                         int range = 2) {
-  geometry::AxisAlignedBoundingBox3<Scalar> aabb;
 
-  for (size_t i = 0; i < n_points; ++i) {
-    aabb.Expand(points[i]);
+namespace detail {
+// Points binned into tiles of kTileSize^3 voxels of a field by a counting
+// sort of the voxel each point lies in. Candidates() gathers the points of
+// the bins within tile_reach tiles, in index order, so a splatter applying
+// them in that order performs the operations of a serial loop over the
+// points on every voxel, and the field comes out bit for bit the same at
+// any thread count. Tiles never share voxels and are splatted in parallel.
+class PointTiles {
+ public:
+  static constexpr offset_t kTileSize = 32;
+
+  template <typename Scalar, typename GridType>
+  PointTiles(const Field<Scalar, Scalar, GridType> &field,
+             const std::vector<std::array<offset_t, 3>> &cells,
+             offset_t reach) {
+    size_[0] = offset_t(field.width());
+    size_[1] = offset_t(field.height());
+    size_[2] = offset_t(field.depth());
+    tile_reach_ = (std::max<offset_t>(reach, 0) + kTileSize - 1) / kTileSize;
+    for (int axis = 0; axis < 3; axis++) {
+      tiles_[axis] = (size_[axis] + kTileSize - 1) / kTileSize;
+    }
+    std::vector<uint32_t> keys(cells.size());
+    ParallelFor(0, int64_t(cells.size()), 4096,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    offset_t tile[3];
+                    for (int axis = 0; axis < 3; axis++) {
+                      tile[axis] = std::clamp<offset_t>(
+                          cells[i][axis] / kTileSize, 0, tiles_[axis] - 1);
+                    }
+                    keys[i] = uint32_t(
+                        (tile[2] * tiles_[1] + tile[1]) * tiles_[0] + tile[0]);
+                  }
+                });
+    bin_offsets_.assign(num_tiles() + 1, 0);
+    for (uint32_t key : keys) {
+      bin_offsets_[key + 1]++;
+    }
+    for (size_t tile = 0; tile < num_tiles(); tile++) {
+      bin_offsets_[tile + 1] += bin_offsets_[tile];
+    }
+    bins_.resize(cells.size());
+    std::vector<size_t> next(bin_offsets_.begin(), bin_offsets_.end() - 1);
+    for (size_t i = 0; i < cells.size(); i++) {
+      bins_[next[keys[i]]++] = uint32_t(i);
+    }
   }
 
-  aabb.min_bound -= Vector3<Scalar>{radius, radius, radius} * margin;
-  aabb.max_bound += Vector3<Scalar>{radius, radius, radius} * margin;
+  size_t num_tiles() const {
+    return size_t(tiles_[0] * tiles_[1] * tiles_[2]);
+  }
 
-  Vector3<Scalar> grid_size = (aabb.Size() / radius) * n_subdivisions;
+  const offset_t *size() const {
+    return size_;
+  }
 
-  size_t width = static_cast<size_t>(std::ceil(grid_size[0]));
-  size_t height = static_cast<size_t>(std::ceil(grid_size[1]));
-  size_t depth = static_cast<size_t>(std::ceil(grid_size[2]));
+  void TileOrigin(size_t tile, offset_t origin[3]) const {
+    origin[0] = offset_t(tile) % tiles_[0] * kTileSize;
+    origin[1] = offset_t(tile) / tiles_[0] % tiles_[1] * kTileSize;
+    origin[2] = offset_t(tile) / (tiles_[0] * tiles_[1]) * kTileSize;
+  }
 
-  geometry::Field<Scalar, Scalar> field(
-      width, height, depth, radius / n_subdivisions, aabb.min_bound, 1.0);
+  void Candidates(size_t tile, std::vector<uint32_t> &candidates) const {
+    offset_t origin[3], index[3];
+    TileOrigin(tile, origin);
+    for (int axis = 0; axis < 3; axis++) {
+      index[axis] = origin[axis] / kTileSize;
+    }
+    candidates.clear();
+    for (offset_t z = std::max<offset_t>(index[2] - tile_reach_, 0);
+         z <= std::min(index[2] + tile_reach_, tiles_[2] - 1); z++) {
+      for (offset_t y = std::max<offset_t>(index[1] - tile_reach_, 0);
+           y <= std::min(index[1] + tile_reach_, tiles_[1] - 1); y++) {
+        for (offset_t x = std::max<offset_t>(index[0] - tile_reach_, 0);
+             x <= std::min(index[0] + tile_reach_, tiles_[0] - 1); x++) {
+          size_t bin = size_t((z * tiles_[1] + y) * tiles_[0] + x);
+          candidates.insert(candidates.end(),
+                            bins_.begin() + bin_offsets_[bin],
+                            bins_.begin() + bin_offsets_[bin + 1]);
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+  }
 
-  for (size_t i = 0; i < n_points; ++i) {
-    Vector3<Scalar> grid_pos = field.to_grid_position(points[i]);
-    offset_t x = static_cast<offset_t>(std::floor(grid_pos[0]));
-    offset_t y = static_cast<offset_t>(std::floor(grid_pos[1]));
-    offset_t z = static_cast<offset_t>(std::floor(grid_pos[2]));
-    offset_t low_x = x - n_subdivisions * range;
-    offset_t low_y = y - n_subdivisions * range;
-    offset_t low_z = z - n_subdivisions * range;
-    offset_t high_x = x + n_subdivisions * range + 1;
-    offset_t high_y = y + n_subdivisions * range + 1;
-    offset_t high_z = z + n_subdivisions * range + 1;
-    low_x = std::max(low_x, offset_t{0});
-    low_y = std::max(low_y, offset_t{0});
-    low_z = std::max(low_z, offset_t{0});
-    high_x = std::min(high_x, static_cast<offset_t>(field.width()));
-    high_y = std::min(high_y, static_cast<offset_t>(field.height()));
-    high_z = std::min(high_z, static_cast<offset_t>(field.depth()));
+  // Whether Candidates(tile) is non-empty, without gathering them.
+  bool HasCandidates(size_t tile) const {
+    offset_t origin[3], index[3];
+    TileOrigin(tile, origin);
+    for (int axis = 0; axis < 3; axis++) {
+      index[axis] = origin[axis] / kTileSize;
+    }
+    for (offset_t z = std::max<offset_t>(index[2] - tile_reach_, 0);
+         z <= std::min(index[2] + tile_reach_, tiles_[2] - 1); z++) {
+      for (offset_t y = std::max<offset_t>(index[1] - tile_reach_, 0);
+           y <= std::min(index[1] + tile_reach_, tiles_[1] - 1); y++) {
+        for (offset_t x = std::max<offset_t>(index[0] - tile_reach_, 0);
+             x <= std::min(index[0] + tile_reach_, tiles_[0] - 1); x++) {
+          size_t bin = size_t((z * tiles_[1] + y) * tiles_[0] + x);
+          if (bin_offsets_[bin] != bin_offsets_[bin + 1]) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+ private:
+  offset_t size_[3];
+  offset_t tiles_[3];
+  offset_t tile_reach_;
+  std::vector<size_t> bin_offsets_;
+  std::vector<uint32_t> bins_;
+};
+
+// The voxel of the field each point lies in.
+template <typename Scalar, typename GridType>
+std::vector<std::array<offset_t, 3>> PointCells(
+    const Vector3<Scalar> *points,
+    size_t n_points,
+    const Field<Scalar, Scalar, GridType> &field) {
+  std::vector<std::array<offset_t, 3>> cells(n_points);
+  ParallelFor(0, int64_t(n_points), 4096, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i++) {
+      Vector3<Scalar> grid_pos = field.to_grid_position(points[i]);
+      for (int axis = 0; axis < 3; axis++) {
+        cells[i][axis] = static_cast<offset_t>(std::floor(grid_pos[axis]));
+      }
+    }
+  });
+  return cells;
+}
+
+// World coordinates of the voxel planes of a field along each axis. The
+// diagonal transform makes coordinate a of the world position of voxel
+// (i, j, k) a function of index a alone, computed by the same expression as
+// to_world_position.
+template <typename Scalar, typename GridType>
+void VoxelWorldCoordinates(const Field<Scalar, Scalar, GridType> &field,
+                           std::vector<Scalar> world[3]) {
+  offset_t size[3] = {offset_t(field.width()), offset_t(field.height()),
+                      offset_t(field.depth())};
+  for (int axis = 0; axis < 3; axis++) {
+    world[axis].resize(size[axis]);
+  }
+  for (offset_t i = 0; i < *std::max_element(size, size + 3); i++) {
+    Vector3<Scalar> world_pos = field.to_world_position(
+        Vector3<Scalar>{Scalar(i), Scalar(i), Scalar(i)});
+    for (int axis = 0; axis < 3; axis++) {
+      if (i < size[axis]) {
+        world[axis][i] = world_pos[axis];
+      }
+    }
+  }
+}
+
+// Splats the isotropic kernels of PointToField. World positions come from
+// per-axis tables, and rows and voxels of the box beyond the kernel range
+// are skipped before computing their distance.
+template <typename Scalar>
+class PointSplatter {
+ public:
+  template <typename GridType>
+  PointSplatter(const Vector3<Scalar> *points,
+                size_t n_points,
+                Scalar radius,
+                size_t n_subdivisions,
+                int range,
+                const Field<Scalar, Scalar, GridType> &field)
+      : points_(points),
+        radius_(radius),
+        range_(range),
+        reach_(offset_t(n_subdivisions * range)),
+        cells_(PointCells(points, n_points, field)),
+        tiles_(field, cells_, reach_) {
+    VoxelWorldCoordinates(field, world_);
+  }
+
+  const PointTiles &tiles() const {
+    return tiles_;
+  }
+
+  // Subtracts the kernels of the points reaching tile from values, where
+  // voxel (x, y, z) of the field is at values[(x - x0) + (y - y0) * y_stride
+  // + (z - z0) * z_stride] for the tile origin (x0, y0, z0).
+  void Splat(size_t tile,
+             Scalar *values,
+             offset_t y_stride,
+             offset_t z_stride) const {
+    constexpr offset_t kTileSize = PointTiles::kTileSize;
+    const offset_t *size = tiles_.size();
+    offset_t origin[3];
+    tiles_.TileOrigin(tile, origin);
+    std::vector<uint32_t> candidates;
+    tiles_.Candidates(tile, candidates);
 
     auto kernel_function = [](Scalar distance) -> Scalar {
       if (distance < 1.0) {
@@ -55,20 +214,232 @@ Mesh<Scalar> PointToMesh(const Vector3<Scalar> *points,
       return 0.0;
     };
 
-    for (offset_t x = low_x; x < high_x; ++x) {
-      for (offset_t y = low_y; y < high_y; ++y) {
-        for (offset_t z = low_z; z < high_z; ++z) {
-          Vector3<Scalar> grid_pos{Scalar(x), Scalar(y), Scalar(z)};
-          Vector3<Scalar> world_pos = field.to_world_position(grid_pos);
-          Scalar distance = (world_pos - points[i]).norm() / radius;
-          if (distance < range) {
-            field(x, y, z) -= kernel_function(distance);
+    // Voxels are tested exactly as the serial loop tests them, the bounds
+    // only skip work: rounding is monotonic, so a row whose y and z offsets
+    // alone are out of range has no voxel in range, and bound leaves enough
+    // slack for the rounding of the distance.
+    const double bound = double(range_) * range_ * radius_ * radius_ * 1.001;
+    Scalar squares[3][kTileSize];
+    for (uint32_t i : candidates) {
+      const Vector3<Scalar> &point = points_[i];
+      offset_t low[3], high[3];
+      bool empty = false;
+      for (int axis = 0; axis < 3; axis++) {
+        low[axis] = std::max({cells_[i][axis] - reach_, origin[axis],
+                              offset_t{0}});
+        high[axis] = std::min({cells_[i][axis] + reach_ + 1,
+                               origin[axis] + kTileSize, size[axis]});
+        empty |= low[axis] >= high[axis];
+        for (offset_t v = low[axis]; v < high[axis]; v++) {
+          Scalar d = world_[axis][v] - point[axis];
+          squares[axis][v - low[axis]] = d * d;
+        }
+      }
+      if (empty) {
+        continue;
+      }
+      for (offset_t z = low[2]; z < high[2]; z++) {
+        for (offset_t y = low[1]; y < high[1]; y++) {
+          Scalar row = squares[1][y - low[1]] + squares[2][z - low[2]];
+          if (std::sqrt(row) / radius_ >= range_) {
+            continue;
+          }
+          Scalar *row_values =
+              values + (y - origin[1]) * y_stride + (z - origin[2]) * z_stride;
+          for (offset_t x = low[0]; x < high[0]; x++) {
+            if (double(squares[0][x - low[0]]) + double(row) >= bound) {
+              continue;
+            }
+            Vector3<Scalar> world_pos{world_[0][x], world_[1][y],
+                                      world_[2][z]};
+            Scalar distance = (world_pos - point).norm() / radius_;
+            if (distance < range_) {
+              row_values[x - origin[0]] -= kernel_function(distance);
+            }
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  const Vector3<Scalar> *points_;
+  Scalar radius_;
+  int range_;
+  offset_t reach_;
+  std::vector<std::array<offset_t, 3>> cells_;
+  PointTiles tiles_;
+  std::vector<Scalar> world_[3];
+};
+
+// Runs splatter.Splat on every tile of its tiles() straight into the cells
+// of a dense grid, in parallel.
+template <typename Splatter, typename Scalar>
+void SplatTiles(const Splatter &splatter,
+                data_structure::LinearGrid<Scalar> &grid) {
+  const PointTiles &tiles = splatter.tiles();
+  ParallelFor(0, int64_t(tiles.num_tiles()), 1,
+              [&](int64_t begin, int64_t end) {
+                for (int64_t tile = begin; tile < end; tile++) {
+                  offset_t origin[3];
+                  tiles.TileOrigin(tile, origin);
+                  splatter.Splat(
+                      tile, grid.data() + grid.offset(origin[0], origin[1],
+                                                      origin[2]),
+                      grid.y_stride(), grid.z_stride());
+                }
+              });
+}
+
+// Runs splatter.Splat on batches of tiles in parallel into scratch buffers
+// filled with the background, then copies the leaves that changed into the
+// sparse grid. Tiles no point reaches stay background and are skipped.
+template <typename Splatter, typename Scalar>
+void SplatTiles(const Splatter &splatter,
+                data_structure::SparseGrid<Scalar> &grid) {
+  const PointTiles &tiles = splatter.tiles();
+  constexpr offset_t tile_size = PointTiles::kTileSize;
+  constexpr offset_t tile_volume = tile_size * tile_size * tile_size;
+  // Tiles hold whole leaves.
+  offset_t leaf_size = offset_t(grid.leaf_size());
+  const offset_t *size = tiles.size();
+  const Scalar background = grid.background();
+  std::vector<size_t> active;
+  for (size_t tile = 0; tile < tiles.num_tiles(); tile++) {
+    if (tiles.HasCandidates(tile)) {
+      active.push_back(tile);
+    }
+  }
+  const size_t batch = 64;
+  std::vector<Scalar> buffers(std::min(batch, active.size()) * tile_volume);
+  for (size_t first = 0; first < active.size(); first += batch) {
+    size_t count = std::min(batch, active.size() - first);
+    ParallelFor(0, int64_t(count), 1, [&](int64_t begin, int64_t end) {
+      for (int64_t b = begin; b < end; b++) {
+        Scalar *values = buffers.data() + b * tile_volume;
+        std::fill(values, values + tile_volume, background);
+        splatter.Splat(active[first + b], values, tile_size,
+                       tile_size * tile_size);
+      }
+    });
+    for (size_t b = 0; b < count; b++) {
+      const Scalar *values = buffers.data() + b * tile_volume;
+      offset_t origin[3];
+      tiles.TileOrigin(active[first + b], origin);
+      for (offset_t lz = 0; lz < tile_size; lz += leaf_size) {
+        for (offset_t ly = 0; ly < tile_size; ly += leaf_size) {
+          for (offset_t lx = 0; lx < tile_size; lx += leaf_size) {
+            offset_t end[3] = {
+                std::min(leaf_size, size[0] - origin[0] - lx),
+                std::min(leaf_size, size[1] - origin[1] - ly),
+                std::min(leaf_size, size[2] - origin[2] - lz)};
+            if (end[0] <= 0 || end[1] <= 0 || end[2] <= 0) {
+              continue;
+            }
+            auto value = [&](offset_t x, offset_t y, offset_t z) {
+              return values[(lz + z) * tile_size * tile_size +
+                            (ly + y) * tile_size + lx + x];
+            };
+            bool changed = false;
+            for (offset_t z = 0; z < end[2] && !changed; z++) {
+              for (offset_t y = 0; y < end[1] && !changed; y++) {
+                for (offset_t x = 0; x < end[0] && !changed; x++) {
+                  changed = value(x, y, z) != background;
+                }
+              }
+            }
+            if (!changed) {
+              continue;
+            }
+            for (offset_t z = 0; z < end[2]; z++) {
+              for (offset_t y = 0; y < end[1]; y++) {
+                for (offset_t x = 0; x < end[0]; x++) {
+                  grid(origin[0] + lx + x, origin[1] + ly + y,
+                       origin[2] + lz + z) = value(x, y, z);
+                }
+              }
+            }
           }
         }
       }
     }
   }
+}
+
+template <typename Scalar, typename GridType>
+Field<Scalar, Scalar, GridType> CreatePointField(const Vector3<Scalar> *points,
+                                                 size_t n_points,
+                                                 Scalar radius,
+                                                 size_t n_subdivisions,
+                                                 Scalar margin) {
+  geometry::AxisAlignedBoundingBox3<Scalar> aabb;
+
+  for (size_t i = 0; i < n_points; ++i) {
+    aabb.Expand(points[i]);
+  }
 
+  aabb.min_bound -= Vector3<Scalar>{radius, radius, radius} * margin;
+  aabb.max_bound += Vector3<Scalar>{radius, radius, radius} * margin;
+
+  Vector3<Scalar> grid_size = (aabb.Size() / radius) * n_subdivisions;
+
+  size_t width = static_cast<size_t>(std::ceil(grid_size[0]));
+  size_t height = static_cast<size_t>(std::ceil(grid_size[1]));
+  size_t depth = static_cast<size_t>(std::ceil(grid_size[2]));
+
+  return Field<Scalar, Scalar, GridType>(
+      width, height, depth, radius / n_subdivisions, aabb.min_bound, 1.0);
+}
+}  // namespace detail
+
+// The field PointToMesh meshes: 1 minus a kernel of radius range * radius
+// around every point, on voxels of radius / n_subdivisions covering the
+// points with a margin of margin * radius. Tiles of the field are splatted
+// in parallel.
+template <typename Scalar>
+Field<Scalar, Scalar> PointToField(const Vector3<Scalar> *points,
+                                   size_t n_points,
+                                   Scalar radius,
+                                   size_t n_subdivisions = 1,
+                                   Scalar margin = 2.0,
+                                   int range = 2) {
+  auto field =
+      detail::CreatePointField<Scalar, data_structure::LinearGrid<Scalar>>(
+          points, n_points, radius, n_subdivisions, margin);
+  detail::PointSplatter<Scalar> splatter(points, n_points, radius,
+                                         n_subdivisions, range, field);
+  detail::SplatTiles(splatter, field.grid());
+  return field;
+}
+
+// The same field on a SparseGrid with a background of 1, where only the
+// leaves a kernel changed are allocated.
+template <typename Scalar>
+Field<Scalar, Scalar, data_structure::SparseGrid<Scalar>> PointToSparseField(
+    const Vector3<Scalar> *points,
+    size_t n_points,
+    Scalar radius,
+    size_t n_subdivisions = 1,
+    Scalar margin = 2.0,
+    int range = 2) {
+  auto field =
+      detail::CreatePointField<Scalar, data_structure::SparseGrid<Scalar>>(
+          points, n_points, radius, n_subdivisions, margin);
+  detail::PointSplatter<Scalar> splatter(points, n_points, radius,
+                                         n_subdivisions, range, field);
+  detail::SplatTiles(splatter, field.grid());
+  return field;
+}
+
+template <typename Scalar>
+Mesh<Scalar> PointToMesh(const Vector3<Scalar> *points,
+                         size_t n_points,
+                         Scalar radius,
+                         size_t n_subdivisions = 1,
+                         Scalar margin = 2.0,
+                         int range = 2) {
+  auto field =
+      PointToField(points, n_points, radius, n_subdivisions, margin, range);
   Mesh<Scalar> mesh = MarchingCubes<Scalar, Scalar>(field);
   return mesh;
 }
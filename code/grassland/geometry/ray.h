@@ -1,5 +1,6 @@
 #pragma once
 #include "grassland/geometry/geometry_util.h"
+#include "grassland/geometry/triangle.h"
 
 namespace grassland::geometry {
 template <typename Scalar, int dim>
@@ -27,4 +28,43 @@ using Ray2d = Ray2<double>;
 
 using Ray3f = Ray3<float>;
 using Ray3d = Ray3<double>;
+
+// Moller-Trumbore intersection of a ray with a triangle. Returns true for a
+// hit at a ray parameter in [t_min, *t] and sets *t there, along with the
+// barycentric weights u and v of the second and third vertex. Triangles
+// seen edge-on are missed.
+template <typename Scalar>
+LM_DEVICE_FUNC bool RayTriangleIntersection(const Ray3<Scalar> &ray,
+                                            const Triangle3<Scalar> &triangle,
+                                            Scalar t_min,
+                                            Scalar *t,
+                                            Scalar *u,
+                                            Scalar *v) {
+  Vector3<Scalar> e1 = triangle[1] - triangle[0];
+  Vector3<Scalar> e2 = triangle[2] - triangle[0];
+  Vector3<Scalar> p = ray.direction.cross(e2);
+  Scalar det = e1.dot(p);
+  if (det == Scalar(0)) {
+    return false;
+  }
+  Scalar inv_det = Scalar(1) / det;
+  Vector3<Scalar> s = ray.origin - triangle[0];
+  Scalar hit_u = s.dot(p) * inv_det;
+  if (hit_u < Scalar(0) || hit_u > Scalar(1)) {
+    return false;
+  }
+  Vector3<Scalar> q = s.cross(e1);
+  Scalar hit_v = ray.direction.dot(q) * inv_det;
+  if (hit_v < Scalar(0) || hit_u + hit_v > Scalar(1)) {
+    return false;
+  }
+  Scalar hit_t = e2.dot(q) * inv_det;
+  if (hit_t < t_min || hit_t > *t) {
+    return false;
+  }
+  *t = hit_t;
+  *u = hit_u;
+  *v = hit_v;
+  return true;
+}
 }  // namespace grassland::geometry
@@ -0,0 +1,57 @@
+#pragma once
+#include "grassland/geometry/field.h"
+#include "grassland/physics/basic_functions.h"
+
+namespace grassland {
+
+// A signed distance field sampled from a grid, with the same function set
+// interface as SphereSDF and the other analytic SDFs. The value, Jacobian
+// and Hessian are those of the interpolant, evaluated from one gather of the
+// surrounding cells. The default Catmull-Rom kernel has a continuous
+// gradient, so normals and contact Hessians do not jump at cell faces as
+// they do with trilinear interpolation. field is not owned and must outlive
+// the function set.
+template <typename Real,
+          typename GridType = data_structure::LinearGrid<Real>>
+struct GridSDF {
+  typedef Real Scalar;
+  typedef Eigen::Vector<Real, 3> InputType;
+  typedef Eigen::Matrix<Real, 1, 1> OutputType;
+
+  // Inside the box spanned by the cell positions of the field.
+  bool ValidInput(const InputType &v) const {
+    Eigen::Vector3<Real> pos = field->to_grid_position(v);
+    return pos.minCoeff() >= 0 && pos[0] <= field->width() - 1 &&
+           pos[1] <= field->height() - 1 && pos[2] <= field->depth() - 1;
+  }
+
+  OutputType operator()(const InputType &v) const {
+    return OutputType{field->Sample(v, interpolation)};
+  }
+
+  Eigen::
+      Matrix<Real, OutputType::SizeAtCompileTime, InputType::SizeAtCompileTime>
+      Jacobian(const InputType &v) const {
+    Eigen::Vector3<Real> gradient;
+    field->SampleWithGradient(v, &gradient, interpolation);
+    return gradient.transpose();
+  }
+
+  HessianTensor<Real,
+                OutputType::SizeAtCompileTime,
+                InputType::SizeAtCompileTime>
+  Hessian(const InputType &v) const {
+    HessianTensor<Real, OutputType::SizeAtCompileTime,
+                  InputType::SizeAtCompileTime>
+        H;
+    Eigen::Vector3<Real> gradient;
+    field->SampleWithHessian(v, &gradient, &H.m[0], interpolation);
+    return H;
+  }
+
+  const geometry::Field<Real, Real, GridType> *field{nullptr};
+  data_structure::grid_interpolation_type interpolation{
+      data_structure::grid_interpolation_type::catmull_rom};
+};
+
+}  // namespace grassland
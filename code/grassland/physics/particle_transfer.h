@@ -0,0 +1,523 @@
+#pragma once
+#include "grassland/data_structure/data_structure.h"
+#include "grassland/physics/physics_util.h"
+
+namespace grassland {
+
+enum class particle_kernel_type : uint8_t { linear = 0, quadratic_bspline };
+
+struct ParticleTransferSettings {
+  particle_kernel_type kernel{particle_kernel_type::linear};
+  // Particles are binned into cubic tiles of this many cells per side. The
+  // kernels reach one node before and two nodes after the cell of a
+  // particle, so tiles narrower than 4 cells are widened to 4.
+  size_t tile_size{8};
+};
+
+// Particle-grid transfers for PIC, FLIP and APIC (Jiang et al. 2015) between
+// equal-mass particles and a width x height x depth MACGrid, or cell-centred
+// LinearGrids of the same size. Positions are in cell units as in
+// mac_grid_operators.h, and particles outside the domain are clamped onto
+// its boundary. The grids written by ParticleToGrid must not have ghost
+// layers.
+//
+// Bin() sorts the particles by tile and then by cell with a counting sort.
+// ParticleToGrid visits the tiles in the 8 colours of a 2 x 2 x 2 colouring:
+// the footprints of two tiles of one colour never overlap, so their
+// particles scatter straight into the grids in parallel without atomics,
+// and every node sums its contributions in an order that does not depend on
+// the number of threads.
+template <typename Scalar>
+class ParticleTransfer {
+ public:
+  typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+  typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+
+  ParticleTransfer(size_t width,
+                   size_t height,
+                   size_t depth,
+                   const ParticleTransferSettings &settings = {})
+      : width_(width),
+        height_(height),
+        depth_(depth),
+        settings_(settings),
+        tile_size_(std::max<size_t>(settings.tile_size, 4)),
+        tiles_x_((width + tile_size_ - 1) / tile_size_),
+        tiles_y_((height + tile_size_ - 1) / tile_size_),
+        tiles_z_((depth + tile_size_ - 1) / tile_size_),
+        face_weights_(width, height, depth, Scalar(0)),
+        cell_weights_(width, height, depth, Scalar(0)) {
+    for (size_t z = 0; z < tiles_z_; z++) {
+      for (size_t y = 0; y < tiles_y_; y++) {
+        for (size_t x = 0; x < tiles_x_; x++) {
+          size_t colour = (x & 1) | ((y & 1) << 1) | ((z & 1) << 2);
+          coloured_tiles_[colour].push_back((z * tiles_y_ + y) * tiles_x_ +
+                                            x);
+        }
+      }
+    }
+  }
+
+  // Sorts the particles into cells. Must be called whenever the particles
+  // have moved and before ParticleToGrid, with the same positions.
+  void Bin(const std::vector<Vector3> &positions) {
+    size_t n = positions.size();
+    size_t num_tiles = tiles_x_ * tiles_y_ * tiles_z_;
+    size_t tile_cells = tile_size_ * tile_size_ * tile_size_;
+    tile_keys_.resize(n);
+    cell_keys_.resize(n);
+    ParallelFor(0, int64_t(n), data_structure::kParallelGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    offset_t cell[3];
+                    CellOf(positions[i], cell);
+                    size_t t[3], c[3];
+                    for (int axis = 0; axis < 3; axis++) {
+                      t[axis] = size_t(cell[axis]) / tile_size_;
+                      c[axis] = size_t(cell[axis]) % tile_size_;
+                    }
+                    tile_keys_[i] =
+                        uint32_t((t[2] * tiles_y_ + t[1]) * tiles_x_ + t[0]);
+                    cell_keys_[i] =
+                        uint32_t((c[2] * tile_size_ + c[1]) * tile_size_ +
+                                 c[0]);
+                  }
+                });
+
+    // Stable counting sort by tile, with one histogram per chunk of
+    // particles so that counting and scattering run in parallel.
+    size_t num_chunks = std::clamp<size_t>(n / 16384, 1, 64);
+    size_t chunk_size = (n + num_chunks - 1) / num_chunks;
+    chunk_offsets_.assign(num_chunks * num_tiles, 0);
+    ParallelFor(0, int64_t(num_chunks), 1, [&](int64_t begin, int64_t end) {
+      for (int64_t chunk = begin; chunk < end; chunk++) {
+        size_t *counts = chunk_offsets_.data() + chunk * num_tiles;
+        for (size_t i = chunk * chunk_size;
+             i < std::min(n, (chunk + 1) * chunk_size); i++) {
+          counts[tile_keys_[i]]++;
+        }
+      }
+    });
+    tile_offsets_.resize(num_tiles + 1);
+    size_t offset = 0;
+    for (size_t tile = 0; tile < num_tiles; tile++) {
+      tile_offsets_[tile] = offset;
+      for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        size_t count = chunk_offsets_[chunk * num_tiles + tile];
+        chunk_offsets_[chunk * num_tiles + tile] = offset;
+        offset += count;
+      }
+    }
+    tile_offsets_[num_tiles] = n;
+    scratch_.resize(n);
+    ParallelFor(0, int64_t(num_chunks), 1, [&](int64_t begin, int64_t end) {
+      for (int64_t chunk = begin; chunk < end; chunk++) {
+        size_t *offsets = chunk_offsets_.data() + chunk * num_tiles;
+        for (size_t i = chunk * chunk_size;
+             i < std::min(n, (chunk + 1) * chunk_size); i++) {
+          scratch_[offsets[tile_keys_[i]]++] = uint32_t(i);
+        }
+      }
+    });
+
+    // Then by cell within each tile, for locality of the scatter.
+    order_.resize(n);
+    ParallelFor(0, int64_t(num_tiles), 64, [&](int64_t begin, int64_t end) {
+      std::vector<size_t> counts(tile_cells + 1);
+      for (int64_t tile = begin; tile < end; tile++) {
+        size_t first = tile_offsets_[tile];
+        size_t last = tile_offsets_[tile + 1];
+        if (last - first < 2) {
+          std::copy(scratch_.begin() + first, scratch_.begin() + last,
+                    order_.begin() + first);
+          continue;
+        }
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = first; i < last; i++) {
+          counts[cell_keys_[scratch_[i]] + 1]++;
+        }
+        for (size_t c = 0; c < tile_cells; c++) {
+          counts[c + 1] += counts[c];
+        }
+        for (size_t i = first; i < last; i++) {
+          order_[first + counts[cell_keys_[scratch_[i]]]++] = scratch_[i];
+        }
+      }
+    });
+  }
+
+  // Velocities on the faces from the particles: the weighted average of
+  // v_p + C_p (x_face - x_p) for APIC, where C_p is affine[p], or of v_p for
+  // PIC and FLIP when affine is null. Faces no particle reaches are zero,
+  // face_weights() tells them apart.
+  void ParticleToGrid(const std::vector<Vector3> &positions,
+                      const std::vector<Vector3> &velocities,
+                      const std::vector<Matrix3> *affine,
+                      data_structure::MACGrid<Scalar> &velocity) {
+    Scalar *momentum[3] = {velocity.u().data(), velocity.v().data(),
+                           velocity.w().data()};
+    Scalar *weights[3] = {face_weights_.u().data(), face_weights_.v().data(),
+                          face_weights_.w().data()};
+    const data_structure::LinearGrid<Scalar> *grids[3] = {
+        &velocity.u(), &velocity.v(), &velocity.w()};
+    for (int component = 0; component < 3; component++) {
+      size_t size = grids[component]->buffer().size();
+      std::fill(momentum[component], momentum[component] + size, Scalar(0));
+      std::fill(weights[component], weights[component] + size, Scalar(0));
+    }
+    DispatchKernel([&](auto kernel_width) {
+      constexpr int N = decltype(kernel_width)::value;
+      ForEachTileParticle([&](uint32_t p) {
+        for (int component = 0; component < 3; component++) {
+          Stencil<N> stencil(Clamp(positions[p]) - FaceOffset(component),
+                             *grids[component]);
+          Vector3 row = affine ? Vector3((*affine)[p].row(component))
+                               : Vector3::Zero();
+          stencil.Scatter(velocities[p][component], row, momentum[component],
+                          weights[component]);
+        }
+      });
+    });
+    for (int component = 0; component < 3; component++) {
+      Normalize(momentum[component], weights[component],
+                grids[component]->buffer().size());
+    }
+  }
+
+  // The weighted average of values on the cells of grid.
+  void ParticleToGrid(const std::vector<Vector3> &positions,
+                      const std::vector<Scalar> &values,
+                      data_structure::LinearGrid<Scalar> &grid) {
+    std::fill(grid.buffer().begin(), grid.buffer().end(), Scalar(0));
+    std::fill(cell_weights_.buffer().begin(), cell_weights_.buffer().end(),
+              Scalar(0));
+    DispatchKernel([&](auto kernel_width) {
+      constexpr int N = decltype(kernel_width)::value;
+      ForEachTileParticle([&](uint32_t p) {
+        Stencil<N> stencil(Clamp(positions[p]) - CellOffset(), grid);
+        stencil.Scatter(values[p], Vector3::Zero(), grid.data(),
+                        cell_weights_.data());
+      });
+    });
+    Normalize(grid.data(), cell_weights_.data(), grid.buffer().size());
+  }
+
+  // PIC velocities interpolated from the faces, and for APIC the affine
+  // matrices C_p as well when affine is not null. velocities and affine are
+  // resized to the number of particles.
+  void GridToParticle(const data_structure::MACGrid<Scalar> &velocity,
+                      const std::vector<Vector3> &positions,
+                      std::vector<Vector3> &velocities,
+                      std::vector<Matrix3> *affine = nullptr) const {
+    velocities.resize(positions.size());
+    if (affine) {
+      affine->resize(positions.size());
+    }
+    const data_structure::LinearGrid<Scalar> *grids[3] = {
+        &velocity.u(), &velocity.v(), &velocity.w()};
+    DispatchKernel([&](auto kernel_width) {
+      constexpr int N = decltype(kernel_width)::value;
+      ForEachParticle(positions.size(), [&](uint32_t p) {
+        for (int component = 0; component < 3; component++) {
+          Stencil<N> stencil(Clamp(positions[p]) - FaceOffset(component),
+                             *grids[component]);
+          Vector3 row;
+          velocities[p][component] =
+              stencil.Gather(*grids[component], affine ? &row : nullptr);
+          if (affine) {
+            (*affine)[p].row(component) = row.transpose();
+          }
+        }
+      });
+    });
+  }
+
+  // FLIP: adds the change from previous to velocity at each particle to its
+  // velocity, blended with the PIC velocity as flip_ratio * FLIP +
+  // (1 - flip_ratio) * PIC.
+  void GridToParticle(const data_structure::MACGrid<Scalar> &velocity,
+                      const data_structure::MACGrid<Scalar> &previous,
+                      Scalar flip_ratio,
+                      const std::vector<Vector3> &positions,
+                      std::vector<Vector3> &velocities) const {
+    const data_structure::LinearGrid<Scalar> *grids[3] = {
+        &velocity.u(), &velocity.v(), &velocity.w()};
+    const data_structure::LinearGrid<Scalar> *previous_grids[3] = {
+        &previous.u(), &previous.v(), &previous.w()};
+    DispatchKernel([&](auto kernel_width) {
+      constexpr int N = decltype(kernel_width)::value;
+      ForEachParticle(positions.size(), [&](uint32_t p) {
+        for (int component = 0; component < 3; component++) {
+          Stencil<N> stencil(Clamp(positions[p]) - FaceOffset(component),
+                             *grids[component]);
+          Scalar pic = stencil.Gather(*grids[component], nullptr);
+          Scalar old = stencil.Gather(*previous_grids[component], nullptr);
+          velocities[p][component] =
+              pic + flip_ratio * (velocities[p][component] - old);
+        }
+      });
+    });
+  }
+
+  // Values interpolated from the cells of grid.
+  void GridToParticle(const data_structure::LinearGrid<Scalar> &grid,
+                      const std::vector<Vector3> &positions,
+                      std::vector<Scalar> &values) const {
+    values.resize(positions.size());
+    DispatchKernel([&](auto kernel_width) {
+      constexpr int N = decltype(kernel_width)::value;
+      ForEachParticle(positions.size(), [&](uint32_t p) {
+        Stencil<N> stencil(Clamp(positions[p]) - CellOffset(), grid);
+        values[p] = stencil.Gather(grid, nullptr);
+      });
+    });
+  }
+
+  // Rearranges values, one per particle, into the order of order(). The
+  // transfers read the particles in that order, so storing every particle
+  // attribute rearranged every few steps keeps those reads sequential. Bin()
+  // must be called again afterwards.
+  template <class T, class Allocator>
+  void Reorder(std::vector<T, Allocator> &values) const {
+    std::vector<T, Allocator> reordered(values.size());
+    ParallelFor(0, int64_t(values.size()), data_structure::kParallelGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    reordered[i] = values[order_[i]];
+                  }
+                });
+    values.swap(reordered);
+  }
+
+  // Sum of the kernel weights on each face and cell by the last
+  // ParticleToGrid, zero where no particle contributed.
+  const data_structure::MACGrid<Scalar> &face_weights() const {
+    return face_weights_;
+  }
+
+  const data_structure::LinearGrid<Scalar> &cell_weights() const {
+    return cell_weights_;
+  }
+
+  // Particle indices sorted by tile and cell by the last Bin().
+  const std::vector<uint32_t> &order() const {
+    return order_;
+  }
+
+  // The particles of tile t are order()[tile_offsets()[t]] up to
+  // order()[tile_offsets()[t + 1]].
+  const std::vector<size_t> &tile_offsets() const {
+    return tile_offsets_;
+  }
+
+  size_t tile_size() const {
+    return tile_size_;
+  }
+
+  const ParticleTransferSettings &settings() const {
+    return settings_;
+  }
+
+ private:
+  typedef data_structure::offset_t offset_t;
+
+  // Weights of the N x N x N nodes from base around a position in node
+  // coordinates, for the linear (N = 2) or quadratic B-spline (N = 3)
+  // kernel. Nodes outside the grid are cut off by [lo, hi) on each axis.
+  template <int N>
+  struct Stencil {
+    Stencil(const Vector3 &pos,
+            const data_structure::LinearGrid<Scalar> &grid) {
+      offset_t size[3] = {offset_t(grid.width()), offset_t(grid.height()),
+                          offset_t(grid.depth())};
+      for (int axis = 0; axis < 3; axis++) {
+        Scalar x = pos[axis];
+        if constexpr (N == 2) {
+          base[axis] = offset_t(std::floor(x));
+          Scalar f = x - Scalar(base[axis]);
+          w[axis][0] = 1 - f;
+          w[axis][1] = f;
+          d[axis][0] = -f;
+          d[axis][1] = 1 - f;
+          g[axis][0] = -1;
+          g[axis][1] = 1;
+        } else {
+          base[axis] = offset_t(std::floor(x - Scalar(0.5)));
+          Scalar f = x - Scalar(base[axis]);
+          w[axis][0] = Scalar(0.5) * (Scalar(1.5) - f) * (Scalar(1.5) - f);
+          w[axis][1] = Scalar(0.75) - (f - 1) * (f - 1);
+          w[axis][2] = Scalar(0.5) * (f - Scalar(0.5)) * (f - Scalar(0.5));
+          // The APIC inertia tensor of the quadratic B-spline is I / 4.
+          for (int a = 0; a < 3; a++) {
+            d[axis][a] = Scalar(a) - f;
+            g[axis][a] = 4 * w[axis][a] * d[axis][a];
+          }
+        }
+        lo[axis] = int(std::clamp<offset_t>(-base[axis], 0, N));
+        hi[axis] = int(std::clamp<offset_t>(size[axis] - base[axis], 0, N));
+      }
+      origin = grid.offset(base[0], base[1], base[2]);
+      y_stride = offset_t(grid.y_stride());
+      z_stride = offset_t(grid.z_stride());
+    }
+
+    // Adds the weighted value + row . (x_node - x_p) to momentum and the
+    // weights to weights, both laid out like the grid of the stencil.
+    void Scatter(Scalar value,
+                 const Vector3 &row,
+                 Scalar *momentum,
+                 Scalar *weights) const {
+      for (int c = lo[2]; c < hi[2]; c++) {
+        for (int b = lo[1]; b < hi[1]; b++) {
+          Scalar wyz = w[1][b] * w[2][c];
+          Scalar vyz = value + row[1] * d[1][b] + row[2] * d[2][c];
+          offset_t index = origin + c * z_stride + b * y_stride;
+          for (int a = lo[0]; a < hi[0]; a++) {
+            Scalar weight = w[0][a] * wyz;
+            momentum[index + a] += weight * (vyz + row[0] * d[0][a]);
+            weights[index + a] += weight;
+          }
+        }
+      }
+    }
+
+    // The weighted average of the nodes, and the APIC affine row if row is
+    // not null.
+    Scalar Gather(const data_structure::LinearGrid<Scalar> &grid,
+                  Vector3 *row) const {
+      const Scalar *data = grid.data();
+      Scalar value = 0, total = 0;
+      Vector3 affine = Vector3::Zero();
+      for (int c = lo[2]; c < hi[2]; c++) {
+        for (int b = lo[1]; b < hi[1]; b++) {
+          offset_t index = origin + c * z_stride + b * y_stride;
+          for (int a = lo[0]; a < hi[0]; a++) {
+            Scalar node = data[index + a];
+            Scalar weight = w[0][a] * w[1][b] * w[2][c];
+            value += weight * node;
+            total += weight;
+            if (row) {
+              affine += node * Vector3(g[0][a] * w[1][b] * w[2][c],
+                                       w[0][a] * g[1][b] * w[2][c],
+                                       w[0][a] * w[1][b] * g[2][c]);
+            }
+          }
+        }
+      }
+      // Only less than one where nodes were cut off at the boundary.
+      Scalar inv_total = total > 0 ? 1 / total : Scalar(0);
+      if (row) {
+        *row = affine * inv_total;
+      }
+      return value * inv_total;
+    }
+
+    offset_t base[3];
+    int lo[3];
+    int hi[3];
+    offset_t origin;
+    offset_t y_stride;
+    offset_t z_stride;
+    Scalar w[3][N];
+    // Node position minus particle position.
+    Scalar d[3][N];
+    // Weights of the affine velocity gradient.
+    Scalar g[3][N];
+  };
+
+  template <class Func>
+  void DispatchKernel(Func &&func) const {
+    if (settings_.kernel == particle_kernel_type::linear) {
+      func(std::integral_constant<int, 2>{});
+    } else {
+      func(std::integral_constant<int, 3>{});
+    }
+  }
+
+  // Calls func(p) for the particles of every tile, tile by tile, with the
+  // tiles of one colour in parallel.
+  template <class Func>
+  void ForEachTileParticle(Func &&func) const {
+    for (const std::vector<size_t> &tiles : coloured_tiles_) {
+      ParallelFor(0, int64_t(tiles.size()), 1,
+                  [&](int64_t begin, int64_t end) {
+                    for (int64_t i = begin; i < end; i++) {
+                      size_t tile = tiles[i];
+                      for (size_t j = tile_offsets_[tile];
+                           j < tile_offsets_[tile + 1]; j++) {
+                        func(order_[j]);
+                      }
+                    }
+                  });
+    }
+  }
+
+  // Calls func(p) for every particle in parallel, in binned order when the
+  // last Bin() was for as many particles.
+  template <class Func>
+  void ForEachParticle(size_t n, Func &&func) const {
+    bool binned = order_.size() == n;
+    ParallelFor(0, int64_t(n), data_structure::kParallelGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    func(binned ? order_[i] : uint32_t(i));
+                  }
+                });
+  }
+
+  void Normalize(Scalar *values, const Scalar *weights, size_t size) const {
+    ParallelFor(0, int64_t(size), data_structure::kParallelGrain,
+                [&](int64_t begin, int64_t end) {
+                  for (int64_t i = begin; i < end; i++) {
+                    values[i] = weights[i] > 0 ? values[i] / weights[i]
+                                               : Scalar(0);
+                  }
+                });
+  }
+
+  Vector3 Clamp(const Vector3 &pos) const {
+    return pos.cwiseMax(Vector3::Zero())
+        .cwiseMin(Vector3(Scalar(width_), Scalar(height_), Scalar(depth_)));
+  }
+
+  void CellOf(const Vector3 &pos, offset_t cell[3]) const {
+    Vector3 clamped = Clamp(pos);
+    offset_t size[3] = {offset_t(width_), offset_t(height_),
+                        offset_t(depth_)};
+    for (int axis = 0; axis < 3; axis++) {
+      cell[axis] = std::min(offset_t(std::floor(clamped[axis])),
+                            size[axis] - 1);
+    }
+  }
+
+  // Where node (0, 0, 0) of a face or cell grid lies in cell units.
+  static Vector3 FaceOffset(int component) {
+    Vector3 offset = Vector3::Constant(Scalar(0.5));
+    offset[component] = 0;
+    return offset;
+  }
+
+  static Vector3 CellOffset() {
+    return Vector3::Constant(Scalar(0.5));
+  }
+
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  ParticleTransferSettings settings_;
+  size_t tile_size_;
+  size_t tiles_x_;
+  size_t tiles_y_;
+  size_t tiles_z_;
+  std::vector<size_t> coloured_tiles_[8];
+  std::vector<uint32_t> tile_keys_;
+  std::vector<uint32_t> cell_keys_;
+  std::vector<size_t> chunk_offsets_;
+  std::vector<size_t> tile_offsets_;
+  std::vector<uint32_t> scratch_;
+  std::vector<uint32_t> order_;
+  data_structure::MACGrid<Scalar> face_weights_;
+  data_structure::LinearGrid<Scalar> cell_weights_;
+};
+
+}  // namespace grassland
@@ -4,5 +4,8 @@
 #include "grassland/physics/elastic_models.h"
 #include "grassland/physics/fem_elements.h"
 #include "grassland/physics/geometry_sdf.h"
+#include "grassland/physics/grid_sdf.h"
+#include "grassland/physics/particle_transfer.h"
+#include "grassland/physics/pressure_projection.h"
 
 namespace grassland {}
@@ -0,0 +1,431 @@
+#include "grassland/physics/pressure_projection.h"
+
+#include "chrono"
+
+namespace grassland {
+
+using data_structure::grid_boundary_type;
+using data_structure::LinearGrid;
+using data_structure::offset_t;
+
+namespace {
+LinearGrid<float> CreatePaddedGrid(size_t width, size_t height, size_t depth) {
+  return LinearGrid<float>(width, height, depth, 1,
+                           grid_boundary_type::constant, 0.0f, 0.0f);
+}
+
+// Calls func(y, z) for every row of a width x height x depth grid, in
+// parallel.
+template <class Func>
+void ForEachRow(size_t width, size_t height, size_t depth, Func &&func) {
+  offset_t rows_per_chunk = std::max<offset_t>(
+      1, offset_t(data_structure::kParallelGrain) /
+             offset_t(std::max<size_t>(width, 1)));
+  ParallelFor(0, offset_t(height * depth), rows_per_chunk,
+              [&](offset_t row_begin, offset_t row_end) {
+                for (offset_t row = row_begin; row < row_end; row++) {
+                  func(row % offset_t(height), row / offset_t(height));
+                }
+              });
+}
+}  // namespace
+
+PressureProjection::Level::Level(size_t width, size_t height, size_t depth)
+    : width(width),
+      height(height),
+      depth(depth),
+      cells(width, height, depth, fluid_cell_type::solid),
+      diagonal(width, height, depth, uint8_t(0)),
+      x(CreatePaddedGrid(width, height, depth)),
+      b(CreatePaddedGrid(width, height, depth)),
+      r(CreatePaddedGrid(width, height, depth)) {
+}
+
+PressureProjection::PressureProjection(
+    size_t width,
+    size_t height,
+    size_t depth,
+    const PressureProjectionSettings &settings)
+    : width_(width),
+      height_(height),
+      depth_(depth),
+      settings_(settings),
+      pressure_(CreatePaddedGrid(width, height, depth)),
+      residual_(CreatePaddedGrid(width, height, depth)),
+      search_(CreatePaddedGrid(width, height, depth)),
+      product_(CreatePaddedGrid(width, height, depth)) {
+}
+
+const PressureSolveStats &PressureProjection::Project(
+    data_structure::MACGrid<float> &velocity,
+    const LinearGrid<fluid_cell_type> &cells,
+    float scale) {
+  auto start = std::chrono::steady_clock::now();
+  stats_ = PressureSolveStats{};
+  auto has_size = [](const auto &grid, size_t width, size_t height,
+                     size_t depth) {
+    return grid.width() == width && grid.height() == height &&
+           grid.depth() == depth;
+  };
+  if (!has_size(cells, width_, height_, depth_) ||
+      !has_size(velocity.u(), width_ + 1, height_, depth_) ||
+      !has_size(velocity.v(), width_, height_ + 1, depth_) ||
+      !has_size(velocity.w(), width_, height_, depth_ + 1)) {
+    LogError(
+        "PressureProjection: velocity {} x {} x {} or cells {} x {} x {} do "
+        "not match the solver size {} x {} x {}",
+        velocity.width(), velocity.height(), velocity.depth(), cells.width(),
+        cells.height(), cells.depth(), width_, height_, depth_);
+    return stats_;
+  }
+  SetupLevels(cells);
+  stats_.levels = int(levels_.size());
+  const Level &fine = levels_[0];
+
+  auto non_solid = [&](offset_t x, offset_t y, offset_t z) {
+    return x >= 0 && y >= 0 && z >= 0 && x < offset_t(width_) &&
+           y < offset_t(height_) && z < offset_t(depth_) &&
+           cells(x, y, z) != fluid_cell_type::solid;
+  };
+
+  // Faces of solid cells and of the domain boundary do not move.
+  auto &u = velocity.u();
+  auto &v = velocity.v();
+  auto &w = velocity.w();
+  data_structure::ParallelForEach(
+      u, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (!non_solid(x - 1, y, z) || !non_solid(x, y, z)) {
+          value = 0.0f;
+        }
+      });
+  data_structure::ParallelForEach(
+      v, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (!non_solid(x, y - 1, z) || !non_solid(x, y, z)) {
+          value = 0.0f;
+        }
+      });
+  data_structure::ParallelForEach(
+      w, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (!non_solid(x, y, z - 1) || !non_solid(x, y, z)) {
+          value = 0.0f;
+        }
+      });
+
+  // Right-hand side -div(u) / scale on fluid cells, zero elsewhere.
+  float inv_scale = 1.0f / scale;
+  data_structure::ParallelForEach(
+      residual_, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        value = fine.diagonal(x, y, z)
+                    ? -((u(x + 1, y, z) - u(x, y, z)) +
+                        (v(x, y + 1, z) - v(x, y, z)) +
+                        (w(x, y, z + 1) - w(x, y, z))) *
+                          inv_scale
+                    : 0.0f;
+      });
+  if (!has_air_) {
+    RemoveMean(residual_);
+  }
+
+  data_structure::ParallelFill(
+      pressure_, [](offset_t, offset_t, offset_t) { return 0.0f; });
+  float initial_residual = data_structure::MaxAbs(residual_);
+  stats_.initial_residual = initial_residual;
+  stats_.converged = initial_residual == 0.0f;
+
+  if (!stats_.converged) {
+    VCycle();
+    search_.buffer() = levels_[0].x.buffer();
+    double rz = Dot(residual_, levels_[0].x);
+    for (int iteration = 0; iteration < settings_.max_iterations;
+         iteration++) {
+      ApplyOperator(fine, search_, product_);
+      double sq = Dot(search_, product_);
+      if (sq <= 0.0) {
+        break;
+      }
+      float alpha = float(rz / sq);
+      ForEachRow(width_, height_, depth_, [&](offset_t y, offset_t z) {
+        float *p = &pressure_(0, y, z);
+        float *r = &residual_(0, y, z);
+        const float *s = &search_(0, y, z);
+        const float *q = &product_(0, y, z);
+        for (size_t x = 0; x < width_; x++) {
+          p[x] += alpha * s[x];
+          r[x] -= alpha * q[x];
+        }
+      });
+
+      stats_.iterations = iteration + 1;
+      stats_.relative_residual =
+          data_structure::MaxAbs(residual_) / initial_residual;
+      stats_.residual_history.push_back(stats_.relative_residual);
+      if (stats_.relative_residual <= settings_.tolerance) {
+        stats_.converged = true;
+        break;
+      }
+
+      VCycle();
+      const LinearGrid<float> &preconditioned = levels_[0].x;
+      double rz_new = Dot(residual_, preconditioned);
+      float beta = float(rz_new / rz);
+      rz = rz_new;
+      ForEachRow(width_, height_, depth_, [&](offset_t y, offset_t z) {
+        float *s = &search_(0, y, z);
+        const float *z_row = &preconditioned(0, y, z);
+        for (size_t x = 0; x < width_; x++) {
+          s[x] = z_row[x] + beta * s[x];
+        }
+      });
+    }
+    if (!has_air_) {
+      RemoveMean(pressure_);
+    }
+  }
+
+  // Air cells keep zero pressure, so fluid-air faces see the free surface.
+  data_structure::ParallelForEach(
+      u, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (non_solid(x - 1, y, z) && non_solid(x, y, z)) {
+          value -= (pressure_(x, y, z) - pressure_(x - 1, y, z)) * scale;
+        }
+      });
+  data_structure::ParallelForEach(
+      v, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (non_solid(x, y - 1, z) && non_solid(x, y, z)) {
+          value -= (pressure_(x, y, z) - pressure_(x, y - 1, z)) * scale;
+        }
+      });
+  data_structure::ParallelForEach(
+      w, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (non_solid(x, y, z - 1) && non_solid(x, y, z)) {
+          value -= (pressure_(x, y, z) - pressure_(x, y, z - 1)) * scale;
+        }
+      });
+
+  stats_.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return stats_;
+}
+
+void PressureProjection::SetupLevels(
+    const LinearGrid<fluid_cell_type> &cells) {
+  if (levels_.empty()) {
+    size_t width = width_, height = height_, depth = depth_;
+    levels_.emplace_back(width, height, depth);
+    while (std::min({width, height, depth}) / 2 >= settings_.coarsest_size) {
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+      depth = (depth + 1) / 2;
+      levels_.emplace_back(width, height, depth);
+    }
+  }
+
+  data_structure::ParallelFill(
+      levels_[0].cells,
+      [&](offset_t x, offset_t y, offset_t z) { return cells(x, y, z); });
+  // A coarse cell is air if any of its children is, so that the free surface
+  // survives coarsening, else fluid if any child is fluid.
+  for (size_t l = 1; l < levels_.size(); l++) {
+    const Level &fine = levels_[l - 1];
+    Level &coarse = levels_[l];
+    data_structure::ParallelFill(
+        coarse.cells, [&](offset_t x, offset_t y, offset_t z) {
+          bool any_fluid = false;
+          for (offset_t k = 2 * z; k < std::min<offset_t>(2 * z + 2,
+                                                          fine.depth);
+               k++) {
+            for (offset_t j = 2 * y;
+                 j < std::min<offset_t>(2 * y + 2, fine.height); j++) {
+              for (offset_t i = 2 * x;
+                   i < std::min<offset_t>(2 * x + 2, fine.width); i++) {
+                if (fine.cells(i, j, k) == fluid_cell_type::air) {
+                  return fluid_cell_type::air;
+                }
+                any_fluid |= fine.cells(i, j, k) == fluid_cell_type::fluid;
+              }
+            }
+          }
+          return any_fluid ? fluid_cell_type::fluid : fluid_cell_type::solid;
+        });
+  }
+
+  for (auto &level : levels_) {
+    auto non_solid = [&](offset_t x, offset_t y, offset_t z) {
+      return x >= 0 && y >= 0 && z >= 0 && x < offset_t(level.width) &&
+             y < offset_t(level.height) && z < offset_t(level.depth) &&
+             level.cells(x, y, z) != fluid_cell_type::solid;
+    };
+    data_structure::ParallelFill(
+        level.diagonal, [&](offset_t x, offset_t y, offset_t z) {
+          if (level.cells(x, y, z) != fluid_cell_type::fluid) {
+            return uint8_t(0);
+          }
+          return uint8_t(non_solid(x - 1, y, z) + non_solid(x + 1, y, z) +
+                         non_solid(x, y - 1, z) + non_solid(x, y + 1, z) +
+                         non_solid(x, y, z - 1) + non_solid(x, y, z + 1));
+        });
+  }
+
+  const Level &fine = levels_[0];
+  has_air_ = false;
+  num_fluid_cells_ = 0;
+  for (size_t i = 0; i < fine.cells.buffer().size(); i++) {
+    has_air_ |= fine.cells.buffer()[i] == fluid_cell_type::air;
+    num_fluid_cells_ += fine.diagonal.buffer()[i] != 0;
+  }
+}
+
+void PressureProjection::ApplyOperator(const Level &level,
+                                       const LinearGrid<float> &in,
+                                       LinearGrid<float> &out) const {
+  offset_t y_stride = in.y_stride(), z_stride = in.z_stride();
+  ForEachRow(level.width, level.height, level.depth,
+             [&](offset_t y, offset_t z) {
+               const uint8_t *diagonal = &level.diagonal(0, y, z);
+               const float *p = &in(0, y, z);
+               float *result = &out(0, y, z);
+               for (size_t x = 0; x < level.width; x++) {
+                 result[x] = diagonal[x]
+                                 ? diagonal[x] * p[x] -
+                                       (p[x - 1] + p[x + 1] + p[x - y_stride] +
+                                        p[x + y_stride] + p[x - z_stride] +
+                                        p[x + z_stride])
+                                 : 0.0f;
+               }
+             });
+}
+
+void PressureProjection::Smooth(Level &level, int sweeps, bool reverse) const {
+  offset_t y_stride = level.x.y_stride(), z_stride = level.x.z_stride();
+  for (int sweep = 0; sweep < 2 * sweeps; sweep++) {
+    offset_t color = (sweep + reverse) & 1;
+    ForEachRow(level.width, level.height, level.depth,
+               [&](offset_t y, offset_t z) {
+                 const uint8_t *diagonal = &level.diagonal(0, y, z);
+                 const float *b = &level.b(0, y, z);
+                 float *p = &level.x(0, y, z);
+                 for (offset_t x = (y + z + color) & 1;
+                      x < offset_t(level.width); x += 2) {
+                   if (diagonal[x]) {
+                     p[x] = (b[x] + p[x - 1] + p[x + 1] + p[x - y_stride] +
+                             p[x + y_stride] + p[x - z_stride] +
+                             p[x + z_stride]) /
+                            diagonal[x];
+                   }
+                 }
+               });
+  }
+}
+
+void PressureProjection::ComputeResidual(Level &level) const {
+  ApplyOperator(level, level.x, level.r);
+  ForEachRow(level.width, level.height, level.depth,
+             [&](offset_t y, offset_t z) {
+               const float *b = &level.b(0, y, z);
+               float *r = &level.r(0, y, z);
+               for (size_t x = 0; x < level.width; x++) {
+                 r[x] = b[x] - r[x];
+               }
+             });
+}
+
+// Half the sum of the children, which matches the coarse operator being the
+// fine stencil rediscretized at twice the spacing.
+void PressureProjection::Restrict(const Level &fine, Level &coarse) const {
+  data_structure::ParallelForEach(
+      coarse.b, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        value = 0.0f;
+        if (!coarse.diagonal(x, y, z)) {
+          return;
+        }
+        for (offset_t k = 2 * z; k < std::min<offset_t>(2 * z + 2, fine.depth);
+             k++) {
+          for (offset_t j = 2 * y;
+               j < std::min<offset_t>(2 * y + 2, fine.height); j++) {
+            for (offset_t i = 2 * x;
+                 i < std::min<offset_t>(2 * x + 2, fine.width); i++) {
+              value += fine.r(i, j, k);
+            }
+          }
+        }
+        value *= 0.5f;
+      });
+}
+
+void PressureProjection::Prolongate(const Level &coarse, Level &fine) const {
+  data_structure::ParallelForEach(
+      fine.x, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (fine.diagonal(x, y, z)) {
+          value += coarse.x(x / 2, y / 2, z / 2);
+        }
+      });
+}
+
+// One symmetric V-cycle applied to residual_, leaving the result in the
+// finest level's x. Red-black Gauss-Seidel runs red first on the way down
+// and black first on the way up, so the preconditioner stays symmetric.
+void PressureProjection::VCycle() {
+  levels_[0].b.buffer() = residual_.buffer();
+  for (size_t l = 0; l < levels_.size(); l++) {
+    Level &level = levels_[l];
+    data_structure::ParallelFill(
+        level.x, [](offset_t, offset_t, offset_t) { return 0.0f; });
+    if (l + 1 == levels_.size()) {
+      Smooth(level, settings_.coarsest_sweeps, false);
+      Smooth(level, settings_.coarsest_sweeps, true);
+      break;
+    }
+    Smooth(level, settings_.smoothing_sweeps, false);
+    ComputeResidual(level);
+    Restrict(level, levels_[l + 1]);
+  }
+  for (size_t l = levels_.size() - 1; l > 0; l--) {
+    Prolongate(levels_[l], levels_[l - 1]);
+    Smooth(levels_[l - 1], settings_.smoothing_sweeps, true);
+  }
+  if (!has_air_) {
+    RemoveMean(levels_[0].x);
+  }
+}
+
+void PressureProjection::RemoveMean(LinearGrid<float> &grid) const {
+  if (!num_fluid_cells_) {
+    return;
+  }
+  const auto &diagonal = levels_[0].diagonal;
+  float mean = float(
+      data_structure::ReduceRows(
+          width_, height_, depth_, 0.0,
+          [&](offset_t y, offset_t z) {
+            double sum = 0.0;
+            for (size_t x = 0; x < width_; x++) {
+              sum += diagonal(x, y, z) ? grid(x, y, z) : 0.0f;
+            }
+            return sum;
+          },
+          data_structure::ReduceSum<double>()) /
+      num_fluid_cells_);
+  data_structure::ParallelForEach(
+      grid, [&](offset_t x, offset_t y, offset_t z, float &value) {
+        if (diagonal(x, y, z)) {
+          value -= mean;
+        }
+      });
+}
+
+double PressureProjection::Dot(const LinearGrid<float> &a,
+                               const LinearGrid<float> &b) const {
+  return data_structure::ReduceRows(
+      width_, height_, depth_, 0.0,
+      [&](offset_t y, offset_t z) {
+        const float *row_a = &a(0, y, z);
+        const float *row_b = &b(0, y, z);
+        return data_structure::ReduceRow(
+            width_, 0.0,
+            [&](offset_t x) { return double(row_a[x]) * row_b[x]; },
+            data_structure::ReduceSum<double>());
+      },
+      data_structure::ReduceSum<double>());
+}
+}  // namespace grassland
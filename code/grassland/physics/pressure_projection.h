@@ -0,0 +1,124 @@
+#pragma once
+#include "grassland/data_structure/data_structure.h"
+#include "grassland/physics/physics_util.h"
+
+namespace grassland {
+
+enum class fluid_cell_type : uint8_t { fluid = 0, solid, air };
+
+struct PressureProjectionSettings {
+  // The solve stops once the largest residual is below tolerance times the
+  // largest entry of the right-hand side.
+  float tolerance{1e-5f};
+  int max_iterations{500};
+  // Red-black Gauss-Seidel sweeps before and after each coarse grid
+  // correction, and on the coarsest level.
+  int smoothing_sweeps{2};
+  int coarsest_sweeps{32};
+  // Levels are halved until one side would drop below this many cells.
+  size_t coarsest_size{4};
+};
+
+struct PressureSolveStats {
+  int iterations{0};
+  int levels{0};
+  bool converged{false};
+  // Largest absolute residual before the first iteration, and after the
+  // last one relative to it.
+  float initial_residual{0.0f};
+  float relative_residual{0.0f};
+  double seconds{0.0};
+  std::vector<float> residual_history;
+};
+
+// Pressure projection for a MACGrid<float> velocity, solving the Poisson
+// equation with a matrix-free conjugate gradient preconditioned by a
+// geometric multigrid V-cycle (MGPCG, McAdams et al. 2010). Every level
+// applies the 7-point stencil directly from the cell classification, no
+// matrix is assembled, and all kernels run on the global thread pool with a
+// reduction order that does not depend on the thread count.
+//
+// Air cells have zero pressure. Solid cells and the outside of the domain
+// have zero velocity. If no cell is air, the pressure is defined up to a
+// constant and is returned with zero mean.
+class PressureProjection {
+ public:
+  PressureProjection(size_t width,
+                     size_t height,
+                     size_t depth,
+                     const PressureProjectionSettings &settings = {});
+
+  // Makes velocity divergence-free in fluid cells. Faces touching a solid
+  // cell or the domain boundary are set to zero, the others lose
+  // scale * grad p, where scale is usually dt / (density * dx). cells must be
+  // width x height x depth and velocity a MACGrid of that size, otherwise an
+  // error is logged and nothing is changed; stats().converged is then false.
+  const PressureSolveStats &Project(
+      data_structure::MACGrid<float> &velocity,
+      const data_structure::LinearGrid<fluid_cell_type> &cells,
+      float scale);
+
+  const data_structure::LinearGrid<float> &pressure() const {
+    return pressure_;
+  }
+
+  const PressureSolveStats &stats() const {
+    return stats_;
+  }
+
+  PressureProjectionSettings &settings() {
+    return settings_;
+  }
+
+ private:
+  struct Level {
+    Level(size_t width, size_t height, size_t depth);
+
+    size_t width;
+    size_t height;
+    size_t depth;
+    data_structure::LinearGrid<fluid_cell_type> cells;
+    // Number of non-solid neighbours of a fluid cell, 0 for other cells.
+    data_structure::LinearGrid<uint8_t> diagonal;
+    // Padded with a ghost layer of zeros, which stands for the solid domain
+    // boundary and keeps the stencils free of bounds checks.
+    data_structure::LinearGrid<float> x;
+    data_structure::LinearGrid<float> b;
+    data_structure::LinearGrid<float> r;
+  };
+
+  void SetupLevels(const data_structure::LinearGrid<fluid_cell_type> &cells);
+
+  void ApplyOperator(const Level &level,
+                     const data_structure::LinearGrid<float> &in,
+                     data_structure::LinearGrid<float> &out) const;
+
+  void Smooth(Level &level, int sweeps, bool reverse) const;
+
+  void ComputeResidual(Level &level) const;
+
+  void Restrict(const Level &fine, Level &coarse) const;
+
+  void Prolongate(const Level &coarse, Level &fine) const;
+
+  void VCycle();
+
+  void RemoveMean(data_structure::LinearGrid<float> &grid) const;
+
+  double Dot(const data_structure::LinearGrid<float> &a,
+             const data_structure::LinearGrid<float> &b) const;
+
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  PressureProjectionSettings settings_;
+  PressureSolveStats stats_;
+  std::vector<Level> levels_;
+  bool has_air_{false};
+  size_t num_fluid_cells_{0};
+  data_structure::LinearGrid<float> pressure_;
+  data_structure::LinearGrid<float> residual_;
+  data_structure::LinearGrid<float> search_;
+  data_structure::LinearGrid<float> product_;
+};
+}  // namespace grassland
@@ -0,0 +1,55 @@
+#pragma once
+#include "cstddef"
+#include "cstdint"
+#include "string"
+
+namespace grassland {
+
+// A whole file mapped into memory. Pages are read from disk on first access,
+// so opening a large file is cheap. The mapping is copy-on-write: writes
+// through data() are visible to this process only and never reach the file.
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept;
+
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  // Maps filename, closing any file mapped before. Returns 0 on success and
+  // -1 if the file cannot be opened or mapped.
+  int Open(const std::string &filename);
+
+  void Close();
+
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+
+  uint8_t *data() {
+    return data_;
+  }
+
+  const uint8_t *data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  uint8_t *data_{nullptr};
+  size_t size_{0};
+#ifdef _WIN32
+  void *file_handle_{nullptr};
+  void *mapping_handle_{nullptr};
+#endif
+};
+}  // namespace grassland
@@ -0,0 +1,121 @@
+#include "grassland/util/thread_pool.h"
+
+#include "memory"
+
+namespace grassland {
+
+namespace {
+thread_local bool in_parallel_region = false;
+
+std::unique_ptr<ThreadPool> global_thread_pool;
+std::mutex global_thread_pool_mutex;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (!num_threads) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (size_t i = 1; i < num_threads; i++) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Run(size_t num_chunks,
+                     const std::function<void(size_t)> &func) {
+  if (!num_chunks) {
+    return;
+  }
+  if (in_parallel_region || workers_.empty() || num_chunks == 1) {
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      func(chunk);
+    }
+    return;
+  }
+
+  // Jobs submitted by different threads take turns.
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    func_ = &func;
+    num_chunks_ = num_chunks;
+    pending_ = workers_.size();
+    exception_ = nullptr;
+    generation_++;
+  }
+  start_cv_.notify_all();
+
+  RunChunks(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() { return pending_ == 0; });
+  func_ = nullptr;
+  if (exception_) {
+    std::exception_ptr exception = exception_;
+    exception_ = nullptr;
+    lock.unlock();
+    std::rethrow_exception(exception);
+  }
+}
+
+void ThreadPool::WorkerLoop(size_t thread_index) {
+  uint64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock,
+                     [&]() { return stop_ || generation_ != generation; });
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+    }
+
+    RunChunks(thread_index);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::RunChunks(size_t thread_index) {
+  in_parallel_region = true;
+  try {
+    for (size_t chunk = thread_index; chunk < num_chunks_;
+         chunk += num_threads()) {
+      (*func_)(chunk);
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!exception_) {
+      exception_ = std::current_exception();
+    }
+  }
+  in_parallel_region = false;
+}
+
+ThreadPool &GlobalThreadPool() {
+  std::lock_guard<std::mutex> lock(global_thread_pool_mutex);
+  if (!global_thread_pool) {
+    global_thread_pool = std::make_unique<ThreadPool>();
+  }
+  return *global_thread_pool;
+}
+
+void SetGlobalThreadCount(size_t num_threads) {
+  std::lock_guard<std::mutex> lock(global_thread_pool_mutex);
+  global_thread_pool = std::make_unique<ThreadPool>(num_threads);
+}
+}  // namespace grassland
@@ -0,0 +1,82 @@
+#pragma once
+#include "algorithm"
+#include "condition_variable"
+#include "cstdint"
+#include "exception"
+#include "functional"
+#include "mutex"
+#include "thread"
+#include "vector"
+
+namespace grassland {
+
+// A fixed set of worker threads for data-parallel loops. Run() splits a job
+// into numbered chunks and assigns chunk c to thread c % num_threads(), the
+// calling thread being thread 0, so the same chunk always runs on the same
+// thread and the schedule does not depend on timing. Run() called from
+// inside a running job executes its chunks serially on the calling thread.
+class ThreadPool {
+ public:
+  // num_threads counts the calling thread; 0 means one per hardware thread.
+  explicit ThreadPool(size_t num_threads = 0);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t num_threads() const {
+    return workers_.size() + 1;
+  }
+
+  // Calls func(chunk) for every chunk in [0, num_chunks) and returns when all
+  // of them are done. An exception thrown by func is rethrown here.
+  void Run(size_t num_chunks, const std::function<void(size_t)> &func);
+
+ private:
+  void WorkerLoop(size_t thread_index);
+
+  void RunChunks(size_t thread_index);
+
+  std::vector<std::thread> workers_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t)> *func_{nullptr};
+  size_t num_chunks_{0};
+  size_t pending_{0};
+  uint64_t generation_{0};
+  bool stop_{false};
+  std::exception_ptr exception_;
+};
+
+// The pool used by ParallelFor and the parallel grid kernels. It is created
+// on first use with one thread per hardware thread.
+ThreadPool &GlobalThreadPool();
+
+// Replaces the global pool by one with num_threads threads (0 means one per
+// hardware thread). Must not be called while a parallel loop is running.
+void SetGlobalThreadCount(size_t num_threads);
+
+// Calls func(chunk_begin, chunk_end) for consecutive ranges of at most grain
+// items covering [begin, end), in parallel on the global pool. The ranges
+// only depend on begin, end and grain, not on the number of threads.
+template <class Func>
+void ParallelFor(int64_t begin, int64_t end, int64_t grain, Func &&func) {
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max<int64_t>(grain, 1);
+  size_t num_chunks = (end - begin + grain - 1) / grain;
+  if (num_chunks == 1) {
+    func(begin, end);
+    return;
+  }
+  GlobalThreadPool().Run(num_chunks, [&](size_t chunk) {
+    int64_t chunk_begin = begin + int64_t(chunk) * grain;
+    func(chunk_begin, std::min(chunk_begin + grain, end));
+  });
+}
+}  // namespace grassland
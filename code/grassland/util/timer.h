@@ -0,0 +1,15 @@
+#pragma once
+#include "chrono"
+
+namespace grassland {
+
+// Wall-clock seconds taken by func(), measured with a steady clock.
+template <class Func>
+double MeasureSeconds(Func &&func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace grassland
@@ -10,7 +10,10 @@
 #include "grassland/util/double_ptr.h"
 #include "grassland/util/event_manager.h"
 #include "grassland/util/log.h"
+#include "grassland/util/mapped_file.h"
 #include "grassland/util/string_convert.h"
+#include "grassland/util/thread_pool.h"
+#include "grassland/util/timer.h"
 
 namespace grassland {
 #if defined(__CUDACC__)
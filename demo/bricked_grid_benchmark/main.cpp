@@ -0,0 +1,122 @@
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+using data_structure::offset_t;
+
+template <class GridType>
+void FillGrid(GridType &grid) {
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        grid(i, j, k) = std::sin(0.1f * i) + std::cos(0.07f * j) + 0.01f * k;
+      }
+    }
+  }
+}
+
+template <class GridType>
+float BenchmarkSample(const GridType &grid,
+                      const std::vector<geometry::Vector3<float>> &positions,
+                      double *seconds) {
+  float sum = 0.0f;
+  *seconds = MeasureSeconds([&]() {
+    for (const auto &pos : positions) {
+      sum += grid.sample(pos[0], pos[1], pos[2]);
+    }
+  });
+  return sum;
+}
+
+// Cells are visited tile by tile, which is how a stencil kernel would walk a
+// bricked grid; the linear grid is walked the same way for a fair comparison.
+template <class GridType>
+float BenchmarkStencil(const GridType &grid,
+                       GridType &result,
+                       size_t tile_size,
+                       double *seconds) {
+  offset_t width = grid.width(), height = grid.height(), depth = grid.depth();
+  *seconds = MeasureSeconds([&]() {
+    for (offset_t tz = 1; tz + 1 < depth; tz += tile_size) {
+      for (offset_t ty = 1; ty + 1 < height; ty += tile_size) {
+        for (offset_t tx = 1; tx + 1 < width; tx += tile_size) {
+          offset_t end_z = std::min<offset_t>(tz + tile_size, depth - 1);
+          offset_t end_y = std::min<offset_t>(ty + tile_size, height - 1);
+          offset_t end_x = std::min<offset_t>(tx + tile_size, width - 1);
+          for (offset_t k = tz; k < end_z; k++) {
+            for (offset_t j = ty; j < end_y; j++) {
+              for (offset_t i = tx; i < end_x; i++) {
+                result(i, j, k) = grid(i - 1, j, k) + grid(i + 1, j, k) +
+                                  grid(i, j - 1, k) + grid(i, j + 1, k) +
+                                  grid(i, j, k - 1) + grid(i, j, k + 1) -
+                                  6.0f * grid(i, j, k);
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+  return result(width / 2, height / 2, depth / 2);
+}
+
+int main(int argc, char **argv) {
+  size_t size = argc > 1 ? std::stoul(argv[1]) : 256;
+  size_t num_samples = argc > 2 ? std::stoul(argv[2]) : 10000000;
+
+  data_structure::LinearGrid<float> linear_grid(size, size, size);
+  data_structure::BrickedGrid<float> bricked_grid(size, size, size);
+  FillGrid(linear_grid);
+  FillGrid(bricked_grid);
+
+  // Random positions stress the memory system, coherent positions (a ray
+  // marching along z) are what advection and collision queries look like.
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(0.0f, float(size - 1));
+  std::vector<geometry::Vector3<float>> random_positions(num_samples);
+  for (auto &pos : random_positions) {
+    pos = {dis(gen), dis(gen), dis(gen)};
+  }
+  std::vector<geometry::Vector3<float>> coherent_positions(num_samples);
+  float step = float(size - 1) / 64.0f;
+  for (size_t i = 0; i < num_samples; i++) {
+    if (i % 64 == 0) {
+      coherent_positions[i] = {dis(gen), dis(gen), 0.0f};
+    } else {
+      coherent_positions[i] = coherent_positions[i - 1] +
+                              geometry::Vector3<float>{0.0f, 0.0f, step};
+    }
+  }
+
+  LogInfo("Grid {}^3, {} samples", size, num_samples);
+
+  double linear_seconds, bricked_seconds;
+  float linear_sum, bricked_sum;
+
+  linear_sum = BenchmarkSample(linear_grid, random_positions, &linear_seconds);
+  bricked_sum =
+      BenchmarkSample(bricked_grid, random_positions, &bricked_seconds);
+  LogInfo("Random trilinear sample:     linear {:.3f}s, bricked {:.3f}s ({})",
+          linear_seconds, bricked_seconds, linear_sum - bricked_sum);
+
+  linear_sum =
+      BenchmarkSample(linear_grid, coherent_positions, &linear_seconds);
+  bricked_sum =
+      BenchmarkSample(bricked_grid, coherent_positions, &bricked_seconds);
+  LogInfo("Coherent trilinear sample:   linear {:.3f}s, bricked {:.3f}s ({})",
+          linear_seconds, bricked_seconds, linear_sum - bricked_sum);
+
+  data_structure::LinearGrid<float> linear_result(size, size, size);
+  data_structure::BrickedGrid<float> bricked_result(size, size, size);
+  for (size_t tile_size : {size_t(8), size}) {
+    linear_sum = BenchmarkStencil(linear_grid, linear_result, tile_size,
+                                  &linear_seconds);
+    bricked_sum = BenchmarkStencil(bricked_grid, bricked_result, tile_size,
+                                   &bricked_seconds);
+    LogInfo("7-point stencil, {}^3 tiles: linear {:.3f}s, bricked {:.3f}s ({})",
+            tile_size, linear_seconds, bricked_seconds,
+            linear_sum - bricked_sum);
+  }
+
+  return 0;
+}
@@ -37,13 +37,7 @@ int main() {
   geometry::Field<double, double, decltype(grid_view)> field_view(
       1.0, {-5.0, -5.0, -5.0}, grid_view);
 
-  for (int i = 0; i < field.width(); i++) {
-    for (int j = 0; j < field.height(); j++) {
-      for (int k = 0; k < field.depth(); k++) {
-        field(i, j, k) = SignedDistanceFunction(field.get_position(i, j, k));
-      }
-    }
-  }
+  field.FillFromFunction(SignedDistanceFunction);
 
   //  for (int k = 0; k < field.depth(); k++) {
   //      for (int j = 0; j < field.height(); j++) {
@@ -0,0 +1,65 @@
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+template <class ContentType>
+void BenchmarkField(size_t size, size_t num_samples) {
+  geometry::Field<ContentType, ContentType> field(
+      size, size, size, ContentType(2) / ContentType(size),
+      {-1.0, -1.0, -1.0}, 0);
+  for (size_t k = 0; k < size; k++) {
+    for (size_t j = 0; j < size; j++) {
+      for (size_t i = 0; i < size; i++) {
+        field(i, j, k) = field.get_position(i, j, k).norm() - 0.5;
+      }
+    }
+  }
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<ContentType> dis(-1.0, 1.0);
+  std::vector<geometry::Vector3<ContentType>> positions(num_samples);
+  for (auto &pos : positions) {
+    pos = {dis(gen), dis(gen), dis(gen)};
+  }
+  std::vector<ContentType> per_point(num_samples);
+  std::vector<ContentType> batched(num_samples);
+
+  double per_point_seconds = MeasureSeconds([&]() {
+    for (size_t i = 0; i < num_samples; i++) {
+      per_point[i] = field(positions[i]);
+    }
+  });
+  double batched_seconds = MeasureSeconds([&]() {
+    field.SampleBatch(positions.data(), batched.data(), num_samples);
+  });
+
+  ContentType max_error = 0;
+  for (size_t i = 0; i < num_samples; i++) {
+    max_error = std::max(max_error, std::abs(per_point[i] - batched[i]));
+  }
+  LogInfo(
+      "Field<{}> {}^3: per point {:.1f} Msamples/s, SampleBatch {:.1f} "
+      "Msamples/s, speedup {:.2f}x, max difference {}",
+      sizeof(ContentType) == 4 ? "float" : "double", size,
+      num_samples / per_point_seconds * 1e-6,
+      num_samples / batched_seconds * 1e-6,
+      per_point_seconds / batched_seconds, max_error);
+}
+
+int main(int argc, char **argv) {
+  size_t size = argc > 1 ? std::stoul(argv[1]) : 256;
+  size_t num_samples = argc > 2 ? std::stoul(argv[2]) : 10000000;
+
+#if defined(__AVX512F__)
+  LogInfo("Vector path: AVX-512");
+#elif defined(__AVX2__)
+  LogInfo("Vector path: AVX2");
+#else
+  LogInfo("Vector path: none, configure with -DLONGMARCH_ENABLE_AVX2=ON");
+#endif
+
+  BenchmarkField<float>(size, num_samples);
+  BenchmarkField<double>(size, num_samples);
+  return 0;
+}
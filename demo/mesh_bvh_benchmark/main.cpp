@@ -0,0 +1,155 @@
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+// A bumpy sphere of 2 * resolution^2 triangles, built as a latitude and
+// longitude grid.
+geometry::Mesh<float> BumpySphere(size_t resolution) {
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  const float pi = 3.14159265358979f;
+  for (size_t i = 0; i <= resolution; i++) {
+    float theta = pi * i / resolution;
+    for (size_t j = 0; j <= resolution; j++) {
+      float phi = 2 * pi * j / resolution;
+      float radius = 1.0f + 0.05f * std::sin(7 * theta) * std::sin(9 * phi);
+      positions.push_back(radius * geometry::Vector3<float>{
+                                       std::sin(theta) * std::cos(phi),
+                                       std::sin(theta) * std::sin(phi),
+                                       std::cos(theta)});
+    }
+  }
+  auto vertex = [&](size_t i, size_t j) {
+    return uint32_t(i * (resolution + 1) + j);
+  };
+  for (size_t i = 0; i < resolution; i++) {
+    for (size_t j = 0; j < resolution; j++) {
+      indices.insert(indices.end(), {vertex(i, j), vertex(i + 1, j),
+                                     vertex(i + 1, j + 1), vertex(i, j),
+                                     vertex(i + 1, j + 1), vertex(i, j + 1)});
+    }
+  }
+  return geometry::Mesh<float>(positions.size(), indices.size(),
+                               indices.data(), positions.data());
+}
+
+// Ray and box query throughput of bvh. Returns the closest hit rate in
+// Mrays/s.
+double BenchmarkQueries(const data_structure::MeshBVH<float> &bvh,
+                        const std::vector<geometry::Ray3<float>> &rays,
+                        size_t resolution) {
+  size_t num_rays = rays.size();
+  std::vector<uint8_t> hits(num_rays);
+  double closest_seconds = MeasureSeconds([&]() {
+    ParallelFor(0, int64_t(num_rays), 1024, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        data_structure::MeshRayHit<float> hit;
+        hits[i] = bvh.ClosestHit(rays[i], 0.0f, 10.0f, &hit);
+      }
+    });
+  });
+  size_t num_hits = std::count(hits.begin(), hits.end(), uint8_t(1));
+  double closest_rate = num_rays / closest_seconds * 1e-6;
+  LogInfo("  Closest hit: {:.2f} Mrays/s, {:.1f}% hit", closest_rate,
+          100.0 * num_hits / num_rays);
+
+  double any_seconds = MeasureSeconds([&]() {
+    ParallelFor(0, int64_t(num_rays), 1024, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        hits[i] = bvh.AnyHit(rays[i], 0.0f, 10.0f);
+      }
+    });
+  });
+  LogInfo("  Any hit: {:.2f} Mrays/s", num_rays / any_seconds * 1e-6);
+
+  // Boxes around a few dozen triangles on the surface.
+  size_t num_boxes = num_rays / 10;
+  std::vector<size_t> counts(num_boxes);
+  float half_size = 10.0f / resolution;
+  double overlap_seconds = MeasureSeconds([&]() {
+    ParallelFor(0, int64_t(num_boxes), 1024, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        geometry::Vector3<float> center = rays[i].direction;
+        geometry::AABB3<float> box(center);
+        box.Expand(center - geometry::Vector3<float>::Constant(half_size));
+        box.Expand(center + geometry::Vector3<float>::Constant(half_size));
+        bvh.ForEachOverlap(box, [&](uint32_t) { counts[i]++; });
+      }
+    });
+  });
+  size_t num_found = 0;
+  for (size_t count : counts) {
+    num_found += count;
+  }
+  LogInfo("  Box overlap: {:.2f} Mqueries/s, {:.1f} triangles per box",
+          num_boxes / overlap_seconds * 1e-6, double(num_found) / num_boxes);
+  return closest_rate;
+}
+
+int main(int argc, char **argv) {
+  size_t resolution = argc > 1 ? std::stoul(argv[1]) : 720;
+  size_t num_rays = argc > 2 ? std::stoul(argv[2]) : 4000000;
+  auto mesh = BumpySphere(resolution);
+  LogInfo("Bumpy sphere, {} triangles, {} threads", mesh.NumIndices() / 3,
+          GlobalThreadPool().num_threads());
+
+  // Rays from random points in the bounding cube to random directions, so
+  // that most start outside the sphere and some inside.
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1.5f, 1.5f);
+  std::normal_distribution<float> normal;
+  std::vector<geometry::Ray3<float>> rays(num_rays);
+  for (auto &ray : rays) {
+    ray.origin = {dis(gen), dis(gen), dis(gen)};
+    ray.direction = {normal(gen), normal(gen), normal(gen)};
+    ray.direction.normalize();
+  }
+
+  data_structure::MeshBVH<float> bvh;
+  double build_seconds =
+      MeasureSeconds([&]() { bvh = data_structure::MeshBVH<float>(mesh); });
+  LogInfo("Binned SAH build: {:.1f} ms, {} nodes", build_seconds * 1e3,
+          bvh.num_nodes());
+  double sah_rate = BenchmarkQueries(bvh, rays, resolution);
+
+  // Rebuilds, as for a deforming mesh, with the best of a few timed.
+  data_structure::MeshBVHSettings settings;
+  settings.builder = data_structure::bvh_builder_type::linear;
+  double linear_seconds = std::numeric_limits<double>::max();
+  for (int n = 0; n < 5; n++) {
+    linear_seconds = std::min(linear_seconds, MeasureSeconds([&]() {
+      bvh = data_structure::MeshBVH<float>(mesh, settings);
+    }));
+  }
+  LogInfo("Linear build: {:.1f} ms, {} nodes", linear_seconds * 1e3,
+          bvh.num_nodes());
+  double linear_rate = BenchmarkQueries(bvh, rays, resolution);
+  LogInfo("Linear vs binned SAH: {:.1f}x faster build, {:.2f}x closest hit "
+          "rate",
+          build_seconds / linear_seconds, linear_rate / sah_rate);
+
+  // A wave running over the sphere, with the tree refit every frame and
+  // rebuilt when it degrades.
+  std::vector<geometry::Vector3<float>> positions(
+      mesh.Positions(), mesh.Positions() + mesh.NumVertices());
+  bvh = data_structure::MeshBVH<float>(mesh);
+  size_t num_frames = 20;
+  for (size_t frame = 1; frame <= num_frames; frame++) {
+    float phase = 0.2f * frame;
+    for (size_t v = 0; v < positions.size(); v++) {
+      const auto &rest = mesh.Positions()[v];
+      positions[v] = rest * (1.0f + 0.2f * std::sin(5 * rest[2] + phase));
+    }
+    if (bvh.Update(positions.data(), mesh.Indices())) {
+      LogInfo("Frame {}: rebuilt", frame);
+    }
+  }
+  const auto &stats = bvh.update_stats();
+  LogInfo("Deforming, {} frames: {:.1f} ms per refit, {} rebuilds of "
+          "{:.1f} ms, final SAH cost ratio {:.2f}",
+          num_frames, stats.refit_seconds / stats.refits * 1e3,
+          stats.builds - 1, stats.build_seconds / stats.builds * 1e3,
+          bvh.sah_cost_ratio());
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+int main(int argc, char **argv) {
+  size_t num_points = argc > 1 ? std::stoul(argv[1]) : 10000000;
+  size_t num_queries = argc > 2 ? std::stoul(argv[2]) : 1000000;
+  size_t k = argc > 3 ? std::stoul(argv[3]) : 16;
+
+  // Uniform points in the unit cube, and queries among them.
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  std::vector<geometry::Vector3<float>> points(num_points);
+  for (auto &point : points) {
+    point = {dis(gen), dis(gen), dis(gen)};
+  }
+  std::vector<geometry::Vector3<float>> queries(num_queries);
+  for (auto &query : queries) {
+    query = {dis(gen), dis(gen), dis(gen)};
+  }
+  LogInfo("{} uniform points, {} queries, {} threads", num_points,
+          num_queries, GlobalThreadPool().num_threads());
+
+  data_structure::PointCloudKDTree<float> tree;
+  double build_seconds = MeasureSeconds([&]() {
+    tree = data_structure::PointCloudKDTree<float>(points.data(), num_points);
+  });
+  LogInfo("Build: {:.1f} ms, depth {}", build_seconds * 1e3, tree.depth());
+
+  std::vector<uint32_t> indices;
+  std::vector<float> distances_squared;
+  double knn_seconds = MeasureSeconds([&]() {
+    tree.KNearest(queries.data(), num_queries, k, &indices,
+                  &distances_squared);
+  });
+  LogInfo("{}-nearest: {:.2f} Mqueries/s", k,
+          num_queries / knn_seconds * 1e-6);
+
+  // A radius holding about 2k points on average.
+  float radius = std::cbrt(2.0f * k / num_points * 3.0f / (4.0f * 3.14159f));
+  std::vector<size_t> offsets;
+  double radius_seconds = MeasureSeconds([&]() {
+    tree.RadiusSearch(queries.data(), num_queries, radius, &offsets, &indices,
+                      &distances_squared);
+  });
+  LogInfo("Radius {:.4f}: {:.2f} Mqueries/s, {:.1f} neighbours per query",
+          radius, num_queries / radius_seconds * 1e-6,
+          double(indices.size()) / num_queries);
+
+  // The same radius queries on the hash grid of PointToMesh.
+  geometry::PointHashGrid<float> hash_grid(points.data(), num_points, radius);
+  size_t num_found = 0;
+  double hash_seconds = MeasureSeconds([&]() {
+    for (const auto &query : queries) {
+      hash_grid.ForEachNeighbour(query, radius,
+                                 [&](uint32_t, float) { num_found++; });
+    }
+  });
+  LogInfo("PointHashGrid radius, one thread: {:.2f} Mqueries/s, {} found",
+          num_queries / hash_seconds * 1e-6, num_found);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+// Samples field at positions, reports the throughput, the memory taken by
+// the cells and the largest difference to the double precision reference.
+template <class FieldType>
+void BenchmarkField(const std::string &name,
+                    const FieldType &field,
+                    size_t bytes_per_cell,
+                    const std::vector<geometry::Vector3<float>> &positions,
+                    const std::vector<double> &reference) {
+  std::vector<float> samples(positions.size());
+  double seconds = MeasureSeconds([&]() {
+    for (size_t i = 0; i < positions.size(); i++) {
+      samples[i] = float(field(positions[i]));
+    }
+  });
+  double max_error = 0;
+  for (size_t i = 0; i < positions.size(); i++) {
+    max_error = std::max(max_error, std::abs(samples[i] - reference[i]));
+  }
+  LogInfo("{:>16}: {} bytes/cell, {:.1f} MB, {:.1f} Msamples/s, max error {}",
+          name, bytes_per_cell,
+          field.width() * field.height() * field.depth() * bytes_per_cell *
+              1e-6,
+          positions.size() / seconds * 1e-6, max_error);
+}
+
+int main(int argc, char **argv) {
+  size_t size = argc > 1 ? std::stoul(argv[1]) : 256;
+  size_t num_samples = argc > 2 ? std::stoul(argv[2]) : 10000000;
+  float delta_x = 2.0f / size;
+  geometry::Vector3<float> offset{-1.0f, -1.0f, -1.0f};
+
+  // Signed distance to a sphere of radius 0.5.
+  geometry::Field<double, float> field_double(size, size, size, delta_x,
+                                              offset);
+  field_double.FillFromFunction([](const geometry::Vector3<float> &pos) {
+    return pos.cast<double>().norm() - 0.5;
+  });
+  data_structure::LinearGrid<float> grid_float(size, size, size);
+  data_structure::ParallelTransform(field_double.grid(), grid_float,
+                                    [](double value) { return float(value); });
+  geometry::Field<float, float> field_float(delta_x, offset, grid_float);
+
+  using data_structure::Fixed16Codec;
+  using data_structure::Fixed8Codec;
+  using data_structure::HalfCodec;
+  using data_structure::QuantizedGrid;
+  geometry::Field<float, float, QuantizedGrid<float, HalfCodec>> field_half(
+      delta_x, offset, QuantizedGrid<float, HalfCodec>(grid_float));
+  geometry::Field<float, float, QuantizedGrid<float, Fixed16Codec<>>>
+      field_fixed16(delta_x, offset,
+                    QuantizedGrid<float, Fixed16Codec<>>(grid_float));
+  geometry::Field<float, float, QuantizedGrid<float, Fixed8Codec<>>>
+      field_fixed8(delta_x, offset,
+                   QuantizedGrid<float, Fixed8Codec<>>(grid_float));
+  geometry::Field<float, float, QuantizedGrid<float, Fixed8Codec<>>>
+      field_bricked8(delta_x, offset,
+                     QuantizedGrid<float, Fixed8Codec<>>(grid_float, 8));
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+  std::vector<geometry::Vector3<float>> positions(num_samples);
+  for (auto &pos : positions) {
+    pos = {dis(gen), dis(gen), dis(gen)};
+  }
+  std::vector<double> reference(num_samples);
+  for (size_t i = 0; i < num_samples; i++) {
+    reference[i] = field_double(positions[i]);
+  }
+
+  LogInfo("Sphere SDF {}^3, {} random samples", size, num_samples);
+  BenchmarkField("double", field_double, 8, positions, reference);
+  BenchmarkField("float", field_float, 4, positions, reference);
+  BenchmarkField("half", field_half, 2, positions, reference);
+  BenchmarkField("fixed16", field_fixed16, 2, positions, reference);
+  BenchmarkField("fixed8", field_fixed8, 1, positions, reference);
+  BenchmarkField("fixed8 bricks 8", field_bricked8, 1, positions, reference);
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+TEST(DataStructure, BrickedGridMatchesLinearGrid) {
+  data_structure::LinearGrid<double> linear_grid(13, 7, 21, 0.0);
+  data_structure::BrickedGrid<double> bricked_grid(13, 7, 21, 0.0);
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> value_dis(-1, 1);
+
+  for (size_t k = 0; k < linear_grid.depth(); k++) {
+    for (size_t j = 0; j < linear_grid.height(); j++) {
+      for (size_t i = 0; i < linear_grid.width(); i++) {
+        double value = value_dis(gen);
+        linear_grid(i, j, k) = value;
+        bricked_grid(i, j, k) = value;
+      }
+    }
+  }
+
+  for (size_t k = 0; k < linear_grid.depth(); k++) {
+    for (size_t j = 0; j < linear_grid.height(); j++) {
+      for (size_t i = 0; i < linear_grid.width(); i++) {
+        EXPECT_EQ(bricked_grid.get(i, j, k), linear_grid.get(i, j, k));
+      }
+    }
+  }
+
+  std::uniform_real_distribution<double> pos_dis(-2, 23);
+  for (int i = 0; i < 10000; i++) {
+    double x = pos_dis(gen), y = pos_dis(gen), z = pos_dis(gen);
+    EXPECT_NEAR(bricked_grid.sample(x, y, z), linear_grid.sample(x, y, z),
+                1e-12);
+  }
+}
+
+TEST(DataStructure, BrickedGridField) {
+  geometry::Field<double> field(11, 11, 11, 1.0, {-5.0, -5.0, -5.0}, 1);
+  geometry::Field<double, float, data_structure::BrickedGrid<double, 4>>
+      bricked_field(11, 11, 11, 1.0, {-5.0, -5.0, -5.0}, 1);
+
+  for (size_t i = 0; i < field.width(); i++) {
+    for (size_t j = 0; j < field.height(); j++) {
+      for (size_t k = 0; k < field.depth(); k++) {
+        field(i, j, k) = field.get_position(i, j, k).norm() - 3.0;
+        bricked_field(i, j, k) = bricked_field.get_position(i, j, k).norm() -
+                                 3.0;
+      }
+    }
+  }
+
+  auto mesh = geometry::MarchingCubes(field);
+  auto bricked_mesh = geometry::MarchingCubes(bricked_field);
+  EXPECT_EQ(mesh.NumVertices(), bricked_mesh.NumVertices());
+  EXPECT_EQ(mesh.NumIndices(), bricked_mesh.NumIndices());
+
+  data_structure::MACGrid<float, data_structure::BrickedGrid<float>> mac_grid(
+      4, 5, 6, 1.0f);
+  EXPECT_EQ(mac_grid.width(), 4);
+  EXPECT_EQ(mac_grid.height(), 5);
+  EXPECT_EQ(mac_grid.depth(), 6);
+  EXPECT_FLOAT_EQ(mac_grid.sample_u(1.3f, 2.7f, 0.2f), 1.0f);
+}
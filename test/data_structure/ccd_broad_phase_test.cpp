@@ -0,0 +1,191 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+// A size x size vertex grid of unit spacing in the xy-plane at height z,
+// two triangles per cell.
+void ClothGrid(size_t size,
+               double z,
+               std::vector<geometry::Vector3<double>> *positions,
+               std::vector<uint32_t> *indices) {
+  positions->clear();
+  indices->clear();
+  for (size_t y = 0; y < size; y++) {
+    for (size_t x = 0; x < size; x++) {
+      positions->push_back({double(x), double(y), z});
+    }
+  }
+  for (size_t y = 0; y + 1 < size; y++) {
+    for (size_t x = 0; x + 1 < size; x++) {
+      uint32_t v = uint32_t(y * size + x);
+      uint32_t s = uint32_t(size);
+      indices->insert(indices->end(), {v, v + 1, v + s + 1, v, v + s + 1,
+                                       v + s});
+    }
+  }
+}
+
+bool Overlaps(const geometry::AABB3<double> &a,
+              const geometry::AABB3<double> &b) {
+  return (a.min_bound.array() <= b.max_bound.array()).all() &&
+         (b.min_bound.array() <= a.max_bound.array()).all();
+}
+
+template <size_t N, size_t M>
+bool ShareVertex(const std::array<uint32_t, N> &a,
+                 const std::array<uint32_t, M> &b) {
+  for (uint32_t u : a) {
+    for (uint32_t w : b) {
+      if (u == w) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+}  // namespace
+
+TEST(DataStructure, CCDBroadPhaseSelf) {
+  // A crumpled cloth with random motion.
+  std::vector<geometry::Vector3<double>> positions;
+  std::vector<uint32_t> indices;
+  ClothGrid(20, 0.0, &positions, &indices);
+  std::mt19937 gen{6};
+  std::normal_distribution<double> normal;
+  std::vector<geometry::Vector3<double>> displacements(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    positions[i] = 0.3 * positions[i] +
+                   0.5 * geometry::Vector3<double>{normal(gen), normal(gen),
+                                                   normal(gen)};
+    displacements[i] = {normal(gen), normal(gen), normal(gen)};
+    displacements[i] *= 0.2;
+  }
+  data_structure::CCDMesh<double> mesh(indices.data(), indices.size() / 3,
+                                       positions.size());
+  EXPECT_EQ(mesh.edges().size(), 3 * 19 * 19 + 2 * 19);
+  mesh.Update(positions.data(), displacements.data(), 0.01);
+  SetGlobalThreadCount(1);
+  data_structure::CCDPairs serial;
+  data_structure::FindCCDPairs(mesh, &serial);
+  auto serial_impact = data_structure::EarliestImpact(mesh, serial);
+  SetGlobalThreadCount(3);
+  data_structure::CCDPairs pairs;
+  data_structure::FindCCDPairs(mesh, &pairs);
+  auto impact = data_structure::EarliestImpact(mesh, pairs);
+  SetGlobalThreadCount(0);
+  EXPECT_EQ(pairs.vertex_face, serial.vertex_face);
+  EXPECT_EQ(pairs.edge_edge, serial.edge_edge);
+  EXPECT_TRUE(pairs.face_vertex.empty());
+  EXPECT_EQ(impact.t, serial_impact.t);
+  EXPECT_EQ(impact.type, serial_impact.type);
+  EXPECT_EQ(impact.pair, serial_impact.pair);
+
+  // All overlapping pairs that share no vertex, found by brute force, and
+  // the earliest impact among all pairs.
+  const auto &faces = mesh.faces();
+  const auto &edges = mesh.edges();
+  std::vector<std::array<uint32_t, 2>> vertex_face, edge_edge;
+  double earliest = 1.0;
+  for (uint32_t v = 0; v < positions.size(); v++) {
+    for (uint32_t f = 0; f < faces.size(); f++) {
+      if (ShareVertex(std::array<uint32_t, 1>{v}, faces[f])) {
+        continue;
+      }
+      if (Overlaps(mesh.vertex_boxes()[v], mesh.face_boxes()[f])) {
+        vertex_face.push_back({v, f});
+      }
+      double t = earliest;
+      const auto &face = faces[f];
+      if (geometry::FacePointCCD(
+              positions[face[0]], positions[face[1]], positions[face[2]],
+              displacements[face[0]], displacements[face[1]],
+              displacements[face[2]], positions[v], displacements[v], &t)) {
+        earliest = t;
+      }
+    }
+  }
+  for (uint32_t e = 0; e < edges.size(); e++) {
+    for (uint32_t other = e + 1; other < edges.size(); other++) {
+      const auto &a = edges[e];
+      const auto &b = edges[other];
+      if (ShareVertex(a, b)) {
+        continue;
+      }
+      if (Overlaps(mesh.edge_boxes()[e], mesh.edge_boxes()[other])) {
+        edge_edge.push_back({e, other});
+      }
+      double t = earliest;
+      if (geometry::EdgeEdgeCCD(positions[a[0]], positions[a[1]],
+                                displacements[a[0]], displacements[a[1]],
+                                positions[b[0]], positions[b[1]],
+                                displacements[b[0]], displacements[b[1]],
+                                &t)) {
+        earliest = t;
+      }
+    }
+  }
+  EXPECT_GT(edge_edge.size(), 1000);
+  std::sort(pairs.vertex_face.begin(), pairs.vertex_face.end());
+  std::sort(pairs.edge_edge.begin(), pairs.edge_edge.end());
+  EXPECT_EQ(pairs.vertex_face, vertex_face);
+  EXPECT_EQ(pairs.edge_edge, edge_edge);
+  ASSERT_TRUE(impact.found);
+  EXPECT_EQ(impact.t, earliest);
+}
+
+TEST(DataStructure, CCDBroadPhaseTwoMeshes) {
+  // A cloth falling onto a resting one, offset so that vertices, edges and
+  // faces all meet.
+  std::vector<geometry::Vector3<double>> positions_a, positions_b;
+  std::vector<uint32_t> indices_a, indices_b;
+  ClothGrid(12, 0.5, &positions_a, &indices_a);
+  ClothGrid(10, 0.0, &positions_b, &indices_b);
+  for (auto &position : positions_a) {
+    position += geometry::Vector3<double>{-0.3, -0.2, 0.0};
+  }
+  std::vector<geometry::Vector3<double>> displacements_a(
+      positions_a.size(), geometry::Vector3<double>{0.0, 0.0, -1.0});
+  std::vector<geometry::Vector3<double>> displacements_b(
+      positions_b.size(), geometry::Vector3<double>::Zero());
+  data_structure::CCDMesh<double> a(indices_a.data(), indices_a.size() / 3,
+                                    positions_a.size());
+  data_structure::CCDMesh<double> b(indices_b.data(), indices_b.size() / 3,
+                                    positions_b.size());
+  a.Update(positions_a.data(), displacements_a.data());
+  b.Update(positions_b.data(), displacements_b.data());
+  data_structure::CCDPairs pairs;
+  data_structure::FindCCDPairs(a, b, &pairs);
+
+  size_t expected_vertex_face = 0, expected_face_vertex = 0;
+  for (size_t v = 0; v < positions_a.size(); v++) {
+    for (size_t f = 0; f < b.faces().size(); f++) {
+      expected_vertex_face += Overlaps(a.vertex_boxes()[v], b.face_boxes()[f]);
+    }
+  }
+  for (size_t f = 0; f < a.faces().size(); f++) {
+    for (size_t v = 0; v < positions_b.size(); v++) {
+      expected_face_vertex += Overlaps(a.face_boxes()[f], b.vertex_boxes()[v]);
+    }
+  }
+  EXPECT_EQ(pairs.vertex_face.size(), expected_vertex_face);
+  EXPECT_EQ(pairs.face_vertex.size(), expected_face_vertex);
+  for (const auto &pair : pairs.edge_edge) {
+    EXPECT_TRUE(Overlaps(a.edge_boxes()[pair[0]], b.edge_boxes()[pair[1]]));
+  }
+
+  auto impact = data_structure::EarliestImpact(a, b, pairs);
+  ASSERT_TRUE(impact.found);
+  EXPECT_NEAR(impact.t, 0.5, 1e-9);
+
+  // Moving apart, nothing collides.
+  for (auto &displacement : displacements_a) {
+    displacement = -displacement;
+  }
+  a.Update(positions_a.data(), displacements_a.data());
+  data_structure::FindCCDPairs(a, b, &pairs);
+  EXPECT_EQ(pairs.size(), 0);
+  EXPECT_FALSE(data_structure::EarliestImpact(a, b, pairs).found);
+}
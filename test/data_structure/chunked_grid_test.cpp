@@ -0,0 +1,139 @@
+#include "filesystem"
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+std::string TempFile(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+float Value(int64_t x, int64_t y, int64_t z) {
+  return float(x) + 0.01f * float(y) - 0.5f * float(z);
+}
+}  // namespace
+
+TEST(DataStructure, ChunkedGridAccess) {
+  std::string filename = TempFile("chunked_grid_access.bin");
+  {
+    // 5 x 4 x 3 bricks of 16^3 floats through a cache of 8 of them.
+    data_structure::ChunkedGrid<float, 16> grid(filename, 70, 50, 40,
+                                                8 * 16 * 16 * 16 * 4, 1.0f);
+    EXPECT_EQ(grid.num_bricks(), 60);
+    EXPECT_EQ(grid.capacity(), 8);
+    data_structure::LinearGrid<float> reference(70, 50, 40, 0.0f);
+    EXPECT_EQ(grid(69, 49, 39), 1.0f);
+    for (int64_t z = 0; z < 40; z++) {
+      for (int64_t y = 0; y < 50; y++) {
+        for (int64_t x = 0; x < 70; x++) {
+          grid(x, y, z) = Value(x, y, z);
+          reference(x, y, z) = Value(x, y, z);
+        }
+      }
+    }
+    // Rows of 20 bricks thrash the cache of 8.
+    data_structure::ChunkedGridStats stats = grid.stats();
+    EXPECT_GT(stats.misses, 60);
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_EQ(stats.bricks_written, stats.evictions);
+
+    // Random access pages bricks back in from the file.
+    grid.reset_stats();
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dis(-2.0f, 72.0f);
+    for (int i = 0; i < 2000; i++) {
+      float x = dis(gen), y = dis(gen) * 0.7f, z = dis(gen) * 0.55f;
+      EXPECT_FLOAT_EQ(grid.sample(x, y, z), reference.sample(x, y, z));
+    }
+    stats = grid.stats();
+    EXPECT_GT(stats.bricks_read, 0);
+    EXPECT_GT(stats.hit_rate(), 0.5);
+    EXPECT_LT(stats.hit_rate(), 1.0);
+
+    data_structure::LinearGrid<float> block(20, 20, 20, 0.0f);
+    grid.ReadBlock(-3, 40, 30, &block);
+    for (int64_t z = 0; z < 20; z++) {
+      for (int64_t y = 0; y < 20; y++) {
+        for (int64_t x = 0; x < 20; x++) {
+          EXPECT_EQ(block(x, y, z),
+                    reference.get_clamped(x - 3, y + 40, z + 30));
+        }
+      }
+    }
+
+    // Streaming passes see every cell once and load every brick once.
+    grid.reset_stats();
+    std::atomic<int64_t> cells{0};
+    grid.ForEachBrick([&](int64_t x0, int64_t y0, int64_t z0,
+                          data_structure::LinearGridView<float> brick) {
+      EXPECT_EQ(x0 % 16, 0);
+      EXPECT_EQ(brick(0, 0, 0), Value(x0, y0, z0));
+      for (size_t z = 0; z < brick.depth(); z++) {
+        for (size_t y = 0; y < brick.height(); y++) {
+          for (size_t x = 0; x < brick.width(); x++) {
+            brick(x, y, z) += 1.0f;
+          }
+        }
+      }
+      cells += brick.width() * brick.height() * brick.depth();
+    });
+    EXPECT_EQ(cells, 70 * 50 * 40);
+    EXPECT_LE(grid.stats().misses, 60);
+    EXPECT_EQ(grid(12, 34, 39), Value(12, 34, 39) + 1.0f);
+    float sum = data_structure::Sum(reference) + 70 * 50 * 40;
+    EXPECT_NEAR(data_structure::Sum(grid), sum, 1e-5f * sum);
+    EXPECT_EQ(data_structure::Min(grid), Value(0, 0, 39) + 1.0f);
+    EXPECT_EQ(data_structure::Max(grid), Value(69, 49, 0) + 1.0f);
+  }
+  EXPECT_FALSE(std::filesystem::exists(filename));
+
+  // 2D grids get flat bricks.
+  data_structure::ChunkedGrid<double> flat(TempFile("chunked_grid_flat.bin"),
+                                           100, 40, 1, 0);
+  EXPECT_EQ(flat.brick_depth(), 1);
+  flat(99, 39) = 2.0;
+  EXPECT_EQ(flat(99, 39), 2.0);
+  EXPECT_EQ(flat(0, 0), 0.0);
+
+  EXPECT_THROW(data_structure::ChunkedGrid<float>(
+                   TempFile("chunked_grid_missing_directory/grid.bin"), 8, 8,
+                   8, 0),
+               std::runtime_error);
+}
+
+TEST(DataStructure, ChunkedGridMarchingCubes) {
+  geometry::Field<float> field(40, 36, 33, 0.05f, {-1.0f, -0.9f, -0.8f});
+  field.FillFromFunction([](const geometry::Vector3<float> &pos) {
+    return pos.norm() - 0.7f;
+  });
+  data_structure::ChunkedGrid<float, 8> grid(
+      TempFile("chunked_grid_marching_cubes.bin"), 40, 36, 33, 0);
+  grid.ForEachBrick([&](int64_t x0, int64_t y0, int64_t z0,
+                        data_structure::LinearGridView<float> brick) {
+    for (int64_t z = 0; z < int64_t(brick.depth()); z++) {
+      for (int64_t y = 0; y < int64_t(brick.height()); y++) {
+        for (int64_t x = 0; x < int64_t(brick.width()); x++) {
+          brick(x, y, z) = field(x0 + x, y0 + y, z0 + z);
+        }
+      }
+    }
+  });
+  auto expected = geometry::MarchingCubes(field, 0.0f);
+  auto mesh = geometry::MarchingCubes(grid, field.get_transform(), 0.0f);
+  ASSERT_EQ(mesh.NumIndices(), expected.NumIndices());
+  double area = 0.0, expected_area = 0.0;
+  for (size_t i = 0; i < mesh.NumIndices(); i += 3) {
+    auto triangle_area = [](const auto &m, size_t i) {
+      const auto *p = m.Positions();
+      const auto *index = m.Indices();
+      return 0.5 * (p[index[i + 1]] - p[index[i]])
+                       .cross(p[index[i + 2]] - p[index[i]])
+                       .norm();
+    };
+    area += triangle_area(mesh, i);
+    expected_area += triangle_area(expected, i);
+  }
+  EXPECT_NEAR(area, expected_area, 1e-3);
+}
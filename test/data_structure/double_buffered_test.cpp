@@ -0,0 +1,90 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+
+using namespace long_march;
+
+TEST(DataStructure, LinearGridSwapAndMove) {
+  data_structure::LinearGrid<float> a(4, 5, 6, 1.0f);
+  data_structure::LinearGrid<float> b(
+      2, 3, 4, 1, data_structure::grid_boundary_type::constant, 2.0f, -1.0f);
+  const float *a_data = a.data();
+  const float *b_data = b.data();
+  a.swap(b);
+  EXPECT_EQ(a.data(), b_data);
+  EXPECT_EQ(b.data(), a_data);
+  EXPECT_EQ(a.width(), 2);
+  EXPECT_EQ(a.ghost_layers(), 1);
+  EXPECT_EQ(a(-1, 0, 0), -1.0f);
+  EXPECT_EQ(a(1, 2, 3), 2.0f);
+  EXPECT_EQ(b.width(), 4);
+  EXPECT_EQ(b(3, 4, 5), 1.0f);
+  std::swap(a, b);
+  EXPECT_EQ(a.data(), a_data);
+
+  // Moves hand the storage over instead of copying it.
+  data_structure::LinearGrid<float> moved(std::move(a));
+  EXPECT_EQ(moved.data(), a_data);
+  b = std::move(moved);
+  EXPECT_EQ(b.data(), a_data);
+
+  data_structure::LinearGrid<float> uninitialized(
+      7, 8, 9, data_structure::grid_uninitialized);
+  EXPECT_EQ(uninitialized.buffer().size(), 7 * 8 * 9);
+  EXPECT_EQ(uninitialized.y_stride(), 7);
+  uninitialized(6, 7, 8) = 3.0f;
+  EXPECT_EQ(uninitialized.buffer().back(), 3.0f);
+  data_structure::LinearGrid<float> padded(
+      3, 3, 3, 2, data_structure::grid_boundary_type::constant,
+      data_structure::grid_uninitialized, 5.0f);
+  EXPECT_EQ(padded.buffer().size(), 7 * 7 * 7);
+  padded.UpdateGhosts();
+  EXPECT_EQ(padded(-2, 1, 1), 5.0f);
+
+  data_structure::MACGrid<double> u(3, 4, 5, 1.0);
+  data_structure::MACGrid<double> v(3, 4, 5,
+                                    data_structure::grid_uninitialized);
+  EXPECT_EQ(v.u().width(), 4);
+  EXPECT_EQ(v.w().depth(), 6);
+  const double *u_data = u.u().data();
+  swap(u, v);
+  EXPECT_EQ(v.u().data(), u_data);
+  EXPECT_EQ(v.w()(2, 3, 5), 1.0);
+}
+
+TEST(DataStructure, DoubleBufferedStep) {
+  using Grid = data_structure::LinearGrid<double>;
+  data_structure::DoubleBuffered<Grid> buffers(
+      Grid(16, 16, 16, 0.0),
+      Grid(16, 16, 16, data_structure::grid_uninitialized));
+  buffers.front()(8, 8, 8) = 1.0;
+  const double *first = buffers.front().data();
+  const double *second = buffers.back().data();
+
+  // Damped smoothing steps halve the total and alternate the buffers.
+  for (int step = 0; step < 5; step++) {
+    const Grid &front = buffers.front();
+    data_structure::ParallelForEach(
+        buffers.back(), [&](int64_t x, int64_t y, int64_t z, double &value) {
+          value = 0.5 * front(x, y, z);
+          for (int axis = 0; axis < 3; axis++) {
+            int64_t d[3] = {0, 0, 0};
+            d[axis] = 1;
+            value += (front.get_clamped(x - d[0], y - d[1], z - d[2]) +
+                      front.get_clamped(x + d[0], y + d[1], z + d[2]) -
+                      2.0 * front(x, y, z)) /
+                     12.0;
+          }
+        });
+    buffers.swap();
+    EXPECT_EQ(buffers.front().data(), step % 2 ? first : second);
+    EXPECT_EQ(buffers.back().data(), step % 2 ? second : first);
+  }
+  EXPECT_NEAR(data_structure::Sum(buffers.front()), 1.0 / 32.0, 1e-12);
+
+  data_structure::DoubleBuffered<data_structure::MACGrid<float>> velocity(
+      8, 8, 8, 0.0f);
+  velocity.back().u()(1, 2, 3) = 4.0f;
+  velocity.swap();
+  EXPECT_EQ(velocity.front().u()(1, 2, 3), 4.0f);
+  EXPECT_EQ(velocity.back().u()(1, 2, 3), 0.0f);
+}
@@ -0,0 +1,230 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+using data_structure::grid_interpolation_type;
+
+constexpr grid_interpolation_type kInterpolations[] = {
+    grid_interpolation_type::linear, grid_interpolation_type::catmull_rom,
+    grid_interpolation_type::monotone_cubic,
+    grid_interpolation_type::quadratic_bspline};
+
+template <class Func>
+data_structure::LinearGrid<double> Tabulate(size_t size, Func &&func) {
+  data_structure::LinearGrid<double> grid(size, size, size);
+  for (size_t k = 0; k < size; k++) {
+    for (size_t j = 0; j < size; j++) {
+      for (size_t i = 0; i < size; i++) {
+        grid(i, j, k) = func(i, j, k);
+      }
+    }
+  }
+  return grid;
+}
+
+// Largest error of sampling grid, which tabulates func(x / size), at random
+// positions away from the boundary.
+template <class Func>
+double MaxSampleError(size_t size,
+                      grid_interpolation_type interpolation,
+                      Func &&func) {
+  double inv_size = 1.0 / size;
+  auto grid = Tabulate(size, [&](double x, double y, double z) {
+    return func(x * inv_size, y * inv_size, z * inv_size);
+  });
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(0.25, 0.75);
+  double max_error = 0;
+  for (int i = 0; i < 1000; i++) {
+    double x = dis(gen), y = dis(gen), z = dis(gen);
+    double value = grid.sample(x * size, y * size, z * size, interpolation);
+    max_error = std::max(max_error, std::abs(value - func(x, y, z)));
+  }
+  return max_error;
+}
+}  // namespace
+
+TEST(DataStructure, GridInterpolationAccuracy) {
+  auto smooth = [](double x, double y, double z) {
+    return std::sin(6 * x) * std::cos(5 * y) * std::sin(4 * z + 1);
+  };
+  double linear_fine = MaxSampleError(64, grid_interpolation_type::linear,
+                                      smooth);
+  double linear = MaxSampleError(32, grid_interpolation_type::linear, smooth);
+  double cubic =
+      MaxSampleError(32, grid_interpolation_type::catmull_rom, smooth);
+  double monotone =
+      MaxSampleError(32, grid_interpolation_type::monotone_cubic, smooth);
+  // A cubic grid at half the resolution beats a linear one.
+  EXPECT_LT(cubic, linear_fine);
+  EXPECT_LT(cubic, linear / 4);
+  EXPECT_LT(monotone, linear);
+
+  // Catmull-Rom reproduces quadratics, the B-spline linear functions.
+  auto quadratic = [](double x, double y, double z) {
+    return 3 * x * x - 2 * x * y + z * z + y - 1;
+  };
+  EXPECT_LT(MaxSampleError(16, grid_interpolation_type::catmull_rom,
+                           quadratic),
+            1e-12);
+  auto linear_func = [](double x, double y, double z) {
+    return 3 * x - 2 * y + z + 0.5;
+  };
+  EXPECT_LT(MaxSampleError(16, grid_interpolation_type::quadratic_bspline,
+                           linear_func),
+            1e-12);
+}
+
+TEST(DataStructure, GridInterpolationLinearMatchesSample) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> value_dis(-1, 1);
+  auto grid = Tabulate(9, [&](int, int, int) { return value_dis(gen); });
+  std::uniform_real_distribution<double> pos_dis(-2, 11);
+  for (int i = 0; i < 1000; i++) {
+    double x = pos_dis(gen), y = pos_dis(gen), z = pos_dis(gen);
+    EXPECT_NEAR(data_structure::SampleInterpolated(
+                    grid, grid_interpolation_type::linear, x, y, z),
+                grid.sample(x, y, z), 1e-12);
+  }
+}
+
+TEST(DataStructure, GridInterpolationMonotone) {
+  // A step along x: the monotone kernel stays within [0, 1], Catmull-Rom
+  // overshoots next to the step.
+  auto grid = Tabulate(8, [](int x, int, int) { return x < 4 ? 0.0 : 1.0; });
+  double lowest = 0, highest = 1;
+  for (double x = 0; x <= 7; x += 0.01) {
+    double value =
+        grid.sample(x, 3.3, 4.6, grid_interpolation_type::monotone_cubic);
+    EXPECT_GE(value, 0.0);
+    EXPECT_LE(value, 1.0);
+    double cubic =
+        grid.sample(x, 3.3, 4.6, grid_interpolation_type::catmull_rom);
+    lowest = std::min(lowest, cubic);
+    highest = std::max(highest, cubic);
+  }
+  EXPECT_LT(lowest, -0.01);
+  EXPECT_GT(highest, 1.01);
+
+  // Random cells: samples stay within the 8 cells around them.
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> value_dis(-1, 1);
+  auto noise = Tabulate(8, [&](int, int, int) { return value_dis(gen); });
+  std::uniform_real_distribution<double> pos_dis(1, 6);
+  for (int i = 0; i < 1000; i++) {
+    double x = pos_dis(gen), y = pos_dis(gen), z = pos_dis(gen);
+    double value =
+        noise.sample(x, y, z, grid_interpolation_type::monotone_cubic);
+    int x0 = std::floor(x), y0 = std::floor(y), z0 = std::floor(z);
+    double lo = noise(x0, y0, z0), hi = lo;
+    for (int corner = 1; corner < 8; corner++) {
+      double corner_value = noise(x0 + (corner & 1), y0 + ((corner >> 1) & 1),
+                                  z0 + (corner >> 2));
+      lo = std::min(lo, corner_value);
+      hi = std::max(hi, corner_value);
+    }
+    EXPECT_GE(value, lo - 1e-12);
+    EXPECT_LE(value, hi + 1e-12);
+  }
+}
+
+TEST(DataStructure, GridInterpolationGradient) {
+  auto grid = Tabulate(12, [](double x, double y, double z) {
+    return std::sin(0.5 * x) * std::cos(0.3 * y) + 0.1 * z * z;
+  });
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(2.0, 9.0);
+  const double h = 1e-6;
+  for (auto interpolation : kInterpolations) {
+    for (int i = 0; i < 100; i++) {
+      double x = dis(gen), y = dis(gen), z = dis(gen);
+      double gradient[3];
+      double value = grid.sample_gradient(x, y, z, interpolation, gradient);
+      EXPECT_NEAR(value, grid.sample(x, y, z, interpolation), 1e-12);
+      double pos[3] = {x, y, z};
+      for (int axis = 0; axis < 3; axis++) {
+        double lo[3] = {x, y, z}, hi[3] = {x, y, z};
+        lo[axis] = pos[axis] - h;
+        hi[axis] = pos[axis] + h;
+        double difference =
+            (grid.sample(hi[0], hi[1], hi[2], interpolation) -
+             grid.sample(lo[0], lo[1], lo[2], interpolation)) /
+            (2 * h);
+        EXPECT_NEAR(gradient[axis], difference, 1e-5);
+      }
+    }
+  }
+}
+
+TEST(DataStructure, GridInterpolationMonotoneDerivatives) {
+  // x * g(y) + 10 * y is monotone along y, but its derivative along x, g,
+  // is not, so the limiter must act on the values and not on g.
+  const double g[8] = {0, 0, 0, 1, 0, 2, 0, 0};
+  auto grid = Tabulate(8, [&](int x, int y, int) { return x * g[y] + 10 * y; });
+  const auto monotone = grid_interpolation_type::monotone_cubic;
+  const double h = 1e-6;
+  auto check = [&](const data_structure::LinearGrid<double> &grid, double x,
+                   double y, double z) {
+    double gradient[3], hessian[9], hessian_gradient[3];
+    grid.sample_gradient(x, y, z, monotone, gradient);
+    grid.sample_hessian(x, y, z, monotone, hessian_gradient, hessian);
+    double pos[3] = {x, y, z};
+    for (int axis = 0; axis < 3; axis++) {
+      double lo[3] = {x, y, z}, hi[3] = {x, y, z};
+      lo[axis] = pos[axis] - h;
+      hi[axis] = pos[axis] + h;
+      double difference = (grid.sample(hi[0], hi[1], hi[2], monotone) -
+                           grid.sample(lo[0], lo[1], lo[2], monotone)) /
+                          (2 * h);
+      EXPECT_NEAR(gradient[axis], difference, 1e-5);
+      EXPECT_NEAR(hessian_gradient[axis], gradient[axis], 1e-12);
+      double gradient_lo[3], gradient_hi[3];
+      grid.sample_gradient(lo[0], lo[1], lo[2], monotone, gradient_lo);
+      grid.sample_gradient(hi[0], hi[1], hi[2], monotone, gradient_hi);
+      for (int other = 0; other < 3; other++) {
+        EXPECT_NEAR(hessian[3 * axis + other],
+                    (gradient_hi[other] - gradient_lo[other]) / (2 * h), 1e-4);
+      }
+    }
+    return gradient[0];
+  };
+  EXPECT_NEAR(check(grid, 3.3, 3.5, 3.2), 0.4375, 1e-12);
+
+  // Random cells, where the limiter is active in many places.
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> value_dis(-1, 1);
+  auto noise = Tabulate(8, [&](int, int, int) { return value_dis(gen); });
+  std::uniform_real_distribution<double> pos_dis(1, 6);
+  for (int i = 0; i < 200; i++) {
+    check(noise, pos_dis(gen), pos_dis(gen), pos_dis(gen));
+  }
+}
+
+TEST(DataStructure, GridInterpolationField) {
+  geometry::Field<double, double> field(16, 16, 16, 0.125,
+                                        {-1.0, -1.0, -1.0});
+  field.FillFromFunction(
+      [](const geometry::Vector3<double> &pos) { return pos.norm(); });
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-0.8, 0.8);
+  std::vector<geometry::Vector3<double>> positions(100);
+  for (auto &pos : positions) {
+    pos = {dis(gen), dis(gen), dis(gen)};
+  }
+  for (auto interpolation : kInterpolations) {
+    std::vector<double> batch(positions.size());
+    field.SampleBatch(positions.data(), batch.data(), positions.size(),
+                      interpolation);
+    for (size_t i = 0; i < positions.size(); i++) {
+      geometry::Vector3<double> grid_pos =
+          field.to_grid_position(positions[i]);
+      double expected = field.grid().sample(grid_pos[0], grid_pos[1],
+                                            grid_pos[2], interpolation);
+      EXPECT_NEAR(field.Sample(positions[i], interpolation), expected, 1e-12);
+      EXPECT_NEAR(batch[i], expected, 1e-12);
+    }
+  }
+}
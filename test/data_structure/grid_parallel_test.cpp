@@ -0,0 +1,78 @@
+#include "atomic"
+#include "gtest/gtest.h"
+#include "long_march.h"
+
+using namespace long_march;
+
+TEST(DataStructure, ParallelForEachVisitsEveryCellOnce) {
+  SetGlobalThreadCount(4);
+  data_structure::LinearGrid<int> grid(37, 11, 23, 0);
+  data_structure::ParallelForEach(
+      grid,
+      [](data_structure::offset_t x, data_structure::offset_t y,
+         data_structure::offset_t z, int &value) {
+        value += int(x + 100 * y + 10000 * z) + 1;
+      },
+      100);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        EXPECT_EQ(grid(i, j, k), int(i + 100 * j + 10000 * k) + 1);
+      }
+    }
+  }
+
+  data_structure::LinearGrid<double> result(37, 11, 23, 0.0);
+  data_structure::ParallelTransform(grid, result,
+                                    [](int value) { return 0.5 * value; });
+  EXPECT_EQ(result(3, 4, 5), 0.5 * grid(3, 4, 5));
+
+  data_structure::ParallelFill(
+      grid, [](data_structure::offset_t x, data_structure::offset_t y,
+               data_structure::offset_t z) { return int(x * y * z); });
+  EXPECT_EQ(grid(36, 10, 22), 36 * 10 * 22);
+}
+
+TEST(DataStructure, ThreadPoolNestedAndSerialRuns) {
+  SetGlobalThreadCount(3);
+  std::atomic<int> count{0};
+  ParallelFor(0, 64, 1, [&](int64_t begin, int64_t end) {
+    ParallelFor(0, 10, 3, [&](int64_t inner_begin, int64_t inner_end) {
+      count += int(inner_end - inner_begin) * int(end - begin);
+    });
+  });
+  EXPECT_EQ(count, 640);
+
+  SetGlobalThreadCount(1);
+  count = 0;
+  ParallelFor(5, 1005, 7, [&](int64_t begin, int64_t end) {
+    count += int(end - begin);
+  });
+  EXPECT_EQ(count, 1000);
+
+  SetGlobalThreadCount(0);
+  EXPECT_THROW(ParallelFor(0, 100, 1,
+                           [](int64_t begin, int64_t) {
+                             if (begin == 42) {
+                               throw std::runtime_error("chunk failed");
+                             }
+                           }),
+               std::runtime_error);
+}
+
+TEST(DataStructure, FillFromFunctionOnSparseField) {
+  SetGlobalThreadCount(4);
+  geometry::Field<double, double, data_structure::SparseGrid<double>> field(
+      40, 36, 44, 0.25, {-5.0, -4.5, -5.5});
+  field.FillFromFunction(
+      [](const geometry::Vector3<double> &pos) { return pos.norm(); });
+  const auto &grid = field.grid();
+  EXPECT_EQ(grid.num_leaves(), size_t(5 * 5 * 6));
+  for (size_t k = 0; k < field.depth(); k++) {
+    for (size_t j = 0; j < field.height(); j++) {
+      for (size_t i = 0; i < field.width(); i++) {
+        EXPECT_EQ(grid(i, j, k), field.get_position(i, j, k).norm());
+      }
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+TEST(DataStructure, GridReductionMatchesSerial) {
+  data_structure::LinearGrid<float> a(
+      67, 31, 19, 1, data_structure::grid_boundary_type::clamp);
+  data_structure::LinearGrid<float> b(67, 31, 19, 0.0f);
+  data_structure::LinearGrid<uint8_t> mask(67, 31, 19, uint8_t(0));
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-2.0f, 1.0f);
+  double sum = 0.0, dot = 0.0, squared_norm = 0.0;
+  double masked_sum = 0.0, masked_dot = 0.0;
+  float min = 1e30f, max = -1e30f, max_abs = 0.0f, masked_max = -1e30f;
+  for (size_t k = 0; k < a.depth(); k++) {
+    for (size_t j = 0; j < a.height(); j++) {
+      for (size_t i = 0; i < a.width(); i++) {
+        a(i, j, k) = dis(gen);
+        b(i, j, k) = dis(gen);
+        mask(i, j, k) = (i + j + k) % 3 == 0;
+        sum += a(i, j, k);
+        dot += double(a(i, j, k)) * b(i, j, k);
+        squared_norm += double(a(i, j, k)) * a(i, j, k);
+        min = std::min(min, a(i, j, k));
+        max = std::max(max, a(i, j, k));
+        max_abs = std::max(max_abs, std::abs(a(i, j, k)));
+        if (mask(i, j, k)) {
+          masked_sum += a(i, j, k);
+          masked_dot += double(a(i, j, k)) * b(i, j, k);
+          masked_max = std::max(masked_max, a(i, j, k));
+        }
+      }
+    }
+  }
+  // Ghost cells must not take part.
+  a.set_boundary(data_structure::grid_boundary_type::constant, 100.0f);
+  a.UpdateGhosts();
+
+  EXPECT_EQ(data_structure::Min(a), min);
+  EXPECT_EQ(data_structure::Max(a), max);
+  EXPECT_EQ(data_structure::MaxAbs(a), max_abs);
+  EXPECT_EQ(data_structure::Max(a, mask), masked_max);
+  EXPECT_NEAR(data_structure::Sum(a), sum, 1e-2);
+  EXPECT_NEAR(data_structure::Sum(a, mask), masked_sum, 1e-2);
+  EXPECT_NEAR(data_structure::Dot(a, b), dot, 1e-2);
+  EXPECT_NEAR(data_structure::SquaredNorm(a), squared_norm, 1e-2);
+  EXPECT_NEAR(data_structure::L2Norm(a.view()), std::sqrt(squared_norm),
+              1e-3);
+  EXPECT_NEAR(data_structure::Dot(a, b, mask), masked_dot, 1e-2);
+}
+
+TEST(DataStructure, GridReductionIsReproducible) {
+  data_structure::LinearGrid<float> grid(300, 40, 30, 0.0f);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+  for (auto &value : grid.buffer()) {
+    value = dis(gen);
+  }
+
+  std::vector<float> sums, norms;
+  for (size_t num_threads : {1, 2, 3, 8}) {
+    SetGlobalThreadCount(num_threads);
+    sums.push_back(data_structure::Sum(grid));
+    norms.push_back(data_structure::SquaredNorm(grid));
+  }
+  SetGlobalThreadCount(0);
+  for (size_t i = 1; i < sums.size(); i++) {
+    EXPECT_EQ(sums[i], sums[0]);
+    EXPECT_EQ(norms[i], norms[0]);
+  }
+}
+
+TEST(DataStructure, MACGridReduction) {
+  data_structure::MACGrid<double> grid(8, 9, 10, 0.5);
+  grid.v()(3, 4, 5) = -7.0;
+  EXPECT_EQ(data_structure::MaxAbs(grid), 7.0);
+  size_t num_faces = 9 * 9 * 10 + 8 * 10 * 10 + 8 * 9 * 11;
+  EXPECT_NEAR(data_structure::SquaredNorm(grid),
+              0.25 * (num_faces - 1) + 49.0, 1e-9);
+  EXPECT_NEAR(data_structure::Dot(grid, grid),
+              data_structure::SquaredNorm(grid), 1e-9);
+}
+
+TEST(DataStructure, GridReductionOnOtherGridTypes) {
+  data_structure::LinearGrid<float> grid(37, 21, 13, 0.0f);
+  data_structure::LinearGrid<float> band(37, 21, 13, 0.0f);
+  data_structure::BrickedGrid<float> bricked(37, 21, 13, 0.0f);
+  data_structure::SparseGrid<float> sparse(37, 21, 13, 0.0f);
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        grid(i, j, k) = bricked(i, j, k) = dis(gen);
+        if (j < 8) {
+          band(i, j, k) = sparse(i, j, k) = dis(gen);
+        }
+      }
+    }
+  }
+
+  // The same cells reduced in the same order give the same bits.
+  EXPECT_EQ(data_structure::Sum(bricked), data_structure::Sum(grid));
+  EXPECT_EQ(data_structure::Min(bricked), data_structure::Min(grid));
+  EXPECT_EQ(data_structure::Max(bricked), data_structure::Max(grid));
+  EXPECT_EQ(data_structure::Dot(bricked, grid),
+            data_structure::Dot(grid, grid));
+  EXPECT_EQ(data_structure::Sum(sparse), data_structure::Sum(band));
+  EXPECT_EQ(data_structure::MaxAbs(sparse), data_structure::MaxAbs(band));
+  EXPECT_EQ(data_structure::Dot(grid, sparse),
+            data_structure::Dot(grid, band));
+}
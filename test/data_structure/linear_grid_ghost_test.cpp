@@ -0,0 +1,130 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+template <class GridType>
+void FillRandom(GridType &grid, std::mt19937 &gen) {
+  std::uniform_real_distribution<double> value_dis(-1, 1);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        grid(i, j, k) = value_dis(gen);
+      }
+    }
+  }
+}
+
+int Wrap(int i, int size) {
+  return ((i % size) + size) % size;
+}
+}  // namespace
+
+TEST(DataStructure, LinearGridGhostClampMatchesUnpadded) {
+  data_structure::LinearGrid<double> grid(13, 7, 21, 0.0);
+  data_structure::LinearGrid<double> padded(
+      13, 7, 21, 2, data_structure::grid_boundary_type::clamp);
+
+  std::mt19937 gen(0);
+  FillRandom(grid, gen);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        padded(i, j, k) = grid(i, j, k);
+      }
+    }
+  }
+  padded.UpdateGhosts();
+
+  EXPECT_EQ(padded(-2, 3, 4), grid(0, 3, 4));
+  EXPECT_EQ(padded(14, -1, 22), grid(12, 0, 20));
+
+  std::uniform_real_distribution<double> pos_dis(-5, 25);
+  std::vector<double> xs(1000), ys(1000), zs(1000), out(1000);
+  for (int i = 0; i < 1000; i++) {
+    xs[i] = pos_dis(gen);
+    ys[i] = pos_dis(gen);
+    zs[i] = pos_dis(gen);
+    EXPECT_EQ(padded.sample(xs[i], ys[i], zs[i]),
+              grid.sample(xs[i], ys[i], zs[i]));
+  }
+
+  padded.sample_batch(xs.data(), ys.data(), zs.data(), out.data(), 1000);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_NEAR(out[i], grid.sample(xs[i], ys[i], zs[i]), 1e-12);
+  }
+
+  auto view = padded.view();
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(view.sample(xs[i], ys[i], zs[i]),
+              grid.sample(xs[i], ys[i], zs[i]));
+  }
+}
+
+TEST(DataStructure, LinearGridGhostPeriodicAndConstant) {
+  data_structure::LinearGrid<double> periodic(
+      5, 6, 7, 2, data_structure::grid_boundary_type::periodic);
+  data_structure::LinearGrid<double> constant(
+      5, 6, 7, 1, data_structure::grid_boundary_type::constant, 0.0, 3.0);
+
+  std::mt19937 gen(1);
+  FillRandom(periodic, gen);
+  FillRandom(constant, gen);
+  periodic.UpdateGhosts();
+  constant.UpdateGhosts();
+
+  for (int k = -2; k < 9; k++) {
+    for (int j = -2; j < 8; j++) {
+      for (int i = -2; i < 7; i++) {
+        EXPECT_EQ(periodic(i, j, k),
+                  periodic(Wrap(i, 5), Wrap(j, 6), Wrap(k, 7)));
+      }
+    }
+  }
+  // Sampling across the seam blends the last and the first layer.
+  EXPECT_NEAR(periodic.sample(4.5, 2.0, 3.0),
+              0.5 * (periodic(4, 2, 3) + periodic(0, 2, 3)), 1e-12);
+
+  EXPECT_EQ(constant(-1, 0, 0), 3.0);
+  EXPECT_EQ(constant(5, 6, 7), 3.0);
+  EXPECT_NEAR(constant.sample(-0.5, 2.0, 3.0),
+              0.5 * (constant(0, 2, 3) + 3.0), 1e-12);
+  EXPECT_EQ(constant.sample(-10.0, 2.0, 3.0), 3.0);
+}
+
+TEST(DataStructure, LaplacianGhostMatchesClamped) {
+  data_structure::LinearGrid<double> grid(9, 10, 11, 0.0);
+  data_structure::LinearGrid<double> padded(
+      9, 10, 11, 1, data_structure::grid_boundary_type::clamp);
+  data_structure::LinearGrid<double> result(9, 10, 11, 0.0);
+  data_structure::LinearGrid<double> padded_result(
+      9, 10, 11, 1, data_structure::grid_boundary_type::clamp);
+
+  std::mt19937 gen(2);
+  FillRandom(grid, gen);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        padded(i, j, k) = grid(i, j, k);
+      }
+    }
+  }
+  padded.UpdateGhosts();
+
+  data_structure::Laplacian(grid, 4.0, result);
+  data_structure::Laplacian(padded, 4.0, padded_result);
+  for (size_t k = 0; k < grid.depth(); k++) {
+    for (size_t j = 0; j < grid.height(); j++) {
+      for (size_t i = 0; i < grid.width(); i++) {
+        EXPECT_NEAR(padded_result(i, j, k), result(i, j, k), 1e-12);
+      }
+    }
+  }
+  EXPECT_NEAR(result(4, 5, 6),
+              4.0 * (grid(3, 5, 6) + grid(5, 5, 6) + grid(4, 4, 6) +
+                     grid(4, 6, 6) + grid(4, 5, 5) + grid(4, 5, 7) -
+                     6.0 * grid(4, 5, 6)),
+              1e-12);
+}
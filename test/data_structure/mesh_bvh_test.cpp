@@ -0,0 +1,359 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+// Random small triangles in the unit cube, three vertices each.
+void RandomTriangles(size_t num_triangles,
+                     std::vector<geometry::Vector3<float>> *positions,
+                     std::vector<uint32_t> *indices) {
+  std::mt19937 gen{uint32_t(num_triangles)};
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  std::uniform_real_distribution<float> offset(-0.02f, 0.02f);
+  positions->clear();
+  indices->clear();
+  for (size_t i = 0; i < num_triangles; i++) {
+    geometry::Vector3<float> center{dis(gen), dis(gen), dis(gen)};
+    for (int k = 0; k < 3; k++) {
+      indices->push_back(uint32_t(positions->size()));
+      positions->push_back(center + geometry::Vector3<float>{
+                                        offset(gen), offset(gen), offset(gen)});
+    }
+  }
+}
+
+geometry::Triangle3<float> MeshTriangle(
+    const std::vector<geometry::Vector3<float>> &positions,
+    const std::vector<uint32_t> &indices,
+    size_t i) {
+  geometry::Triangle3<float> triangle;
+  for (int k = 0; k < 3; k++) {
+    triangle.m.col(k) = positions[indices[3 * i + k]];
+  }
+  return triangle;
+}
+
+// Every triangle sits in exactly one leaf and children lie in their parent.
+void CheckStructure(const data_structure::MeshBVH<float> &bvh) {
+  const auto &nodes = bvh.nodes();
+  std::vector<int> seen(bvh.num_triangles(), 0);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const auto &node = nodes[i];
+    if (node.count) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        seen[j]++;
+        const auto &m = bvh.triangles()[j].m;
+        EXPECT_TRUE((m.rowwise().minCoeff().array() >=
+                     node.bounds.min_bound.array())
+                        .all());
+        EXPECT_TRUE((m.rowwise().maxCoeff().array() <=
+                     node.bounds.max_bound.array())
+                        .all());
+      }
+      continue;
+    }
+    ASSERT_LT(node.offset, nodes.size());
+    for (size_t child : {i + 1, size_t(node.offset)}) {
+      EXPECT_TRUE((nodes[child].bounds.min_bound.array() >=
+                   node.bounds.min_bound.array())
+                      .all());
+      EXPECT_TRUE((nodes[child].bounds.max_bound.array() <=
+                   node.bounds.max_bound.array())
+                      .all());
+    }
+  }
+  for (int count : seen) {
+    ASSERT_EQ(count, 1);
+  }
+}
+}  // namespace
+
+TEST(DataStructure, MeshBVHRayQueries) {
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  RandomTriangles(20000, &positions, &indices);
+  data_structure::MeshBVH<float> bvh(positions.data(), indices.data(), 20000);
+  ASSERT_EQ(bvh.num_triangles(), 20000);
+  CheckStructure(bvh);
+
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+  size_t hits = 0;
+  for (int n = 0; n < 500; n++) {
+    geometry::Ray3<float> ray{{dis(gen), dis(gen), dis(gen)},
+                              {normal(gen), normal(gen), normal(gen)}};
+    float t_max = 2.0f;
+    float expected_t = t_max;
+    uint32_t expected_triangle = 0;
+    bool expected_hit = false;
+    for (size_t i = 0; i < 20000; i++) {
+      float u, v;
+      if (geometry::RayTriangleIntersection(
+              ray, MeshTriangle(positions, indices, i), 0.0f, &expected_t, &u,
+              &v)) {
+        expected_triangle = uint32_t(i);
+        expected_hit = true;
+      }
+    }
+    data_structure::MeshRayHit<float> hit;
+    ASSERT_EQ(bvh.ClosestHit(ray, 0.0f, t_max, &hit), expected_hit);
+    ASSERT_EQ(bvh.AnyHit(ray, 0.0f, t_max), expected_hit);
+    if (expected_hit) {
+      EXPECT_EQ(hit.t, expected_t);
+      EXPECT_EQ(hit.triangle, expected_triangle);
+      geometry::Vector3<float> point =
+          (1 - hit.u - hit.v) * positions[indices[3 * hit.triangle]] +
+          hit.u * positions[indices[3 * hit.triangle + 1]] +
+          hit.v * positions[indices[3 * hit.triangle + 2]];
+      EXPECT_LT((point - (ray.origin + hit.t * ray.direction)).norm(), 1e-4f);
+      hits++;
+    }
+  }
+  EXPECT_GT(hits, 250);
+
+  // Rays along the axes, with zero direction components.
+  for (int axis = 0; axis < 3; axis++) {
+    geometry::Ray3<float> ray{positions[0], geometry::Vector3<float>::Zero()};
+    ray.origin[axis] = -1.0f;
+    ray.direction[axis] = 1.0f;
+    data_structure::MeshRayHit<float> hit;
+    EXPECT_TRUE(bvh.ClosestHit(ray, 0.0f, 3.0f, &hit));
+    EXPECT_LE(hit.t, positions[0][axis] + 1.0f);
+  }
+}
+
+TEST(DataStructure, MeshBVHOverlapQueries) {
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  RandomTriangles(5000, &positions, &indices);
+  data_structure::MeshBVH<float> bvh(positions.data(), indices.data(), 5000);
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  for (int n = 0; n < 100; n++) {
+    geometry::Vector3<float> corner{dis(gen), dis(gen), dis(gen)};
+    geometry::AABB3<float> box(corner);
+    box.Expand(corner + geometry::Vector3<float>{0.1f, 0.2f, 0.05f});
+    std::vector<uint32_t> found;
+    bvh.ForEachOverlap(box, [&](uint32_t i) { found.push_back(i); });
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 0; i < 5000; i++) {
+      auto m = MeshTriangle(positions, indices, i).m;
+      if ((m.rowwise().minCoeff().array() <= box.max_bound.array()).all() &&
+          (box.min_bound.array() <= m.rowwise().maxCoeff().array()).all()) {
+        expected.push_back(i);
+      }
+    }
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, expected);
+  }
+}
+
+TEST(DataStructure, MeshBVHBuild) {
+  // The tree does not depend on the number of threads.
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  RandomTriangles(100000, &positions, &indices);
+  SetGlobalThreadCount(1);
+  data_structure::MeshBVH<float> serial(positions.data(), indices.data(),
+                                        100000);
+  SetGlobalThreadCount(3);
+  data_structure::MeshBVH<float> parallel(positions.data(), indices.data(),
+                                          100000);
+  SetGlobalThreadCount(0);
+  CheckStructure(parallel);
+  EXPECT_EQ(serial.triangle_ids(), parallel.triangle_ids());
+  ASSERT_EQ(serial.num_nodes(), parallel.num_nodes());
+  for (size_t i = 0; i < serial.num_nodes(); i++) {
+    EXPECT_EQ(serial.nodes()[i].offset, parallel.nodes()[i].offset);
+    EXPECT_EQ(serial.nodes()[i].count, parallel.nodes()[i].count);
+  }
+
+  // Coincident triangles fall back to median splits.
+  std::vector<uint32_t> same(3 * 1000);
+  for (size_t i = 0; i < same.size(); i++) {
+    same[i] = uint32_t(i % 3);
+  }
+  data_structure::MeshBVH<float> stacked(positions.data(), same.data(), 1000);
+  CheckStructure(stacked);
+  geometry::Ray3<float> ray{
+      MeshTriangle(positions, indices, 0).m.rowwise().mean() -
+          geometry::Vector3<float>{0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f}};
+  EXPECT_TRUE(stacked.AnyHit(ray, 0.0f, 2.0f));
+
+  // A mesh of a unit square, hit from above.
+  std::vector<geometry::Vector3<double>> square = {
+      {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  std::vector<uint32_t> square_indices = {0, 1, 2, 0, 2, 3};
+  geometry::Mesh<double> mesh(4, 6, square_indices.data(), square.data());
+  data_structure::MeshBVH<double> square_bvh(mesh);
+  data_structure::MeshRayHit<double> hit;
+  EXPECT_TRUE(square_bvh.ClosestHit({{0.25, 0.75, 2.0}, {0.0, 0.0, -1.0}},
+                                    0.0, 10.0, &hit));
+  EXPECT_EQ(hit.triangle, 1);
+  EXPECT_DOUBLE_EQ(hit.t, 2.0);
+  EXPECT_FALSE(square_bvh.AnyHit({{1.5, 0.5, 2.0}, {0.0, 0.0, -1.0}}, 0.0,
+                                 10.0));
+  EXPECT_FALSE(data_structure::MeshBVH<double>().AnyHit(
+      {{0.25, 0.75, 2.0}, {0.0, 0.0, -1.0}}, 0.0, 10.0));
+}
+
+TEST(DataStructure, MeshBVHLinearBuild) {
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  RandomTriangles(100000, &positions, &indices);
+  data_structure::MeshBVHSettings settings;
+  settings.builder = data_structure::bvh_builder_type::linear;
+  SetGlobalThreadCount(1);
+  data_structure::MeshBVH<float> serial(positions.data(), indices.data(),
+                                        100000, settings);
+  SetGlobalThreadCount(3);
+  data_structure::MeshBVH<float> parallel(positions.data(), indices.data(),
+                                          100000, settings);
+  SetGlobalThreadCount(0);
+  CheckStructure(parallel);
+  EXPECT_EQ(serial.triangle_ids(), parallel.triangle_ids());
+  ASSERT_EQ(serial.num_nodes(), parallel.num_nodes());
+  for (size_t i = 0; i < serial.num_nodes(); i++) {
+    EXPECT_EQ(serial.nodes()[i].offset, parallel.nodes()[i].offset);
+    EXPECT_EQ(serial.nodes()[i].count, parallel.nodes()[i].count);
+    EXPECT_LE(serial.nodes()[i].count, settings.max_leaf_size);
+  }
+
+  // Both builds find the same hits.
+  settings.wide_morton_codes = true;
+  data_structure::MeshBVH<float> wide(positions.data(), indices.data(),
+                                      100000, settings);
+  CheckStructure(wide);
+  data_structure::MeshBVH<float> sah(positions.data(), indices.data(), 100000);
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+  for (int n = 0; n < 500; n++) {
+    geometry::Ray3<float> ray{{dis(gen), dis(gen), dis(gen)},
+                              {normal(gen), normal(gen), normal(gen)}};
+    data_structure::MeshRayHit<float> expected;
+    bool expected_hit = sah.ClosestHit(ray, 0.0f, 2.0f, &expected);
+    for (const auto *bvh : {&parallel, &wide}) {
+      data_structure::MeshRayHit<float> hit;
+      ASSERT_EQ(bvh->ClosestHit(ray, 0.0f, 2.0f, &hit), expected_hit);
+      ASSERT_EQ(bvh->AnyHit(ray, 0.0f, 2.0f), expected_hit);
+      if (expected_hit) {
+        EXPECT_EQ(hit.t, expected.t);
+        EXPECT_EQ(hit.triangle, expected.triangle);
+      }
+    }
+  }
+
+  // Coincident triangles share one Morton code, and a single triangle is
+  // the root leaf.
+  std::vector<uint32_t> same(3 * 1000);
+  for (size_t i = 0; i < same.size(); i++) {
+    same[i] = uint32_t(i % 3);
+  }
+  for (size_t n : {size_t(1), size_t(5), size_t(1000)}) {
+    data_structure::MeshBVH<float> stacked(positions.data(), same.data(), n,
+                                           settings);
+    CheckStructure(stacked);
+    std::vector<uint32_t> found;
+    stacked.ForEachOverlap(geometry::AABB3<float>(positions[0]),
+                           [&](uint32_t i) { found.push_back(i); });
+    EXPECT_EQ(found.size(), n);
+  }
+}
+
+TEST(DataStructure, ParallelRadixSort) {
+  std::mt19937_64 gen{4};
+  std::vector<uint64_t> keys(300000);
+  for (auto &key : keys) {
+    // Few distinct high digits, so some passes are skipped.
+    key = gen() & 0x7000ffffffffffffull;
+  }
+  std::vector<uint32_t> values(keys.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = uint32_t(i);
+  }
+  std::vector<std::pair<uint64_t, uint32_t>> expected;
+  for (size_t i = 0; i < keys.size(); i++) {
+    expected.emplace_back(keys[i], values[i]);
+  }
+  std::stable_sort(
+      expected.begin(), expected.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  SetGlobalThreadCount(3);
+  data_structure::ParallelRadixSort(&keys, &values, 63);
+  SetGlobalThreadCount(0);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(keys[i], expected[i].first);
+    ASSERT_EQ(values[i], expected[i].second);
+  }
+}
+
+TEST(DataStructure, MeshBVHRefit) {
+  std::vector<geometry::Vector3<float>> positions;
+  std::vector<uint32_t> indices;
+  RandomTriangles(50000, &positions, &indices);
+  data_structure::MeshBVH<float> bvh(positions.data(), indices.data(), 50000);
+  EXPECT_GT(bvh.sah_cost(), 0.0f);
+  EXPECT_EQ(bvh.sah_cost_ratio(), 1.0f);
+
+  // Refitting to the same positions keeps the tree as built.
+  auto built_nodes = bvh.nodes();
+  bvh.Refit(positions.data(), indices.data());
+  EXPECT_EQ(bvh.sah_cost_ratio(), 1.0f);
+  for (size_t i = 0; i < built_nodes.size(); i++) {
+    ASSERT_EQ(bvh.nodes()[i].bounds.min_bound, built_nodes[i].bounds.min_bound);
+    ASSERT_EQ(bvh.nodes()[i].bounds.max_bound, built_nodes[i].bounds.max_bound);
+  }
+
+  // A smooth deformation, after which queries match a fresh build.
+  for (auto &position : positions) {
+    position += 0.1f * geometry::Vector3<float>{std::sin(4 * position[1]),
+                                                std::cos(3 * position[2]),
+                                                position[0] * position[0]};
+  }
+  SetGlobalThreadCount(3);
+  bvh.Refit(positions.data(), indices.data());
+  SetGlobalThreadCount(0);
+  CheckStructure(bvh);
+  data_structure::MeshBVH<float> fresh(positions.data(), indices.data(),
+                                       50000);
+  EXPECT_LT(bvh.sah_cost_ratio(), 1.5f);
+  EXPECT_GE(bvh.sah_cost(), fresh.sah_cost());
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+  for (int n = 0; n < 300; n++) {
+    geometry::Ray3<float> ray{{dis(gen), dis(gen), dis(gen)},
+                              {normal(gen), normal(gen), normal(gen)}};
+    data_structure::MeshRayHit<float> hit, expected;
+    bool expected_hit = fresh.ClosestHit(ray, 0.0f, 2.0f, &expected);
+    ASSERT_EQ(bvh.ClosestHit(ray, 0.0f, 2.0f, &hit), expected_hit);
+    if (expected_hit) {
+      EXPECT_EQ(hit.t, expected.t);
+      EXPECT_EQ(hit.triangle, expected.triangle);
+    }
+  }
+  EXPECT_FALSE(bvh.Update(positions.data(), indices.data()));
+
+  // Scattering the triangles degrades the tree past the threshold.
+  std::vector<uint32_t> shuffled = indices;
+  std::shuffle(shuffled.begin(), shuffled.end(), gen);
+  data_structure::MeshBVHSettings settings;
+  settings.builder = data_structure::bvh_builder_type::linear;
+  data_structure::MeshBVH<float> scattered(positions.data(), indices.data(),
+                                           50000, settings);
+  EXPECT_TRUE(scattered.Update(positions.data(), shuffled.data()));
+  EXPECT_EQ(scattered.sah_cost_ratio(), 1.0f);
+  CheckStructure(scattered);
+  const auto &stats = scattered.update_stats();
+  EXPECT_EQ(stats.builds, 2);
+  EXPECT_EQ(stats.refits, 1);
+  EXPECT_GT(stats.build_seconds, 0.0);
+  EXPECT_GT(stats.refit_seconds, 0.0);
+  EXPECT_EQ(bvh.update_stats().builds, 1);
+  EXPECT_EQ(bvh.update_stats().refits, 3);
+}
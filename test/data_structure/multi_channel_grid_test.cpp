@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+TEST(DataStructure, MultiChannelGridMatchesInterleaved) {
+  using Vector = Eigen::Vector3f;
+  data_structure::LinearGrid<Vector> interleaved(13, 7, 5);
+  data_structure::MultiChannelGrid<float, 3> planes(13, 7, 5);
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value_dis(-1.0f, 1.0f);
+  for (int k = 0; k < 5; k++) {
+    for (int j = 0; j < 7; j++) {
+      for (int i = 0; i < 13; i++) {
+        Vector value(value_dis(gen), value_dis(gen), value_dis(gen));
+        interleaved(i, j, k) = value;
+        planes(i, j, k) = value;
+      }
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(planes.channel_data(c)) %
+                  data_structure::kChannelAlignment,
+              0);
+  }
+  EXPECT_EQ(planes.get(4, 5, 3), interleaved(4, 5, 3));
+  EXPECT_EQ(planes(4, 5, 3)[1], interleaved(4, 5, 3)[1]);
+  EXPECT_EQ(planes.channel(2)(4, 5, 3), interleaved(4, 5, 3)[2]);
+
+  std::uniform_real_distribution<float> pos_dis(-2.0f, 15.0f);
+  for (int i = 0; i < 1000; i++) {
+    float x = pos_dis(gen), y = pos_dis(gen), z = pos_dis(gen);
+    Vector expected = interleaved.sample(x, y, z);
+    Vector actual = planes.sample(x, y, z);
+    for (int c = 0; c < 3; c++) {
+      EXPECT_NEAR(actual[c], expected[c], 1e-5f);
+    }
+  }
+}
+
+TEST(DataStructure, MultiChannelGridPerChannel) {
+  data_structure::MultiChannelGrid<double, 4> grid(
+      9, 8, 7, Eigen::Vector4d(1.0, 2.0, 3.0, 4.0));
+  EXPECT_EQ(grid.get(8, 7, 6), Eigen::Vector4d(1.0, 2.0, 3.0, 4.0));
+
+  // A kernel on one channel leaves the others alone.
+  auto channel = grid.channel(1);
+  data_structure::ParallelFill(channel, [](int64_t x, int64_t y, int64_t z) {
+    return double(x + y + z);
+  });
+  EXPECT_EQ(grid.get(2, 3, 4), Eigen::Vector4d(1.0, 9.0, 3.0, 4.0));
+  EXPECT_EQ(data_structure::Sum(grid.channel(0)), 9.0 * 8 * 7);
+  grid(2, 3, 4)[3] = -1.0;
+  grid(2, 3, 4) += Eigen::Vector4d::Ones();
+  EXPECT_EQ(grid.get(2, 3, 4), Eigen::Vector4d(2.0, 10.0, 4.0, 0.0));
+
+  // Whole cells through a Field.
+  geometry::Field<Eigen::Vector3f, float,
+                  data_structure::MultiChannelGrid<float, 3>>
+      field(4, 4, 4, 1.0f, {0.0f, 0.0f, 0.0f});
+  field.FillFromFunction(
+      [](const geometry::Vector3<float> &pos) -> Eigen::Vector3f {
+        return pos;
+      });
+  Eigen::Vector3f pos(1.25f, 2.5f, 0.75f);
+  EXPECT_TRUE(field(pos).isApprox(pos));
+}
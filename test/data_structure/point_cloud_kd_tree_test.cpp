@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+std::vector<geometry::Vector3<double>> RandomPoints(size_t n, uint32_t seed) {
+  std::mt19937 gen{seed};
+  std::normal_distribution<double> dis;
+  std::vector<geometry::Vector3<double>> points(n);
+  for (auto &point : points) {
+    point = {dis(gen), dis(gen), 0.3 * dis(gen)};
+  }
+  return points;
+}
+
+// The k nearest points to pos by brute force, nearest first.
+std::vector<std::pair<double, uint32_t>> BruteForceKNearest(
+    const std::vector<geometry::Vector3<double>> &points,
+    const geometry::Vector3<double> &pos,
+    size_t k) {
+  std::vector<std::pair<double, uint32_t>> all;
+  for (size_t i = 0; i < points.size(); i++) {
+    all.emplace_back((points[i] - pos).squaredNorm(), uint32_t(i));
+  }
+  std::sort(all.begin(), all.end());
+  all.resize(std::min(k, all.size()));
+  return all;
+}
+}  // namespace
+
+TEST(DataStructure, PointCloudKDTreeKNearest) {
+  auto points = RandomPoints(20000, 0);
+  data_structure::PointCloudKDTree<double> tree(points.data(), points.size());
+  EXPECT_EQ(tree.num_points(), points.size());
+  EXPECT_LE((points.size() >> tree.depth()) + 1, 16);
+
+  auto queries = RandomPoints(300, 1);
+  std::vector<std::pair<double, uint32_t>> neighbours;
+  for (const auto &query : queries) {
+    tree.KNearest(query, 10, &neighbours);
+    EXPECT_EQ(neighbours, BruteForceKNearest(points, query, 10));
+  }
+
+  std::vector<uint32_t> indices;
+  std::vector<double> distances_squared;
+  SetGlobalThreadCount(3);
+  tree.KNearest(queries.data(), queries.size(), 10, &indices,
+                &distances_squared);
+  SetGlobalThreadCount(0);
+  ASSERT_EQ(indices.size(), queries.size() * 10);
+  for (size_t q = 0; q < queries.size(); q++) {
+    auto expected = BruteForceKNearest(points, queries[q], 10);
+    for (size_t j = 0; j < 10; j++) {
+      EXPECT_EQ(indices[q * 10 + j], expected[j].second);
+      EXPECT_EQ(distances_squared[q * 10 + j], expected[j].first);
+    }
+  }
+
+  // Fewer points than leaves, leaf_size and k.
+  for (size_t n : {size_t(0), size_t(1), size_t(5), size_t(37)}) {
+    data_structure::PointCloudKDTree<double> small(points.data(), n, 4);
+    small.KNearest(queries.data(), 2, 8, &indices, &distances_squared);
+    for (size_t q = 0; q < 2; q++) {
+      auto expected = BruteForceKNearest(
+          std::vector<geometry::Vector3<double>>(points.begin(),
+                                                 points.begin() + n),
+          queries[q], 8);
+      for (size_t j = 0; j < 8; j++) {
+        uint32_t index = j < expected.size() ? expected[j].second
+                                             : small.kInvalidIndex;
+        EXPECT_EQ(indices[q * 8 + j], index);
+      }
+    }
+  }
+}
+
+TEST(DataStructure, PointCloudKDTreeRadiusSearch) {
+  // Duplicated points land on both sides of splits.
+  auto points = RandomPoints(10000, 2);
+  points.insert(points.end(), points.begin(), points.begin() + 5000);
+  data_structure::PointCloudKDTree<double> tree(points.data(), points.size(),
+                                                8);
+  auto queries = RandomPoints(200, 3);
+  const double radius = 0.2;
+  std::vector<size_t> offsets;
+  std::vector<uint32_t> indices;
+  std::vector<double> distances_squared;
+  SetGlobalThreadCount(3);
+  tree.RadiusSearch(queries.data(), queries.size(), radius, &offsets,
+                    &indices, &distances_squared);
+  SetGlobalThreadCount(0);
+  ASSERT_EQ(offsets.size(), queries.size() + 1);
+  ASSERT_EQ(offsets.back(), indices.size());
+  size_t total = 0;
+  for (size_t q = 0; q < queries.size(); q++) {
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < points.size(); i++) {
+      if ((points[i] - queries[q]).squaredNorm() <= radius * radius) {
+        expected.push_back(uint32_t(i));
+      }
+    }
+    std::vector<uint32_t> found;
+    tree.ForEachInRadius(queries[q], radius, [&](uint32_t i, double d2) {
+      EXPECT_EQ(d2, (points[i] - queries[q]).squaredNorm());
+      found.push_back(i);
+    });
+    ASSERT_EQ(std::vector<uint32_t>(indices.begin() + offsets[q],
+                                    indices.begin() + offsets[q + 1]),
+              found);
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, expected);
+    total += expected.size();
+  }
+  EXPECT_GT(total, 1000);
+}
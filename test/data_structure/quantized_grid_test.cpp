@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+data_structure::LinearGrid<float> SphereSdf(size_t size) {
+  data_structure::LinearGrid<float> grid(size, size, size);
+  for (size_t k = 0; k < size; k++) {
+    for (size_t j = 0; j < size; j++) {
+      for (size_t i = 0; i < size; i++) {
+        Eigen::Vector3f pos(i, j, k);
+        grid(i, j, k) =
+            (pos - Eigen::Vector3f::Constant(0.5f * size)).norm() - 0.3f * size;
+      }
+    }
+  }
+  return grid;
+}
+}  // namespace
+
+TEST(DataStructure, HalfConversion) {
+  using data_structure::Half;
+  // Every finite half survives a round trip through float.
+  for (uint32_t bits = 0; bits < 0x10000; bits++) {
+    if ((bits & 0x7c00) == 0x7c00 && (bits & 0x3ff)) {
+      continue;
+    }
+    float value = Half::FromBits(uint16_t(bits));
+    EXPECT_EQ(Half(value).bits(), bits);
+  }
+  EXPECT_EQ(float(Half(65504.0f)), 65504.0f);
+  EXPECT_TRUE(std::isinf(float(Half(1e6f))));
+  EXPECT_TRUE(std::isnan(float(Half(std::nanf("")))));
+  // Ties round to even: 1 + 2^-11 lies between 1 and 1 + 2^-10.
+  EXPECT_EQ(float(Half(1.0f + std::ldexp(1.0f, -11))), 1.0f);
+  EXPECT_EQ(float(Half(1.0f + 3 * std::ldexp(1.0f, -11))),
+            1.0f + std::ldexp(1.0f, -9));
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1000.0f, 1000.0f);
+  for (int i = 0; i < 10000; i++) {
+    float value = dis(gen);
+    EXPECT_LE(std::abs(float(Half(value)) - value),
+              std::abs(value) * std::ldexp(1.0f, -11));
+  }
+}
+
+TEST(DataStructure, QuantizedGridError) {
+  auto sdf = SphereSdf(32);
+  float lo = data_structure::Min(sdf);
+  float hi = data_structure::Max(sdf);
+
+  using Fixed16Grid =
+      data_structure::QuantizedGrid<float, data_structure::Fixed16Codec<>>;
+  using Fixed8Grid =
+      data_structure::QuantizedGrid<float, data_structure::Fixed8Codec<>>;
+  data_structure::QuantizedGrid<float, data_structure::HalfCodec> half(sdf);
+  Fixed16Grid fixed16(sdf);
+  Fixed8Grid fixed8(sdf);
+  Fixed8Grid bricked8(sdf, 8);
+  EXPECT_THROW(Fixed8Grid(sdf, 6), std::invalid_argument);
+  ASSERT_EQ(fixed8.codecs().size(), 1);
+  ASSERT_EQ(bricked8.codecs().size(), 64);
+  EXPECT_EQ(half.storage().buffer().size() * sizeof(half.storage()[0]),
+            32 * 32 * 32 * 2);
+  EXPECT_EQ(fixed8.storage().buffer().size(), 32 * 32 * 32);
+
+  // Decoding in float adds rounding errors of a few ulps of the values.
+  float rounding = 1e-5f;
+  float fixed8_error = 0.5f * (hi - lo) / 255.0f + rounding;
+  for (int k = 0; k < 32; k++) {
+    for (int j = 0; j < 32; j++) {
+      for (int i = 0; i < 32; i++) {
+        float value = sdf(i, j, k);
+        EXPECT_LE(std::abs(half(i, j, k) - value),
+                  std::abs(value) * std::ldexp(1.0f, -11));
+        EXPECT_LE(std::abs(fixed16(i, j, k) - value),
+                  fixed16.codec(i, j, k).max_error() + rounding);
+        EXPECT_LE(std::abs(fixed8(i, j, k) - value), fixed8_error);
+        EXPECT_LE(std::abs(bricked8(i, j, k) - value),
+                  bricked8.codec(i, j, k).max_error() + rounding);
+        EXPECT_LE(bricked8.codec(i, j, k).max_error(), fixed8_error);
+      }
+    }
+  }
+
+  // Interpolation is linear, so sampling is off by no more than the cells.
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1.0f, 33.0f);
+  for (int i = 0; i < 1000; i++) {
+    float x = dis(gen), y = dis(gen), z = dis(gen);
+    EXPECT_NEAR(fixed8.sample(x, y, z), sdf.sample(x, y, z),
+                fixed8_error);
+    EXPECT_NEAR(half.sample(x, y, z), sdf.sample(x, y, z),
+                std::max(std::abs(lo), std::abs(hi)) * std::ldexp(1.0f, -11));
+  }
+}
+
+TEST(DataStructure, QuantizedGridWriteAndWrap) {
+  using Codec = data_structure::Fixed16Codec<double>;
+  using Grid = data_structure::QuantizedGrid<double, Codec>;
+  Codec codec = Codec::FromRange(-2.0, 2.0);
+  Grid grid(4, 5, 6, 1.0, codec);
+  EXPECT_NEAR(grid(3, 4, 5), 1.0, codec.max_error());
+  grid(1, 2, 3) = -1.5;
+  grid(1, 2, 3) += 0.25;
+  EXPECT_NEAR(grid(1, 2, 3), -1.25, 2 * codec.max_error());
+  // Values outside the range are clamped.
+  grid(0, 0, 0) = 5.0;
+  EXPECT_NEAR(grid(0, 0, 0), 2.0, codec.max_error());
+
+  // The same codes seen through a LinearGridView.
+  auto &storage = grid.storage();
+  data_structure::QuantizedGrid<double, Codec,
+                                data_structure::LinearGridView<uint16_t>>
+      view(storage.view(), grid.codecs());
+  EXPECT_EQ(view(1, 2, 3), grid(1, 2, 3));
+  EXPECT_EQ(view.sample(1.5, 2.25, 2.75), grid.sample(1.5, 2.25, 2.75));
+
+  // A double codec keeps the precision of a range far from zero, where
+  // values rounded to float are off by up to 1/32.
+  Codec far = Codec::FromRange(1e6, 1e6 + 1.0);
+  Grid far_grid(2, 2, 2, 1e6 + 0.3, far);
+  EXPECT_NEAR(far_grid(1, 1, 1), 1e6 + 0.3, far.max_error() + 1e-9);
+
+  // Fields decode through the grid.
+  using HalfGrid =
+      data_structure::QuantizedGrid<float, data_structure::HalfCodec>;
+  geometry::Field<float, float, HalfGrid> field(8, 8, 8, 0.5f,
+                                                {0.0f, 0.0f, 0.0f});
+  field.FillFromFunction(
+      [](const geometry::Vector3<float> &pos) { return pos.sum(); });
+  EXPECT_FLOAT_EQ(field(2, 3, 4), 4.5f);
+  EXPECT_NEAR(field(geometry::Vector3<float>{1.25f, 1.0f, 2.0f}), 4.25f,
+              4.25f * std::ldexp(1.0f, -11));
+}
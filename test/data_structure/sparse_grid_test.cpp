@@ -0,0 +1,75 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+TEST(DataStructure, SparseGridNarrowBand) {
+  const double band = 1.5;
+  geometry::Field<double, double> dense_field(41, 37, 45, 0.25,
+                                              {-5.0, -4.5, -5.5}, band);
+  geometry::Field<double, double, data_structure::SparseGrid<double>>
+      sparse_field(41, 37, 45, 0.25, {-5.0, -4.5, -5.5}, band);
+
+  for (size_t i = 0; i < dense_field.width(); i++) {
+    for (size_t j = 0; j < dense_field.height(); j++) {
+      for (size_t k = 0; k < dense_field.depth(); k++) {
+        double sdf = dense_field.get_position(i, j, k).norm() - 3.0;
+        if (std::abs(sdf) < band) {
+          dense_field(i, j, k) = sdf;
+          sparse_field(i, j, k) = sdf;
+        }
+      }
+    }
+  }
+
+  const auto &sparse_grid = sparse_field.grid();
+  EXPECT_LT(sparse_grid.num_leaves() * sparse_grid.kLeafVolume,
+            dense_field.width() * dense_field.height() * dense_field.depth());
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dis(-6.0, 6.0);
+  for (int i = 0; i < 10000; i++) {
+    geometry::Vector3<double> pos(dis(gen), dis(gen), dis(gen));
+    EXPECT_NEAR(sparse_field(pos), dense_field(pos), 1e-12);
+  }
+
+  size_t num_active = 0;
+  sparse_grid.ForEachActive([&](data_structure::offset_t x,
+                                data_structure::offset_t y,
+                                data_structure::offset_t z, double value) {
+    EXPECT_EQ(value, dense_field(x, y, z));
+    num_active++;
+  });
+  EXPECT_GT(num_active, 0);
+
+  auto dense_mesh = geometry::MarchingCubes(dense_field);
+  auto sparse_mesh = geometry::MarchingCubes(sparse_field);
+  EXPECT_GT(dense_mesh.NumIndices(), 0);
+  EXPECT_EQ(sparse_mesh.NumVertices(), dense_mesh.NumVertices());
+  EXPECT_EQ(sparse_mesh.NumIndices(), dense_mesh.NumIndices());
+}
+
+TEST(DataStructure, SparseGridPrune) {
+  data_structure::SparseGrid<float> grid(100, 100, 100, 1.0f);
+  grid(5, 5, 5) = 2.0f;
+  grid(50, 50, 50) = 1.0f;
+  grid(99, 0, 99) = 3.0f;
+  EXPECT_EQ(grid.num_leaves(), 3);
+  EXPECT_TRUE(grid.is_active(50, 51, 52));
+  EXPECT_FALSE(grid.is_active(20, 20, 20));
+  EXPECT_EQ(grid.get(20, 20, 20), 1.0f);
+
+  EXPECT_EQ(grid.Prune(), 1);
+  EXPECT_EQ(grid.num_leaves(), 2);
+  EXPECT_FALSE(grid.is_active(50, 50, 50));
+  EXPECT_EQ(grid.get(5, 5, 5), 2.0f);
+  EXPECT_EQ(grid.get(99, 0, 99), 3.0f);
+
+  data_structure::SparseGrid<float> copy(grid);
+  copy(5, 5, 5) = 4.0f;
+  EXPECT_EQ(grid.get(5, 5, 5), 2.0f);
+  EXPECT_EQ(copy.get(5, 5, 5), 4.0f);
+  EXPECT_EQ(copy.get(99, 0, 99), 3.0f);
+}
@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+// Jittered particles filling [0, 1] x [0, 1] x [0, 0.5] at a spacing of
+// 0.025.
+std::vector<geometry::Vector3<float>> FluidBlock() {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-0.3f, 0.3f);
+  std::vector<geometry::Vector3<float>> points;
+  for (int k = 0; k < 20; k++) {
+    for (int j = 0; j < 40; j++) {
+      for (int i = 0; i < 40; i++) {
+        points.push_back(
+            geometry::Vector3<float>{i + 0.5f + dis(gen), j + 0.5f + dis(gen),
+                                     k + 0.5f + dis(gen)} *
+            0.025f);
+      }
+    }
+  }
+  return points;
+}
+
+// Standard deviation of the height of the top surface away from the sides.
+float TopRoughness(const geometry::Mesh<float> &mesh) {
+  double sum = 0.0, sum_squared = 0.0;
+  size_t count = 0;
+  for (size_t i = 0; i < mesh.NumVertices(); i++) {
+    const auto &pos = mesh.Positions()[i];
+    if (pos.x() > 0.2f && pos.x() < 0.8f && pos.y() > 0.2f &&
+        pos.y() < 0.8f && pos.z() > 0.25f) {
+      sum += pos.z();
+      sum_squared += pos.z() * pos.z();
+      count++;
+    }
+  }
+  EXPECT_GT(count, 100);
+  double mean = sum / count;
+  return float(std::sqrt(std::max(sum_squared / count - mean * mean, 0.0)));
+}
+}  // namespace
+
+TEST(Geometry, PointHashGrid) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-3.0, 3.0);
+  std::vector<geometry::Vector3<double>> points(20000);
+  for (auto &point : points) {
+    point = {dis(gen), dis(gen), dis(gen)};
+  }
+  geometry::PointHashGrid<double> hash_grid(points.data(), points.size(),
+                                            0.4);
+  EXPECT_GE(hash_grid.num_buckets(), 2 * points.size());
+  for (int n = 0; n < 200; n++) {
+    geometry::Vector3<double> pos{dis(gen), dis(gen), dis(gen)};
+    std::vector<uint32_t> found;
+    hash_grid.ForEachNeighbour(pos, 0.3, [&](uint32_t j, double d2) {
+      EXPECT_DOUBLE_EQ(d2, (points[j] - pos).squaredNorm());
+      found.push_back(j);
+    });
+    std::vector<uint32_t> expected;
+    for (size_t j = 0; j < points.size(); j++) {
+      if ((points[j] - pos).squaredNorm() <= 0.09) {
+        expected.push_back(uint32_t(j));
+      }
+    }
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, expected);
+  }
+}
+
+TEST(Geometry, AnisotropicKernels) {
+  auto points = FluidBlock();
+  const float radius = 0.025f;
+  std::vector<geometry::Vector3<float>> centers;
+  std::vector<geometry::Matrix<float, 3, 3>> transforms;
+  geometry::AnisotropicKernelSettings<float> settings;
+  geometry::ComputeAnisotropicKernels(points.data(), points.size(), radius,
+                                      settings, &centers, &transforms);
+  ASSERT_EQ(transforms.size(), points.size());
+  size_t top = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    // Unit volume and clamped stretch.
+    Eigen::SelfAdjointEigenSolver<geometry::Matrix<float, 3, 3>> solver(
+        transforms[i] * radius);
+    auto axes = solver.eigenvalues();
+    EXPECT_NEAR(axes.prod(), 1.0f, 1e-3f);
+    EXPECT_LE(axes[2] / axes[0], settings.max_stretch * 1.001f);
+    const auto &pos = points[i];
+    if (pos.z() > 0.48f && pos.x() > 0.2f && pos.x() < 0.8f &&
+        pos.y() > 0.2f && pos.y() < 0.8f) {
+      // Kernels at the free surface are flattened across it.
+      geometry::Vector3<float> normal = transforms[i].col(2);
+      geometry::Vector3<float> tangent = transforms[i].col(0);
+      EXPECT_GT(normal.norm(), 1.5f * tangent.norm());
+      EXPECT_LT(centers[i].z(), pos.z());
+      top++;
+    }
+  }
+  EXPECT_GT(top, 100);
+
+  // Isolated points keep spherical kernels.
+  std::vector<geometry::Vector3<float>> sparse = {{0.0f, 0.0f, 0.0f},
+                                                  {1.0f, 0.0f, 0.0f}};
+  geometry::ComputeAnisotropicKernels(sparse.data(), sparse.size(), radius,
+                                      settings, &centers, &transforms);
+  geometry::Matrix<float, 3, 3> spherical =
+      geometry::Matrix<float, 3, 3>::Identity() / radius;
+  EXPECT_EQ(transforms[1], spherical);
+  EXPECT_EQ(centers[1], sparse[1]);
+}
+
+TEST(Geometry, AnisotropicPointToMesh) {
+  auto points = FluidBlock();
+  const float radius = 0.025f;
+  auto isotropic = geometry::PointToMesh(points.data(), points.size(), radius,
+                                         2);
+  auto anisotropic = geometry::AnisotropicPointToMesh(
+      points.data(), points.size(), radius, 2);
+  ASSERT_GT(anisotropic.NumIndices(), 0);
+  // The top comes out flatter than with spherical kernels.
+  float isotropic_roughness = TopRoughness(isotropic);
+  float anisotropic_roughness = TopRoughness(anisotropic);
+  EXPECT_LT(anisotropic_roughness, 0.5f * isotropic_roughness);
+
+  auto field = geometry::AnisotropicPointToField(points.data(), points.size(),
+                                                 radius, 2);
+  SetGlobalThreadCount(3);
+  auto sparse = geometry::AnisotropicPointToSparseField(
+      points.data(), points.size(), radius, size_t(2));
+  SetGlobalThreadCount(0);
+  ASSERT_EQ(sparse.depth(), field.depth());
+  for (size_t z = 0; z < field.depth(); z++) {
+    for (size_t y = 0; y < field.height(); y++) {
+      for (size_t x = 0; x < field.width(); x++) {
+        ASSERT_EQ(sparse(x, y, z), field(x, y, z));
+      }
+    }
+  }
+}
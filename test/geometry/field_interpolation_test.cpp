@@ -31,3 +31,79 @@ TEST(Geometry, FieldInterpolation) {
     EXPECT_NEAR(field_view_result, predicted_result, 1e-6);
   }
 }
+
+TEST(Geometry, FieldFillFromFunction) {
+  geometry::Field<double, double> field(21, 22, 23, 0.5, {-1.0, 2.0, 3.0});
+  field.FillFromFunction(
+      [](const geometry::Vector3<double> &pos) { return pos.norm(); });
+  for (size_t k = 0; k < field.depth(); k++) {
+    for (size_t j = 0; j < field.height(); j++) {
+      for (size_t i = 0; i < field.width(); i++) {
+        EXPECT_EQ(field(i, j, k), field.get_position(i, j, k).norm());
+      }
+    }
+  }
+}
+
+TEST(Geometry, FieldSampleWithDerivatives) {
+  // Catmull-Rom reproduces quadratics, so its derivatives are exact, also
+  // through a transform with different cell sizes per axis.
+  geometry::Field<double, double> field(16, 12, 10, {0.25, 0.5, 0.3},
+                                        {-2.0, -3.0, -1.5});
+  auto func = [](const geometry::Vector3<double> &p) {
+    return p[0] * p[0] + 2 * p[0] * p[1] - p[2] * p[2] + 3 * p[1];
+  };
+  field.FillFromFunction(func);
+  Eigen::Matrix3d expected_hessian;
+  expected_hessian << 2, 2, 0, 2, 0, 0, 0, 0, -2;
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-0.5, 0.5);
+  std::vector<geometry::Vector3<double>> positions(100);
+  for (auto &pos : positions) {
+    pos = {dis(gen), dis(gen), dis(gen)};
+  }
+  auto interpolation = data_structure::grid_interpolation_type::catmull_rom;
+  std::vector<double> values(positions.size());
+  std::vector<geometry::Vector3<double>> gradients(positions.size());
+  std::vector<geometry::Matrix3<double>> hessians(positions.size());
+  field.SampleWithHessianBatch(positions.data(), values.data(),
+                               gradients.data(), hessians.data(),
+                               positions.size(), interpolation);
+  for (size_t i = 0; i < positions.size(); i++) {
+    const auto &p = positions[i];
+    geometry::Vector3<double> expected_gradient(2 * p[0] + 2 * p[1],
+                                                2 * p[0] + 3, -2 * p[2]);
+    geometry::Vector3<double> gradient;
+    EXPECT_NEAR(field.SampleWithGradient(p, &gradient, interpolation),
+                func(p), 1e-10);
+    EXPECT_LT((gradient - expected_gradient).norm(), 1e-10);
+    EXPECT_NEAR(values[i], func(p), 1e-10);
+    EXPECT_LT((gradients[i] - expected_gradient).norm(), 1e-10);
+    EXPECT_LT((hessians[i] - expected_hessian).norm(), 1e-9);
+  }
+
+  // Trilinear derivatives match finite differences of the trilinear
+  // interpolant, away from the cell faces where its gradient jumps.
+  const double h = 1e-6;
+  for (const auto &p : positions) {
+    geometry::Vector3<double> grid_pos = field.to_grid_position(p);
+    if ((grid_pos.array() - grid_pos.array().round()).abs().minCoeff() <
+        1e-4) {
+      continue;
+    }
+    geometry::Vector3<double> gradient;
+    geometry::Matrix3<double> hessian;
+    field.SampleWithHessian(p, &gradient, &hessian);
+    for (int axis = 0; axis < 3; axis++) {
+      geometry::Vector3<double> offset = geometry::Vector3<double>::Zero();
+      offset[axis] = h;
+      EXPECT_NEAR(gradient[axis],
+                  (field(p + offset) - field(p - offset)) / (2 * h), 1e-5);
+      geometry::Vector3<double> g_hi, g_lo;
+      field.SampleWithGradient(p + offset, &g_hi);
+      field.SampleWithGradient(p - offset, &g_lo);
+      EXPECT_LT((hessian.col(axis) - (g_hi - g_lo) / (2 * h)).norm(), 1e-4);
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#include "filesystem"
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+// A file name no other test run uses at the same time.
+std::string UniqueTempFile(const std::string &name) {
+  std::random_device rd;
+  return (std::filesystem::temp_directory_path() /
+          (name + "_" + std::to_string(rd()) + std::to_string(rd()) +
+           ".lmfield"))
+      .string();
+}
+}  // namespace
+
+TEST(Geometry, FieldSaveLoadMmap) {
+  geometry::Field<float, double> field(13, 7, 5, 0.25, {-1.0, 2.0, 0.5});
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+  for (auto &value : field.grid().buffer()) {
+    value = dis(gen);
+  }
+  std::string filename = UniqueTempFile("field_io_test");
+  ASSERT_EQ(geometry::SaveField(filename, field), 0);
+
+  std::unique_ptr<geometry::Field<float, double>> loaded;
+  ASSERT_EQ((geometry::LoadField<float, double>(filename, &loaded)), 0);
+  EXPECT_EQ(loaded->grid().buffer(), field.grid().buffer());
+  EXPECT_EQ(loaded->get_transform(), field.get_transform());
+
+  MappedFile file;
+  std::unique_ptr<geometry::Field<
+      float, double, data_structure::LinearGridView<float>>>
+      mapped;
+  ASSERT_EQ((geometry::MmapField<float, double>(filename, file, &mapped)), 0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(mapped->grid().data()) %
+                geometry::kFieldFileAlignment,
+            0);
+  for (size_t k = 0; k < field.depth(); k++) {
+    for (size_t j = 0; j < field.height(); j++) {
+      for (size_t i = 0; i < field.width(); i++) {
+        EXPECT_EQ((*mapped)(i, j, k), field(i, j, k));
+      }
+    }
+  }
+  geometry::Vector3<double> pos{0.3, 2.7, 1.1};
+  EXPECT_EQ((*mapped)(pos), field(pos));
+
+  // Wrong element type and missing files are reported, not crashed on.
+  std::unique_ptr<geometry::Field<double, double>> wrong_type;
+  EXPECT_EQ((geometry::LoadField<double, double>(filename, &wrong_type)), -1);
+  EXPECT_EQ((geometry::LoadField<float, double>(filename + ".missing",
+                                                  &loaded)),
+            -1);
+
+  // Ghost layers are not saved; vector elements are.
+  data_structure::LinearGrid<geometry::Vector3<float>> vectors(
+      3, 4, 5, 1, data_structure::grid_boundary_type::clamp,
+      geometry::Vector3<float>{1.0f, 2.0f, 3.0f});
+  ASSERT_EQ(geometry::SaveGrid(filename, vectors), 0);
+  std::unique_ptr<geometry::Field<geometry::Vector3<float>, float>>
+      loaded_vectors;
+  ASSERT_EQ((geometry::LoadField<geometry::Vector3<float>, float>(
+                filename, &loaded_vectors)),
+            0);
+  EXPECT_EQ(loaded_vectors->grid().buffer().size(), size_t(3 * 4 * 5));
+  EXPECT_EQ(loaded_vectors->grid()(2, 3, 4), vectors(2, 3, 4));
+
+  file.Close();
+  std::filesystem::remove(filename);
+}
+
+TEST(Geometry, FieldFileRejectsWrappingHeaders) {
+  geometry::Field<float, float> field(13, 7, 5, 0.25f, {0.0f, 0.0f, 0.0f});
+  std::string filename = UniqueTempFile("field_io_wrapping_test");
+  ASSERT_EQ(geometry::SaveField(filename, field), 0);
+  geometry::FieldFileHeader header{};
+  {
+    std::ifstream file(filename, std::ios::binary);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    ASSERT_TRUE(file.good());
+  }
+
+  // Each header makes the extent or the end of the payload wrap around 2^64
+  // to a value that fits the file.
+  std::vector<geometry::FieldFileHeader> headers(3, header);
+  headers[0].z_stride = uint64_t(1) << 62;
+  headers[0].depth = 5;
+  headers[1].payload_offset = ~uint64_t(0) - 1023;
+  headers[2].y_stride = uint64_t(1) << 62;
+  headers[2].z_stride = uint64_t(1) << 62;
+  headers[2].height = 5;
+  headers[2].depth = 1;
+  for (const auto &crafted : headers) {
+    {
+      std::fstream file(filename,
+                        std::ios::binary | std::ios::in | std::ios::out);
+      file.write(reinterpret_cast<const char *>(&crafted), sizeof(crafted));
+      ASSERT_TRUE(file.good());
+    }
+    std::unique_ptr<geometry::Field<float, float>> loaded;
+    EXPECT_EQ((geometry::LoadField<float, float>(filename, &loaded)), -1);
+    MappedFile file;
+    std::unique_ptr<geometry::Field<float, float,
+                                    data_structure::LinearGridView<float>>>
+        mapped;
+    EXPECT_EQ((geometry::MmapField<float, float>(filename, file, &mapped)),
+              -1);
+  }
+  std::filesystem::remove(filename);
+}
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+#include "set"
+
+using namespace long_march;
+
+namespace {
+geometry::Field<float> SphereField() {
+  geometry::Field<float> field(33, 33, 33, 1.0f / 16.0f,
+                               {-1.0f, -1.0f, -1.0f});
+  field.FillFromFunction([](const geometry::Vector3<float> &pos) {
+    return pos.norm() - 0.6f;
+  });
+  return field;
+}
+
+bool Crosses(const geometry::Field<float> &field,
+             int i,
+             int j,
+             int k,
+             float level) {
+  float lo = field(i, j, k);
+  float hi = lo;
+  for (int c = 1; c < 8; c++) {
+    float value = field(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+    lo = std::min(lo, value);
+    hi = std::max(hi, value);
+  }
+  return lo <= level && level <= hi;
+}
+}  // namespace
+
+TEST(Geometry, FieldPyramidCells) {
+  auto field = SphereField();
+  geometry::FieldPyramid<float> pyramid(field);
+  ASSERT_EQ(pyramid.num_levels(), 6);
+  EXPECT_EQ(pyramid.min(0).width(), 32);
+  EXPECT_EQ(pyramid.min(5).width(), 1);
+  EXPECT_FLOAT_EQ(pyramid.min(5)(0, 0, 0), -0.6f);
+
+  std::set<std::array<int, 3>> visited;
+  pyramid.ForEachCell(0.0f, 0.0f, [&](int64_t i, int64_t j, int64_t k) {
+    EXPECT_TRUE(visited.insert({int(i), int(j), int(k)}).second);
+  });
+  size_t crossing = 0;
+  for (int k = 0; k < 32; k++) {
+    for (int j = 0; j < 32; j++) {
+      for (int i = 0; i < 32; i++) {
+        bool crosses = Crosses(field, i, j, k, 0.0f);
+        crossing += crosses;
+        EXPECT_EQ(visited.count({i, j, k}), crosses);
+      }
+    }
+  }
+  EXPECT_EQ(visited.size(), crossing);
+  EXPECT_LT(crossing, 32 * 32 * 32 / 4);
+
+  auto mesh = geometry::MarchingCubes(field, 0.0f);
+  auto skipped = geometry::MarchingCubes(pyramid, 0.0f);
+  EXPECT_EQ(skipped.NumIndices(), mesh.NumIndices());
+
+  // Full weighting keeps linear functions.
+  geometry::Field<float> linear(33, 17, 9, 0.5f, {1.0f, 2.0f, 3.0f});
+  linear.FillFromFunction([](const geometry::Vector3<float> &pos) {
+    return pos.x() + 2.0f * pos.y() - pos.z();
+  });
+  geometry::FieldPyramid<float> linear_pyramid(linear);
+  geometry::Field<float> coarse(linear_pyramid.level_transform(1),
+                                linear_pyramid.sample(1));
+  EXPECT_EQ(coarse.width(), 17);
+  EXPECT_EQ(coarse.depth(), 5);
+  geometry::Vector3<float> pos = coarse.get_position(3, 4, 2);
+  EXPECT_NEAR(coarse(3, 4, 2), pos.x() + 2.0f * pos.y() - pos.z(), 1e-4f);
+}
+
+TEST(Geometry, FieldPyramidQueries) {
+  auto field = SphereField();
+  geometry::FieldPyramid<float> pyramid(field);
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dis(-1.2f, 1.2f);
+
+  // The bound is the distance to the nearest crossing cell.
+  for (int n = 0; n < 200; n++) {
+    geometry::Vector3<float> pos(dis(gen), dis(gen), dis(gen));
+    geometry::Vector3<float> grid_pos = field.to_grid_position(pos);
+    float expected = std::numeric_limits<float>::infinity();
+    for (int k = 0; k < 32; k++) {
+      for (int j = 0; j < 32; j++) {
+        for (int i = 0; i < 32; i++) {
+          if (Crosses(field, i, j, k, 0.0f)) {
+            geometry::Vector3<float> lo(i, j, k);
+            geometry::Vector3<float> gap =
+                (lo - grid_pos)
+                    .cwiseMax(grid_pos - lo - geometry::Vector3<float>::Ones())
+                    .cwiseMax(geometry::Vector3<float>::Zero());
+            expected = std::min(expected, gap.norm() / 16.0f);
+          }
+        }
+      }
+    }
+    float bound = pyramid.DistanceLowerBound(pos, 0.0f, 0.0f);
+    EXPECT_NEAR(bound, expected, 1e-5f);
+    EXPECT_LE(bound, std::abs(pos.norm() - 0.6f) + 1e-5f);
+    EXPECT_EQ(pyramid.DistanceLowerBound(pos, 0.0f, 0.0f, 0.1f),
+              std::min(expected, 0.1f));
+  }
+
+  // Rays through the center enter a crossing cell just before the sphere.
+  for (int n = 0; n < 100; n++) {
+    geometry::Vector3<float> direction(dis(gen), dis(gen), dis(gen));
+    direction.normalize();
+    geometry::Ray3<float> ray{-2.0f * direction, direction};
+    float t;
+    ASSERT_TRUE(pyramid.FirstCandidate(ray, 0.0f, 10.0f, 0.0f, 0.0f, &t));
+    EXPECT_LE(t, 1.4f);
+    EXPECT_GE(t, 1.4f - std::sqrt(3.0f) / 16.0f);
+    // Starting inside the sphere only the far side is left.
+    ASSERT_TRUE(pyramid.FirstCandidate(ray, 2.0f, 10.0f, 0.0f, 0.0f, &t));
+    EXPECT_LE(t, 2.6f);
+    EXPECT_GE(t, 2.6f - std::sqrt(3.0f) / 16.0f);
+  }
+  geometry::Ray3<float> miss{{-2.0f, 0.9f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+  float t;
+  EXPECT_FALSE(pyramid.FirstCandidate(miss, 0.0f, 10.0f, 0.0f, 0.0f, &t));
+
+  // Broad phase against the inside of the sphere.
+  float lowest = std::numeric_limits<float>::lowest();
+  geometry::AABB3<float> inner({-0.2f, -0.2f, -0.2f});
+  inner.Expand({0.2f, 0.2f, 0.2f});
+  geometry::AABB3<float> outer({0.7f, 0.7f, 0.7f});
+  outer.Expand({1.0f, 1.0f, 1.0f});
+  geometry::AABB3<float> straddling({0.5f, -0.1f, -0.1f});
+  straddling.Expand({0.7f, 0.1f, 0.1f});
+  EXPECT_FALSE(pyramid.MayContain(inner, 0.0f, 0.0f));
+  EXPECT_TRUE(pyramid.MayContain(inner, lowest, 0.0f));
+  EXPECT_FALSE(pyramid.MayContain(outer, lowest, 0.0f));
+  EXPECT_TRUE(pyramid.MayContain(straddling, 0.0f, 0.0f));
+}
@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+
+using namespace long_march;
+
+namespace {
+// A level set of the sphere of radius 0.6 around the origin that is far from
+// a distance: it grows quadratically and is stretched along x.
+geometry::Field<float> DistortedSphere(size_t size,
+                                       const geometry::Vector3<float> &delta) {
+  geometry::Vector3<float> offset = -0.5f * (size - 1) * delta;
+  geometry::Field<float> field(size, size, size, delta, offset);
+  field.FillFromFunction([](const geometry::Vector3<float> &pos) {
+    return 3.0f * (pos.squaredNorm() - 0.36f) * (1.5f + pos.x());
+  });
+  return field;
+}
+
+float MaxError(const geometry::Field<float> &field, float band) {
+  float error = 0.0f;
+  for (size_t k = 0; k < field.depth(); k++) {
+    for (size_t j = 0; j < field.height(); j++) {
+      for (size_t i = 0; i < field.width(); i++) {
+        float exact = field.get_position(i, j, k).norm() - 0.6f;
+        exact = std::clamp(exact, -band, band);
+        error = std::max(error, std::abs(field(i, j, k) - exact));
+      }
+    }
+  }
+  return error;
+}
+}  // namespace
+
+TEST(Geometry, RedistanceFastSweeping) {
+  geometry::Vector3<float> delta(0.04f, 0.04f, 0.04f);
+  auto field = DistortedSphere(48, delta);
+  geometry::Redistance(field);
+  // First order accurate away from the surface.
+  EXPECT_LT(MaxError(field, 1e9f), 1.0f * delta.x());
+
+  // Anisotropic cells and small tiles.
+  delta = {0.05f, 0.03f, 0.04f};
+  auto stretched = DistortedSphere(48, delta);
+  geometry::RedistanceSettings<float> settings;
+  settings.tile_size = 5;
+  geometry::Redistance(stretched, settings);
+  EXPECT_LT(MaxError(stretched, 1e9f), 1.0f * delta.x());
+
+  // The tiles of a front are independent, so the thread count has no effect.
+  auto serial = DistortedSphere(48, delta);
+  SetGlobalThreadCount(1);
+  geometry::Redistance(serial, settings);
+  SetGlobalThreadCount(0);
+  EXPECT_EQ(serial.grid().buffer(), stretched.grid().buffer());
+}
+
+TEST(Geometry, RedistanceFastMarching) {
+  geometry::Vector3<float> delta(0.04f, 0.04f, 0.04f);
+  auto field = DistortedSphere(48, delta);
+  geometry::RedistanceSettings<float> settings;
+  settings.method = geometry::redistance_method::fast_marching;
+  settings.band = 0.2f;
+  geometry::Redistance(field, settings);
+  EXPECT_LT(MaxError(field, settings.band), 1.0f * delta.x());
+  EXPECT_FLOAT_EQ(field(0, 0, 0), 0.2f);
+  EXPECT_FLOAT_EQ(field(24, 24, 24), -0.2f);
+
+  // Both methods solve the same discrete equations.
+  auto swept = DistortedSphere(48, delta);
+  settings.method = geometry::redistance_method::fast_sweeping;
+  geometry::Redistance(swept, settings);
+  for (int k = 0; k < 48; k++) {
+    for (int j = 0; j < 48; j++) {
+      for (int i = 0; i < 48; i++) {
+        EXPECT_NEAR(field(i, j, k), swept(i, j, k), 1e-4f);
+      }
+    }
+  }
+
+  // Without a surface there is no distance to compute.
+  geometry::Field<float> empty(8, 8, 8, 1.0f, {0.0f, 0.0f, 0.0f});
+  empty.FillFromFunction([](const geometry::Vector3<float> &) { return 2.0f; });
+  geometry::Redistance(empty, settings);
+  EXPECT_EQ(empty(3, 3, 3), 2.0f);
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+// The serial splatting PointToMesh used to run.
+template <typename Scalar>
+void ReferenceSplat(const geometry::Vector3<Scalar> *points,
+                    size_t n_points,
+                    Scalar radius,
+                    size_t n_subdivisions,
+                    int range,
+                    geometry::Field<Scalar, Scalar> &field) {
+  using geometry::offset_t;
+  for (size_t i = 0; i < n_points; ++i) {
+    geometry::Vector3<Scalar> grid_pos = field.to_grid_position(points[i]);
+    offset_t x = static_cast<offset_t>(std::floor(grid_pos[0]));
+    offset_t y = static_cast<offset_t>(std::floor(grid_pos[1]));
+    offset_t z = static_cast<offset_t>(std::floor(grid_pos[2]));
+    offset_t reach = n_subdivisions * range;
+    offset_t low_x = std::max(x - reach, offset_t{0});
+    offset_t low_y = std::max(y - reach, offset_t{0});
+    offset_t low_z = std::max(z - reach, offset_t{0});
+    offset_t high_x = std::min(x + reach + 1, offset_t(field.width()));
+    offset_t high_y = std::min(y + reach + 1, offset_t(field.height()));
+    offset_t high_z = std::min(z + reach + 1, offset_t(field.depth()));
+    auto kernel_function = [](Scalar distance) -> Scalar {
+      if (distance < 1.0) {
+        return 2.0 - distance * distance;
+      } else if (distance < 2.0) {
+        return (2.0 - distance) * (2.0 - distance);
+      }
+      return 0.0;
+    };
+    for (offset_t x = low_x; x < high_x; ++x) {
+      for (offset_t y = low_y; y < high_y; ++y) {
+        for (offset_t z = low_z; z < high_z; ++z) {
+          geometry::Vector3<Scalar> world_pos =
+              field.to_world_position({Scalar(x), Scalar(y), Scalar(z)});
+          Scalar distance = (world_pos - points[i]).norm() / radius;
+          if (distance < range) {
+            field(x, y, z) -= kernel_function(distance);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Scalar>
+void CheckPointToField(size_t n_subdivisions, int range) {
+  std::mt19937 gen(int(n_subdivisions) * 10 + range);
+  std::normal_distribution<Scalar> dis;
+  std::vector<geometry::Vector3<Scalar>> points(3000);
+  for (auto &point : points) {
+    point = {dis(gen), dis(gen), dis(gen)};
+    point = point.normalized() * Scalar(2) +
+            geometry::Vector3<Scalar>{Scalar(0.5), 0, 0} * dis(gen);
+  }
+  const Scalar radius = 0.1;
+  auto field = geometry::PointToField(points.data(), points.size(), radius,
+                                      n_subdivisions, Scalar(2), range);
+  geometry::Field<Scalar, Scalar> expected(
+      field.width(), field.height(), field.depth(), field.get_transform(),
+      Scalar(1.0));
+  ReferenceSplat(points.data(), points.size(), radius, n_subdivisions, range,
+                 expected);
+  ASSERT_EQ(field.grid().buffer(), expected.grid().buffer());
+
+  SetGlobalThreadCount(3);
+  auto sparse = geometry::PointToSparseField(
+      points.data(), points.size(), radius, n_subdivisions, Scalar(2), range);
+  SetGlobalThreadCount(0);
+  ASSERT_EQ(sparse.width(), field.width());
+  EXPECT_EQ(sparse.get_transform(), field.get_transform());
+  size_t changed = 0;
+  for (size_t z = 0; z < field.depth(); z++) {
+    for (size_t y = 0; y < field.height(); y++) {
+      for (size_t x = 0; x < field.width(); x++) {
+        ASSERT_EQ(sparse(x, y, z), field(x, y, z));
+        changed += field(x, y, z) != Scalar(1);
+      }
+    }
+  }
+  EXPECT_GT(changed, 0);
+  EXPECT_LE(sparse.grid().num_leaves() * 512, 4 * changed);
+}
+}  // namespace
+
+TEST(Geometry, PointToField) {
+  CheckPointToField<float>(1, 2);
+  CheckPointToField<float>(5, 2);
+  CheckPointToField<double>(3, 3);
+}
+
+TEST(Geometry, PointToMesh) {
+  // A sampled sphere closes into one surface of about the same radius.
+  std::mt19937 gen(0);
+  std::normal_distribution<float> dis;
+  std::vector<geometry::Vector3<float>> points(20000);
+  for (auto &point : points) {
+    point = geometry::Vector3<float>{dis(gen), dis(gen), dis(gen)}
+                .normalized();
+  }
+  auto mesh = geometry::PointToMesh(points.data(), points.size(), 0.05f, 2);
+  ASSERT_GT(mesh.NumIndices(), 0);
+  for (size_t i = 0; i < mesh.NumVertices(); i++) {
+    EXPECT_NEAR(mesh.Positions()[i].norm(), 1.0f, 0.1f);
+  }
+  auto sparse = geometry::MarchingCubes(geometry::PointToSparseField(
+      points.data(), points.size(), 0.05f, size_t(2)));
+  EXPECT_EQ(sparse.NumIndices(), mesh.NumIndices());
+}
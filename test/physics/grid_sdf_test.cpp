@@ -0,0 +1,58 @@
+#include "grassland/physics/physics.h"
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+TEST(Physics, GridSDFMatchesSphereSDF) {
+  SphereSDF<double> sphere;
+  sphere.center = {0.1, -0.2, 0.05};
+  sphere.radius = 0.6;
+  geometry::Field<double, double> field(65, 65, 65, 2.0 / 64,
+                                        {-1.0, -1.0, -1.0});
+  field.FillFromFunction([&](const geometry::Vector3<double> &pos) {
+    return sphere(pos).value();
+  });
+  GridSDF<double> grid_sdf;
+  grid_sdf.field = &field;
+
+  EXPECT_TRUE(grid_sdf.ValidInput({0.9, -0.9, 0.0}));
+  EXPECT_FALSE(grid_sdf.ValidInput({1.1, 0.0, 0.0}));
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-0.9, 0.9);
+  for (int i = 0; i < 1000; i++) {
+    Eigen::Vector3d v(dis(gen), dis(gen), dis(gen));
+    double distance_to_center = (v - sphere.center).norm();
+    if (distance_to_center < 0.3) {
+      continue;
+    }
+    EXPECT_NEAR(grid_sdf(v).value(), sphere(v).value(), 1e-4);
+    EXPECT_LT((grid_sdf.Jacobian(v) - sphere.Jacobian(v)).norm(), 2e-3);
+    EXPECT_LT((grid_sdf.Hessian(v).m[0] - sphere.Hessian(v).m[0]).norm(),
+              0.15 / distance_to_center);
+  }
+
+  // Derivatives are those of the interpolant itself.
+  const double h = 1e-6;
+  for (int i = 0; i < 100; i++) {
+    Eigen::Vector3d v(dis(gen), dis(gen), dis(gen));
+    auto jacobian = grid_sdf.Jacobian(v);
+    auto hessian = grid_sdf.Hessian(v);
+    for (int axis = 0; axis < 3; axis++) {
+      Eigen::Vector3d offset = Eigen::Vector3d::Zero();
+      offset[axis] = h;
+      EXPECT_NEAR(jacobian(0, axis),
+                  (grid_sdf(v + offset) - grid_sdf(v - offset)).value() /
+                      (2 * h),
+                  1e-5);
+      EXPECT_LT((hessian.m[0].row(axis) -
+                 (grid_sdf.Jacobian(v + offset) -
+                  grid_sdf.Jacobian(v - offset)) /
+                     (2 * h))
+                    .norm(),
+                1e-3);
+    }
+  }
+}
@@ -0,0 +1,206 @@
+#include "grassland/physics/physics.h"
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+using Vector3 = ParticleTransfer<double>::Vector3;
+using Matrix3 = ParticleTransfer<double>::Matrix3;
+
+std::vector<Vector3> RandomPositions(size_t n,
+                                     const Vector3 &lo,
+                                     const Vector3 &hi,
+                                     int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dis(0.0, 1.0);
+  std::vector<Vector3> positions(n);
+  for (auto &pos : positions) {
+    for (int axis = 0; axis < 3; axis++) {
+      pos[axis] = lo[axis] + (hi[axis] - lo[axis]) * dis(gen);
+    }
+  }
+  return positions;
+}
+}  // namespace
+
+TEST(Physics, ParticleTransferAffine) {
+  // APIC reproduces affine velocity fields exactly with both kernels.
+  Vector3 offset(0.3, -0.2, 0.5);
+  Matrix3 gradient;
+  gradient << 0.1, -0.3, 0.2, 0.4, 0.05, -0.1, -0.2, 0.3, -0.15;
+  auto field = [&](const Vector3 &pos) { return offset + gradient * pos; };
+  const size_t n = 20;
+  auto positions = RandomPositions(8 * n * n * n, Vector3::Zero(),
+                                   Vector3::Constant(double(n)), 0);
+  std::vector<Vector3> velocities;
+  for (const auto &pos : positions) {
+    velocities.push_back(field(pos));
+  }
+  std::vector<Matrix3> affine(positions.size(), gradient);
+
+  for (auto kernel : {particle_kernel_type::linear,
+                      particle_kernel_type::quadratic_bspline}) {
+    ParticleTransferSettings settings;
+    settings.kernel = kernel;
+    ParticleTransfer<double> transfer(n, n, n, settings);
+    transfer.Bin(positions);
+    ASSERT_EQ(transfer.tile_offsets().back(), positions.size());
+    data_structure::MACGrid<double> velocity(n, n, n);
+    transfer.ParticleToGrid(positions, velocities, &affine, velocity);
+    for (size_t k = 0; k < n; k++) {
+      for (size_t j = 0; j < n; j++) {
+        for (size_t i = 1; i < n; i++) {
+          ASSERT_GT(transfer.face_weights().u()(i, j, k), 0.0);
+          EXPECT_NEAR(velocity.u()(i, j, k),
+                      field(Vector3(i, j + 0.5, k + 0.5))[0], 1e-10);
+          EXPECT_NEAR(velocity.v()(j, i, k),
+                      field(Vector3(j + 0.5, i, k + 0.5))[1], 1e-10);
+          EXPECT_NEAR(velocity.w()(j, k, i),
+                      field(Vector3(j + 0.5, k + 0.5, i))[2], 1e-10);
+        }
+      }
+    }
+
+    // Back on particles away from the boundary, velocity and gradient are
+    // recovered.
+    auto inner = RandomPositions(1000, Vector3::Constant(2.0),
+                                 Vector3::Constant(n - 2.0), 1);
+    std::vector<Vector3> recovered;
+    std::vector<Matrix3> recovered_affine;
+    transfer.GridToParticle(velocity, inner, recovered, &recovered_affine);
+    for (size_t p = 0; p < inner.size(); p++) {
+      EXPECT_LT((recovered[p] - field(inner[p])).norm(), 1e-10);
+      EXPECT_LT((recovered_affine[p] - gradient).norm(), 1e-10);
+    }
+  }
+}
+
+TEST(Physics, ParticleTransferDeterministic) {
+  const size_t n = 24;
+  auto positions = RandomPositions(100000, Vector3::Constant(-1.0),
+                                   Vector3::Constant(n + 1.0), 2);
+  std::mt19937 gen(3);
+  std::normal_distribution<double> dis;
+  std::vector<Vector3> velocities(positions.size());
+  std::vector<double> values(positions.size());
+  for (size_t p = 0; p < positions.size(); p++) {
+    velocities[p] = Vector3(dis(gen), dis(gen), dis(gen));
+    values[p] = dis(gen);
+  }
+
+  ParticleTransferSettings settings;
+  settings.kernel = particle_kernel_type::quadratic_bspline;
+  settings.tile_size = 4;
+  auto run = [&](size_t threads, data_structure::MACGrid<double> &velocity,
+                 data_structure::LinearGrid<double> &density) {
+    SetGlobalThreadCount(threads);
+    ParticleTransfer<double> transfer(n, n, n, settings);
+    transfer.Bin(positions);
+    transfer.ParticleToGrid(positions, velocities, nullptr, velocity);
+    transfer.ParticleToGrid(positions, values, density);
+    std::vector<uint32_t> sorted = transfer.order();
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t p = 0; p < sorted.size(); p++) {
+      ASSERT_EQ(sorted[p], p);
+    }
+  };
+  data_structure::MACGrid<double> serial(n, n, n), parallel(n, n, n);
+  data_structure::LinearGrid<double> serial_density(n, n, n, 0.0);
+  data_structure::LinearGrid<double> parallel_density(n, n, n, 0.0);
+  run(1, serial, serial_density);
+  run(4, parallel, parallel_density);
+  SetGlobalThreadCount(0);
+  EXPECT_EQ(serial.u().buffer(), parallel.u().buffer());
+  EXPECT_EQ(serial.v().buffer(), parallel.v().buffer());
+  EXPECT_EQ(serial.w().buffer(), parallel.w().buffer());
+  EXPECT_EQ(serial_density.buffer(), parallel_density.buffer());
+
+  // A naive scatter gives the same grid up to rounding.
+  data_structure::LinearGrid<double> momentum(n, n, n, 0.0);
+  data_structure::LinearGrid<double> weight(n, n, n, 0.0);
+  for (size_t p = 0; p < positions.size(); p++) {
+    Vector3 pos = positions[p].cwiseMax(0.0).cwiseMin(double(n)) -
+                  Vector3::Constant(0.5);
+    int64_t base[3];
+    double w[3][3];
+    for (int axis = 0; axis < 3; axis++) {
+      base[axis] = int64_t(std::floor(pos[axis] - 0.5));
+      double f = pos[axis] - base[axis];
+      w[axis][0] = 0.5 * (1.5 - f) * (1.5 - f);
+      w[axis][1] = 0.75 - (f - 1.0) * (f - 1.0);
+      w[axis][2] = 0.5 * (f - 0.5) * (f - 0.5);
+    }
+    for (int c = 0; c < 3; c++) {
+      for (int b = 0; b < 3; b++) {
+        for (int a = 0; a < 3; a++) {
+          int64_t x = base[0] + a, y = base[1] + b, z = base[2] + c;
+          if (x >= 0 && y >= 0 && z >= 0 && x < int64_t(n) &&
+              y < int64_t(n) && z < int64_t(n)) {
+            momentum(x, y, z) += w[0][a] * w[1][b] * w[2][c] * values[p];
+            weight(x, y, z) += w[0][a] * w[1][b] * w[2][c];
+          }
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < momentum.buffer().size(); i++) {
+    EXPECT_NEAR(serial_density.buffer()[i],
+                momentum.buffer()[i] / weight.buffer()[i], 1e-10);
+  }
+}
+
+TEST(Physics, ParticleTransferFlip) {
+  const size_t n = 12;
+  auto positions = RandomPositions(4 * n * n * n, Vector3::Zero(),
+                                   Vector3::Constant(double(n)), 4);
+  std::mt19937 gen(5);
+  std::normal_distribution<double> dis;
+  std::vector<Vector3> velocities(positions.size());
+  for (auto &velocity : velocities) {
+    velocity = Vector3(dis(gen), dis(gen), dis(gen));
+  }
+  ParticleTransfer<double> transfer(n, n, n);
+  transfer.Bin(positions);
+  data_structure::MACGrid<double> previous(n, n, n);
+  transfer.ParticleToGrid(positions, velocities, nullptr, previous);
+
+  // Adding a uniform velocity on the grid adds it to every particle with
+  // FLIP, and PIC smooths the particle velocities out.
+  data_structure::MACGrid<double> velocity(n, n, n);
+  velocity = previous;
+  for (auto &value : velocity.v().buffer()) {
+    value += 2.0;
+  }
+  std::vector<Vector3> flip = velocities;
+  transfer.GridToParticle(velocity, previous, 1.0, positions, flip);
+  std::vector<Vector3> pic;
+  transfer.GridToParticle(velocity, positions, pic);
+  double flip_error = 0.0, pic_error = 0.0;
+  for (size_t p = 0; p < positions.size(); p++) {
+    flip_error += (flip[p] - velocities[p] - Vector3(0.0, 2.0, 0.0)).norm();
+    pic_error += (pic[p] - velocities[p] - Vector3(0.0, 2.0, 0.0)).norm();
+  }
+  EXPECT_LT(flip_error, 1e-10 * positions.size());
+  EXPECT_GT(pic_error, 0.5 * positions.size());
+
+  std::vector<Vector3> blend = velocities;
+  transfer.GridToParticle(velocity, previous, 0.95, positions, blend);
+  for (size_t p = 0; p < positions.size(); p++) {
+    EXPECT_LT((blend[p] - (0.95 * flip[p] + 0.05 * pic[p])).norm(), 1e-10);
+  }
+
+  // Stored in binned order, the particles bin to the identity.
+  std::vector<Vector3> sorted_positions = positions;
+  std::vector<Vector3> sorted_flip = flip;
+  transfer.Reorder(sorted_positions);
+  transfer.Reorder(sorted_flip);
+  for (size_t p = 0; p < positions.size(); p++) {
+    ASSERT_EQ(sorted_flip[p], flip[transfer.order()[p]]);
+  }
+  transfer.Bin(sorted_positions);
+  for (size_t p = 0; p < positions.size(); p++) {
+    ASSERT_EQ(transfer.order()[p], p);
+  }
+}
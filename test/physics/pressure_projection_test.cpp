@@ -0,0 +1,108 @@
+#include "grassland/physics/physics.h"
+#include "gtest/gtest.h"
+#include "long_march.h"
+#include "random"
+
+using namespace long_march;
+
+namespace {
+void RandomizeVelocity(data_structure::MACGrid<float> &velocity, int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+  for (auto *grid : {&velocity.u(), &velocity.v(), &velocity.w()}) {
+    for (auto &value : grid->buffer()) {
+      value = dis(gen);
+    }
+  }
+}
+
+float MaxFluidDivergence(
+    const data_structure::MACGrid<float> &velocity,
+    const data_structure::LinearGrid<fluid_cell_type> &cells) {
+  data_structure::LinearGrid<float> divergence(
+      velocity.width(), velocity.height(), velocity.depth(), 0.0f);
+  data_structure::Divergence(velocity, 1.0f, divergence);
+  data_structure::LinearGrid<uint8_t> fluid(
+      velocity.width(), velocity.height(), velocity.depth(), uint8_t(0));
+  for (size_t i = 0; i < fluid.buffer().size(); i++) {
+    fluid.buffer()[i] = cells.buffer()[i] == fluid_cell_type::fluid;
+  }
+  return data_structure::MaxAbs(divergence, fluid);
+}
+}  // namespace
+
+TEST(Physics, PressureProjectionClosedBox) {
+  const size_t n = 24;
+  data_structure::MACGrid<float> velocity(n, n, n);
+  data_structure::LinearGrid<fluid_cell_type> cells(n, n, n,
+                                                    fluid_cell_type::fluid);
+  // A solid block in the middle.
+  for (int k = 8; k < 14; k++) {
+    for (int j = 6; j < 12; j++) {
+      for (int i = 10; i < 16; i++) {
+        cells(i, j, k) = fluid_cell_type::solid;
+      }
+    }
+  }
+  RandomizeVelocity(velocity, 0);
+
+  PressureProjection projection(n, n, n);
+  const auto &stats = projection.Project(velocity, cells, 0.5f);
+  EXPECT_TRUE(stats.converged);
+  EXPECT_LT(stats.iterations, 60);
+  EXPECT_GT(stats.levels, 1);
+  EXPECT_EQ(stats.residual_history.size(), size_t(stats.iterations));
+  EXPECT_LT(MaxFluidDivergence(velocity, cells), 1e-3f);
+  EXPECT_EQ(velocity.u()(0, 3, 3), 0.0f);
+  EXPECT_EQ(velocity.u()(n, 3, 3), 0.0f);
+  EXPECT_EQ(velocity.u()(10, 7, 9), 0.0f);
+  EXPECT_EQ(velocity.w()(12, 8, 14), 0.0f);
+}
+
+TEST(Physics, PressureProjectionFreeSurface) {
+  const size_t n = 32;
+  data_structure::MACGrid<float> velocity(n, n, n);
+  data_structure::LinearGrid<fluid_cell_type> cells(n, n, n,
+                                                    fluid_cell_type::air);
+  for (size_t k = 0; k < n; k++) {
+    for (size_t j = 0; j < n / 2; j++) {
+      for (size_t i = 0; i < n; i++) {
+        cells(i, j, k) = fluid_cell_type::fluid;
+      }
+    }
+  }
+  RandomizeVelocity(velocity, 1);
+
+  PressureProjection projection(n, n, n);
+  const auto &stats = projection.Project(velocity, cells, 1.0f);
+  EXPECT_TRUE(stats.converged);
+  EXPECT_LT(stats.iterations, 60);
+  EXPECT_LT(MaxFluidDivergence(velocity, cells), 1e-3f);
+  EXPECT_EQ(projection.pressure()(3, n - 1, 3), 0.0f);
+
+  // Same input, different thread count, same answer.
+  data_structure::MACGrid<float> velocity2(n, n, n);
+  RandomizeVelocity(velocity2, 1);
+  SetGlobalThreadCount(3);
+  projection.Project(velocity2, cells, 1.0f);
+  SetGlobalThreadCount(0);
+  EXPECT_EQ(velocity2.u().buffer(), velocity.u().buffer());
+}
+
+TEST(Physics, PressureProjectionRejectsMismatchedGrids) {
+  const size_t n = 8;
+  PressureProjection projection(n, n, n);
+  data_structure::LinearGrid<fluid_cell_type> cells(n, n, n,
+                                                    fluid_cell_type::fluid);
+  data_structure::MACGrid<float> velocity(n, n + 1, n);
+  RandomizeVelocity(velocity, 2);
+  auto original = velocity.v().buffer();
+  EXPECT_FALSE(projection.Project(velocity, cells, 1.0f).converged);
+  EXPECT_EQ(projection.stats().iterations, 0);
+  EXPECT_EQ(velocity.v().buffer(), original);
+
+  data_structure::MACGrid<float> matching(n, n, n);
+  data_structure::LinearGrid<fluid_cell_type> small_cells(
+      n, n, n - 1, fluid_cell_type::fluid);
+  EXPECT_FALSE(projection.Project(matching, small_cells, 1.0f).converged);
+}